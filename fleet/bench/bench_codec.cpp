@@ -0,0 +1,97 @@
+// Columnar codec: compression ratio and encode/decode throughput on
+// simulator output (per-vehicle runs, CRCs valid like received packets).
+// g++ -std=c++17 -O2 -o bench_codec bench/bench_codec.cpp src/telemetry_codec.cpp src/fleet_state.cpp src/crc16.cpp -I include
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include "../include/telemetry_codec.h"
+#include "../include/fleet_state.h"
+#include "../include/crc16.h"
+
+const size_t VEHICLES = 64;
+const size_t TICKS = 16384;
+const double SIM_DT = 0.1;
+const int ROUNDS = 5;
+
+template <typename Fn>
+double Measure(Fn fn){
+    double best = 1e30;
+    for(int r=0; r<ROUNDS; r++){
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        double s = std::chrono::duration<double>(t1 - t0).count();
+        if(s<best) best = s;
+    }
+    return best;
+}
+
+int main(){
+    // Per-vehicle runs, the way an archive or a per-vehicle uplink sees them
+    FleetState fleet(VEHICLES, 1000);
+    std::vector<std::vector<Packet>> runs(VEHICLES, std::vector<Packet>(TICKS));
+    std::vector<Packet> tick(VEHICLES);
+    uint8_t wire[32];
+    uint64_t clock_ms = 1700000000000ull;
+    uint32_t jitter = 1;
+    for(size_t t=0; t<TICKS; t++){
+        for(size_t i=0; i<VEHICLES; i++) fleet.SetThrottle(i, (std::sin((t+i*50)*0.01)+1.0) / 2.0 * 0.7);
+        fleet.Tick(SIM_DT);
+        fleet.Snapshot(tick.data(), VEHICLES, SIM_DT);
+        jitter = jitter*1103515245 + 12345;
+        clock_ms += 100 + (jitter >> 16) % 3; // Sleep-based loop runs a little late
+        for(size_t i=0; i<VEHICLES; i++){
+            Packet& p = tick[i];
+            p.magic = Packet::MAGIC;
+            p.sequence_id = (uint32_t)t;
+            p.timestamp = clock_ms;
+            p.serialize(wire);
+            p.crc16 = CalculateCRC(wire, 28);
+            p.reserved[0] = p.reserved[1] = 0;
+            runs[i][t] = p;
+        }
+    }
+    const size_t total = VEHICLES * TICKS;
+    const double raw_bytes = (double)total * Packet::SIZE;
+
+    std::cout << "Codec over " << VEHICLES << " vehicles x " << TICKS << " packets, best of " << ROUNDS << "\n\n";
+    std::cout << std::left << std::setw(8) << "block" << std::right
+              << std::setw(10) << "bytes/pkt" << std::setw(8) << "ratio"
+              << std::setw(14) << "encode MB/s" << std::setw(14) << "decode MB/s"
+              << std::setw(14) << "enc Mpkt/s" << std::setw(14) << "dec Mpkt/s" << "\n";
+
+    const size_t block_sizes[] = {16, 64, 256, 1024, 4096};
+    for(size_t block : block_sizes){
+        TelemetryEncoder encoder(block);
+        double enc = Measure([&]{
+            encoder.Clear();
+            for(const auto& run : runs) encoder.Add(run.data(), run.size());
+            encoder.Flush();
+        });
+
+        TelemetryDecoder decoder;
+        std::vector<Packet> decoded;
+        decoded.reserve(total);
+        double dec = Measure([&]{
+            decoded.clear();
+            decoder.DecodeStream(encoder.Data().data(), encoder.Data().size(), decoded);
+        });
+        if(decoded.size()!=total){
+            std::cerr << "decode failed\n";
+            return 1;
+        }
+
+        double size = (double)encoder.Data().size();
+        // Throughput in terms of the raw 32-byte packets moved
+        std::cout << std::left << std::setw(8) << block << std::right << std::fixed
+                  << std::setw(10) << std::setprecision(2) << size / total
+                  << std::setw(7) << std::setprecision(1) << raw_bytes / size << "x"
+                  << std::setw(14) << std::setprecision(0) << raw_bytes / enc / 1e6
+                  << std::setw(14) << raw_bytes / dec / 1e6
+                  << std::setw(14) << std::setprecision(1) << total / enc / 1e6
+                  << std::setw(14) << total / dec / 1e6 << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Wire -> PacketBatch decode throughput per kernel, in GB/s of wire records.
+// g++ -std=c++17 -O2 -o bench_decode bench/bench_decode.cpp src/packet.cpp src/packet_batch.cpp src/crc16.cpp -I include
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include "../include/packet_batch.h"
+#include "../include/crc16.h"
+
+const size_t PACKETS = 1 << 20;
+const int ROUNDS = 5;
+
+// Best-of-ROUNDS ns per packet
+template <typename Fn>
+double Measure(Fn fn){
+    double best = 1e30;
+    for(int r=0; r<ROUNDS; r++){
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / PACKETS;
+        if(ns<best) best = ns;
+    }
+    return best;
+}
+
+void Report(const std::string& name, double ns){
+    std::cout << std::left << std::setw(22) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(2) << ns << " ns/pkt"
+              << std::setw(10) << (Packet::SIZE / ns) << " GB/s"
+              << std::setw(10) << std::setprecision(1) << (1e3 / ns) << " Mpkt/s\n";
+}
+
+int main(){
+    std::vector<uint8_t> records(PACKETS * Packet::SIZE);
+    for(size_t i=0; i<PACKETS; i++){
+        Packet p{};
+        p.magic = Packet::MAGIC;
+        p.vehicle_id = (uint16_t)(i % 5000);
+        p.sequence_id = (uint32_t)i;
+        p.timestamp = 1700000000000ull + i*100;
+        p.rpm = (uint16_t)(800 + (i*37) % 7000);
+        p.speed = (uint16_t)(i % 200);
+        p.jerk = (int16_t)((i*17) % 400) - 200;
+        p.version = Packet::VERSION;
+        p.serialize(records.data() + i*Packet::SIZE);
+    }
+    Crc16::StampBatch(records.data(), PACKETS);
+
+    PacketBatch batch(PACKETS);
+    std::cout << "Decode of " << PACKETS << " packets, best of " << ROUNDS
+              << " (CRC: " << Crc16::Name(Crc16::Active()) << ")\n\n";
+
+    // Per-packet parse, what a consumer without the batch path does
+    Report("Packet::parse", Measure([&]{
+        Packet p{};
+        size_t ok = 0;
+        for(size_t i=0; i<PACKETS; i++) ok += Packet::parse(records.data() + i*Packet::SIZE, Packet::SIZE, p)==PacketError::OK;
+        batch.count = ok;
+    }));
+
+    const PacketDecode::Impl impls[] = {PacketDecode::Impl::SCALAR, PacketDecode::Impl::SSSE3, PacketDecode::Impl::AVX2};
+    for(PacketDecode::Impl impl : impls){
+        if(!PacketDecode::Supported(impl)) continue;
+        PacketDecode::Select(impl);
+        std::string name = PacketDecode::Name(impl);
+        Report(name, Measure([&]{
+            batch.Clear();
+            PacketDecode::Decode(records.data(), PACKETS, batch);
+        }));
+        Report(name + " (validated)", Measure([&]{
+            batch.Clear();
+            PacketDecode::DecodeValid(records.data(), PACKETS, batch);
+        }));
+    }
+    return 0;
+}
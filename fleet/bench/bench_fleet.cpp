@@ -0,0 +1,376 @@
+// Hot path benchmarks: every stage a packet goes through, one at a time, then
+// N vehicles end to end into a loopback MQTT sink. Each stage reports ns/op,
+// heap allocations/op and packets/s (one op = one packet's worth of work).
+// --json writes the results for later runs to --compare against, which exits
+// 1 on a regression so it can gate a build.
+// g++ -std=c++17 -O2 -o bench_fleet bench/bench_fleet.cpp src/vehicle.cpp src/fleet_state.cpp src/crc16.cpp src/packet.cpp src/mini_broker.cpp -I include -lpthread
+// Linux only (the sink is the epoll based MiniBroker).
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include "../include/vehicle.h"
+#include "../include/fleet_state.h"
+#include "../include/packet.h"
+#include "../include/crc16.h"
+#include "../include/mqtt_forge.h"
+#include "../include/mini_broker.h"
+
+// Every heap allocation goes through here. Counted per thread so the sink's
+// buffers don't show up in the publisher's numbers.
+static thread_local uint64_t g_allocs = 0;
+
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t size){
+    g_allocs++;
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+const int ROUNDS = 5;
+const size_t VEHICLES = 1000;     // Working set for the per-vehicle stages
+const size_t OPS = 1 << 20;       // Per round, per stage
+const size_t PUBLISH_CHUNK = 4096;
+const double DT = 0.1;
+
+template <typename T>
+inline void Keep(const T& value) { asm volatile("" : : "g"(&value) : "memory"); }
+
+struct Result {
+    std::string name;
+    double ns_per_op;
+    double allocs_per_op;
+    double ops_per_sec;
+};
+
+std::vector<Result> g_results;
+
+void Report(const Result& r){
+    std::cout << std::left << std::setw(22) << r.name << std::right << std::fixed
+              << std::setw(10) << std::setprecision(2) << r.ns_per_op << " ns/op"
+              << std::setw(9) << std::setprecision(3) << r.allocs_per_op << " allocs/op"
+              << std::setw(11) << std::setprecision(0) << r.ops_per_sec << " pkt/s\n";
+    g_results.push_back(r);
+}
+
+// Best-of-ROUNDS. fn(ops) does ops operations
+template <typename Fn>
+void Measure(const std::string& name, size_t ops, Fn fn){
+    fn(ops / 16); // Warm caches, lazy allocations, CRC dispatch
+    double best = 1e30;
+    uint64_t allocs = 0;
+    for(int r=0; r<ROUNDS; r++){
+        uint64_t a0 = g_allocs;
+        auto t0 = std::chrono::steady_clock::now();
+        fn(ops);
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t a = g_allocs - a0;
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ops;
+        if(ns<best) best = ns;
+        if(r==0 || a<allocs) allocs = a;
+    }
+    Report({name, best, (double)allocs / ops, 1e9 / best});
+}
+
+// The in-tree broker (mini_broker.h) on its own thread, on a free loopback port
+class LoopbackSink {
+    MiniBroker m_broker;
+    std::atomic<bool> m_running{true};
+    std::thread m_thread;
+
+    static BrokerOptions Options(){
+        BrokerOptions options;
+        options.port = 0;
+        return options;
+    }
+
+public:
+    LoopbackSink() : m_broker(Options()) {}
+
+    bool Start(){
+        if(!m_broker.Start()) return false;
+        m_thread = std::thread([this]{ m_broker.Run(m_running); });
+        return true;
+    }
+
+    ~LoopbackSink(){
+        m_running = false;
+        if(m_thread.joinable()) m_thread.join();
+    }
+
+    int Port() const { return m_broker.Port(); }
+    uint64_t Publishes() const { return m_broker.Stats().publishes.load(std::memory_order_relaxed); }
+
+    // Waits until count PUBLISHes have arrived, false on timeout
+    bool WaitFor(uint64_t count, int timeout_ms){
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while(Publishes()<count){
+            if(std::chrono::steady_clock::now()>deadline) return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return true;
+    }
+};
+
+// Publishes until the kernel has taken everything queued so far
+void Drain(MqttForge& link){
+    while(link.IsConnected() && link.TxBacklog()>0){
+        link.Tick();
+        std::this_thread::yield();
+    }
+}
+
+void Stages(LoopbackSink& sink){
+    std::vector<Vehicle> cars;
+    for(size_t i=0; i<VEHICLES; i++){
+        cars.emplace_back((uint16_t)(1 + i));
+        cars.back().SetThrottle(0.5);
+    }
+    Packet packet{};
+    uint8_t wire[32];
+
+    Measure("vehicle_tick", OPS, [&](size_t ops){
+        for(size_t i=0; i<ops; i++) cars[i % VEHICLES].Tick(DT);
+    });
+    Measure("vehicle_snapshot", OPS, [&](size_t ops){
+        for(size_t i=0; i<ops; i++){
+            cars[i % VEHICLES].Snapshot(packet, DT);
+            Keep(packet);
+        }
+    });
+
+    // Struct-of-arrays fleet, one op = one vehicle
+    FleetState fleet(VEHICLES, 1);
+    for(size_t i=0; i<VEHICLES; i++) fleet.SetThrottle(i, 0.5);
+    std::vector<Packet> packets(VEHICLES);
+    Measure("fleet_tick", OPS, [&](size_t ops){
+        for(size_t done=0; done<ops; done+=VEHICLES) fleet.Tick(DT);
+    });
+    Measure("fleet_snapshot", OPS, [&](size_t ops){
+        for(size_t done=0; done<ops; done+=VEHICLES){
+            fleet.Snapshot(packets.data(), VEHICLES, DT);
+            Keep(packets[0]);
+        }
+    });
+
+    Measure("packet_serialize", OPS, [&](size_t ops){
+        for(size_t i=0; i<ops; i++){
+            packets[i % VEHICLES].serialize(wire);
+            Keep(wire);
+        }
+    });
+    Measure("crc16", OPS, [&](size_t ops){
+        uint16_t crc = 0;
+        for(size_t i=0; i<ops; i++){
+            wire[0] = (uint8_t)i;
+            crc ^= CalculateCRC(wire, 28);
+        }
+        Keep(crc);
+    });
+
+    for(int qos=0; qos<=1; qos++){
+        MqttForge link;
+        if(!link.Connect("127.0.0.1", sink.Port(), "bench_publish_" + std::to_string(qos))){
+            std::cerr << "loopback connect failed\n";
+            return;
+        }
+        PreparedPublish prep = link.Prepare("fleet/1/telemetry", qos);
+        const size_t ops = OPS / 8;
+        Measure("mqtt_publish_qos" + std::to_string(qos), ops, [&](size_t n){
+            for(size_t i=0; i<n; i++){
+                if(!link.Publish(prep, wire, sizeof(wire))) break;
+                if(i % PUBLISH_CHUNK == PUBLISH_CHUNK-1) Drain(link);
+            }
+            Drain(link);
+        });
+        // Topic string + vector per call, the convenience overload
+        if(qos==0){
+            std::vector<uint8_t> payload(wire, wire + sizeof(wire));
+            Measure("mqtt_publish_topic", ops, [&](size_t n){
+                for(size_t i=0; i<n; i++){
+                    if(!link.Publish("fleet/1/telemetry", payload, 0)) break;
+                    if(i % PUBLISH_CHUNK == PUBLISH_CHUNK-1) Drain(link);
+                }
+                Drain(link);
+            });
+        }
+        link.Disconnect();
+    }
+}
+
+// N vehicles, one session each, ticks as fast as possible:
+// Tick, Snapshot, serialize, CRC, Publish, then one Tick() per link
+void EndToEnd(LoopbackSink& sink, size_t vehicles, size_t ticks, int qos){
+    std::vector<std::unique_ptr<Vehicle>> cars;
+    std::vector<std::unique_ptr<MqttForge>> links;
+    std::vector<PreparedPublish> preps;
+    for(size_t i=0; i<vehicles; i++){
+        uint16_t id = (uint16_t)(1 + i);
+        cars.emplace_back(new Vehicle(id));
+        cars.back()->SetThrottle(0.5);
+        links.emplace_back(new MqttForge());
+        if(!links.back()->Connect("127.0.0.1", sink.Port(), "bench_e2e_" + std::to_string(id))){
+            std::cerr << "loopback connect failed for vehicle " << id << "\n";
+            return;
+        }
+        preps.push_back(links.back()->Prepare("fleet/" + std::to_string(id) + "/telemetry", qos));
+    }
+
+    uint64_t before = sink.Publishes();
+    uint64_t sent = 0, failed = 0;
+    Packet packet{};
+    uint8_t wire[32];
+    uint64_t a0 = g_allocs;
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t t=0; t<ticks; t++){
+        for(size_t i=0; i<vehicles; i++){
+            cars[i]->Tick(DT);
+            cars[i]->Snapshot(packet, DT);
+            packet.magic = Packet::MAGIC;
+            packet.sequence_id = (uint32_t)t;
+            packet.timestamp = 1704067200000ull + t*100;
+            packet.crc16 = 0;
+            packet.serialize(wire);
+            uint16_t crc = CalculateCRC(wire, 28);
+            wire[28] = crc >> 8;
+            wire[29] = crc & 0xFF;
+            if(links[i]->Publish(preps[i], wire, sizeof(wire))) sent++;
+            else failed++;
+        }
+        for(auto& link : links) link->Tick();
+    }
+    for(auto& link : links) Drain(*link);
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t allocs = g_allocs - a0;
+    bool all = sink.WaitFor(before + sent, 5000);
+    auto t2 = std::chrono::steady_clock::now();
+    uint64_t received = sink.Publishes() - before;
+
+    double send_s = std::chrono::duration<double>(t1 - t0).count();
+    double recv_s = std::chrono::duration<double>(t2 - t0).count();
+    std::string tag = "e2e_qos" + std::to_string(qos);
+    std::cout << "\n" << vehicles << " vehicles x " << ticks << " ticks, QoS " << qos << ": sent " << sent
+              << ", failed " << failed << ", received " << received << (all ? "" : " (timed out)") << "\n";
+    Report({tag + "_send", send_s * 1e9 / (sent ? sent : 1), (double)allocs / (sent ? sent : 1), sent / send_s});
+    Report({tag + "_delivered", recv_s * 1e9 / (received ? received : 1), (double)allocs / (received ? received : 1),
+            received / recv_s});
+    for(auto& link : links) link->Disconnect();
+}
+
+// One result per line, so --compare can read it back without a JSON parser
+bool WriteJson(const std::string& path, size_t vehicles, size_t ticks){
+    std::ofstream out(path);
+    if(!out) return false;
+    out << "{\n  \"meta\": {\"timestamp\": " << (long long)std::time(nullptr)
+        << ", \"compiler\": \"" << __VERSION__ << "\""
+        << ", \"crc\": \"" << Crc16::Name(Crc16::Active()) << "\""
+        << ", \"vehicles\": " << vehicles << ", \"ticks\": " << ticks << "},\n  \"results\": [\n";
+    out << std::setprecision(6);
+    for(size_t i=0; i<g_results.size(); i++){
+        const Result& r = g_results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.ns_per_op
+            << ", \"allocs_per_op\": " << r.allocs_per_op << ", \"ops_per_sec\": " << r.ops_per_sec << "}"
+            << (i+1<g_results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return true;
+}
+
+bool ReadJson(const std::string& path, std::vector<Result>& out){
+    std::ifstream in(path);
+    if(!in) return false;
+    std::string line;
+    while(std::getline(in, line)){
+        char name[64];
+        Result r;
+        if(std::sscanf(line.c_str(), " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf, \"allocs_per_op\": %lf, \"ops_per_sec\": %lf",
+                       name, &r.ns_per_op, &r.allocs_per_op, &r.ops_per_sec)==4){
+            r.name = name;
+            out.push_back(r);
+        }
+    }
+    return true;
+}
+
+// Slower by more than threshold_pct, or any new allocation, is a regression
+int Compare(const std::vector<Result>& base, double threshold_pct){
+    int regressions = 0;
+    std::cout << "\nAgainst baseline (threshold " << threshold_pct << "%):\n";
+    for(const Result& now : g_results){
+        for(const Result& old : base){
+            if(old.name!=now.name) continue;
+            double delta = (now.ns_per_op - old.ns_per_op) / old.ns_per_op * 100.0;
+            bool slower = delta > threshold_pct;
+            bool allocs = now.allocs_per_op > old.allocs_per_op + 0.001;
+            std::cout << "  " << std::left << std::setw(22) << now.name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(8) << std::showpos << delta << "%" << std::noshowpos
+                      << (slower ? "  SLOWER" : "") << (allocs ? "  MORE ALLOCS" : "") << "\n";
+            if(slower || allocs) regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]){
+    size_t vehicles = 100, ticks = 1000;
+    std::string json, baseline;
+    double threshold = 10.0;
+    bool stages = true, e2e = true;
+    for(int a=1; a<argc; a++){
+        std::string arg = argv[a];
+        bool has_value = a+1<argc;
+        if(arg=="--vehicles" && has_value) vehicles = std::stoul(argv[++a]);
+        else if(arg=="--ticks" && has_value) ticks = std::stoul(argv[++a]);
+        else if(arg=="--json" && has_value) json = argv[++a];
+        else if(arg=="--compare" && has_value) baseline = argv[++a];
+        else if(arg=="--threshold" && has_value) threshold = std::stod(argv[++a]);
+        else if(arg=="--stages") e2e = false;
+        else if(arg=="--e2e") stages = false;
+        else {
+            std::cerr << "Usage: bench_fleet [--stages | --e2e] [--vehicles N] [--ticks N]\n"
+                      << "                   [--json out.json] [--compare baseline.json] [--threshold PCT]\n";
+            return 2;
+        }
+    }
+
+    LoopbackSink sink;
+    if(!sink.Start()){
+        std::cerr << "cannot listen on loopback\n";
+        return 2;
+    }
+    std::cout << "Fleet hot path, best of " << ROUNDS << " (CRC: " << Crc16::Name(Crc16::Active())
+              << ", sink on 127.0.0.1:" << sink.Port() << ")\n\n";
+
+    if(stages) Stages(sink);
+    if(e2e){
+        EndToEnd(sink, vehicles, ticks, 0);
+        EndToEnd(sink, vehicles, ticks, 1);
+    }
+
+    if(!json.empty() && !WriteJson(json, vehicles, ticks)){
+        std::cerr << "cannot write " << json << "\n";
+        return 2;
+    }
+    if(!baseline.empty()){
+        std::vector<Result> base;
+        if(!ReadJson(baseline, base)){
+            std::cerr << "cannot read " << baseline << "\n";
+            return 2;
+        }
+        int regressions = Compare(base, threshold);
+        std::cout << (regressions ? "REGRESSED: " : "OK: ") << regressions << " stage(s) over threshold\n";
+        return regressions ? 1 : 0;
+    }
+    return 0;
+}
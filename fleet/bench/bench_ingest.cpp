@@ -0,0 +1,125 @@
+// Ingest pipeline throughput without a network: payloads as MqttForge hands
+// them over (single packets or batch frames) through Ingestor::OnMessage,
+// the queue, validation, SoA decode and the sinks, on one thread.
+// g++ -std=c++17 -O2 -o bench_ingest bench/bench_ingest.cpp src/ingest.cpp src/packet.cpp src/packet_batch.cpp src/crc16.cpp -I include -lpthread
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "../include/ingest.h"
+#include "../include/batch_frame.h"
+#include "../include/crc16.h"
+
+const size_t PACKETS = 1 << 20;
+const size_t VEHICLES = 5000;
+const size_t FRAME_RECORDS = 500;
+const int ROUNDS = 5;
+
+// Best-of-ROUNDS ns per record
+template <typename Fn>
+double Measure(Fn fn){
+    double best = 1e30;
+    for(int r=0; r<ROUNDS; r++){
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / PACKETS;
+        if(ns<best) best = ns;
+    }
+    return best;
+}
+
+void Report(const std::string& name, double ns){
+    std::cout << std::left << std::setw(30) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(2) << ns << " ns/pkt"
+              << std::setw(10) << std::setprecision(1) << (1e3 / ns) << " Mpkt/s\n";
+}
+
+// Feeds every payload and pumps whenever the queue could fill up, the way
+// the decode thread keeps up on a box with cores to spare
+void Run(Ingestor& ingest, const std::vector<uint8_t>& payloads, size_t payload_len, size_t records_per_payload){
+    size_t count = payloads.size() / payload_len;
+    size_t since_pump = 0;
+    for(size_t i=0; i<count; i++){
+        ingest.OnMessage(payloads.data() + i*payload_len, payload_len);
+        since_pump += records_per_payload;
+        if(since_pump>=4096){
+            while(ingest.Pump()>0) {}
+            since_pump = 0;
+        }
+    }
+    while(ingest.Pump()>0) {}
+    ingest.Deliver();
+}
+
+int main(){
+    std::vector<uint8_t> records(PACKETS * Packet::SIZE);
+    for(size_t i=0; i<PACKETS; i++){
+        Packet p{};
+        p.magic = Packet::MAGIC;
+        p.vehicle_id = (uint16_t)(i % VEHICLES);
+        p.sequence_id = (uint32_t)(i / VEHICLES);
+        p.timestamp = 1700000000000ull + (i / VEHICLES)*100;
+        p.rpm = (uint16_t)(800 + (i*37) % 7000);
+        p.speed = (uint16_t)(i % 200);
+        p.jerk = (int16_t)((i*17) % 400) - 200;
+        p.version = Packet::VERSION;
+        p.serialize(records.data() + i*Packet::SIZE);
+    }
+    Crc16::StampBatch(records.data(), PACKETS);
+
+    // The same records as batch frames
+    const size_t frame_len = Batch::HEADER_SIZE + FRAME_RECORDS*Batch::RECORD_SIZE;
+    const size_t frames = PACKETS / FRAME_RECORDS;
+    std::vector<uint8_t> framed(frames * frame_len);
+    for(size_t f=0; f<frames; f++){
+        uint8_t* h = framed.data() + f*frame_len;
+        h[0] = Batch::MAGIC >> 8; h[1] = Batch::MAGIC & 0xFF;
+        h[2] = Batch::VERSION; h[3] = Batch::RECORD_SIZE;
+        h[4] = FRAME_RECORDS >> 8; h[5] = FRAME_RECORDS & 0xFF;
+        h[6] = h[7] = 0;
+        std::copy(records.begin() + f*FRAME_RECORDS*Packet::SIZE, records.begin() + (f+1)*FRAME_RECORDS*Packet::SIZE,
+                  h + Batch::HEADER_SIZE);
+    }
+
+    std::cout << "Ingest of " << PACKETS << " packets, best of " << ROUNDS
+              << " (decode: " << PacketDecode::Name(PacketDecode::Active())
+              << ", CRC: " << Crc16::Name(Crc16::Active()) << ")\n\n";
+
+    IngestOptions options;
+    options.max_batch_age_ms = 1000;
+    {
+        Ingestor ingest(options);
+        Report("packets, no sink", Measure([&]{ Run(ingest, records, Packet::SIZE, 1); }));
+    }
+    {
+        Ingestor ingest(options);
+        Report("frames, no sink", Measure([&]{ Run(ingest, framed, frame_len, FRAME_RECORDS); }));
+    }
+    {
+        VehicleStatsSink stats;
+        Ingestor ingest(options);
+        ingest.AddSink(stats);
+        Report("packets, vehicle stats", Measure([&]{ Run(ingest, records, Packet::SIZE, 1); }));
+    }
+    {
+        VehicleStatsSink stats;
+        Ingestor ingest(options);
+        ingest.AddSink(stats);
+        Report("frames, vehicle stats", Measure([&]{ Run(ingest, framed, frame_len, FRAME_RECORDS); }));
+    }
+    std::FILE* null = std::fopen("/dev/null", "w");
+    if(null){
+        VehicleStatsSink stats;
+        LineProtocolSink lines(null);
+        Ingestor ingest(options);
+        ingest.AddSink(stats);
+        ingest.AddSink(lines);
+        Report("frames, stats + line protocol", Measure([&]{ Run(ingest, framed, frame_len, FRAME_RECORDS); }));
+        ingest.Stop();
+        std::fclose(null);
+    }
+    return 0;
+}
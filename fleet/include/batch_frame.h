@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "packet.h"
+
+// Batched telemetry frame: many 32-byte wire records in one MQTT PUBLISH.
+//
+// |Offset|Field      |Type    |
+// |0x00  |Magic      |uint16  | 0xD351 (single packets use 0xD350)
+// |0x02  |Version    |uint8   | BATCH_VERSION
+// |0x03  |RecordSize |uint8   | 32
+// |0x04  |Count      |uint16  | Records that follow
+// |0x06  |Reserved   |uint16  | Zero
+// |0x08  |Records    |32*Count| Packet::serialize output, CRC included
+//
+// Big-endian like the packets themselves. Only the format and the decoder
+// live here, publishing frames over MQTT is batch_publisher.h.
+namespace Batch {
+    constexpr uint16_t MAGIC = 0xD351;
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = 8;
+    constexpr size_t RECORD_SIZE = 32;
+    constexpr size_t MAX_RECORDS = 0xFFFF;
+
+    // Largest PUBLISH carrying a frame: fixed header, longest topic, packet id
+    constexpr size_t MAX_PUBLISH = 5 + 2 + 0xFFFF + 2 + HEADER_SIZE + MAX_RECORDS*RECORD_SIZE;
+}
+
+enum class BatchError : uint8_t {
+    OK,
+    TOO_SHORT,    // Smaller than the header
+    BAD_MAGIC,
+    BAD_VERSION,  // Newer than this decoder
+    BAD_RECORD,   // Record size this decoder doesn't know
+    BAD_LENGTH    // Count doesn't match the payload size
+};
+
+// Zero-copy view over a received batch frame
+class BatchView {
+    const uint8_t* m_records = nullptr;
+    size_t m_count = 0;
+    uint8_t m_version = 0;
+
+public:
+    static BatchError Parse(const uint8_t* data, size_t len, BatchView& out){
+        if(len<Batch::HEADER_SIZE) return BatchError::TOO_SHORT;
+        uint16_t magic = (data[0]<<8) | data[1];
+        if(magic!=Batch::MAGIC) return BatchError::BAD_MAGIC;
+        if(data[2]==0 || data[2]>Batch::VERSION) return BatchError::BAD_VERSION;
+        if(data[3]!=Batch::RECORD_SIZE) return BatchError::BAD_RECORD;
+        size_t count = (data[4]<<8) | data[5];
+        if(len != Batch::HEADER_SIZE + count*Batch::RECORD_SIZE) return BatchError::BAD_LENGTH;
+        out.m_records = data + Batch::HEADER_SIZE;
+        out.m_count = count;
+        out.m_version = data[2];
+        return BatchError::OK;
+    }
+
+    size_t Count() const { return m_count; }
+    uint8_t Version() const { return m_version; }
+
+    // i-th 32-byte wire record, still big-endian
+    const uint8_t* Record(size_t i) const { return m_records + i*Batch::RECORD_SIZE; }
+};
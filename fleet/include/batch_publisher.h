@@ -0,0 +1,96 @@
+#pragma once
+// Publishing side of batch frames (format in batch_frame.h) over MqttForge.
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "packet.h"
+#include "batch_frame.h"
+#include "mqtt_forge.h"
+
+static_assert(Batch::MAX_PUBLISH<=MAX_RX_FRAME, "A full batch frame must pass the MQTT receive limit");
+static_assert(Batch::MAX_PUBLISH<=MAX_TX_BACKLOG, "A full batch frame must fit the MQTT send backlog");
+
+// Accumulates wire records and publishes them as one batch frame.
+// Flushes when max_records are queued or the oldest record is max_age old,
+// so the added latency is bounded by max_age (plus the caller's Poll period).
+class BatchPublisher {
+    MqttForge& m_link;
+    PreparedPublish m_topic;
+    size_t m_max_records;
+    std::chrono::milliseconds m_max_age;
+
+    std::vector<uint8_t> m_frame;
+    size_t m_count = 0;
+    std::chrono::steady_clock::time_point m_oldest;
+
+    uint64_t m_frames_sent = 0;
+    uint64_t m_records_sent = 0;
+    uint64_t m_records_dropped = 0;
+
+public:
+    BatchPublisher(MqttForge& link, const std::string& topic, size_t max_records, int max_age_ms, int qos = 1)
+        : m_link(link),
+          m_topic(link.Prepare(topic, qos)),
+          m_max_records(max_records==0 ? 1 : (max_records>Batch::MAX_RECORDS ? Batch::MAX_RECORDS : max_records)),
+          m_max_age(max_age_ms) {
+        m_frame.resize(Batch::HEADER_SIZE + m_max_records*Batch::RECORD_SIZE);
+        uint8_t* h = m_frame.data();
+        h[0] = Batch::MAGIC >> 8;
+        h[1] = Batch::MAGIC & 0xFF;
+        h[2] = Batch::VERSION;
+        h[3] = Batch::RECORD_SIZE;
+        h[4] = h[5] = 0;
+        h[6] = h[7] = 0;
+    }
+
+    // record is 32 bytes of serialized Packet with its CRC filled in.
+    // Returns false only when a count-triggered flush failed to publish.
+    bool Add(const uint8_t* record){
+        if(m_count==0) m_oldest = std::chrono::steady_clock::now();
+        std::memcpy(m_frame.data() + Batch::HEADER_SIZE + m_count*Batch::RECORD_SIZE, record, Batch::RECORD_SIZE);
+        m_count++;
+        if(m_count>=m_max_records) return Flush();
+        return true;
+    }
+
+    bool Add(const Packet& packet){
+        uint8_t wire[Batch::RECORD_SIZE];
+        packet.serialize(wire);
+        return Add(wire);
+    }
+
+    // Age-based flush, call this from the sim loop
+    bool Poll(){
+        if(m_count==0) return true;
+        if(std::chrono::steady_clock::now() - m_oldest < m_max_age) return true;
+        return Flush();
+    }
+
+    // Publishes whatever is queued. On failure the records are dropped (and
+    // counted): they are already stale by the time the link comes back. A
+    // QoS 1 frame the link took into its in-flight window before the send
+    // failed is not dropped, the replay after the next CONNACK carries it.
+    bool Flush(){
+        if(m_count==0) return true;
+        m_frame[4] = (m_count>>8) & 0xFF;
+        m_frame[5] = m_count & 0xFF;
+        size_t len = Batch::HEADER_SIZE + m_count*Batch::RECORD_SIZE;
+        uint16_t tracked = 0;
+        bool ok = m_link.Publish(m_topic, m_frame.data(), len, &tracked);
+        if(ok || tracked){
+            m_frames_sent++;
+            m_records_sent += m_count;
+        }
+        else m_records_dropped += m_count;
+        m_count = 0;
+        return ok;
+    }
+
+    size_t Pending() const { return m_count; }
+    uint64_t FramesSent() const { return m_frames_sent; }
+    uint64_t RecordsSent() const { return m_records_sent; }
+    uint64_t RecordsDropped() const { return m_records_dropped; }
+};
@@ -0,0 +1,127 @@
+#pragma once
+// Command topics and O(1) routing of commands to simulated vehicles.
+//
+// A process hosting many vehicles subscribes once to fleet/+/cmd instead of
+// once per vehicle. Each message's vehicle id is parsed straight out of the
+// topic bytes and looked up in a dense table (id - base -> local index), so a
+// command costs the same for 10 vehicles or 65k. fleet/all/cmd is matched by
+// the same filter and reaches every vehicle the router knows in one pass.
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace CommandTopic {
+    constexpr std::string_view PREFIX = "fleet/";
+    constexpr std::string_view SUFFIX = "/cmd";
+    constexpr std::string_view WILDCARD = "fleet/+/cmd";
+    constexpr std::string_view BROADCAST = "fleet/all/cmd";
+    constexpr std::string_view BROADCAST_ID = "all";
+
+    inline std::string For(uint16_t vehicle_id){
+        return std::string(PREFIX) + std::to_string(vehicle_id) + std::string(SUFFIX);
+    }
+
+    enum class Target : uint8_t { NONE, VEHICLE, BROADCAST };
+
+    // fleet/<id>/cmd -> VEHICLE with id set, fleet/all/cmd -> BROADCAST,
+    // anything else (including ids over 65535 or with a sign) -> NONE
+    inline Target Parse(std::string_view topic, uint16_t& id){
+        if(topic.size()<=PREFIX.size()+SUFFIX.size()) return Target::NONE;
+        if(topic.compare(0, PREFIX.size(), PREFIX)!=0) return Target::NONE;
+        if(topic.compare(topic.size()-SUFFIX.size(), SUFFIX.size(), SUFFIX)!=0) return Target::NONE;
+        std::string_view middle = topic.substr(PREFIX.size(), topic.size()-PREFIX.size()-SUFFIX.size());
+        if(middle==BROADCAST_ID) return Target::BROADCAST;
+        if(middle.size()>5) return Target::NONE;
+        uint32_t value = 0;
+        for(char c : middle){
+            if(c<'0' || c>'9') return Target::NONE;
+            value = value*10 + (uint32_t)(c - '0');
+        }
+        if(value>0xFFFF) return Target::NONE;
+        id = (uint16_t)value;
+        return Target::VEHICLE;
+    }
+
+    // First payload byte is the opcode; the ASCII digits '1'..'3' typed into
+    // mosquitto_pub count as 0x01..0x03. 0 for an empty payload.
+    inline uint8_t Opcode(const uint8_t* payload, size_t len){
+        if(len==0) return 0;
+        uint8_t opcode = payload[0];
+        if(opcode>='1' && opcode<='3') opcode -= '0';
+        return opcode;
+    }
+}
+
+class CommandRouter {
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+    // Vehicle id -> caller's index (e.g. a FleetState lane). Ids don't need to
+    // be consecutive, the table spans min..max id of what was added.
+    void Add(uint16_t id, uint32_t index){
+        if(m_table.empty()){
+            m_base = id;
+        }
+        else if(id<m_base){
+            m_table.insert(m_table.begin(), m_base - id, NONE);
+            m_base = id;
+        }
+        if((size_t)(id - m_base)>=m_table.size()) m_table.resize(id - m_base + 1, NONE);
+        if(m_table[id - m_base]==NONE) m_count++;
+        m_table[id - m_base] = index;
+    }
+
+    uint32_t Find(uint16_t id) const {
+        size_t slot = (size_t)id - m_base;
+        return id>=m_base && slot<m_table.size() ? m_table[slot] : NONE;
+    }
+
+    size_t Size() const { return m_count; }
+
+    // Dispatches one message: one(index, opcode) for a known vehicle,
+    // all(opcode) for a broadcast. Returns whether anything was called.
+    template <typename One, typename All>
+    bool Route(std::string_view topic, const uint8_t* payload, size_t len, One&& one, All&& all){
+        uint16_t id = 0;
+        uint8_t opcode = CommandTopic::Opcode(payload, len);
+        switch(CommandTopic::Parse(topic, id)){
+            case CommandTopic::Target::VEHICLE: {
+                if(len==0) break;
+                uint32_t index = Find(id);
+                if(index==NONE){
+                    m_foreign++; // Someone else's vehicle, normal with a wildcard filter
+                    return false;
+                }
+                m_routed++;
+                one(index, opcode);
+                return true;
+            }
+            case CommandTopic::Target::BROADCAST:
+                if(len==0) break;
+                m_broadcasts++;
+                all(opcode);
+                return true;
+            case CommandTopic::Target::NONE:
+                break;
+        }
+        m_malformed++;
+        return false;
+    }
+
+    uint64_t Routed() const { return m_routed; }
+    uint64_t Broadcasts() const { return m_broadcasts; }
+    uint64_t Foreign() const { return m_foreign; }
+    uint64_t Malformed() const { return m_malformed; }
+
+private:
+    uint16_t m_base = 0;
+    std::vector<uint32_t> m_table;
+    size_t m_count = 0;
+
+    uint64_t m_routed = 0;
+    uint64_t m_broadcasts = 0;
+    uint64_t m_foreign = 0;
+    uint64_t m_malformed = 0;
+};
@@ -0,0 +1,144 @@
+#pragma once
+// Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC'11).
+//
+// A draw is a pure function of (seed, vehicle id, tick, stream), so there is
+// no generator state to store, seed or share between threads: any thread can
+// produce any vehicle's noise for any tick and get the same bits. Streams keep
+// independent uses (RPM noise, cpu_load, the driver's dice) from reusing
+// the same numbers.
+//
+// Gaussian() is Box-Muller on top of it with in-house log and sin/cos, plain
+// branch-free double arithmetic with no libm calls. The batch overload is a
+// straight loop over lanes the compiler can vectorize, and because both
+// paths run the same expressions, one vehicle at a time and a whole fleet at
+// once give bit-identical noise (on any libm).
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+namespace CounterRng {
+    enum Stream : uint16_t {
+        RPM_NOISE = 0,
+        CPU_LOAD  = 1,
+        DRIVER    = 2
+    };
+
+    struct Block { uint32_t v[4]; };
+
+    constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+    inline Block Round(const Block& ctr, uint32_t k0, uint32_t k1){
+        uint64_t p0 = (uint64_t)M0 * ctr.v[0];
+        uint64_t p1 = (uint64_t)M1 * ctr.v[2];
+        return Block{{(uint32_t)(p1 >> 32) ^ ctr.v[1] ^ k0, (uint32_t)p1,
+                      (uint32_t)(p0 >> 32) ^ ctr.v[3] ^ k1, (uint32_t)p0}};
+    }
+
+    // Raw Philox4x32-10: 128-bit counter, 64-bit key. The rounds are spelled
+    // out, a loop that -O2 leaves rolled would keep callers from vectorizing.
+    inline Block Philox(Block ctr, uint32_t k0, uint32_t k1){
+        ctr = Round(ctr, k0, k1);               ctr = Round(ctr, k0 + 1*W0, k1 + 1*W1);
+        ctr = Round(ctr, k0 + 2*W0, k1 + 2*W1); ctr = Round(ctr, k0 + 3*W0, k1 + 3*W1);
+        ctr = Round(ctr, k0 + 4*W0, k1 + 4*W1); ctr = Round(ctr, k0 + 5*W0, k1 + 5*W1);
+        ctr = Round(ctr, k0 + 6*W0, k1 + 6*W1); ctr = Round(ctr, k0 + 7*W0, k1 + 7*W1);
+        ctr = Round(ctr, k0 + 8*W0, k1 + 8*W1); ctr = Round(ctr, k0 + 9*W0, k1 + 9*W1);
+        return ctr;
+    }
+
+    // Counter = tick (64 bits), vehicle id and stream; key = seed
+    inline Block Draw(uint64_t seed, uint16_t id, uint64_t tick, Stream stream){
+        Block ctr{{(uint32_t)tick, (uint32_t)(tick >> 32), (uint32_t)id | ((uint32_t)stream << 16), 0}};
+        return Philox(ctr, (uint32_t)seed, (uint32_t)(seed >> 32));
+    }
+
+    inline uint32_t Bits(uint64_t seed, uint16_t id, uint64_t tick, Stream stream){
+        return Draw(seed, id, tick, stream).v[0];
+    }
+
+    // Maps 32 random bits onto [0, n) by multiply-shift (no modulo bias worth the name for small n)
+    inline uint32_t Below(uint32_t bits, uint32_t n){
+        return (uint32_t)(((uint64_t)bits * n) >> 32);
+    }
+
+    // 52 random bits as a double in [1, 2), built from the exponent up
+    inline double OneToTwo(uint32_t hi, uint32_t lo){
+        uint64_t bits = (0x3FFull << 52) | ((uint64_t)(hi & 0xFFFFF) << 32) | lo;
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+
+    // Natural log for x in [2^-52, 1]: exponent split, mantissa folded into
+    // [sqrt(1/2), sqrt(2)), then the atanh series in s = (m-1)/(m+1), |s| < 0.172,
+    // to s^13 (error below 1e-11)
+    inline double Log(double x){
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        int32_t e = (int32_t)(bits >> 52) - 1023;
+        uint64_t mbits = (bits & 0x000FFFFFFFFFFFFFull) | (0x3FFull << 52);
+        double m;
+        std::memcpy(&m, &mbits, sizeof(m));
+        bool fold = m > 1.4142135623730951;
+        m = fold ? m * 0.5 : m;
+        e = fold ? e + 1 : e;
+        double s = (m - 1.0) / (m + 1.0);
+        double s2 = s * s;
+        double poly = 1.0 + s2*(1.0/3 + s2*(1.0/5 + s2*(1.0/7 + s2*(1.0/9 + s2*(1.0/11 + s2*(1.0/13))))));
+        return (double)e * 0.6931471805599453 + 2.0 * s * poly;
+    }
+
+    // sin and cos of 2*pi*u for u in [0, 1): quadrant from 4u, Taylor
+    // polynomials on the remaining [0, pi/2) (error below 1e-11)
+    inline void SinCosTurn(double u, double& s, double& c){
+        double x = u * 4.0;
+        int32_t q = (int32_t)x;
+        double t = (x - (double)q) * 1.5707963267948966;
+        double t2 = t * t;
+        double sn = t * (1.0 - t2*(1.0/6)*(1.0 - t2*(1.0/20)*(1.0 - t2*(1.0/42)*(1.0 - t2*(1.0/72)*(1.0 - t2*(1.0/110)
+                  *(1.0 - t2*(1.0/156)*(1.0 - t2*(1.0/210))))))));
+        double cs = 1.0 - t2*(1.0/2)*(1.0 - t2*(1.0/12)*(1.0 - t2*(1.0/30)*(1.0 - t2*(1.0/56)*(1.0 - t2*(1.0/90)
+                  *(1.0 - t2*(1.0/132)*(1.0 - t2*(1.0/182)*(1.0 - t2*(1.0/240))))))));
+        // Rotate by the quadrant: (sn, cs), (cs, -sn), (-sn, -cs), (-cs, sn)
+        double a = (q & 1) ? cs : sn;
+        double b = (q & 1) ? sn : cs;
+        s = (q & 2) ? -a : a;
+        c = ((q + 1) & 2) ? -b : b;
+    }
+
+    // Box-Muller (cosine branch) split in two: radius squared and cosine from
+    // one Philox block, then sqrt(r2) * c. sqrt sits apart because its errno
+    // check is a branch that keeps a loop around it from vectorizing.
+    inline void BoxMuller(const Block& r, double& r2, double& c){
+        double u1 = 2.0 - OneToTwo(r.v[0], r.v[1]); // (0, 1], log never sees 0
+        double u2 = OneToTwo(r.v[2], r.v[3]) - 1.0; // [0, 1)
+        double s;
+        SinCosTurn(u2, s, c);
+        r2 = -2.0 * Log(u1);
+    }
+
+    // Standard normal
+    inline double Gaussian(uint64_t seed, uint16_t id, uint64_t tick, Stream stream){
+        double r2, c;
+        BoxMuller(Draw(seed, id, tick, stream), r2, c);
+        return std::sqrt(r2) * c;
+    }
+
+    constexpr size_t BATCH = 64;
+
+    // out[i] = Gaussian(seed, ids[i], tick, stream) for a whole fleet
+    inline void Gaussian(uint64_t seed, const uint16_t* ids, size_t n, uint64_t tick, Stream stream, double* out){
+        uint16_t lane[BATCH];
+        double r2[BATCH], c[BATCH];
+        for(size_t base=0; base<n; base+=BATCH){
+            size_t m = n - base < BATCH ? n - base : BATCH;
+            // Always a full batch (the tail padded), a fixed trip count vectorizes even at -O2
+            std::memset(lane, 0, sizeof(lane));
+            std::memcpy(lane, ids + base, m * sizeof(uint16_t));
+            for(size_t i=0; i<BATCH; i++) BoxMuller(Draw(seed, lane[i], tick, stream), r2[i], c[i]);
+            for(size_t i=0; i<m; i++) out[base + i] = std::sqrt(r2[i]) * c[i];
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, MSB first, no final xor).
+// This is the checksum at bytes 28..29 of every Packet, computed over 0..27.
+//
+// Three bit-exact implementations, the fastest one the CPU supports is picked
+// at runtime by Compute() and the batch helpers:
+//   BITWISE - the original bit-at-a-time loop, kept as the reference
+//   SLICE8  - slice-by-8 tables, 8 bytes per step
+//   CLMUL   - PCLMULQDQ fold + Barrett reduction (x86); a 28-byte record is
+//             folded as 7 independent word products and reduced once
+namespace Crc16 {
+
+    constexpr uint16_t INIT = 0xFFFF;
+    constexpr uint16_t POLY = 0x1021;
+    constexpr size_t RECORD_SIZE = 32;  // Wire record
+    constexpr size_t COVERED = 28;      // Bytes the CRC covers
+    constexpr size_t OFFSET = 28;       // Where the CRC lives (big-endian)
+
+    enum class Impl : uint8_t { BITWISE, SLICE8, CLMUL };
+
+    uint16_t Bitwise(const uint8_t* data, size_t length, uint16_t crc = INIT);
+    uint16_t Slice8(const uint8_t* data, size_t length, uint16_t crc = INIT);
+    // Falls back to Slice8 when the CPU has no carry-less multiply
+    uint16_t Clmul(const uint8_t* data, size_t length, uint16_t crc = INIT);
+
+    bool ClmulSupported();
+
+    // Implementation Compute() and the batch functions dispatch to
+    Impl Active();
+    const char* Name(Impl impl);
+
+    // Force a specific implementation (benchmarks, tests)
+    void Select(Impl impl);
+
+    uint16_t Compute(const uint8_t* data, size_t length);
+
+    // --- Batch API over contiguous 32-byte wire records ---
+
+    // out[i] = CRC of records[i][0..28)
+    void ComputeBatch(const uint8_t* records, size_t count, uint16_t* out);
+
+    // Writes each record's CRC into its bytes 28..29
+    void StampBatch(uint8_t* records, size_t count);
+
+    // ok[i] = 1 if the stored CRC matches (ok may be null).
+    // Returns the number of valid records.
+    size_t VerifyBatch(const uint8_t* records, size_t count, uint8_t* ok);
+}
+
+// Drop-in for the simulator's old local helper
+inline uint16_t CalculateCRC(const uint8_t *data, size_t length){
+    return Crc16::Compute(data, length);
+}
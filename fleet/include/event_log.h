@@ -0,0 +1,149 @@
+#pragma once
+// Asynchronous binary event log.
+//
+// Log calls write one fixed 64-byte record (wall-clock ns, vehicle id, event
+// code, writer thread, six integer args) into a lock-free single-producer
+// ring owned by the calling thread: a clock read, a copy and a release
+// store, no lock and no syscall. A background thread drains every ring,
+// orders the batch by time, appends it to a binary file and/or renders it to
+// the console. Records that find their ring full are dropped and counted,
+// the hot path never waits.
+//
+// The file is a LogFileHeader followed by raw records in native byte order;
+// fleet_log (src/fleet_log.cpp) renders it as text.
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "single_writer.h"
+
+enum class LogEvent : uint16_t {
+    NONE,
+    STATUS,              // seq, rpm, speed km/h, StatusTag, sim s (-1 = real time), queue used<<32 | capacity (-1 = none)
+    DRIVER_PANIC,
+    COMMAND_RX,          // opcode
+    VEHICLE_KILL,
+    VEHICLE_LIMP,
+    VEHICLE_NORMAL,
+    VEHICLE_UNKNOWN_CMD, // opcode
+    LINK_UP,             // 1 = subscribed, 0 = subscription failed
+    LINK_CONNECT_FAILED,
+    LINK_LOST,
+    SPOOL_REPLAY,        // records waiting
+    MQTT_SUB_REFUSED,
+    SCENARIO_EVENT,      // event index in the scenario, 1 = started 0 = ended
+    COUNT
+};
+
+// What the status line shows after the speed
+enum class StatusTag : uint8_t { NONE, ABS, OVERHEAT, LOW_BATTERY, SPRINT, STRESS, BRAKING };
+
+struct LogRecord {
+    uint64_t time_ns;    // Unix epoch
+    uint16_t vehicle_id; // 0 when not about a vehicle
+    uint16_t code;       // LogEvent
+    uint32_t thread;     // Writer, in registration order
+    int64_t arg[6];
+};
+static_assert(sizeof(LogRecord)==64, "One record per cache line");
+
+struct LogFileHeader {
+    uint32_t magic;       // EventLog::MAGIC
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t start_ns;
+};
+
+namespace EventLog {
+    constexpr uint32_t MAGIC = 0x474F4C44; // "DLOG"
+    constexpr uint16_t VERSION = 1;
+    constexpr size_t RING_RECORDS = 4096;   // Per writer thread, power of two
+    constexpr int DRAIN_MS = 20;
+
+    struct alignas(64) ThreadRing {
+        alignas(64) std::atomic<uint64_t> tail{0};   // Writer
+        std::atomic<uint64_t> dropped{0};
+        alignas(64) std::atomic<uint64_t> head{0};   // Drain thread
+        uint32_t thread = 0;
+        LogRecord slots[RING_RECORDS];
+    };
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<std::unique_ptr<ThreadRing>> rings;
+    };
+
+    inline Registry& Global(){
+        static Registry registry;
+        return registry;
+    }
+
+    // This thread's ring, created on the first call
+    inline ThreadRing& Local(){
+        thread_local ThreadRing* mine = nullptr;
+        if(!mine){
+            Registry& r = Global();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.rings.emplace_back(new ThreadRing());
+            mine = r.rings.back().get();
+            mine->thread = (uint32_t)(r.rings.size() - 1);
+        }
+        return *mine;
+    }
+
+    inline uint64_t NowNs(){
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Doubles travel as their bit pattern
+    inline int64_t Bits(double v){
+        int64_t out;
+        std::memcpy(&out, &v, sizeof(out));
+        return out;
+    }
+    inline double Double(int64_t bits){
+        double out;
+        std::memcpy(&out, &bits, sizeof(out));
+        return out;
+    }
+
+    inline void Write(LogEvent event, uint16_t vehicle_id, int64_t a0 = 0, int64_t a1 = 0, int64_t a2 = 0,
+                      int64_t a3 = 0, int64_t a4 = 0, int64_t a5 = 0){
+        ThreadRing& ring = Local();
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        if(tail - ring.head.load(std::memory_order_acquire) >= RING_RECORDS){
+            SingleWriter::Bump(ring.dropped);
+            return;
+        }
+        LogRecord& r = ring.slots[tail & (RING_RECORDS - 1)];
+        r.time_ns = NowNs();
+        r.vehicle_id = vehicle_id;
+        r.code = (uint16_t)event;
+        r.thread = ring.thread;
+        r.arg[0] = a0; r.arg[1] = a1; r.arg[2] = a2;
+        r.arg[3] = a3; r.arg[4] = a4; r.arg[5] = a5;
+        ring.tail.store(tail + 1, std::memory_order_release);
+    }
+
+    // Starts the drain thread. path may be empty (no file), console may be
+    // null (no echo). False if the file can't be created.
+    bool Start(const std::string& path, std::ostream* console);
+
+    // Drains what is left, closes the file and joins. Returns records dropped.
+    uint64_t Stop();
+
+    const char* Name(LogEvent event);
+
+    // Timestamped one-line form used by fleet_log
+    void Render(const LogRecord& r, std::ostream& os);
+
+    // The simulator's traditional console text (status line ends in \r)
+    void RenderConsole(const LogRecord& r, std::ostream& os);
+}
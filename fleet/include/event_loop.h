@@ -0,0 +1,67 @@
+#pragma once
+// Single-threaded epoll reactor (Linux only).
+// One EventLoop can drive thousands of non-blocking MqttForge sessions: each
+// session registers its socket with itself as the handler and the loop calls
+// back only the sockets that are actually ready.
+#include <cstdint>
+#include <vector>
+
+class IoHandler {
+public:
+    virtual ~IoHandler() = default;
+    // events is a mask of EPOLLIN / EPOLLOUT / EPOLLERR / EPOLLHUP
+    virtual void OnIoEvent(uint32_t events) = 0;
+};
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+
+class EventLoop {
+    int m_epfd;
+    std::vector<epoll_event> m_events;
+
+public:
+    explicit EventLoop(int max_events = 1024)
+        : m_epfd(epoll_create1(EPOLL_CLOEXEC)), m_events(max_events) {}
+
+    ~EventLoop() {
+        if(m_epfd>=0) close(m_epfd);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool Valid() const { return m_epfd>=0; }
+
+    bool Add(int fd, uint32_t events, IoHandler* handler){
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = handler;
+        return epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    bool Modify(int fd, uint32_t events, IoHandler* handler){
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = handler;
+        return epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    // Closing the fd also removes it, this is for sockets that stay open
+    void Remove(int fd){
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Dispatches ready sockets, waits at most timeout_ms (-1 = forever).
+    // Returns the number of handlers called.
+    int Poll(int timeout_ms){
+        int n = epoll_wait(m_epfd, m_events.data(), (int)m_events.size(), timeout_ms);
+        for(int i=0; i<n; i++){
+            static_cast<IoHandler*>(m_events[i].data.ptr)->OnIoEvent(m_events[i].events);
+        }
+        return n<0 ? 0 : n;
+    }
+};
+
+#endif // __linux__
@@ -0,0 +1,44 @@
+#pragma once
+// Q16.16 signed fixed point: 16 integer bits, 16 fraction bits in an int32.
+// Range is about +-32767 with a resolution of 1/65536 (~1.5e-5). Products
+// and quotients go through 64 bits and products round to nearest; nothing
+// saturates, so callers keep intermediates inside the range (Vehicle's
+// physics peaks around 21000 RPM before its redline clamp).
+#include <cstdint>
+
+class Fixed16 {
+public:
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+    constexpr Fixed16() : m_raw(0) {}
+    explicit constexpr Fixed16(double v) : m_raw((int32_t)(v*ONE + (v>=0 ? 0.5 : -0.5))) {}
+    explicit constexpr Fixed16(int v) : m_raw((int32_t)((uint32_t)v << FRACTION_BITS)) {}
+
+    static constexpr Fixed16 FromRaw(int32_t raw) { Fixed16 f; f.m_raw = raw; return f; }
+    constexpr int32_t Raw() const { return m_raw; }
+
+    explicit constexpr operator double() const { return (double)m_raw / ONE; }
+
+    constexpr Fixed16 operator-() const { return FromRaw(-m_raw); }
+    constexpr Fixed16 operator+(Fixed16 o) const { return FromRaw(m_raw + o.m_raw); }
+    constexpr Fixed16 operator-(Fixed16 o) const { return FromRaw(m_raw - o.m_raw); }
+    constexpr Fixed16 operator*(Fixed16 o) const {
+        return FromRaw((int32_t)(((int64_t)m_raw*o.m_raw + (ONE >> 1)) >> FRACTION_BITS));
+    }
+    constexpr Fixed16 operator/(Fixed16 o) const {
+        return FromRaw((int32_t)(((int64_t)m_raw * ONE) / o.m_raw));
+    }
+    Fixed16& operator+=(Fixed16 o) { m_raw += o.m_raw; return *this; }
+    Fixed16& operator-=(Fixed16 o) { m_raw -= o.m_raw; return *this; }
+
+    constexpr bool operator<(Fixed16 o) const { return m_raw < o.m_raw; }
+    constexpr bool operator>(Fixed16 o) const { return m_raw > o.m_raw; }
+    constexpr bool operator<=(Fixed16 o) const { return m_raw <= o.m_raw; }
+    constexpr bool operator>=(Fixed16 o) const { return m_raw >= o.m_raw; }
+    constexpr bool operator==(Fixed16 o) const { return m_raw == o.m_raw; }
+    constexpr bool operator!=(Fixed16 o) const { return m_raw != o.m_raw; }
+
+private:
+    int32_t m_raw;
+};
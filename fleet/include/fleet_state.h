@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "packet.h"
+#include "vehicle.h"
+
+// Struct-of-arrays version of Vehicle.
+// Every physics field lives in its own contiguous array so a whole fleet can be
+// ticked in one pass of straight-line loops the compiler can vectorize.
+// Tick/Snapshot produce the same numbers as N scalar Vehicles with the same ids.
+class FleetState {
+public:
+    // Vehicles get consecutive ids starting at first_id. The seed keys the
+    // noise like Vehicle's does.
+    FleetState(size_t count, uint16_t first_id, uint64_t seed = 0);
+    explicit FleetState(const std::vector<uint16_t>& ids, uint64_t seed = 0);
+
+    size_t Size() const { return m_id.size(); }
+    uint16_t Id(size_t i) const { return m_id[i]; }
+
+    // Same semantics as the Vehicle methods, applied to vehicle i
+    void SetThrottle(size_t i, double throttle);
+    void OnCommand(size_t i, uint8_t opcode);
+
+    // OnCommand for every vehicle at once (broadcast commands)
+    void OnCommandAll(uint8_t opcode);
+
+    // Updates physics state of the whole fleet by dt seconds
+    void Tick(double dt_seconds);
+
+    // Serializes the fleet into out[0..count). count must not exceed Size()
+    void Snapshot(Packet* out, size_t count, double dt);
+
+    // Read-only views for tests and stats
+    double Speed(size_t i) const { return m_speed[i]; }
+    double Rpm(size_t i) const { return m_rpm[i]; }
+    int Gear(size_t i) const { return static_cast<int>(m_gear[i]); }
+
+private:
+    void Init(size_t count);
+
+    std::vector<uint16_t> m_id;
+
+    // Physics State (one entry per vehicle)
+    std::vector<double> m_speed;
+    std::vector<double> m_rpm;
+    std::vector<double> m_temp;
+    std::vector<double> m_acceleration;
+    std::vector<double> m_prev_accel;
+    std::vector<double> m_target_speed;
+    std::vector<double> m_throttle;
+    std::vector<double> m_battery_level;
+    // Gear and the kill/limp flags are kept 64 bits wide like the doubles
+    std::vector<double> m_gear;
+    std::vector<int64_t> m_remote_kill;
+    std::vector<int64_t> m_limp_mode;
+
+    // Noise is keyed by (seed, id, tick) exactly like Vehicle::Snapshot's,
+    // drawn for the whole fleet in one batch
+    uint64_t m_seed;
+    uint64_t m_ticks = 0;
+    std::vector<double> m_noise_scratch;
+};
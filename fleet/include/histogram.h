@@ -0,0 +1,97 @@
+#pragma once
+// Log-linear histogram for latencies (HDR style, fixed memory, no allocation
+// per sample). Each power of two is split into SUB linear buckets, so any
+// recorded value is reported within 1/SUB (12.5%) of what was measured.
+// Single writer, not thread safe.
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <iomanip>
+
+class Histogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+private:
+    uint64_t m_counts[BUCKETS] = {};
+    uint64_t m_total = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+
+public:
+    // Bucket of a value and the highest value in a bucket, shared with
+    // AtomicHistogram (metrics.h) so per-thread copies merge bucket by bucket
+    static int Index(uint64_t v){
+        if(v < (uint64_t)SUB) return (int)v;
+        int top = 63 - __builtin_clzll(v);            // >= SUB_BITS
+        int shift = top - SUB_BITS;
+        return (shift + 1) * SUB + (int)((v >> shift) & (SUB - 1));
+    }
+
+    // Highest value that lands in bucket i
+    static uint64_t UpperBound(int i){
+        if(i < SUB) return (uint64_t)i;
+        int shift = i / SUB - 1;
+        uint64_t base = (uint64_t)(SUB + i % SUB) << shift;
+        return base + ((1ull << shift) - 1);
+    }
+
+    void Record(uint64_t v){
+        m_counts[Index(v)]++;
+        m_total++;
+        m_sum += v;
+        if(v<m_min) m_min = v;
+        if(v>m_max) m_max = v;
+    }
+
+    // Adds raw buckets recorded elsewhere (counts has BUCKETS entries)
+    void Merge(const uint64_t* counts, uint64_t sum, uint64_t min, uint64_t max){
+        for(int i=0; i<BUCKETS; i++){
+            m_counts[i] += counts[i];
+            m_total += counts[i];
+        }
+        m_sum += sum;
+        if(min<m_min) m_min = min;
+        if(max>m_max) m_max = max;
+    }
+
+    void Reset() { *this = Histogram(); }
+
+    uint64_t Count() const { return m_total; }
+    uint64_t Sum() const { return m_sum; }
+    uint64_t Min() const { return m_total ? m_min : 0; }
+    uint64_t Max() const { return m_max; }
+    double Mean() const { return m_total ? (double)m_sum / m_total : 0.0; }
+
+    // Value at quantile q (0..1), bucket upper bound capped at the real max
+    uint64_t Percentile(double q) const {
+        if(m_total==0) return 0;
+        uint64_t rank = (uint64_t)(q * (double)m_total);
+        if(rank>=m_total) rank = m_total - 1;
+        uint64_t seen = 0;
+        for(int i=0; i<BUCKETS; i++){
+            seen += m_counts[i];
+            if(seen>rank){
+                uint64_t v = UpperBound(i);
+                return v<m_max ? v : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    // Non-empty buckets as "<= bound : count" lines, values divided by scale
+    void Print(std::ostream& os, double scale = 1.0, const char* unit = "") const {
+        std::ios_base::fmtflags flags = os.flags();
+        std::streamsize precision = os.precision();
+        for(int i=0; i<BUCKETS; i++){
+            if(!m_counts[i]) continue;
+            os << "  <= " << std::setw(10) << std::fixed << std::setprecision(1) << UpperBound(i) / scale << unit
+               << " : " << m_counts[i] << "\n";
+        }
+        os.flags(flags);
+        os.precision(precision);
+    }
+};
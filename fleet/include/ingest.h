@@ -0,0 +1,182 @@
+#pragma once
+// Native telemetry ingest: MQTT payloads in, validated PacketBatches out.
+//
+//   network thread          decode thread
+//   OnMessage ──► PacketRing ──► Pump: DecodeValid ──► PacketBatch ──► sinks
+//
+// OnMessage takes single packets and batch frames (batch_frame.h) straight
+// from the MqttForge receive buffer and copies their 32-byte records into a
+// bounded ring, nothing else. The decode thread pulls records in bulk, checks
+// magic, version and CRC with the batch kernels and appends the good ones to
+// a PacketBatch that is allocated once. A batch goes to every sink when it is
+// full or its oldest record is max_batch_age_ms old. Nothing on the way
+// allocates per message.
+//
+// Every stage counts what it loses: payloads that are neither a packet nor a
+// frame, records refused by a full queue, records failing validation, and
+// per sink the records in batches it turned down.
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "packet_batch.h"
+#include "packet_ring.h"
+#include "single_writer.h"
+
+// Receives every decoded batch, on the decode thread
+class IngestSink {
+public:
+    virtual ~IngestSink() = default;
+    virtual const char* Name() const = 0;
+
+    // Only valid records reach a sink. The batch is reused after the call
+    // returns. False means the sink dropped this batch.
+    virtual bool Consume(const PacketBatch& batch) = 0;
+
+    // End of the stream, write out anything buffered
+    virtual void Flush() {}
+};
+
+struct IngestOptions {
+    size_t queue_records = 1 << 16;              // Ring between the two threads
+    RingOverflow overflow = RingOverflow::DROP_NEWEST;
+    size_t batch_records = 4096;                 // Records per PacketBatch
+    int max_batch_age_ms = 20;                   // A partial batch waits at most this long
+};
+
+// Counters have one writer each (network or decode thread) and can be read
+// from any thread
+struct IngestStats {
+    std::atomic<uint64_t> messages{0};       // Payloads received
+    std::atomic<uint64_t> payload_bytes{0};
+    std::atomic<uint64_t> bad_payloads{0};   // Neither a packet nor a valid batch frame
+    std::atomic<uint64_t> records{0};        // Records found in good payloads
+    std::atomic<uint64_t> queued{0};         // Of those, taken by the queue
+    std::atomic<uint64_t> rejected{0};       // Bad magic, version or CRC
+    std::atomic<uint64_t> decoded{0};        // Appended to a batch
+    std::atomic<uint64_t> batches{0};        // Handed to the sinks
+};
+
+class Ingestor {
+public:
+    explicit Ingestor(const IngestOptions& options = IngestOptions());
+    ~Ingestor();
+
+    Ingestor(const Ingestor&) = delete;
+    Ingestor& operator=(const Ingestor&) = delete;
+
+    // Not owned, must outlive the Ingestor. Add all sinks before Start().
+    void AddSink(IngestSink& sink);
+
+    // Network side, call it from the MqttForge message callback
+    void OnMessage(const uint8_t* payload, size_t len);
+
+    // Runs Pump on a thread of its own until Stop(). Records that arrive
+    // after Stop() stay in the queue.
+    void Start();
+    // Closes the queue, decodes what is left, delivers the last batch and
+    // flushes the sinks. Call it once the network side is done.
+    void Stop();
+
+    // One decode step on the calling thread (tests, or no decode thread):
+    // takes what the queue has, up to the room in the batch, and delivers the
+    // batch if it is full or old enough. Returns the records taken.
+    size_t Pump();
+    // Delivers the batch being filled, however small
+    void Deliver();
+
+    const IngestStats& Stats() const { return m_stats; }
+    uint64_t QueueDropped() const { return m_ring.DroppedNewest() + m_ring.DroppedOldest(); }
+
+    // Records delivered to / dropped by the i-th sink
+    size_t SinkCount() const { return m_sinks.size(); }
+    uint64_t SinkRecords(size_t i) const { return m_sinks[i].records.load(std::memory_order_relaxed); }
+    uint64_t SinkDropped(size_t i) const { return m_sinks[i].dropped.load(std::memory_order_relaxed); }
+
+    // Per-stage totals and drops
+    void Report(std::ostream& os) const;
+
+private:
+    struct SinkEntry {
+        IngestSink* sink;
+        std::atomic<uint64_t> records{0};
+        std::atomic<uint64_t> dropped{0};
+        explicit SinkEntry(IngestSink* s) : sink(s) {}
+    };
+
+    void Push(const uint8_t* record);
+
+    IngestOptions m_options;
+    IngestStats m_stats;
+    PacketRing m_ring;
+    std::deque<SinkEntry> m_sinks;          // Deque: entries hold atomics, never move
+
+    // Decode thread
+    std::vector<uint8_t> m_scratch;         // batch_records wire records
+    PacketBatch m_batch;
+    std::chrono::steady_clock::time_point m_oldest;
+    std::chrono::steady_clock::duration m_max_age;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    bool m_stopped = false;
+};
+
+// Per-vehicle counts and sequence tracking: loss upstream of the ingestor
+// (publisher, network, broker) shows up here as sequence gaps. A record that
+// arrives after a later one counts as late, and the gap it leaves behind
+// stays counted.
+class VehicleStatsSink : public IngestSink {
+public:
+    VehicleStatsSink();
+    const char* Name() const override { return "vehicle-stats"; }
+    bool Consume(const PacketBatch& batch) override;
+
+    uint64_t Vehicles() const { return m_vehicles; }
+    uint64_t Records() const { return m_records; }
+    uint64_t Gaps() const { return m_gaps; }          // Sequence ids skipped
+    uint64_t Late() const { return m_late; }          // Duplicate or out of order
+    uint64_t Alerts() const { return m_alerts; }      // Records with any flag set
+    uint64_t PerVehicle(uint16_t id) const { return m_count[id]; }
+
+    // Read it once the decode thread has stopped
+    void Report(std::ostream& os) const;
+
+private:
+    std::vector<uint64_t> m_count;      // 65536 entries, by vehicle id
+    std::vector<uint32_t> m_last_seq;
+    uint64_t m_vehicles = 0, m_records = 0, m_gaps = 0, m_late = 0, m_alerts = 0;
+};
+
+// InfluxDB line protocol, the same measurement, tag and fields the Go
+// backend writes, with the same field types: the influx Go client writes its
+// uint8/uint16 fields as unsigned (u), only jerk (int16) is signed (i), and
+// both ingest paths can share a bucket:
+//   vehicle_status,vehicle_id=7 speed=88u,rpm=3100u,jerk=-12i,...,flags=0u 1700000000123000000
+// Stamped with the packet's own timestamp (ns), not the arrival time.
+// Lines are formatted into a buffer allocated once and written out when it
+// fills up.
+class LineProtocolSink : public IngestSink {
+public:
+    // file is not closed by the sink
+    explicit LineProtocolSink(std::FILE* file, size_t buffer_bytes = 1 << 20);
+    const char* Name() const override { return "line-protocol"; }
+    bool Consume(const PacketBatch& batch) override;
+    void Flush() override;
+
+    uint64_t Lines() const { return m_lines; }
+    uint64_t Bytes() const { return m_bytes; }
+
+private:
+    bool WriteOut();
+
+    std::FILE* m_file;
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+    uint64_t m_lines = 0, m_bytes = 0;
+    bool m_failed = false;
+};
@@ -0,0 +1,195 @@
+#pragma once
+// Hot-path instrumentation: counters, gauges and latency histograms.
+//
+// Every thread that records gets its own cache-line aligned block of
+// counters and log-linear histograms, registered on first use and never
+// freed, so totals survive the thread. Only the owning thread writes a block
+// (plain relaxed load + store, no locked instruction); Snapshot() sums all
+// blocks with relaxed loads from any thread while recording carries on.
+//
+// Off by default: every hook is one relaxed load and a predictable branch
+// until Metrics::Enable(true), so benchmarks and tools that don't ask for
+// metrics pay nothing measurable. Export lives in metrics.cpp.
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+#include "single_writer.h"
+
+enum class Counter : uint8_t {
+    VEHICLE_TICKS,
+    SIM_TICKS,
+    TICKS_SKIPPED,    // Paced ticks dropped after an overrun (--overrun skip)
+    PUBLISHES,
+    PUBLISH_BYTES,    // Payload bytes
+    PUBLISH_FAILS,
+    SEND_CALLS,
+    SEND_BYTES,       // Bytes the kernel took right away
+    TX_QUEUED_BYTES,  // Bytes parked in the backlog for later
+    PUBACKS,
+    RETRANSMITS,
+    PINGS,
+    CONNECTS,         // CONNACKs received
+    LINK_DROPS,
+    COUNT
+};
+
+enum class Gauge : uint8_t {
+    RING_DEPTH,
+    SPOOL_DEPTH,
+    TICK_OVERRUNS,
+    COUNT
+};
+
+// All in nanoseconds
+enum class Latency : uint8_t {
+    VEHICLE_TICK,
+    SIM_TICK,         // Whole simulation tick, wake-up to the next wait
+    PUBLISH,          // MqttForge::Publish call (includes waiting on a full window)
+    PUBACK_RTT,       // QoS 1 publish to its PUBACK
+    COUNT
+};
+
+// Histogram with a single writer and readers on other threads
+class AtomicHistogram {
+    std::atomic<uint64_t> m_counts[Histogram::BUCKETS] = {};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_min{UINT64_MAX};
+    std::atomic<uint64_t> m_max{0};
+
+public:
+    void Record(uint64_t v){
+        SingleWriter::Bump(m_counts[Histogram::Index(v)]);
+        SingleWriter::Bump(m_sum, v);
+        if(v<m_min.load(std::memory_order_relaxed)) m_min.store(v, std::memory_order_relaxed);
+        if(v>m_max.load(std::memory_order_relaxed)) m_max.store(v, std::memory_order_relaxed);
+    }
+
+    // Adds the current contents to h. Buckets are read one at a time, so a
+    // snapshot taken mid-Record can be off by that one sample.
+    void AddTo(Histogram& h) const {
+        uint64_t counts[Histogram::BUCKETS];
+        for(int i=0; i<Histogram::BUCKETS; i++) counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        h.Merge(counts, m_sum.load(std::memory_order_relaxed), m_min.load(std::memory_order_relaxed),
+                m_max.load(std::memory_order_relaxed));
+    }
+};
+
+struct alignas(64) ThreadMetrics {
+    std::atomic<uint64_t> counters[(size_t)Counter::COUNT] = {};
+    AtomicHistogram latency[(size_t)Latency::COUNT];
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[(size_t)Counter::COUNT] = {};
+    int64_t gauges[(size_t)Gauge::COUNT] = {};
+    Histogram latency[(size_t)Latency::COUNT];
+    size_t threads = 0;
+};
+
+namespace Metrics {
+
+    struct Registry {
+        std::atomic<bool> enabled{false};
+        std::mutex lock;
+        std::vector<std::unique_ptr<ThreadMetrics>> threads;
+        // Gauges have one logical owner each, so they are process wide
+        alignas(64) std::atomic<int64_t> gauges[(size_t)Gauge::COUNT] = {};
+    };
+
+    inline Registry& Global(){
+        static Registry registry;
+        return registry;
+    }
+
+    inline bool On(){ return Global().enabled.load(std::memory_order_relaxed); }
+    inline void Enable(bool on){ Global().enabled.store(on, std::memory_order_relaxed); }
+
+    // This thread's block, created on the first call
+    inline ThreadMetrics& Local(){
+        thread_local ThreadMetrics* mine = nullptr;
+        if(!mine){
+            Registry& r = Global();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.threads.emplace_back(new ThreadMetrics());
+            mine = r.threads.back().get();
+        }
+        return *mine;
+    }
+
+    inline void Add(Counter c, uint64_t n = 1){
+        if(!On()) return;
+        SingleWriter::Bump(Local().counters[(size_t)c], n);
+    }
+
+    inline void Set(Gauge g, int64_t v){
+        if(!On()) return;
+        Global().gauges[(size_t)g].store(v, std::memory_order_relaxed);
+    }
+
+    inline void Record(Latency l, uint64_t ns){
+        if(!On()) return;
+        Local().latency[(size_t)l].Record(ns);
+    }
+
+    inline uint64_t NowNs(){
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Records the lifetime of the scope, reads no clock while metrics are off
+    class ScopedTimer {
+        Latency m_what;
+        uint64_t m_start;
+    public:
+        explicit ScopedTimer(Latency what) : m_what(what), m_start(On() ? NowNs() : 0) {}
+        ~ScopedTimer(){ if(m_start) Record(m_what, NowNs() - m_start); }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    };
+
+    // Sums every thread's block, safe while other threads keep recording
+    MetricsSnapshot Snapshot();
+
+    // Prometheus text exposition format (version 0.0.4). Counters get a
+    // _total suffix, latencies are summaries in seconds.
+    void WritePrometheus(std::ostream& os, const MetricsSnapshot& snap);
+}
+
+// Background thread publishing snapshots: rewrites a file every interval
+// (atomically, via rename) and/or answers HTTP GETs on 127.0.0.1:port with
+// the Prometheus text. The HTTP endpoint is Linux only.
+class MetricsExporter {
+public:
+    MetricsExporter(std::string path, int port, int interval_ms = 1000);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Enables recording and starts the thread. False if the port can't be bound.
+    bool Start();
+    // Writes the file one last time and joins
+    void Stop();
+
+    int Port() const { return m_port; }
+
+private:
+    void Run();
+    bool WriteFile();
+    void Serve();
+
+    std::string m_path;
+    int m_port;
+    int m_interval_ms;
+    int m_listen = -1;
+    std::atomic<bool> m_running{false};
+    std::unique_ptr<std::thread> m_thread;
+};
@@ -0,0 +1,133 @@
+#pragma once
+// Minimal MQTT 3.1.1 endpoint for local load tests (Linux only).
+// Speaks exactly what MqttForge uses: CONNECT/CONNACK, SUBSCRIBE/SUBACK,
+// PUBLISH at QoS 0/1 with PUBACK, PINGREQ/PINGRESP and DISCONNECT. Every
+// session lives on one epoll loop, so thousands of connections cost one
+// thread. Publishes are forwarded at QoS 0 to matching subscriptions
+// (+ and # wildcards), which is enough to push commands to simulated cars.
+//
+// On top of that it can decode telemetry payloads (single packets and batch
+// frames) and count them per vehicle, and it can delay or drop PUBACKs to
+// exercise client retransmission and window backpressure.
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "event_loop.h"
+
+#if defined(__linux__)
+
+struct BrokerOptions {
+    std::string bind_ip = "127.0.0.1";
+    int port = 1883;             // 0 picks a free port, see Port()
+    bool decode = false;         // Parse payloads as Packets / batch frames
+    int ack_delay_ms = 0;        // Hold every PUBACK this long
+    double ack_drop_rate = 0.0;  // Fraction of PUBACKs never sent (0..1)
+    uint64_t seed = 1;           // For the drop decisions
+};
+
+// Counters are written by the broker thread and safe to read from any other
+struct BrokerStats {
+    std::atomic<uint64_t> connections{0};     // Open right now
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> publishes{0};
+    std::atomic<uint64_t> publishes_qos1{0};
+    std::atomic<uint64_t> duplicates{0};      // PUBLISH with the DUP flag, i.e. retransmits
+    std::atomic<uint64_t> payload_bytes{0};
+    std::atomic<uint64_t> acks_sent{0};
+    std::atomic<uint64_t> acks_dropped{0};
+    std::atomic<uint64_t> forwarded{0};       // Copies sent to subscribers
+    std::atomic<uint64_t> packets{0};         // Decoded telemetry records with a good CRC
+    std::atomic<uint64_t> bad_packets{0};     // Undecodable payloads or records
+    std::atomic<uint64_t> protocol_errors{0}; // Sessions closed for malformed frames
+};
+
+class MiniBroker {
+public:
+    explicit MiniBroker(const BrokerOptions& options = BrokerOptions());
+    ~MiniBroker();
+
+    MiniBroker(const MiniBroker&) = delete;
+    MiniBroker& operator=(const MiniBroker&) = delete;
+
+    // Binds and listens, false with errno set on failure
+    bool Start();
+    int Port() const { return m_port; }
+
+    // One round of I/O and due acks, waits at most timeout_ms
+    void Poll(int timeout_ms);
+
+    // Polls until running turns false
+    void Run(const std::atomic<bool>& running);
+
+    const BrokerStats& Stats() const { return m_stats; }
+
+    // Distinct subscription filters currently held
+    size_t Filters() const { return m_filters.size(); }
+
+    // Decoded telemetry per vehicle id, only filled with options.decode.
+    // Read it once the broker thread has stopped.
+    const std::vector<uint64_t>& PerVehicle() const { return m_per_vehicle; }
+
+    // Totals plus a per-vehicle summary when decoding
+    void Report(std::ostream& os) const;
+
+private:
+    class Session;
+    class Acceptor;
+
+    struct DelayedAck {
+        int64_t due_ms;
+        uint64_t session;
+        uint16_t pid;
+    };
+
+    void Accept();
+    void PauseAccept();
+    void ResumeAccept();
+    std::string_view Intern(std::string_view filter);
+    void Release(std::string_view filter);
+    void OnPublish(Session& s, uint8_t header, const uint8_t* body, size_t len);
+    void OnSubscribe(Session& s, const uint8_t* body, size_t len);
+    void Decode(const uint8_t* payload, size_t len);
+    void Forward(std::string_view topic, const uint8_t* payload, size_t len);
+    void Ack(uint64_t session, uint16_t pid);
+    void FlushDelayedAcks(int64_t now_ms);
+    void Close(Session& s);
+    void Reap();
+    bool DropAck();
+    static int64_t NowMs();
+    static bool TopicMatches(std::string_view filter, std::string_view topic);
+
+    BrokerOptions m_options;
+    BrokerStats m_stats;
+    EventLoop m_loop;
+    int m_listen = -1;
+    int m_port = 0;
+    std::unique_ptr<Acceptor> m_acceptor;
+    int64_t m_accept_paused_until = 0;      // Out of fds: listener off until then (or a close)
+
+    uint64_t m_next_id = 1;
+    std::unordered_map<uint64_t, std::unique_ptr<Session>> m_sessions;
+    std::vector<uint64_t> m_dead;
+
+    // Exact filters are looked up by topic, wildcard ones scanned. Filter
+    // text is interned once and refcounted by subscription: the views below
+    // point into m_filters' keys, which Reap erases once nobody uses them.
+    std::unordered_map<std::string, uint32_t> m_filters;
+    std::unordered_map<std::string_view, std::vector<uint64_t>> m_exact;
+    std::vector<std::pair<std::string_view, uint64_t>> m_wildcard;
+
+    std::deque<DelayedAck> m_delayed;       // Due order, the delay is constant
+    uint64_t m_rng;
+    std::vector<uint64_t> m_per_vehicle;
+    std::vector<uint8_t> m_frame;           // Forwarding scratch
+};
+
+#endif // __linux__
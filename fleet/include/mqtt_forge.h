@@ -1,85 +1,228 @@
 #pragma once
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <functional>
-
-#pragma comment (lib, "Ws2_32.lib")
+#include <algorithm>
+#include "net_socket.h"
+#include "mqtt_protocol.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "event_log.h"
 
 const int KEEP_ALIVE_SEC = 20;
-const uint8_t PACKET_CONNECT = 0x10;
-const uint8_t PACKET_CONNACK = 0x20;
-const uint8_t PACKET_PUBLISH = 0x30;
-const uint8_t PACKET_PUBACK = 0x40;
-const uint8_t PACKET_SUBSCRIBE = 0x82;
-const uint8_t PACKET_SUBACK = 0x90;
-const uint8_t PACKET_PINGREQ = 0xC0;
-const uint8_t PACKET_PINGRESP = 0xD0;
-const uint8_t PACKET_DISCONNECT = 0xE0;
-
-
-class MqttForge {
+const int CONNECT_TIMEOUT_MS = 2000;
+const size_t MAX_TX_BACKLOG = 8 << 20; // Unsent bytes before the link counts as stalled
+const size_t DEFAULT_INFLIGHT_WINDOW = 64; // Unacked QoS 1 messages allowed on the wire
+const size_t MAX_INFLIGHT_WINDOW = 0x8000; // Leaves half the packet ids free for SUBSCRIBE
+const int DEFAULT_RETRANSMIT_MS = 5000;
+const size_t RX_BUFFER = 16 << 10;    // Initial receive buffer, one recv fills as much as fits
+const size_t MAX_RX_FRAME = 4 << 20;  // Bigger inbound packets are treated as a protocol error.
+                                      // Holds a full batch frame, see batch_publisher.h
+
+enum class LinkState : uint8_t {
+    DOWN,          // No socket
+    CONNECTING,    // TCP handshake in flight
+    AWAIT_CONNACK, // CONNECT sent, waiting on the broker
+    UP
+};
+
+// PUBLISH header for one topic/QoS pair, encoded once by MqttForge::Prepare.
+// Layout: [5 bytes room for type + remaining length][topic len][topic][pid].
+// Each publish only patches the packet id and writes the length right-aligned
+// into the room in front, so header + payload go out with one gather write.
+class PreparedPublish {
+    friend class MqttForge;
+    std::vector<uint8_t> m_header;
+    size_t m_var_len = 0; // Topic length field + topic + pid
+    int m_qos = 0;
+
+    static constexpr size_t ROOM = 5;
+
+public:
+    bool Valid() const { return !m_header.empty(); }
+    int Qos() const { return m_qos; }
+};
+
+// Minimal MQTT 3.1.1 client over a non-blocking socket.
+// Standalone it behaves like a blocking client: Connect/Subscribe/Publish wait
+// for their acks. Attached to an EventLoop it never blocks: the loop drives all
+// reads/writes through OnIoEvent and Tick only runs the keep-alive timer.
+class MqttForge : public IoHandler {
     SOCKET sock;
     bool is_connected = false;
+    LinkState m_state = LinkState::DOWN;
     uint16_t packet_id_counter = 1;
     std::chrono::steady_clock::time_point last_sent_time;
+    std::chrono::steady_clock::time_point m_connect_start;
+
+public:
+    // Topic and payload point into the receive buffer, valid only during the call
+    using MsgCallback = std::function<void(std::string_view topic, const uint8_t* payload, size_t len)>;
+    // Packet id of a QoS 1 publish whose PUBACK just released its slot
+    using AckCallback = std::function<void(uint16_t pid)>;
 
-    using MsgCallback = std::function<void(std::string, const uint8_t*, int)>;
+private:
     MsgCallback m_on_msg;
+    AckCallback m_on_ack;
+
+    // Bytes the kernel didn't take yet, flushed when the socket is writable
+    std::vector<uint8_t> m_tx;
+    size_t m_tx_head = 0;
+
+    // Receive buffer, allocated once. [m_rx_head, m_rx_tail) is data not yet
+    // framed into a full MQTT packet; a partial packet is moved to the front
+    // only when the free space behind it runs low.
+    std::vector<uint8_t> m_rx = std::vector<uint8_t>(RX_BUFFER);
+    size_t m_rx_head = 0;
+    size_t m_rx_tail = 0;
+
+    // PUBACKs for inbound QoS 1 publishes, sent together once a read is framed
+    std::vector<uint8_t> m_acks;
+    bool m_in_read = false; // A callback that pumps I/O must not re-enter the parser
+
+    int m_pending_subacks = 0;
+
+    // QoS 1 in-flight window. A message with packet id pid lives in slot
+    // pid % window, so a PUBACK is matched in O(1). The encoded frame is kept
+    // for retransmission (with DUP set) on timeout or after a reconnect.
+    struct InflightSlot {
+        bool used = false;
+        uint16_t pid = 0;
+        uint64_t order = 0; // Publish order, replayed oldest first after reconnect
+        std::chrono::steady_clock::time_point sent_at;
+        std::vector<uint8_t> frame;
+    };
+    std::vector<InflightSlot> m_inflight = std::vector<InflightSlot>(DEFAULT_INFLIGHT_WINDOW);
+    size_t m_inflight_count = 0;
+    uint64_t m_publish_order = 0;
+    std::chrono::milliseconds m_retransmit_timeout{DEFAULT_RETRANSMIT_MS};
+    uint64_t m_retransmits = 0;
+
+#if defined(__linux__)
+    EventLoop* m_loop = nullptr;
+    bool m_want_write = false;
+#endif
 
 public:
     MqttForge() : sock(INVALID_SOCKET){
-        WSADATA wsaData;
-        WSAStartup(MAKEWORD(2,2), &wsaData);
+        net::Startup();
     }
     ~MqttForge() {
         if(is_connected) Disconnect();
-        WSACleanup();
+        else Drop();
+        net::Cleanup();
     }
 
+    MqttForge(const MqttForge&) = delete;
+    MqttForge& operator=(const MqttForge&) = delete;
+
     void SetCallBack(MsgCallback cb){
-        m_on_msg = cb;
+        m_on_msg = std::move(cb);
     }
 
-    bool SendAll(const std::vector<uint8_t> &data){
-        if(sock==INVALID_SOCKET) return false;
-        size_t total_sent = 0;
-        while(total_sent<data.size()){
-            int n = send(sock, (const  char*) data.data() + total_sent, (int)(data.size()-total_sent), 0);
-            if(n<=0) return false;
-            total_sent += n;
-        }
-        last_sent_time = std::chrono::steady_clock::now();
-        return true;
+    void SetAckCallBack(AckCallback cb){
+        m_on_ack = std::move(cb);
     }
 
-    bool RecvExact(uint8_t *buffer, int len){
-        int total_read = 0;
-        while(total_read<len){
-            int n = recv(sock, (char *)buffer+total_read, len-total_read,0);
-            if(n<=0) return false;
-            total_read += n;
+    LinkState State() const { return m_state; }
+    bool IsConnected() const { return is_connected; }
+    size_t TxBacklog() const { return m_tx.size() - m_tx_head; }
+
+    // Max unacked QoS 1 publishes, at most MAX_INFLIGHT_WINDOW. Only takes
+    // effect while nothing is in flight.
+    void SetInflightWindow(size_t window){
+        if(m_inflight_count>0 || window==0) return;
+        m_inflight.assign(std::min(window, MAX_INFLIGHT_WINDOW), InflightSlot{});
+    }
+    void SetRetransmitTimeout(int ms){ m_retransmit_timeout = std::chrono::milliseconds(ms); }
+
+    size_t InFlight() const { return m_inflight_count; }
+    bool WindowFull() const { return m_inflight_count>=m_inflight.size(); }
+    uint64_t Retransmits() const { return m_retransmits; }
+
+    // Hands every unacked QoS 1 message to fn(pid, payload, len), oldest
+    // first, and empties the window. For callers that keep undelivered data
+    // elsewhere (a spool) once they stop retrying.
+    template <typename Fn>
+    size_t TakeInflight(Fn fn){
+        std::vector<InflightSlot*> pending = PendingOldestFirst();
+        for(InflightSlot* slot : pending){
+            const std::vector<uint8_t>& f = slot->frame;
+            size_t i = 1;
+            while(i<f.size() && (f[i] & 0x80)) i++;
+            size_t offset = i + 1 + 2 + (((size_t)f[i+1] << 8) | f[i+2]) + 2;
+            fn(slot->pid, f.data() + offset, f.size() - offset);
+            slot->used = false;
         }
-        return true;
+        m_inflight_count = 0;
+        return pending.size();
     }
 
-    int DecodeLength(){
-        int multiplier = 1;
-        int value = 0;
-        uint8_t encodedByte;
-        while(true){
-            if(!RecvExact(&encodedByte, 1)) return -1;
-            value += (encodedByte & 127) * multiplier;
-            multiplier *= 128;
-            if(multiplier>128*128*128) return -1;
-            if((encodedByte & 128) == 0) break;
-        }
+#if defined(__linux__)
+    // Hands socket I/O over to the loop. Must be called before BeginConnect.
+    void Attach(EventLoop& loop){
+        m_loop = &loop;
+    }
+#endif
 
-        return value;
+    bool Attached() const {
+#if defined(__linux__)
+        return m_loop != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Writes what the socket takes right now and queues the rest.
+    // Only fails on a dead socket or when the backlog is over MAX_TX_BACKLOG.
+    bool SendAll(const std::vector<uint8_t> &data){
+        return SendAll(data.data(), data.size());
+    }
+
+    bool SendAll(const uint8_t* data, size_t len){
+        return SendAll(data, len, nullptr, 0);
+    }
+
+    // Gather version: head and body leave in one writev, only what the kernel
+    // refuses gets copied into the backlog
+    bool SendAll(const uint8_t* head, size_t head_len, const uint8_t* body, size_t body_len){
+        if(sock==INVALID_SOCKET) return false;
+        size_t len = head_len + body_len;
+        size_t total_sent = 0;
+        if(TxBacklog()==0 && m_state!=LinkState::CONNECTING){
+            while(total_sent<len){
+                long n;
+                if(total_sent<head_len && body_len>0){
+                    n = net::SendV(sock, head + total_sent, head_len - total_sent, body, body_len);
+                }
+                else if(total_sent<head_len){
+                    n = net::Send(sock, head + total_sent, head_len - total_sent);
+                }
+                else {
+                    n = net::Send(sock, body + (total_sent-head_len), len - total_sent);
+                }
+                if(n<0 && net::WouldBlock()) break;
+                if(n<=0) return false;
+                total_sent += n;
+            }
+        }
+        if(total_sent<len){
+            if(TxBacklog() + (len-total_sent) > MAX_TX_BACKLOG) return false;
+            Metrics::Add(Counter::TX_QUEUED_BYTES, len-total_sent);
+            if(total_sent<head_len) m_tx.insert(m_tx.end(), head + total_sent, head + head_len);
+            size_t body_from = (total_sent>head_len) ? total_sent-head_len : 0;
+            if(body_len>body_from) m_tx.insert(m_tx.end(), body + body_from, body + body_len);
+            WantWrite(true);
+        }
+        Metrics::Add(Counter::SEND_CALLS);
+        Metrics::Add(Counter::SEND_BYTES, total_sent);
+        last_sent_time = std::chrono::steady_clock::now();
+        return true;
     }
 
     void EncodeLength(std::vector<uint8_t> &buffer, int length){
@@ -98,22 +241,42 @@ public:
         buffer.insert(buffer.end(), str.begin(), str.end());
     }
 
-    bool Connect(std::string ip, int port, std::string client_id){
-        // Socket init and timeout
-        if(sock!=INVALID_SOCKET) closesocket(sock);
+    // Starts the TCP handshake and queues CONNECT behind it, never blocks.
+    // Progress is made by the EventLoop (attached) or by Tick().
+    bool BeginConnect(const std::string& ip, int port, const std::string& client_id){
+        Drop();
 
         sock = socket(AF_INET, SOCK_STREAM, 0);
         if(sock==INVALID_SOCKET) return false;
-
-        DWORD timeout = 2000;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+        net::SetNonBlocking(sock);
+        net::SetNoDelay(sock);
 
         struct sockaddr_in server;
+        std::memset(&server, 0, sizeof(server));
         server.sin_family = AF_INET;
         server.sin_addr.s_addr = inet_addr(ip.c_str());
         server.sin_port = htons(port);
 
-        if (connect(sock, (struct sockaddr*)&server, sizeof(server)) < 0) return false;
+        m_state = LinkState::CONNECTING;
+        m_connect_start = std::chrono::steady_clock::now();
+        if (connect(sock, (struct sockaddr*)&server, sizeof(server)) < 0){
+            if(!net::ConnectPending()){
+                Drop();
+                return false;
+            }
+        } else {
+            m_state = LinkState::AWAIT_CONNACK;
+        }
+
+#if defined(__linux__)
+        if(m_loop){
+            m_want_write = true;
+            if(!m_loop->Add(sock, EPOLLIN | EPOLLOUT, this)){
+                Drop();
+                return false;
+            }
+        }
+#endif
 
         std::vector<uint8_t> var_header = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02};
         var_header.push_back(KEEP_ALIVE_SEC >> 8);
@@ -128,24 +291,33 @@ public:
         packet.insert(packet.end(), var_header.begin(), var_header.end());
         packet.insert(packet.end(), payload.begin(), payload.end());
 
-        if(!SendAll(packet)) return false;
-        uint8_t ack[4];
-        if(!RecvExact(ack, 4)) return false;
-        if(ack[0]==PACKET_CONNACK && ack[3]==0x00) { // 0x00 means connection accepted
-            is_connected = true;
-            return true;
+        // While CONNECTING this only queues, the bytes go out once TCP is up
+        if(!SendAll(packet)){
+            Drop();
+            return false;
         }
-        return false;
+        return true;
     }
 
-    bool Subscribe(std::string topic){
-        if(!is_connected) return false;
+    // Blocking connect: waits up to CONNECT_TIMEOUT_MS for CONNACK
+    bool Connect(const std::string& ip, int port, const std::string& client_id){
+        if(!BeginConnect(ip, port, client_id)) return false;
+        if(Attached()) return true;
+        return WaitFor([this]{ return m_state==LinkState::UP || m_state==LinkState::DOWN; })
+            && is_connected;
+    }
+
+    // qos is the highest QoS the broker may deliver at (0 or 1)
+    bool Subscribe(const std::string& topic, int qos = 1){
+        // Attached sessions may queue the SUBSCRIBE right behind CONNECT
+        if(!is_connected && !(Attached() && m_state!=LinkState::DOWN)) return false;
 
         // Packet ID
-        uint16_t pid = packet_id_counter++;
+        uint16_t pid = NextPacketId();
+        if(pid==0) return false;
         std::vector<uint8_t> payload;
         EncodeString(payload, topic);
-        payload.push_back(0x01); // QoS 1
+        payload.push_back(qos>0 ? 0x01 : 0x00);
 
         // Header
         std::vector<uint8_t> packet;
@@ -158,123 +330,414 @@ public:
         packet.insert(packet.end(), payload.begin(), payload.end());
 
         if(!SendAll(packet)) return false;
+        m_pending_subacks++;
 
-        uint8_t header;
-        if(!RecvExact(&header, 1)) return false;
-        int len = DecodeLength();
-        if(len<0) return false;
+        // Attached: SUBACK gets consumed by the read path whenever it shows up
+        if(Attached()) return true;
+        return WaitFor([this]{ return m_pending_subacks==0 || !is_connected; }) && is_connected;
+    }
 
-        // Read the remaining bytes to clear the buffer
-        std::vector<uint8_t> body(len);
-        if(!RecvExact(body.data(), len)) return false;
+    // QoS 1 is pipelined: the call returns once the PUBLISH is written and the
+    // PUBACK is matched later by the read path. A full window is backpressure:
+    // standalone sessions wait for a free slot, attached ones return false
+    // (check WindowFull() first to tell that apart from a dead link).
+    bool Publish(const std::string& topic, const std::vector<uint8_t> &payload, int qos = 1){
+        PreparedPublish prep = Prepare(topic, qos);
+        return Publish(prep, payload.data(), payload.size());
+    }
 
-        if(header != PACKET_SUBACK){
-            std::cout<<"[MQTT] Error: Expected SUBACK, got: " << (int) header << "\n" ;
-            return false;
+    // Encodes the topic once. Keep the handle around and publish through it.
+    PreparedPublish Prepare(const std::string& topic, int qos = 1) const {
+        PreparedPublish prep;
+        prep.m_qos = (qos>0) ? 1 : 0;
+        uint16_t len = static_cast<uint16_t> (topic.length());
+        prep.m_header.assign(PreparedPublish::ROOM, 0);
+        prep.m_header.push_back(len>>8);
+        prep.m_header.push_back(len&0xFF);
+        prep.m_header.insert(prep.m_header.end(), topic.begin(), topic.end());
+        if(prep.m_qos>0){
+            prep.m_header.push_back(0); // Packet id, patched per publish
+            prep.m_header.push_back(0);
         }
-        return true;
+        prep.m_var_len = prep.m_header.size() - PreparedPublish::ROOM;
+        return prep;
     }
 
-    bool Publish(std::string topic, const std::vector<uint8_t> &payload, int qos = 1){
-        if(!is_connected) return false;
-        std::vector<uint8_t> var_header;
-        EncodeString(var_header, topic);
+    // Steady state this does no allocation and never copies the payload
+    // (QoS 1 keeps one copy in the in-flight slot for retransmission).
+    // tracked_pid gets the packet id once the in-flight window holds the
+    // message, 0 otherwise. A tracked message is replayed after the next
+    // CONNACK even when this returns false, so the caller must not send it
+    // again.
+    bool Publish(PreparedPublish& prep, const uint8_t* payload, size_t len, uint16_t* tracked_pid = nullptr){
+        if(tracked_pid) *tracked_pid = 0;
+        if(!is_connected || !prep.Valid()) { Metrics::Add(Counter::PUBLISH_FAILS); return false; }
+        Metrics::ScopedTimer timer(Latency::PUBLISH);
+        const int qos = prep.m_qos;
+        if(qos>0 && WindowFull()){
+            if(Attached()) { Metrics::Add(Counter::PUBLISH_FAILS); return false; }
+            auto limit = m_retransmit_timeout + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+            if(!WaitFor([this]{ return !WindowFull() || !is_connected; }, limit) || !is_connected) {
+                Drop();
+                Metrics::Add(Counter::PUBLISH_FAILS);
+                return false;
+            }
+        }
+
+        uint8_t* hdr = prep.m_header.data();
         uint16_t pid = 0;
         if(qos>0){
-            pid = packet_id_counter++;
-            if(pid==0) pid=1;
-            var_header.push_back(pid>>8);
-            var_header.push_back(pid&0xFF);
+            pid = NextPacketId(true);
+            if(pid==0) { Metrics::Add(Counter::PUBLISH_FAILS); return false; }
+            hdr[prep.m_header.size()-2] = pid>>8;
+            hdr[prep.m_header.size()-1] = pid&0xFF;
         }
-        std::vector<uint8_t> packet;
-        uint8_t type = PACKET_PUBLISH;
-        if(qos==1) type |= 0x02;
-        packet.push_back(type);
-        EncodeLength(packet, var_header.size()+payload.size());
-        packet.insert(packet.end(), var_header.begin(), var_header.end());
-        packet.insert(packet.end(), payload.begin(), payload.end());
 
-        if (!SendAll(packet)){ 
-            is_connected = false; 
-            return false;
+        // Remaining length, right-aligned against the topic
+        uint8_t enc[4];
+        int enc_len = 0;
+        size_t remaining = prep.m_var_len + len;
+        do {
+            uint8_t b = remaining % 128;
+            remaining /= 128;
+            if(remaining>0) b |= 0x80;
+            enc[enc_len++] = b;
+        } while(remaining>0 && enc_len<4);
+        size_t start = PreparedPublish::ROOM - 1 - enc_len;
+        hdr[start] = PACKET_PUBLISH | (qos==1 ? 0x02 : 0x00);
+        std::memcpy(hdr + start + 1, enc, enc_len);
+        size_t head_len = prep.m_header.size() - start;
+
+        // Tracked before the send so a failure right here still gets replayed
+        if(qos==1){
+            TrackInflight(pid, hdr + start, head_len, payload, len);
+            if(tracked_pid) *tracked_pid = pid;
         }
 
-        if (qos==1){
-            uint8_t ack[4];
-            if(!RecvExact(ack,4)) {
-                is_connected = false;
-                return false;
-            }
-            if(ack[0]==PACKET_PUBACK) {
-                uint16_t ack_pid = (ack[2]<<8) | ack[3]; // ID sent back by the broker.
-                return (ack_pid==pid);
-            }
+        if (!SendAll(hdr + start, head_len, payload, len)){
+            Drop();
+            Metrics::Add(Counter::PUBLISH_FAILS);
             return false;
         }
+        Metrics::Add(Counter::PUBLISHES);
+        Metrics::Add(Counter::PUBLISH_BYTES, len);
         return true;
     }
 
     void Tick() {
-        if(!is_connected) return;
+        if(m_state==LinkState::DOWN) return;
 
-        // 1. Read
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
-        struct timeval tv = {0,0};
-
-        int activity = select(0, &readfds, NULL, NULL, &tv);
-
-        if(activity>0 && FD_ISSET(sock, &readfds)){
-            uint8_t header;
-            if(RecvExact(&header, 1)){
-                int remaining_len = DecodeLength();
-                if(remaining_len < 0) {
-                    Disconnect();
-                    return;
-                }
-                // Emptying the socket for the next message
-                std::vector<uint8_t> buffer;
-                if(remaining_len > 0) {
-                    buffer.resize(remaining_len);
-                    if(!RecvExact(buffer.data(), remaining_len)){
-                        Disconnect();
-                        return;
-                    }
-                }
-                if((header & 0xF0) == PACKET_PUBLISH){
-                    if(remaining_len>0){
-                        uint16_t topic_len = (buffer[0] << 8)  | buffer[1];
-                        if(topic_len + 2 <= remaining_len){
-                            std::string topic((char*)&buffer[2], topic_len);
-                            int offset = 2+topic_len;
-                            if((header & 0x06) > 0) offset += 2;
-                            if(m_on_msg)  m_on_msg(topic, &buffer[offset], remaining_len-offset);
-                        }
-                    }
-                }
-                else if(header == PACKET_PINGRESP){
-                    std::cout << "[MQTT] Subscribed OK.\n";
-                }
-                else if(header == 0xD0){
-                    std::cout << "[MQTT] Heartbeat received \n";
-                }
+        auto now = std::chrono::steady_clock::now();
+        if(m_state!=LinkState::UP){
+            if(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_connect_start).count() > CONNECT_TIMEOUT_MS){
+                Drop();
+            }
+            else if(!Attached()){
+                PumpIo(0);
             }
+            return;
         }
 
-        auto now = std::chrono::steady_clock::now();
+        // Standalone: drain whatever the socket has, without waiting
+        if(!Attached()) PumpIo(0);
+        if(!is_connected) return;
+
+        if(m_inflight_count>0 && !RetransmitExpired(now)) { Drop(); return; }
+
         // Send a Ping if nothing's been sent for 15s
         if(std::chrono::duration_cast<std::chrono::seconds>(now - last_sent_time).count() >= 15){
-            std::vector<uint8_t> ping = {PACKET_PINGREQ, 0x00}; // 0xC0 0x00 fixed ping packet
-            SendAll(ping);
+            const uint8_t ping[2] = {PACKET_PINGREQ, 0x00}; // 0xC0 0x00 fixed ping packet
+            Metrics::Add(Counter::PINGS);
+            if(!SendAll(ping, 2)) Drop();
         }
     }
 
     void Disconnect() {
         if(!is_connected) return;
-        std::vector<uint8_t> disc = {PACKET_DISCONNECT,0x00};
-        SendAll(disc);
-        closesocket(sock);
+        const uint8_t disc[2] = {PACKET_DISCONNECT,0x00};
+        SendAll(disc, 2);
+        if(!Attached()) FlushTx();
+        is_connected = false; // Asked for, not a link drop
+        Drop();
+    }
+
+    // EventLoop callback, the only place attached sessions touch the socket
+    void OnIoEvent(uint32_t events) override {
+#if defined(__linux__)
+        if(events & (EPOLLERR | EPOLLHUP)){
+            // Still read what's left, the broker may have said something first
+            ReadAvailable();
+            Drop();
+            return;
+        }
+        if(events & EPOLLOUT){
+            if(m_state==LinkState::CONNECTING && !FinishConnect()) return;
+            if(!FlushTx()) { Drop(); return; }
+            if(TxBacklog()==0) WantWrite(false);
+        }
+        if(events & EPOLLIN){
+            if(!ReadAvailable()) Drop();
+        }
+#else
+        (void)events;
+#endif
+    }
+
+private:
+    // Closes the socket and forgets all per-connection state
+    void Drop(){
+        if(is_connected) Metrics::Add(Counter::LINK_DROPS);
+        if(sock!=INVALID_SOCKET){
+            net::Close(sock); // Also removes it from the epoll set
+            sock = INVALID_SOCKET;
+        }
         is_connected = false;
+        m_state = LinkState::DOWN;
+        m_tx.clear();
+        m_tx_head = 0;
+        m_rx_head = m_rx_tail = 0;
+        m_acks.clear();
+        m_pending_subacks = 0;
+#if defined(__linux__)
+        m_want_write = false;
+#endif
+    }
+
+    void WantWrite(bool on){
+#if defined(__linux__)
+        if(!m_loop || m_want_write==on || sock==INVALID_SOCKET) return;
+        m_want_write = on;
+        m_loop->Modify(sock, on ? (EPOLLIN | EPOLLOUT) : EPOLLIN, this);
+#else
+        (void)on;
+#endif
+    }
+
+    bool FinishConnect(){
+        if(net::SocketError(sock)!=0){
+            Drop();
+            return false;
+        }
+        m_state = LinkState::AWAIT_CONNACK;
+        return true;
+    }
+
+    bool FlushTx(){
+        while(m_tx_head<m_tx.size()){
+            long n = net::Send(sock, m_tx.data() + m_tx_head, m_tx.size()-m_tx_head);
+            if(n<0 && net::WouldBlock()) return true;
+            if(n<=0) return false;
+            m_tx_head += n;
+        }
+        m_tx.clear();
+        m_tx_head = 0;
+        return true;
+    }
+
+    // One recv for whatever the socket has (up to the free buffer space),
+    // then every complete packet in the buffer is handled in place. The
+    // socket is level-triggered, anything left over shows up on the next poll.
+    bool ReadAvailable(){
+        if(m_in_read) return true;
+        if(m_rx_head==m_rx_tail) m_rx_head = m_rx_tail = 0;
+        else if(m_rx.size() - m_rx_tail < m_rx.size()/4){
+            std::memmove(m_rx.data(), m_rx.data() + m_rx_head, m_rx_tail - m_rx_head);
+            m_rx_tail -= m_rx_head;
+            m_rx_head = 0;
+        }
+        if(m_rx_tail==m_rx.size()){
+            // One packet bigger than the whole buffer
+            if(m_rx.size()>=MAX_RX_FRAME) return false;
+            m_rx.resize(std::min(m_rx.size()*2, MAX_RX_FRAME));
+        }
+        long n = net::Recv(sock, m_rx.data() + m_rx_tail, m_rx.size() - m_rx_tail);
+        if(n<0 && net::WouldBlock()) return true;
+        if(n<=0) return false; // Closed by peer or hard error
+        m_rx_tail += n;
+        m_in_read = true;
+        bool ok = ParseFrames();
+        m_in_read = false;
+        return ok && FlushAcks();
+    }
+
+    bool ParseFrames(){
+        const uint8_t* rx = m_rx.data();
+        size_t pos = m_rx_head;
+        while(pos<m_rx_tail){
+            // Fixed header: type byte + 1..4 byte remaining length
+            size_t i = pos + 1;
+            int multiplier = 1;
+            size_t remaining_len = 0;
+            bool complete = false;
+            while(i<m_rx_tail){
+                uint8_t encodedByte = rx[i++];
+                remaining_len += (encodedByte & 127) * multiplier;
+                multiplier *= 128;
+                if((encodedByte & 128) == 0) { complete = true; break; }
+                if(multiplier>128*128*128) return false; // Malformed
+            }
+            if(!complete) break; // Partial fixed header
+            // Checked before waiting on the body, an oversized packet never gets buffered
+            if(i - pos + remaining_len > MAX_RX_FRAME) return false;
+            if(m_rx_tail-i < remaining_len) break; // Partial packet
+
+            if(!HandlePacket(rx[pos], rx + i, (int)remaining_len)) return false;
+            if(m_state==LinkState::DOWN) return false;
+            pos = i + remaining_len;
+        }
+        m_rx_head = pos;
+        return true;
+    }
+
+    bool FlushAcks(){
+        if(m_acks.empty()) return true;
+        bool ok = SendAll(m_acks.data(), m_acks.size());
+        m_acks.clear();
+        return ok;
+    }
+
+    bool HandlePacket(uint8_t header, const uint8_t* body, int len){
+        switch(header & 0xF0){
+            case PACKET_CONNACK:
+                if(len<2 || body[1]!=0x00) return false; // 0x00 means connection accepted
+                m_state = LinkState::UP;
+                is_connected = true;
+                Metrics::Add(Counter::CONNECTS);
+                return ReplayInflight();
+            case PACKET_SUBACK:
+                if(m_pending_subacks>0) m_pending_subacks--;
+                if(len>=3 && body[2]==0x80){
+                    EventLog::Write(LogEvent::MQTT_SUB_REFUSED, 0);
+                }
+                return true;
+            case PACKET_PUBACK:
+                if(len>=2) AckInflight((body[0]<<8) | body[1]); // ID sent back by the broker.
+                return true;
+            case PACKET_PUBLISH: {
+                if(len<2) return true;
+                uint16_t topic_len = (body[0] << 8)  | body[1];
+                int offset = 2+topic_len;
+                int qos = (header & 0x06) >> 1;
+                if(qos>0) offset += 2;
+                if(offset>len) return true;
+                if(qos==1){
+                    const uint8_t ack[4] = {PACKET_PUBACK, 0x02, body[2+topic_len], body[3+topic_len]};
+                    m_acks.insert(m_acks.end(), ack, ack + 4);
+                }
+                std::string_view topic((const char*)&body[2], topic_len);
+                if(m_on_msg) m_on_msg(topic, body + offset, (size_t)(len-offset));
+                return true;
+            }
+            case PACKET_PINGRESP:
+            default:
+                return true;
+        }
+    }
+
+    // Skips 0 and ids still waiting on their PUBACK. A QoS 1 publish also
+    // needs its slot free, which always exists once WindowFull() is false.
+    // Gives up with 0 after one lap of the id space.
+    uint16_t NextPacketId(bool need_slot = false){
+        for(uint32_t tries=0; tries<=0xFFFF; tries++){
+            uint16_t pid = packet_id_counter++;
+            if(pid==0) continue;
+            const InflightSlot& slot = m_inflight[pid % m_inflight.size()];
+            if(!slot.used) return pid;
+            if(!need_slot && slot.pid!=pid) return pid;
+        }
+        return 0;
+    }
+
+    void TrackInflight(uint16_t pid, const uint8_t* head, size_t head_len, const uint8_t* body, size_t body_len){
+        InflightSlot& slot = m_inflight[pid % m_inflight.size()];
+        slot.used = true;
+        slot.pid = pid;
+        slot.order = m_publish_order++;
+        slot.sent_at = std::chrono::steady_clock::now();
+        // Reuses the slot's capacity, no allocation once warmed up
+        slot.frame.assign(head, head + head_len);
+        slot.frame.insert(slot.frame.end(), body, body + body_len);
+        m_inflight_count++;
+    }
+
+    void AckInflight(uint16_t pid){
+        InflightSlot& slot = m_inflight[pid % m_inflight.size()];
+        if(!slot.used || slot.pid!=pid) return; // Late duplicate ack
+        slot.used = false;
+        m_inflight_count--;
+        Metrics::Add(Counter::PUBACKS);
+        if(Metrics::On()) Metrics::Record(Latency::PUBACK_RTT, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - slot.sent_at).count());
+        if(m_on_ack) m_on_ack(pid);
+    }
+
+    bool Retransmit(InflightSlot& slot, std::chrono::steady_clock::time_point now){
+        slot.frame[0] |= FLAG_DUP;
+        slot.sent_at = now;
+        m_retransmits++;
+        Metrics::Add(Counter::RETRANSMITS);
+        return SendAll(slot.frame);
+    }
+
+    bool RetransmitExpired(std::chrono::steady_clock::time_point now){
+        for(auto& slot : m_inflight){
+            if(slot.used && now - slot.sent_at >= m_retransmit_timeout){
+                if(!Retransmit(slot, now)) return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<InflightSlot*> PendingOldestFirst(){
+        std::vector<InflightSlot*> pending;
+        pending.reserve(m_inflight_count);
+        for(auto& slot : m_inflight) if(slot.used) pending.push_back(&slot);
+        std::sort(pending.begin(), pending.end(), [](const InflightSlot* a, const InflightSlot* b){
+            return a->order < b->order;
+        });
+        return pending;
+    }
+
+    // After CONNACK: everything still unacked goes out again, oldest first
+    bool ReplayInflight(){
+        if(m_inflight_count==0) return true;
+        std::vector<InflightSlot*> pending = PendingOldestFirst();
+        auto now = std::chrono::steady_clock::now();
+        for(auto* slot : pending){
+            if(!Retransmit(*slot, now)) return false;
+        }
+        return true;
+    }
+
+    // Standalone progress: connect completion, flush, read. Waits up to timeout_ms.
+    void PumpIo(int timeout_ms){
+        if(sock==INVALID_SOCKET) return;
+        short want = net::WANT_READ;
+        if(m_state==LinkState::CONNECTING || TxBacklog()>0) want |= net::WANT_WRITE;
+        short ready = net::Wait(sock, want, timeout_ms);
+        if(ready==0) return;
+        if(m_state==LinkState::CONNECTING){
+            if(!(ready & (net::WANT_WRITE | POLLERR | POLLHUP))) return;
+            if(!FinishConnect()) return;
+        }
+        if(TxBacklog()>0 && !FlushTx()) { Drop(); return; }
+        if(ready & (net::WANT_READ | POLLERR | POLLHUP)){
+            if(!ReadAvailable()) Drop();
+        }
+    }
+
+    // Blocking helper for standalone use, pumps I/O until done() or timeout
+    // Keeps retransmitting meanwhile so a lost PUBACK can't wedge a full window.
+    template <typename Pred>
+    bool WaitFor(Pred done, std::chrono::milliseconds timeout = std::chrono::milliseconds(CONNECT_TIMEOUT_MS)){
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while(!done()){
+            auto now = std::chrono::steady_clock::now();
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            if(left<=0 || sock==INVALID_SOCKET) return false;
+            if(is_connected && m_inflight_count>0 && !RetransmitExpired(now)) { Drop(); return false; }
+            PumpIo((int)std::min<long long>(left, 50));
+        }
+        return true;
     }
-};
\ No newline at end of file
+};
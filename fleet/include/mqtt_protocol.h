@@ -0,0 +1,15 @@
+#pragma once
+// MQTT 3.1.1 control packet types (first byte, with the flags SUBSCRIBE
+// requires) shared by the client in mqtt_forge.h and MiniBroker.
+#include <cstdint>
+
+const uint8_t PACKET_CONNECT = 0x10;
+const uint8_t PACKET_CONNACK = 0x20;
+const uint8_t PACKET_PUBLISH = 0x30;
+const uint8_t PACKET_PUBACK = 0x40;
+const uint8_t PACKET_SUBSCRIBE = 0x82;
+const uint8_t PACKET_SUBACK = 0x90;
+const uint8_t PACKET_PINGREQ = 0xC0;
+const uint8_t PACKET_PINGRESP = 0xD0;
+const uint8_t PACKET_DISCONNECT = 0xE0;
+const uint8_t FLAG_DUP = 0x08;
@@ -0,0 +1,160 @@
+#pragma once
+// Thin portability layer over Winsock / BSD sockets.
+// Everything above this header talks in SOCKET, INVALID_SOCKET and net::*.
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_WIN32)
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment (lib, "Ws2_32.lib")
+#else
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+
+    typedef int SOCKET;
+    #ifndef INVALID_SOCKET
+        #define INVALID_SOCKET (-1)
+    #endif
+#endif
+
+namespace net {
+
+// WSAStartup is refcounted by Windows, one call per MqttForge is fine
+inline void Startup(){
+#if defined(_WIN32)
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2,2), &wsaData);
+#endif
+}
+
+inline void Cleanup(){
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+inline void Close(SOCKET s){
+#if defined(_WIN32)
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+inline bool SetNonBlocking(SOCKET s){
+#if defined(_WIN32)
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int fl = fcntl(s, F_GETFL, 0);
+    return fl >= 0 && fcntl(s, F_SETFL, fl | O_NONBLOCK) == 0;
+#endif
+}
+
+// Telemetry is lots of tiny writes, don't let Nagle hold them back
+inline void SetNoDelay(SOCKET s){
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+// True when the last call failed only because it would have blocked
+inline bool WouldBlock(){
+#if defined(_WIN32)
+    int e = WSAGetLastError();
+    return e == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// Non-blocking connect() that has started but not finished yet
+inline bool ConnectPending(){
+#if defined(_WIN32)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS;
+#endif
+}
+
+// Result of a finished non-blocking connect (0 == connected)
+inline int SocketError(SOCKET s){
+    int err = 0;
+#if defined(_WIN32)
+    int len = sizeof(err);
+#else
+    socklen_t len = sizeof(err);
+#endif
+    if(getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&err, &len) != 0) return -1;
+    return err;
+}
+
+// Never raises SIGPIPE on a dead peer, returns <0 on error
+inline long Send(SOCKET s, const uint8_t* data, size_t len){
+#if defined(_WIN32)
+    return send(s, (const char*)data, (int)len, 0);
+#elif defined(MSG_NOSIGNAL)
+    return send(s, data, len, MSG_NOSIGNAL);
+#else
+    return send(s, data, len, 0);
+#endif
+}
+
+// Gather write of two buffers in one syscall (header + payload, no copy)
+inline long SendV(SOCKET s, const uint8_t* a, size_t alen, const uint8_t* b, size_t blen){
+#if defined(_WIN32)
+    WSABUF bufs[2];
+    bufs[0].buf = (char*)a; bufs[0].len = (ULONG)alen;
+    bufs[1].buf = (char*)b; bufs[1].len = (ULONG)blen;
+    DWORD sent = 0;
+    if(WSASend(s, bufs, 2, &sent, 0, NULL, NULL) != 0) return -1;
+    return (long)sent;
+#else
+    iovec iov[2];
+    iov[0].iov_base = const_cast<uint8_t*>(a); iov[0].iov_len = alen;
+    iov[1].iov_base = const_cast<uint8_t*>(b); iov[1].iov_len = blen;
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+#if defined(MSG_NOSIGNAL)
+    return sendmsg(s, &msg, MSG_NOSIGNAL);
+#else
+    return sendmsg(s, &msg, 0);
+#endif
+#endif
+}
+
+inline long Recv(SOCKET s, uint8_t* data, size_t len){
+#if defined(_WIN32)
+    return recv(s, (char*)data, (int)len, 0);
+#else
+    return recv(s, data, len, 0);
+#endif
+}
+
+constexpr short WANT_READ = POLLIN;
+constexpr short WANT_WRITE = POLLOUT;
+
+// Waits up to timeout_ms for the socket, returns the ready events (0 on timeout)
+inline short Wait(SOCKET s, short events, int timeout_ms){
+    pollfd pfd;
+    pfd.fd = s;
+    pfd.events = events;
+    pfd.revents = 0;
+#if defined(_WIN32)
+    int n = WSAPoll(&pfd, 1, timeout_ms);
+#else
+    int n = poll(&pfd, 1, timeout_ms);
+#endif
+    return (n > 0) ? pfd.revents : 0;
+}
+
+} // namespace net
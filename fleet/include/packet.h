@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <vector>
+#include <type_traits>
+#include "packet_schema.h"
 
 // Platform-specific includes for network ordering
 #if defined(_WIN32)
@@ -18,9 +21,27 @@ namespace Flags {
     constexpr uint8_t REMOTE_KILL  = 1 << 5;
 }
 
+// Why Packet::parse rejected a buffer
+enum class PacketError : uint8_t {
+    OK,
+    TOO_SHORT,    // Less than 32 bytes
+    BAD_MAGIC,
+    BAD_VERSION,  // Zero or newer than this decoder
+    BAD_CRC
+};
+
+const char* PacketErrorName(PacketError err);
+
+// Wire layouts this build reads and writes, oldest first (packet_schema.h)
+using PacketProtocol = Schema::Protocol<Schema::V1>;
+
 #pragma pack(push, 1)
 
 struct Packet {
+    static constexpr uint16_t MAGIC = 0xD350;
+    static constexpr uint8_t VERSION = PacketProtocol::LATEST;
+    static constexpr size_t SIZE = Schema::PACKET_SIZE;
+
     // --- Header (16 Bytes) ---
     // Magic header for quick protocol verification
     uint16_t magic;       // 0xD350 (2 bytes)
@@ -52,51 +73,110 @@ struct Packet {
     // "Strict Serialization: All integers bit-shifted to Big Endian"
     void serialize(std::vector<uint8_t>& buffer) const {
         buffer.resize(32);
-        uint8_t* ptr = buffer.data();
+        serialize(buffer.data());
+    }
 
-        // 1. MAGIC (0xD350)
-        ptr[0] = (magic >> 8) & 0xFF;
-        ptr[1] = magic & 0xFF;
+    // Writes exactly 32 bytes to ptr, no allocation. The layout is the one
+    // for this packet's version (the newest if the version is unknown) and
+    // the reserved bytes are always sent as zero.
+    inline void serialize(uint8_t* ptr) const;
 
-        // 2. Vehicle ID
-        ptr[2] = (vehicle_id >> 8) & 0xFF;
-        ptr[3] = vehicle_id & 0xFF;
+    // Inverse of serialize, no checks at all: the layout comes from the
+    // version byte, fields that layout lacks come back zero and the reserved
+    // bytes come back as-is.
+    inline void deserialize(const uint8_t* ptr);
 
-        // 3. Sequence ID (32-bit)
-        for(int i = 0; i < 4; i++) ptr[4 + i] = (sequence_id >> (24 - (i*8))) & 0xFF;
+    // Validating decode: size, magic, version and CRC (src/packet.cpp).
+    // out is only written when the result is OK.
+    static PacketError parse(const uint8_t* ptr, size_t len, Packet& out);
+};
 
-        // 4. Timestamp (64-bit)
-        for(int i = 0; i < 8; i++) ptr[8 + i] = (timestamp >> (56 - (i*8))) & 0xFF;
+#pragma pack(pop)
 
-        // 5. Physics Block (16-bit fields)
-        ptr[16] = (rpm >> 8) & 0xFF;
-        ptr[17] = rpm & 0xFF;
+// Wire Format (32 Bytes per Packet)
+static_assert(sizeof(Packet) == 32, "Packet size must be exactly 32 bytes");
+
+// Which Packet member holds each schema field. RESERVED has no integer
+// member; it reads as zero so serialize keeps zeroing it.
+template <Schema::FieldId F> struct PacketSlot;
+
+#define PACKET_SLOT(ID, MEMBER) \
+    template <> struct PacketSlot<Schema::FieldId::ID> { \
+        using Type = decltype(Packet::MEMBER); \
+        static constexpr size_t MEMBER_OFFSET = offsetof(Packet, MEMBER); \
+        static Type Get(const Packet& p) { return p.MEMBER; } \
+        static void Set(Packet& p, uint64_t v) { p.MEMBER = (Type)v; } \
+    };
+
+PACKET_SLOT(MAGIC, magic)
+PACKET_SLOT(VEHICLE_ID, vehicle_id)
+PACKET_SLOT(SEQUENCE_ID, sequence_id)
+PACKET_SLOT(TIMESTAMP, timestamp)
+PACKET_SLOT(RPM, rpm)
+PACKET_SLOT(SPEED, speed)
+PACKET_SLOT(JERK, jerk)
+PACKET_SLOT(TEMP, temp)
+PACKET_SLOT(BATTERY_LEVEL, battery_level)
+PACKET_SLOT(GEAR, gear)
+PACKET_SLOT(FLAGS, flags)
+PACKET_SLOT(VERSION, version)
+PACKET_SLOT(CPU_LOAD, cpu_load)
+PACKET_SLOT(CRC16, crc16)
+#undef PACKET_SLOT
+
+template <> struct PacketSlot<Schema::FieldId::RESERVED> {
+    using Type = uint16_t;
+    static constexpr size_t MEMBER_OFFSET = offsetof(Packet, reserved);
+    static Type Get(const Packet&) { return 0; }
+    static void Set(Packet& p, uint64_t v) { p.reserved[0] = (uint8_t)(v >> 8); p.reserved[1] = (uint8_t)v; }
+};
 
-        ptr[18] = (speed >> 8) & 0xFF;
-        ptr[19] = speed & 0xFF;
+namespace Schema {
+    // Every field of the layout has the width and signedness of its member
+    template <typename Layout, size_t... I>
+    constexpr bool FitsPacket(std::index_sequence<I...>){
+        return ((Layout::FIELDS[I].width==sizeof(typename PacketSlot<Layout::FIELDS[I].id>::Type) &&
+                 Layout::FIELDS[I].is_signed==std::is_signed<typename PacketSlot<Layout::FIELDS[I].id>::Type>::value) && ...);
+    }
 
-        ptr[20] = (jerk >> 8) & 0xFF;
-        ptr[21] = jerk & 0xFF;
+    // The layout is the in-memory Packet byte for byte (modulo byte order)
+    template <typename Layout, size_t... I>
+    constexpr bool MirrorsPacket(std::index_sequence<I...>){
+        return ((Layout::FIELDS[I].offset==PacketSlot<Layout::FIELDS[I].id>::MEMBER_OFFSET) && ...);
+    }
 
-        // 6. Single Byte Fields (No shifting needed)
-        ptr[22] = temp;
-        ptr[23] = battery_level;
-        ptr[24] = gear;
-        ptr[25] = flags;
-        ptr[26] = version;
-        ptr[27] = cpu_load;
+    template <typename... Layouts>
+    constexpr bool FitsPacket(Protocol<Layouts...>){
+        return (FitsPacket<Layouts>(std::make_index_sequence<FieldCount<Layouts>()>{}) && ...);
+    }
 
-        // 7. CRC16
-        ptr[28] = (crc16 >> 8) & 0xFF;
-        ptr[29] = crc16 & 0xFF;
+    template <typename Layout>
+    inline void SerializeAs(const Packet& p, uint8_t* ptr){
+        ForEachField<Layout>([&](auto i){
+            constexpr Field f = Layout::FIELDS[decltype(i)::value];
+            Store<f.width, f.endian>(ptr + f.offset, (uint64_t)PacketSlot<f.id>::Get(p));
+        });
+    }
 
-        // 8. Reserved (Zero out)
-        ptr[30] = 0;
-        ptr[31] = 0;
+    template <typename Layout>
+    inline void DeserializeAs(Packet& p, const uint8_t* ptr){
+        if constexpr (FieldCount<Layout>() < (size_t)FieldId::COUNT) p = Packet{};
+        ForEachField<Layout>([&](auto i){
+            constexpr Field f = Layout::FIELDS[decltype(i)::value];
+            PacketSlot<f.id>::Set(p, Load<f.width, f.endian>(ptr + f.offset));
+        });
     }
-};
+}
 
-#pragma pack(pop)
+static_assert(Schema::FitsPacket(PacketProtocol{}), "A layout field does not fit its Packet member");
+static_assert(Schema::MirrorsPacket<Schema::V1>(std::make_index_sequence<Schema::FieldCount<Schema::V1>()>{}),
+              "Packet members must sit at their V1 offsets");
 
-// Wire Format (32 Bytes per Packet)
-static_assert(sizeof(Packet) == 32, "Packet size must be exactly 32 bytes");
\ No newline at end of file
+inline void Packet::serialize(uint8_t* ptr) const {
+    PacketProtocol::Dispatch(version, [&](auto layout){ Schema::SerializeAs<decltype(layout)>(*this, ptr); });
+}
+
+inline void Packet::deserialize(const uint8_t* ptr){
+    PacketProtocol::Dispatch(ptr[PacketProtocol::VERSION_OFFSET],
+                             [&](auto layout){ Schema::DeserializeAs<decltype(layout)>(*this, ptr); });
+}
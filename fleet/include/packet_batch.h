@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "packet.h"
+
+// Struct-of-arrays view of many packets, one column per field, host byte order.
+// Columns are sized once by Reserve() and never reallocate while decoding,
+// so ingest/replay/analytics loops can keep raw pointers into them.
+struct PacketBatch {
+    std::vector<uint16_t> vehicle_id;
+    std::vector<uint32_t> sequence_id;
+    std::vector<uint64_t> timestamp;
+    std::vector<uint16_t> rpm;
+    std::vector<uint16_t> speed;
+    std::vector<int16_t>  jerk;
+    std::vector<uint8_t>  temp;
+    std::vector<uint8_t>  battery_level;
+    std::vector<uint8_t>  gear;
+    std::vector<uint8_t>  flags;
+    std::vector<uint8_t>  version;
+    std::vector<uint8_t>  cpu_load;
+    std::vector<uint16_t> crc16;
+
+    size_t count = 0;
+
+    PacketBatch() = default;
+    explicit PacketBatch(size_t capacity) { Reserve(capacity); }
+
+    void Reserve(size_t capacity);
+    size_t Capacity() const { return rpm.size(); }
+    size_t Room() const { return Capacity() - count; }
+    void Clear() { count = 0; }
+
+    // Row i back as a Packet (magic filled in, reserved zeroed)
+    Packet Get(size_t i) const;
+};
+
+// Bulk decode of contiguous 32-byte wire records into a PacketBatch.
+// The SIMD kernels byte-swap and transpose 8 (SSSE3) or 16 (AVX2) records
+// per step; the widest one the CPU supports is picked at runtime.
+namespace PacketDecode {
+
+    enum class Impl : uint8_t { SCALAR, SSSE3, AVX2 };
+
+    bool Supported(Impl impl);
+    Impl Active();
+    const char* Name(Impl impl);
+
+    // Force a specific kernel (benchmarks, tests). Falls back to the best
+    // supported one if the CPU can't run it.
+    void Select(Impl impl);
+
+    // Appends up to out.Room() records without any validation.
+    // Returns the number of records consumed.
+    size_t Decode(const uint8_t* records, size_t count, PacketBatch& out);
+
+    // ok[i] = 1 if record i has the right magic, a known version and a
+    // matching CRC (ok may be null). Returns the number of valid records.
+    size_t Validate(const uint8_t* records, size_t count, uint8_t* ok);
+
+    // Validate + Decode, only the good records are appended.
+    // Consumes up to out.Room() input records and returns how many;
+    // rejected (if given) is incremented by the number of bad ones.
+    size_t DecodeValid(const uint8_t* records, size_t count, PacketBatch& out, uint64_t* rejected = nullptr);
+}
@@ -0,0 +1,172 @@
+#pragma once
+// Bounded lock-free single-producer / single-consumer ring of 32-byte wire
+// records, the hand-off between the simulation thread and the network thread.
+//
+// Slots are four relaxed 64-bit atomics, so the consumer can copy a record
+// while the producer (under DROP_OLDEST) may be recycling it: the copy is only
+// kept if the consumer's compare-exchange on head still succeeds afterwards.
+// Under DROP_NEWEST and BLOCK the producer never touches head and that
+// compare-exchange can't fail.
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "single_writer.h"
+
+enum class RingOverflow : uint8_t {
+    DROP_OLDEST,  // Overwrite the oldest queued record, freshest data wins
+    DROP_NEWEST,  // Refuse the new record
+    BLOCK         // Wait for the consumer (stalls the producer)
+};
+
+class PacketRing {
+public:
+    static constexpr size_t RECORD_SIZE = 32;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> w[RECORD_SIZE / 8];
+    };
+
+    size_t m_capacity;
+    size_t m_mask;
+    RingOverflow m_policy;
+    std::unique_ptr<Slot[]> m_slots;
+
+    // Producer side
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+    uint64_t m_head_cache = 0;
+    std::atomic<uint64_t> m_pushed{0};
+    std::atomic<uint64_t> m_dropped_oldest{0};
+    std::atomic<uint64_t> m_dropped_newest{0};
+    std::atomic<uint64_t> m_blocked{0};     // Pushes that had to wait
+    std::atomic<uint64_t> m_high_water{0};
+
+    // Consumer side
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    std::atomic<uint64_t> m_popped{0};
+
+    std::atomic<bool> m_closed{false};
+
+    void Store(uint64_t index, const uint8_t* record){
+        Slot& s = m_slots[index & m_mask];
+        for(size_t k=0; k<RECORD_SIZE/8; k++){
+            uint64_t v;
+            std::memcpy(&v, record + k*8, 8);
+            s.w[k].store(v, std::memory_order_relaxed);
+        }
+    }
+
+    void Load(uint64_t index, uint8_t* out) const {
+        const Slot& s = m_slots[index & m_mask];
+        for(size_t k=0; k<RECORD_SIZE/8; k++){
+            uint64_t v = s.w[k].load(std::memory_order_relaxed);
+            std::memcpy(out + k*8, &v, 8);
+        }
+    }
+
+public:
+    // capacity is rounded up to a power of two
+    explicit PacketRing(size_t capacity, RingOverflow policy = RingOverflow::DROP_OLDEST)
+        : m_policy(policy) {
+        size_t cap = 2;
+        while(cap<capacity) cap <<= 1;
+        m_capacity = cap;
+        m_mask = cap - 1;
+        m_slots.reset(new Slot[cap]);
+    }
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    // Producer. False if the record was refused (DROP_NEWEST when full,
+    // BLOCK after Close()); DROP_OLDEST always takes it.
+    bool Push(const uint8_t* record){
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_head_cache >= m_capacity){
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if(tail - m_head_cache >= m_capacity && !MakeRoom(tail)) return false;
+        }
+        Store(tail, record);
+        m_tail.store(tail + 1, std::memory_order_release);
+        SingleWriter::Bump(m_pushed);
+        uint64_t used = tail + 1 - m_head_cache;
+        if(used>m_high_water.load(std::memory_order_relaxed)) m_high_water.store(used, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer. Copies up to max records into out, returns how many
+    size_t Pop(uint8_t* out, size_t max){
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        while(true){
+            uint64_t tail = m_tail.load(std::memory_order_acquire);
+            size_t n = (size_t)(tail - head);
+            if(n>max) n = max;
+            if(n==0) return 0;
+            for(size_t i=0; i<n; i++) Load(head + i, out + i*RECORD_SIZE);
+            // Fails only if the producer dropped some of these meanwhile, head is reloaded
+            if(m_head.compare_exchange_strong(head, head + n, std::memory_order_acq_rel, std::memory_order_acquire)){
+                SingleWriter::Bump(m_popped, n);
+                return n;
+            }
+        }
+    }
+
+    // Wakes a producer stuck in BLOCK, later pushes under BLOCK are refused
+    void Close() { m_closed.store(true, std::memory_order_release); }
+
+    size_t Capacity() const { return m_capacity; }
+    RingOverflow Policy() const { return m_policy; }
+
+    // Approximate when read from the other thread
+    size_t Size() const {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        return tail>head ? (size_t)(tail - head) : 0;
+    }
+    bool Empty() const { return Size()==0; }
+
+    uint64_t Pushed() const { return m_pushed.load(std::memory_order_relaxed); }
+    uint64_t Popped() const { return m_popped.load(std::memory_order_relaxed); }
+    uint64_t DroppedOldest() const { return m_dropped_oldest.load(std::memory_order_relaxed); }
+    uint64_t DroppedNewest() const { return m_dropped_newest.load(std::memory_order_relaxed); }
+    uint64_t Blocked() const { return m_blocked.load(std::memory_order_relaxed); }
+    uint64_t HighWater() const { return m_high_water.load(std::memory_order_relaxed); }
+
+private:
+    // Ring is full at tail, frees one slot according to the policy
+    bool MakeRoom(uint64_t tail){
+        switch(m_policy){
+            case RingOverflow::DROP_NEWEST:
+                SingleWriter::Bump(m_dropped_newest);
+                return false;
+
+            case RingOverflow::DROP_OLDEST: {
+                uint64_t head = m_head_cache;
+                while(tail - head >= m_capacity){
+                    if(m_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)){
+                        head++;
+                        SingleWriter::Bump(m_dropped_oldest);
+                    }
+                }
+                m_head_cache = head;
+                return true;
+            }
+
+            case RingOverflow::BLOCK: {
+                SingleWriter::Bump(m_blocked);
+                for(int spin=0; ; spin++){
+                    if(m_closed.load(std::memory_order_acquire)) return false;
+                    m_head_cache = m_head.load(std::memory_order_acquire);
+                    if(tail - m_head_cache < m_capacity) return true;
+                    if(spin<64) std::this_thread::yield();
+                    else std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+        }
+        return false;
+    }
+};
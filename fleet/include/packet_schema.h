@@ -0,0 +1,169 @@
+#pragma once
+// The packet wire layout as data.
+//
+// Each protocol version is a constexpr table of field descriptors (name,
+// offset, width, signedness, byte order). Packet::serialize/deserialize,
+// Packet::parse and the scalar PacketBatch decoder are generated from these
+// tables by templates that unroll into the same shifts and stores the
+// handwritten code used to have, and the table is checked at compile time:
+// no gaps, no overlaps, widths that match Packet's members.
+//
+// Several versions live side by side. A layout says where everything goes
+// for one value of the version byte; Protocol<...> lists the layouts this
+// build understands and dispatches on that byte. The magic, version byte and
+// CRC must sit at the same offsets (big-endian) in every layout, since they
+// are read before the version is known. To add a version, write its table,
+// add it to PacketProtocol in packet.h and give any new field a member in
+// Packet.
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+
+namespace Schema {
+    enum class Endian : uint8_t { BIG, LITTLE };
+
+    // Every field a packet carries in any version
+    enum class FieldId : uint8_t {
+        MAGIC, VEHICLE_ID, SEQUENCE_ID, TIMESTAMP, RPM, SPEED, JERK, TEMP,
+        BATTERY_LEVEL, GEAR, FLAGS, VERSION, CPU_LOAD, CRC16, RESERVED,
+        COUNT
+    };
+
+    struct Field {
+        FieldId id;
+        const char* name;
+        uint8_t offset;
+        uint8_t width;     // Bytes: 1, 2, 4 or 8
+        bool is_signed;
+        Endian endian;
+    };
+
+    constexpr size_t PACKET_SIZE = 32;
+
+    // Protocol version 1, what fleet_sim sends today
+    struct V1 {
+        static constexpr uint8_t VERSION = 1;
+        static constexpr Field FIELDS[] = {
+            {FieldId::MAGIC,         "magic",         0x00, 2, false, Endian::BIG},
+            {FieldId::VEHICLE_ID,    "vehicle_id",    0x02, 2, false, Endian::BIG},
+            {FieldId::SEQUENCE_ID,   "sequence_id",   0x04, 4, false, Endian::BIG},
+            {FieldId::TIMESTAMP,     "timestamp",     0x08, 8, false, Endian::BIG},
+            {FieldId::RPM,           "rpm",           0x10, 2, false, Endian::BIG},
+            {FieldId::SPEED,         "speed",         0x12, 2, false, Endian::BIG},
+            {FieldId::JERK,          "jerk",          0x14, 2, true,  Endian::BIG},
+            {FieldId::TEMP,          "temp",          0x16, 1, false, Endian::BIG},
+            {FieldId::BATTERY_LEVEL, "battery_level", 0x17, 1, false, Endian::BIG},
+            {FieldId::GEAR,          "gear",          0x18, 1, false, Endian::BIG},
+            {FieldId::FLAGS,         "flags",         0x19, 1, false, Endian::BIG},
+            {FieldId::VERSION,       "version",       0x1A, 1, false, Endian::BIG},
+            {FieldId::CPU_LOAD,      "cpu_load",      0x1B, 1, false, Endian::BIG},
+            {FieldId::CRC16,         "crc16",         0x1C, 2, false, Endian::BIG},
+            {FieldId::RESERVED,      "reserved",      0x1E, 2, false, Endian::BIG},
+        };
+    };
+
+    template <typename Layout>
+    constexpr size_t FieldCount() { return sizeof(Layout::FIELDS) / sizeof(Layout::FIELDS[0]); }
+
+    // Index of a field in a layout's table, FieldCount() when it has none
+    template <typename Layout>
+    constexpr size_t Find(FieldId id){
+        for(size_t i=0; i<FieldCount<Layout>(); i++) if(Layout::FIELDS[i].id==id) return i;
+        return FieldCount<Layout>();
+    }
+
+    template <typename Layout>
+    constexpr bool Has(FieldId id) { return Find<Layout>(id)<FieldCount<Layout>(); }
+
+    template <typename Layout>
+    constexpr size_t OffsetOf(FieldId id) { return Layout::FIELDS[Find<Layout>(id)].offset; }
+
+    template <typename Layout>
+    constexpr Endian EndianOf(FieldId id) { return Layout::FIELDS[Find<Layout>(id)].endian; }
+
+    // Every byte of the packet belongs to exactly one field, widths are
+    // 1/2/4/8, no field appears twice
+    template <typename Layout>
+    constexpr bool Valid(){
+        bool used[PACKET_SIZE] = {};
+        bool seen[(size_t)FieldId::COUNT] = {};
+        for(size_t i=0; i<FieldCount<Layout>(); i++){
+            const Field& f = Layout::FIELDS[i];
+            if(f.width!=1 && f.width!=2 && f.width!=4 && f.width!=8) return false;
+            if(f.offset + f.width > PACKET_SIZE || seen[(size_t)f.id]) return false;
+            seen[(size_t)f.id] = true;
+            for(size_t b=f.offset; b<f.offset + f.width; b++){
+                if(used[b]) return false;
+                used[b] = true;
+            }
+        }
+        for(size_t b=0; b<PACKET_SIZE; b++) if(!used[b]) return false;
+        return Has<Layout>(FieldId::MAGIC) && Has<Layout>(FieldId::VERSION) && Has<Layout>(FieldId::CRC16);
+    }
+    static_assert(Valid<V1>(), "V1 layout has a gap, an overlap or a bad width");
+
+    // Width bytes at p in the given order, as the low bits of a uint64_t.
+    // Fixed trip counts: the compiler folds these into a load plus bswap.
+    template <size_t Width, Endian E>
+    inline uint64_t Load(const uint8_t* p){
+        uint64_t v = 0;
+        for(size_t i=0; i<Width; i++) v |= (uint64_t)p[i] << (E==Endian::BIG ? (Width - 1 - i)*8 : i*8);
+        return v;
+    }
+
+    template <size_t Width, Endian E>
+    inline void Store(uint8_t* p, uint64_t v){
+        for(size_t i=0; i<Width; i++) p[i] = (uint8_t)(v >> (E==Endian::BIG ? (Width - 1 - i)*8 : i*8));
+    }
+
+    // Calls fn(std::integral_constant<size_t, I>) for every field of the
+    // layout, so fn can use Layout::FIELDS[I] as a constant expression
+    template <typename Layout, typename Fn, size_t... I>
+    inline void ForEachField(Fn&& fn, std::index_sequence<I...>){
+        (fn(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    template <typename Layout, typename Fn>
+    inline void ForEachField(Fn&& fn){
+        ForEachField<Layout>(fn, std::make_index_sequence<FieldCount<Layout>()>{});
+    }
+
+    // The layouts one build understands, dispatched on the version byte
+    template <typename... Layouts>
+    struct Protocol {
+        static_assert(sizeof...(Layouts)>0, "A protocol needs at least one layout");
+        static_assert((Valid<Layouts>() && ...), "Invalid layout in protocol");
+
+        using Latest = std::tuple_element_t<sizeof...(Layouts) - 1, std::tuple<Layouts...>>;
+        static constexpr size_t COUNT = sizeof...(Layouts);
+        static constexpr uint8_t LATEST = Latest::VERSION;
+        static constexpr size_t MAGIC_OFFSET = OffsetOf<Latest>(FieldId::MAGIC);
+        static constexpr size_t VERSION_OFFSET = OffsetOf<Latest>(FieldId::VERSION);
+        static constexpr size_t CRC_OFFSET = OffsetOf<Latest>(FieldId::CRC16);
+
+        static_assert(((OffsetOf<Layouts>(FieldId::MAGIC)==MAGIC_OFFSET &&
+                        OffsetOf<Layouts>(FieldId::VERSION)==VERSION_OFFSET &&
+                        OffsetOf<Layouts>(FieldId::CRC16)==CRC_OFFSET &&
+                        EndianOf<Layouts>(FieldId::MAGIC)==Endian::BIG &&
+                        EndianOf<Layouts>(FieldId::CRC16)==Endian::BIG) && ...),
+                      "Magic, version and CRC must not move between versions");
+        static_assert(((Layouts::VERSION!=0) && ...), "Version 0 marks a zeroed buffer");
+
+        static constexpr bool Known(uint8_t version) { return ((version==Layouts::VERSION) || ...); }
+
+        // fn(Layout{}) with the layout for this version byte; unknown
+        // versions get the latest one. Returns whether the version was known.
+        template <typename Fn>
+        static bool Dispatch(uint8_t version, Fn&& fn){
+            if constexpr (COUNT==1){
+                fn(Latest{});
+                return Known(version);
+            }
+            bool known = ((version==Layouts::VERSION ? (fn(Layouts{}), true) : false) || ...);
+            if(!known) fn(Latest{});
+            return known;
+        }
+    };
+}
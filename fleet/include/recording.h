@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Recorded fleet traffic: the serialized 32-byte records of a run, exactly as
+// they were sent, so fleet_replay can stream the same bytes again later
+// without simulating anything.
+//
+// An append-only file: a header, then blocks back to back. Each block header
+// carries the time range and a per-vehicle index of its records, so a reader
+// looking for one vehicle or one time window skips whole blocks unread.
+//
+// File header
+// |Offset|Field       |Type  |
+// |0x00  |Magic       |uint32| 0x44524543 "DREC"
+// |0x04  |Version     |uint8 | Recording::VERSION
+// |0x05  |RecordSize  |uint8 | 32
+// |0x06  |Reserved    |uint16|
+// |0x08  |BlockRecords|uint32| Writer's block size
+// |0x0C  |Reserved    |uint32|
+// |0x10  |Created     |uint64| Unix ms
+//
+// Block
+// |Offset|Field       |Type  |
+// |0x00  |Magic       |uint32| 0x44424C4B "DBLK"
+// |0x04  |Records     |uint32| At most Recording::MAX_BLOCK_RECORDS
+// |0x08  |Vehicles    |uint32| Index entries
+// |0x0C  |HeaderCrc   |uint16| CRC16 of header (this field 0) + index
+// |0x0E  |Reserved    |uint16|
+// |0x10  |FirstTime   |uint64| Lowest packet timestamp in the block
+// |0x18  |LastTime    |uint64| Highest
+// |0x20  |Index       |      | Vehicles x (id uint16, records uint16), by id
+// |...   |Records     |      | Records x 32 bytes, in the order sent
+//
+// Big-endian like the packets, a recording travels between machines. Records
+// are not covered by the header CRC, each packet carries its own. A block is
+// written with one call once complete, so a crash loses at most the block
+// being filled; readers stop at a torn or corrupt block and report it.
+namespace Recording {
+    constexpr uint32_t MAGIC = 0x44524543;
+    constexpr uint32_t BLOCK_MAGIC = 0x44424C4B;
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t RECORD_SIZE = 32;
+    constexpr size_t HEADER_SIZE = 24;
+    constexpr size_t BLOCK_HEADER_SIZE = 32;
+    constexpr size_t INDEX_ENTRY_SIZE = 4;
+    constexpr size_t MAX_BLOCK_RECORDS = 0xFFFF;
+    constexpr size_t DEFAULT_BLOCK_RECORDS = 4096;
+}
+
+// One block as read back: header fields, the index and (once loaded) the records
+struct RecordingBlock {
+    uint64_t offset = 0;      // Of the block header in the file
+    uint32_t records = 0;
+    uint64_t first_ts = 0;
+    uint64_t last_ts = 0;
+    std::vector<std::pair<uint16_t, uint16_t>> vehicles;  // (id, records), by id
+    std::vector<uint8_t> data;                            // records * 32 bytes
+
+    // Records of this vehicle in the block, 0 when absent
+    uint16_t CountOf(uint16_t vehicle_id) const;
+};
+
+// Buffers records into blocks and appends each full block with one write.
+class RecordingWriter {
+public:
+    RecordingWriter() = default;
+    ~RecordingWriter();
+
+    RecordingWriter(const RecordingWriter&) = delete;
+    RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+    // Creates (truncates) the file and writes its header
+    bool Open(const std::string& path, size_t block_records = Recording::DEFAULT_BLOCK_RECORDS);
+    // Writes the partial block and closes the file
+    bool Close();
+    bool IsOpen() const { return m_file!=nullptr; }
+
+    // record is 32 bytes of serialized Packet. False once a write failed.
+    bool Append(const uint8_t* record);
+    bool Append(const uint8_t* records, size_t count);
+
+    // Ends the current block early
+    bool Flush();
+
+    uint64_t Records() const { return m_records; }
+    uint64_t Blocks() const { return m_blocks; }
+    uint64_t Bytes() const { return m_bytes; }
+
+private:
+    std::FILE* m_file = nullptr;
+    bool m_failed = false;
+    size_t m_block_records = 0;
+
+    // Block being filled
+    std::vector<uint8_t> m_data;
+    std::vector<uint16_t> m_counts;     // Per vehicle id, 65536 entries
+    std::vector<uint16_t> m_vehicles;   // Ids with a nonzero count
+    uint32_t m_pending = 0;
+    uint64_t m_first_ts = 0, m_last_ts = 0;
+    std::vector<uint8_t> m_header;      // Scratch for header + index
+
+    uint64_t m_records = 0, m_blocks = 0, m_bytes = 0;
+};
+
+// Walks a recording block by block.
+class RecordingReader {
+public:
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    // False with a reason if the file is missing or not a recording
+    bool Open(const std::string& path, std::string& error);
+    void Close();
+
+    // Reads the next block header and index. False at the end of the file or
+    // at a torn/corrupt block (Damaged() tells them apart).
+    bool Next(RecordingBlock& block);
+
+    // Loads the records of the block Next just returned. Skipping that call
+    // skips the records without reading them.
+    bool Load(RecordingBlock& block);
+
+    uint8_t Version() const { return m_version; }
+    uint32_t BlockRecords() const { return m_block_records; }
+    uint64_t Created() const { return m_created; }
+    uint64_t FileSize() const { return m_size; }
+    bool Damaged() const { return m_damaged; }
+
+private:
+    std::FILE* m_file = nullptr;
+    uint64_t m_size = 0;
+    uint64_t m_next = 0;         // Offset of the next block header
+    uint64_t m_records_at = 0;   // Offset of the current block's records
+    uint8_t m_version = 0;
+    uint32_t m_block_records = 0;
+    uint64_t m_created = 0;
+    bool m_damaged = false;
+    std::vector<uint8_t> m_header;
+};
@@ -0,0 +1,119 @@
+#pragma once
+// Data-driven driver behaviour.
+//
+// A scenario is a Markov chain over named driver states, each with a throttle
+// profile, plus fleet-wide events on a schedule. It is loaded from a small
+// text file (format in the README, examples in fleet/scenarios/). Every
+// decision_s virtual seconds every vehicle picks its next state from the
+// row of its current state in the active transition matrix. Events either
+// swap in another matrix for a while ("rush hour") or force every vehicle
+// into one state at once ("panic-stop storm").
+//
+// ScenarioRunner evaluates a whole fleet slice per step. The dice come from
+// CounterRng keyed by (seed, vehicle id, decision), so a vehicle makes the
+// same choices whichever runner, shard or thread evaluates it.
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "event_log.h"
+
+struct ScenarioState {
+    enum class Profile : uint8_t { CONSTANT, WAVE };
+
+    std::string name;
+    Profile profile = Profile::CONSTANT;
+    double level = 0;     // CONSTANT: the throttle. WAVE: peak throttle
+    double freq = 0;      // WAVE: radians per virtual second
+    double phase = 0;     // WAVE: radians per vehicle id
+    bool alert = false;   // Entering it is reported (fleet_sim logs a panic)
+    StatusTag tag = StatusTag::NONE;
+
+    double Throttle(double t, uint16_t id) const {
+        if(profile==Profile::WAVE) return (std::sin(t*freq + id*phase)+1.0) / 2.0 * level;
+        return level;
+    }
+};
+
+struct ScenarioEvent {
+    enum class Kind : uint8_t { FORCE, MATRIX };
+
+    double at = 0;        // Virtual seconds
+    double duration = 0;
+    double every = 0;     // Repeat period, 0 = once
+    Kind kind = Kind::FORCE;
+    uint8_t target = 0;   // State (FORCE) or matrix (MATRIX) index
+
+    bool ActiveAt(double t) const;
+};
+
+class Scenario {
+public:
+    static constexpr size_t MAX_STATES = 16;
+
+    // One row of a transition matrix: the first target whose threshold is
+    // above 32 random bits wins. Unused slots hold 2^32 and never match.
+    struct Row {
+        uint64_t threshold[MAX_STATES];
+        uint8_t target[MAX_STATES];
+    };
+
+    struct Matrix {
+        std::string name;
+        std::vector<Row> rows;    // One per state
+    };
+
+    // What fleet_sim has always done: cruise, sprint, idle, 2% panic stops
+    static const Scenario& Builtin();
+
+    // False with a "line N: ..." message on the first problem
+    bool Parse(const std::string& text, std::string& error);
+    bool Load(const std::string& path, std::string& error);
+
+    int FindState(const std::string& name) const;
+    int FindMatrix(const std::string& name) const;
+
+    double decision_s = 10.0;
+    uint8_t initial = 0;
+    std::vector<ScenarioState> states;
+    std::vector<Matrix> matrices;   // matrices[0] is the base one
+    std::vector<ScenarioEvent> events;
+};
+
+class ScenarioRunner {
+public:
+    ScenarioRunner(const Scenario& scenario, const std::vector<uint16_t>& ids, uint64_t seed);
+
+    // Applies the events and the decision due at virtual time t, then writes
+    // every vehicle's throttle. Returns how many vehicles entered an alert state.
+    size_t Step(double t, double* throttle);
+
+    size_t Size() const { return m_ids.size(); }
+
+    // State the vehicle drives in right now (a forcing event overrides its own)
+    uint8_t State(size_t i) const { return m_force>=0 ? (uint8_t)m_force : m_state[i]; }
+    StatusTag Tag(size_t i) const { return m_scenario.states[State(i)].tag; }
+    bool Alerted(size_t i) const { return m_alerted[i]!=0; }
+
+    // Events that started (true) or ended (false) in the last Step
+    const std::vector<std::pair<size_t, bool>>& EventChanges() const { return m_changes; }
+
+    uint64_t Decisions() const { return m_decisions; }
+    uint64_t Alerts() const { return m_alerts; }
+
+private:
+    void Decide(const Scenario::Matrix& matrix);
+
+    const Scenario& m_scenario;
+    std::vector<uint16_t> m_ids;
+    uint64_t m_seed;
+    std::vector<uint8_t> m_state;
+    std::vector<uint8_t> m_alerted;
+    std::vector<uint8_t> m_event_active;
+    std::vector<std::pair<size_t, bool>> m_changes;
+    double m_next_decision;
+    int m_force = -1;
+    uint64_t m_decisions = 0;
+    uint64_t m_alerts = 0;
+};
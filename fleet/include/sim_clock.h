@@ -0,0 +1,97 @@
+#pragma once
+// Virtual simulation time.
+// Physics, packet timestamps and driver decisions all read this clock instead
+// of the wall clock, so the same seed produces the same packets whether the
+// run is paced in real time, sped up N times or not paced at all.
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <memory>
+#include "tick_scheduler.h"
+
+enum class ClockMode : uint8_t {
+    REALTIME,  // 1 virtual second per wall second
+    SCALED,    // N virtual seconds per wall second
+    AFAP       // As fast as possible, no pacing at all
+};
+
+class SimClock {
+    ClockMode m_mode;
+    double m_scale;
+    double m_dt;
+    uint64_t m_epoch_ms;
+    uint64_t m_ticks = 0;
+    std::chrono::steady_clock::time_point m_wall_start;
+    std::unique_ptr<TickScheduler> m_pacer; // Null in AFAP
+
+public:
+    // Fixed start time for runs that must be reproducible (2024-01-01 UTC)
+    static constexpr uint64_t FIXED_EPOCH_MS = 1704067200000ull;
+
+    // dt is the virtual length of one tick in seconds. epoch_ms is the
+    // virtual time of tick 0, 0 means "wall clock now". policy decides what
+    // happens to ticks the caller was too slow for (see TickScheduler).
+    SimClock(double dt, ClockMode mode = ClockMode::REALTIME, double scale = 1.0, uint64_t epoch_ms = 0,
+             OverrunPolicy policy = OverrunPolicy::CATCH_UP)
+        : m_mode(mode),
+          m_scale(mode==ClockMode::REALTIME || scale<=0 ? 1.0 : scale),
+          m_dt(dt),
+          m_epoch_ms(epoch_ms),
+          m_wall_start(std::chrono::steady_clock::now()) {
+        if(m_epoch_ms==0){
+            m_epoch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()
+            ).count();
+        }
+        if(m_mode!=ClockMode::AFAP) m_pacer.reset(new TickScheduler(m_scale / m_dt, policy));
+    }
+
+    // "1" (real time), "10" / "0.5" (scaled) or "max" (as fast as possible)
+    static bool ParseSpeed(const std::string& text, ClockMode& mode, double& scale){
+        if(text=="max"){
+            mode = ClockMode::AFAP;
+            scale = 0;
+            return true;
+        }
+        try{
+            size_t used = 0;
+            double value = std::stod(text, &used);
+            if(used!=text.size() || !(value>0)) return false;
+            mode = value==1.0 ? ClockMode::REALTIME : ClockMode::SCALED;
+            scale = value;
+            return true;
+        } catch(...){
+            return false;
+        }
+    }
+
+    ClockMode Mode() const { return m_mode; }
+    double Scale() const { return m_mode==ClockMode::AFAP ? 0.0 : m_scale; }
+    double Dt() const { return m_dt; }
+    uint64_t Ticks() const { return m_ticks; }
+
+    // Virtual seconds since tick 0. Derived from the tick count, so it
+    // never accumulates floating point error over a long run.
+    double Seconds() const { return m_ticks * m_dt; }
+
+    // Virtual wall-clock time in ms, what goes into packet timestamps
+    uint64_t NowMs() const { return m_epoch_ms + (uint64_t)std::llround(Seconds() * 1000.0); }
+
+    // Real time spent since the clock was created
+    double WallSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_wall_start).count();
+    }
+
+    // Pacing stats (lateness histogram, overruns), null when not paced
+    const TickScheduler* Pacer() const { return m_pacer.get(); }
+
+    // Blocks until the next tick is due and moves virtual time to it.
+    // Returns the ticks advanced: more than 1 when the pacer skipped some,
+    // the caller should step its physics that many times.
+    uint64_t Tick(){
+        uint64_t n = m_pacer ? m_pacer->Wait() : 1;
+        m_ticks += n;
+        return n;
+    }
+};
@@ -0,0 +1,12 @@
+#pragma once
+// Counters with exactly one writing thread, read from any other. The writer
+// adds with a relaxed load and store instead of fetch_add: no locked
+// instruction on the hot path, and readers still never see a torn value.
+#include <cstdint>
+#include <atomic>
+
+namespace SingleWriter {
+    inline void Bump(std::atomic<uint64_t>& c, uint64_t n = 1){
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Store-and-forward spool: a circular file of 32-byte wire records, mapped
+// into memory, that keeps telemetry produced while the link is down.
+// Records are stored exactly as serialized, so sequence_id, timestamp and
+// CRC survive the round trip untouched.
+//
+// |Offset|Field      |Type  |
+// |0x00  |Magic      |uint32| 0x4453504C "DSPL"
+// |0x04  |Version    |uint8 | Spooler::VERSION
+// |0x05  |RecordSize |uint8 | 32
+// |0x08  |Capacity   |uint64| Record slots in the ring
+// |0x40  |Commit A   |      | seq, head, tail (uint64 each), crc16
+// |0x80  |Commit B   |      | same
+// |0x1000|Records    |32*Capacity
+//
+// head/tail are running record counts (slot = count % Capacity). Every
+// change writes the commit slot the previous one didn't use, with a higher
+// seq and its own CRC, so a torn header write leaves the other slot intact.
+// On open the newest valid slot wins, then records in [head, tail) are
+// checked (magic + packet CRC) and the tail is cut at the first bad one.
+// Native byte order: a spool is only read back by the machine that wrote it.
+namespace Spooler {
+    constexpr uint32_t MAGIC = 0x4453504C;
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t RECORD_SIZE = 32;
+    constexpr size_t HEADER_SIZE = 4096;
+    constexpr size_t DEFAULT_MAX_BYTES = 64u << 20;
+}
+
+class Spool {
+public:
+    Spool() = default;
+    ~Spool();
+
+    Spool(const Spool&) = delete;
+    Spool& operator=(const Spool&) = delete;
+
+    // Creates the file or recovers an existing one. max_bytes caps the whole
+    // file; an existing non-empty spool keeps the capacity it was made with.
+    bool Open(const std::string& path, size_t max_bytes = Spooler::DEFAULT_MAX_BYTES);
+    void Close();
+    bool IsOpen() const { return m_base!=nullptr; }
+
+    // Adds a record, overwriting the oldest one when full
+    void Append(const uint8_t* record);
+
+    // Copies up to max of the oldest records into out without removing them,
+    // starting skip records past the oldest
+    size_t Peek(uint8_t* out, size_t max, size_t skip = 0) const;
+
+    // Drops the n oldest records, after they have been delivered
+    void Consume(size_t n);
+
+    // Pushes dirty pages to disk, wait=true blocks until they are written
+    void Sync(bool wait = false);
+
+    size_t Size() const { return (size_t)(m_tail - m_head); }
+    size_t Capacity() const { return m_capacity; }
+    bool Empty() const { return m_tail==m_head; }
+
+    uint64_t Appended() const { return m_appended; }
+    uint64_t Overwritten() const { return m_overwritten; }  // Lost to the size cap
+    uint64_t Recovered() const { return m_recovered; }      // Found at Open
+    uint64_t Discarded() const { return m_discarded; }      // Cut off at Open as corrupt
+
+private:
+    void Commit();
+    uint8_t* Slot(uint64_t n) const;
+
+    int m_fd = -1;
+    uint8_t* m_base = nullptr;
+    size_t m_map_size = 0;
+    uint64_t m_capacity = 0;
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+    uint64_t m_seq = 0;
+
+    uint64_t m_appended = 0;
+    uint64_t m_overwritten = 0;
+    uint64_t m_recovered = 0;
+    uint64_t m_discarded = 0;
+};
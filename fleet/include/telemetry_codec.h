@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "packet.h"
+
+// Columnar compression for runs of packets from one vehicle.
+//
+// A stream is blocks back to back, each block is a fixed header followed by
+// the columns of up to 65535 packets of the same vehicle:
+//
+// |Offset|Field      |Type  |
+// |0x00  |Magic      |uint16| 0xD352
+// |0x02  |Version    |uint8 | Codec::VERSION
+// |0x03  |Options    |uint8 | Codec::OPT_* bits
+// |0x04  |Count      |uint16| Packets in the block
+// |0x06  |VehicleID  |uint16|
+// |0x08  |FirstSeq   |uint32|
+// |0x0C  |FirstTime  |uint64| Timestamp of the first packet
+// |0x14  |LastTime   |uint64| Timestamp of the last packet
+// |0x1C  |PayloadLen |uint32| Column bytes that follow
+//
+// Big-endian like the packets. Columns, in order:
+//   sequence_id, timestamp         - delta-of-delta, zig-zag
+//   rpm, speed, jerk, temp,
+//   battery_level, cpu_load        - delta, zig-zag
+//   gear, flags, version, magic,
+//   reserved[0], reserved[1]       - run-length (value, run) varint pairs
+//   crc16                          - raw, only if OPT_CRC_RECOMPUTE is clear
+// Each zig-zag column starts with a tag byte and is stored in whichever form
+// is smaller for the block:
+//   varint - one varint per value, a zero is followed by the zero run length,
+//            so constant fields (steady seq stride, parked car) cost ~nothing
+//   packed - groups of 32 values bit-packed at the group's widest value,
+//            for noisy fields (rpm noise, cpu load) that never hit zero
+namespace Codec {
+    constexpr uint16_t MAGIC = 0xD352;
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = 32;
+    constexpr size_t MAX_BLOCK_RECORDS = 0xFFFF;
+    constexpr size_t DEFAULT_BLOCK_RECORDS = 1024;
+
+    // Every packet in the block carried a valid CRC, so the decoder
+    // recomputes it instead of storing the column
+    constexpr uint8_t OPT_CRC_RECOMPUTE = 1 << 0;
+}
+
+enum class CodecError : uint8_t {
+    OK,
+    TOO_SHORT,    // Header or payload cut off
+    BAD_MAGIC,
+    BAD_VERSION,
+    CORRUPT       // Columns don't add up to Count packets
+};
+
+// Decoded block header plus where the block sits in its stream
+struct CodecBlockInfo {
+    uint64_t offset = 0;      // Of the header, from the start of the stream
+    uint32_t size = 0;        // Header + payload
+    uint16_t count = 0;
+    uint16_t vehicle_id = 0;
+    uint32_t first_seq = 0;
+    uint64_t first_ts = 0;
+    uint64_t last_ts = 0;
+    uint8_t options = 0;
+};
+
+// Buffers packets and cuts them into blocks. A block is closed when it is
+// full, when a packet from another vehicle arrives, or on Flush().
+class TelemetryEncoder {
+    size_t m_block_records;
+    std::vector<Packet> m_pending;
+    std::vector<uint8_t> m_out;
+    std::vector<CodecBlockInfo> m_index;
+
+    std::vector<uint64_t> m_values; // Column scratch
+    std::vector<uint8_t> m_wire;    // CRC check scratch
+
+public:
+    explicit TelemetryEncoder(size_t block_records = Codec::DEFAULT_BLOCK_RECORDS);
+
+    void Add(const Packet& packet);
+    void Add(const Packet* packets, size_t count);
+    void Flush();
+
+    // Encodes packets (all the same vehicle, 1..MAX_BLOCK_RECORDS) as one
+    // block appended to out. Used by Flush, exposed for batched uplinks.
+    CodecBlockInfo EncodeBlock(const Packet* packets, size_t count, std::vector<uint8_t>& out);
+
+    // Encoded stream and its index so far (closed blocks only)
+    const std::vector<uint8_t>& Data() const { return m_out; }
+    const std::vector<CodecBlockInfo>& Index() const { return m_index; }
+    size_t Pending() const { return m_pending.size(); }
+
+    void Clear();
+};
+
+class TelemetryDecoder {
+    std::vector<uint64_t> m_values;
+    std::vector<uint8_t> m_wire;
+
+public:
+    static CodecError ReadHeader(const uint8_t* data, size_t len, CodecBlockInfo& out);
+
+    // Decodes one block from the start of data, appending to out.
+    // consumed (if given) is set to the block size on success.
+    CodecError DecodeBlock(const uint8_t* data, size_t len, std::vector<Packet>& out, size_t* consumed = nullptr);
+
+    // Whole stream, block after block
+    CodecError DecodeStream(const uint8_t* data, size_t len, std::vector<Packet>& out);
+};
+
+// Random access into an encoded stream: built from the block headers alone,
+// then (vehicle, timestamp) -> block with a binary search.
+class BlockIndex {
+    std::vector<CodecBlockInfo> m_blocks;
+    std::vector<uint32_t> m_order; // m_blocks sorted by (vehicle_id, first_ts)
+
+    void Sort();
+
+public:
+    // Walks the headers, payloads are skipped
+    CodecError Build(const uint8_t* data, size_t len);
+    void Assign(const std::vector<CodecBlockInfo>& blocks);
+
+    size_t Size() const { return m_blocks.size(); }
+    const CodecBlockInfo& Block(size_t i) const { return m_blocks[i]; }
+
+    // First block of vehicle_id whose last timestamp is >= timestamp,
+    // i.e. the block holding timestamp or the next one after it.
+    // Returns nullptr if the vehicle has nothing at or after that time.
+    const CodecBlockInfo* Find(uint16_t vehicle_id, uint64_t timestamp) const;
+};
@@ -0,0 +1,90 @@
+#pragma once
+// Runs one task per shard on a pool of worker threads, once per tick.
+// Shards are dealt out to workers in contiguous ranges; a worker that runs
+// out of its own shards steals the rest of someone else's range, so one slow
+// shard (a heavy driver state, a backed-up socket) only delays the worker
+// that holds it. Run() returns once every shard is done: the tick barrier.
+//
+// Worker 0 is the thread that calls Run(), the others are spawned here and
+// optionally pinned one per core. The caller is pinned by its first Run():
+// threads it starts before that keep the full CPU mask, threads it starts
+// after inherit CPU 0.
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+
+class TickExecutor {
+public:
+    // shard index, index of the worker running it
+    using Task = std::function<void(size_t shard, size_t worker)>;
+
+    // workers 0 = one per hardware thread. Shards are never fewer than workers.
+    TickExecutor(size_t workers, size_t shards, bool pin = true);
+    ~TickExecutor();
+
+    TickExecutor(const TickExecutor&) = delete;
+    TickExecutor& operator=(const TickExecutor&) = delete;
+
+    // Runs task for every shard and waits for all of them
+    void Run(const Task& task);
+
+    size_t Workers() const { return m_workers.size(); }
+    size_t Shards() const { return m_shards.size(); }
+    uint64_t Ticks() const { return m_ticks; }
+
+    // Stats, only stable between Run() calls
+    const Histogram& ShardTime(size_t shard) const { return m_shards[shard].time; }  // ns
+    uint64_t ShardLastNs(size_t shard) const { return m_shards[shard].last_ns; }
+    size_t ShardLastWorker(size_t shard) const { return m_shards[shard].last_worker; }
+    uint64_t Executed(size_t worker) const { return m_workers[worker]->executed; }
+    uint64_t Stolen(size_t worker) const { return m_workers[worker]->stolen; }
+    const Histogram& TickTime() const { return m_tick_time; }  // ns, whole barrier
+
+    // Per-worker and per-shard tick times, microseconds
+    void Report(std::ostream& os) const;
+
+private:
+    // One worker's range of shards. next is claimed with fetch_add by the
+    // owner and by thieves alike, so every shard runs exactly once per tick.
+    struct alignas(64) Worker {
+        std::atomic<uint32_t> next{0};
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        std::thread thread;
+    };
+
+    struct Shard {
+        Histogram time;
+        uint64_t last_ns = 0;
+        size_t last_worker = 0;
+    };
+
+    void WorkerMain(size_t w);
+    void Drain(size_t w);
+    void RunShard(size_t w, uint32_t shard);
+    static void Pin(size_t cpu);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<Shard> m_shards;
+    Histogram m_tick_time;
+    uint64_t m_ticks = 0;
+    bool m_pin;
+
+    const Task* m_task = nullptr;
+    std::atomic<uint64_t> m_generation{0};  // Bumped to start a tick
+    std::atomic<size_t> m_busy{0};          // Spawned workers still in the tick
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+};
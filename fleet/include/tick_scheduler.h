@@ -0,0 +1,133 @@
+#pragma once
+// Fixed-rate tick pacing on absolute deadlines.
+// Deadline n is start + n*period computed in integer nanoseconds, so the
+// work done between ticks never shifts the schedule. On Linux the wait is a
+// clock_nanosleep(TIMER_ABSTIME) on CLOCK_MONOTONIC; elsewhere sleep_until.
+// Every wake-up records how late it was against its deadline.
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <ostream>
+#include <iomanip>
+#include "histogram.h"
+
+#if defined(__linux__)
+    #include <time.h>
+    #include <cerrno>
+#endif
+
+enum class OverrunPolicy : uint8_t {
+    CATCH_UP,  // Run missed ticks back to back until on schedule again
+    SKIP       // Drop missed ticks, resume on the next future deadline
+};
+
+// Where TickScheduler reads the time and sleeps. Tests swap in a clock
+// they move by hand.
+struct MonotonicClock {
+    static int64_t NowNs(){
+#if defined(__linux__)
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void SleepUntilNs(int64_t deadline){
+#if defined(__linux__)
+        timespec ts;
+        ts.tv_sec = deadline / 1000000000ll;
+        ts.tv_nsec = deadline % 1000000000ll;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr)==EINTR) {}
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(deadline))));
+#endif
+    }
+};
+
+template <typename Clock>
+class BasicTickScheduler {
+    int64_t m_period_ns;
+    OverrunPolicy m_policy;
+    int64_t m_max_backlog;   // CATCH_UP: ticks owed beyond this are dropped
+    int64_t m_start_ns = 0;
+    int64_t m_next = 1;      // Index of the next deadline
+
+    uint64_t m_ticks = 0;
+    uint64_t m_overruns = 0; // Wake-ups that found a later deadline already due
+    uint64_t m_skipped = 0;
+    Histogram m_lateness;    // ns
+
+    int64_t DeadlineNs(int64_t n) const { return m_start_ns + n * m_period_ns; }
+
+    // Book-keeping once deadline m_next has passed, returns periods consumed
+    uint64_t Claim(int64_t now){
+        m_lateness.Record((uint64_t)(now - DeadlineNs(m_next)));
+        uint64_t periods = 1;
+        int64_t behind = (now - DeadlineNs(m_next)) / m_period_ns; // Further deadlines already due
+        if(behind>0) m_overruns++;
+        if(m_policy==OverrunPolicy::SKIP && behind>0){
+            periods += behind;
+            m_skipped += behind;
+        }
+        else if(m_policy==OverrunPolicy::CATCH_UP && behind>m_max_backlog){
+            int64_t drop = behind - m_max_backlog;
+            periods += drop;
+            m_skipped += drop;
+        }
+        m_next += periods;
+        m_ticks++;
+        return periods;
+    }
+
+public:
+    // max_backlog caps how far CATCH_UP may fall behind (default: 1 s of ticks)
+    explicit BasicTickScheduler(double rate_hz, OverrunPolicy policy = OverrunPolicy::CATCH_UP, int64_t max_backlog = -1)
+        : m_period_ns((int64_t)(1e9 / (rate_hz>0 ? rate_hz : 1.0))),
+          m_policy(policy),
+          m_max_backlog(max_backlog>=0 ? max_backlog : (int64_t)(rate_hz>1 ? rate_hz : 1)) {
+        if(m_period_ns<1) m_period_ns = 1;
+        Start();
+    }
+
+    // Deadline 0 is now, the first Wait() returns one period from here
+    void Start(){
+        m_start_ns = Clock::NowNs();
+        m_next = 1;
+    }
+
+    // Blocks until the next deadline. Returns how many periods it covers:
+    // 1 on schedule, more when SKIP (or a CATCH_UP backlog cap) dropped ticks.
+    uint64_t Wait(){
+        int64_t deadline = DeadlineNs(m_next);
+        if(Clock::NowNs()<deadline) Clock::SleepUntilNs(deadline);
+        return Claim(Clock::NowNs());
+    }
+
+    int64_t PeriodNs() const { return m_period_ns; }
+    OverrunPolicy Policy() const { return m_policy; }
+    uint64_t Ticks() const { return m_ticks; }
+    uint64_t Overruns() const { return m_overruns; }
+    uint64_t Skipped() const { return m_skipped; }
+    const Histogram& Lateness() const { return m_lateness; }
+
+    // One line summary, lateness in microseconds. Leaves the stream's
+    // formatting as it found it.
+    void Report(std::ostream& os) const {
+        std::ios_base::fmtflags flags = os.flags();
+        std::streamsize precision = os.precision();
+        os << std::fixed << std::setprecision(1)
+           << "Tick lateness (us): p50 " << m_lateness.Percentile(0.50) / 1e3
+           << " | p99 " << m_lateness.Percentile(0.99) / 1e3
+           << " | p99.9 " << m_lateness.Percentile(0.999) / 1e3
+           << " | max " << m_lateness.Max() / 1e3
+           << " | ticks " << m_ticks << ", overruns " << m_overruns << ", skipped " << m_skipped << "\n";
+        os.flags(flags);
+        os.precision(precision);
+    }
+};
+
+using TickScheduler = BasicTickScheduler<MonotonicClock>;
@@ -1,7 +1,7 @@
 #pragma once
 #include <cstdint>
-#include <random>
 #include "packet.h"
+#include "fixed_point.h"
 
 enum VehicleCommand : uint8_t {
     CMD_KILL = 0x01,
@@ -9,9 +9,21 @@ enum VehicleCommand : uint8_t {
     CMD_NORMAL = 0x03
 };
 
-class Vehicle{
+// Sensor noise and ECU load, drawn from CounterRng (see counter_rng.h)
+namespace VehicleNoise {
+    constexpr double RPM_SIGMA = 2.5;
+    constexpr uint32_t CPU_LOAD_BASE = 10;
+    constexpr uint32_t CPU_LOAD_SPAN = 30;
+}
+
+// Physics state and arithmetic run in Real: double (the reference model),
+// float or Fixed16. The interface stays in double either way, conversions
+// happen at the edges. Instantiated for those three in vehicle.cpp.
+template <typename Real>
+class BasicVehicle{
 public:
-    Vehicle(uint16_t id);
+    // Noise is a function of (seed, id, tick), the same seed gives the same packets
+    BasicVehicle(uint16_t id, uint64_t seed = 0);
 
     // Updates physics state by dt seconds
     void Tick(double dt_seconds);
@@ -23,7 +35,7 @@ public:
     void CalculateRPM();
 
     // Calculate torque factor based on where we are in the power band
-    double GetTorqueCurve(double rpm);
+    Real GetTorqueCurve(Real rpm);
 
     // Set the throttle (multiplier for max_force)
     void SetThrottle(double throttle);
@@ -31,25 +43,39 @@ public:
     // Called whenever a network packet arrives
     void OnCommand(uint8_t opcode);
 
+    // Read-only views for tests
+    double Speed() const { return static_cast<double>(m_speed); }
+    double Rpm() const { return static_cast<double>(m_rpm); }
+    double Temp() const { return static_cast<double>(m_temp); }
+    double Battery() const { return static_cast<double>(m_battery_level); }
+    int Gear() const { return m_gear; }
 
 private:
     uint16_t m_id;
 
     // Physics State
-    double m_speed; // km/h
-    double m_rpm; // 0-15000
-    double m_temp; // Celsius
-    double m_acceleration; // m/s^2
-    double m_prev_accel;
+    Real m_speed; // km/h
+    Real m_rpm; // 0-15000
+    Real m_temp; // Celsius
+    Real m_acceleration; // m/s^2
+    Real m_prev_accel;
 
     int m_gear;
-    double m_target_speed;
-    double m_throttle;
-    double m_battery_level;
+    Real m_target_speed;
+    Real m_throttle;
+    Real m_battery_level;
     bool m_remote_kill;
     bool m_limp_mode;
 
-    // Random noise generator for added realism
-    std::mt19937 m_rng;
-    std::normal_distribution<double> m_noise;
-};
\ No newline at end of file
+    // Keys the noise draws, no generator state to carry
+    uint64_t m_seed;
+    uint64_t m_ticks;
+};
+
+extern template class BasicVehicle<double>;
+extern template class BasicVehicle<float>;
+extern template class BasicVehicle<Fixed16>;
+
+using Vehicle = BasicVehicle<double>;
+using VehicleF32 = BasicVehicle<float>;
+using VehicleQ16 = BasicVehicle<Fixed16>;
@@ -0,0 +1,262 @@
+#include "../include/crc16.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define CRC16_HAVE_CLMUL 1
+#endif
+
+namespace {
+
+// --- Slice-by-8 tables, built at compile time ---
+// T[0][b] is the CRC of the single byte b, T[k][b] the contribution of b
+// followed by k zero bytes.
+struct SliceTables {
+    uint16_t t[8][256];
+
+    constexpr SliceTables() : t{} {
+        for(int b=0; b<256; b++){
+            uint16_t crc = (uint16_t)(b << 8);
+            for(int j=0; j<8; j++){
+                crc = (crc & 0x8000) ? (uint16_t)((crc<<1) ^ Crc16::POLY) : (uint16_t)(crc<<1);
+            }
+            t[0][b] = crc;
+        }
+        for(int k=1; k<8; k++){
+            for(int b=0; b<256; b++){
+                uint16_t prev = t[k-1][b];
+                t[k][b] = (uint16_t)((prev << 8) ^ t[0][prev >> 8]);
+            }
+        }
+    }
+};
+
+constexpr SliceTables kTables;
+
+inline uint16_t ByteStep(uint16_t crc, uint8_t byte){
+    return (uint16_t)((crc << 8) ^ kTables.t[0][(crc >> 8) ^ byte]);
+}
+
+inline uint64_t LoadBE64(const uint8_t* p){
+    uint64_t v = 0;
+    for(int i=0; i<8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+// --- GF(2) constants for the carry-less path ---
+// Polynomials are plain integers, bit n = coefficient of x^n.
+constexpr uint64_t FULL_POLY = 0x10000 | Crc16::POLY; // x^16 + x^12 + x^5 + 1
+
+// x^n mod P
+constexpr uint64_t XPowMod(int n){
+    uint64_t r = 1;
+    for(int i=0; i<n; i++){
+        r <<= 1;
+        if(r & 0x10000) r ^= FULL_POLY;
+    }
+    return r;
+}
+
+// floor(x^48 / P), degree 32
+constexpr uint64_t BarrettMu(){
+    // Long division of x^48 by P, bit by bit from the top
+    uint64_t rem = 0;
+    uint64_t quo = 0;
+    for(int i=48; i>=0; i--){
+        rem = (rem << 1) | (i==48 ? 1 : 0);
+        quo <<= 1;
+        if(rem & 0x10000){
+            rem ^= FULL_POLY;
+            quo |= 1;
+        }
+    }
+    return quo;
+}
+
+constexpr uint64_t K48 = XPowMod(48);
+constexpr uint64_t MU = BarrettMu();
+static_assert(MU >> 32 == 1, "Barrett constant must have degree 32");
+
+// Fixed 28-byte record: word j (big-endian 32 bits, j=0 first) sits at
+// x^(32*(6-j)) in the message, so it contributes w_j * x^(32*(6-j)+16) mod P.
+constexpr uint64_t K_REC[7] = {
+    XPowMod(32*6+16), XPowMod(32*5+16), XPowMod(32*4+16), XPowMod(32*3+16),
+    XPowMod(32*2+16), XPowMod(32*1+16), XPowMod(16)
+};
+static_assert(Crc16::COVERED == 28, "K_REC assumes 7 words per record");
+
+#if defined(CRC16_HAVE_CLMUL)
+__attribute__((target("pclmul,sse4.1")))
+inline uint64_t ClMul(uint64_t a, uint64_t b){
+    __m128i r = _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)a), _mm_cvtsi64_si128((long long)b), 0x00);
+    return (uint64_t)_mm_cvtsi128_si64(r); // Inputs are small enough that the high half is zero
+}
+
+// One 8-byte step: r' = (r * x^64 + D * x^16) mod P = (V * x^16) mod P, V = r*x^48 ^ D.
+// V*x^16 = hi*x^48 + lo*x^16, the hi part is folded with x^48 mod P and the
+// remaining < 48-bit value is reduced with Barrett.
+__attribute__((target("pclmul,sse4.1")))
+inline uint16_t ClmulStep(uint16_t crc, uint64_t chunk){
+    uint64_t v = chunk ^ ((uint64_t)crc << 48);
+    uint64_t w = ClMul(v >> 32, K48) ^ ((v & 0xFFFFFFFFull) << 16);
+    uint64_t q = ClMul(w >> 16, MU) >> 32;
+    return (uint16_t)((w ^ ClMul(q, FULL_POLY)) & 0xFFFF);
+}
+
+inline uint32_t LoadBE32(const uint8_t* p){
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Whole-record version of ClmulStep: the seven word products are independent,
+// so they all issue back to back instead of forming a 3-step dependency chain.
+// The init value is XORed into the first 16 message bits, which is what the
+// direct MSB-first algorithm does implicitly.
+__attribute__((target("pclmul,sse4.1")))
+inline uint16_t ClmulRecord(const uint8_t* r){
+    uint64_t w = ClMul(LoadBE32(r) ^ ((uint32_t)Crc16::INIT << 16), K_REC[0]);
+    for(int j=1; j<6; j++) w ^= ClMul(LoadBE32(r + 4*j), K_REC[j]);
+    w ^= (uint64_t)LoadBE32(r + 24) << 16; // x^16 mod P is x^16 itself
+    uint64_t q = ClMul(w >> 16, MU) >> 32;
+    return (uint16_t)((w ^ ClMul(q, FULL_POLY)) & 0xFFFF);
+}
+
+__attribute__((target("pclmul,sse4.1")))
+uint16_t ClmulImpl(const uint8_t* data, size_t length, uint16_t crc){
+    if(length==Crc16::COVERED && crc==Crc16::INIT) return ClmulRecord(data);
+
+    size_t i = 0;
+    for(; i+8<=length; i+=8) crc = ClmulStep(crc, LoadBE64(data + i));
+    for(; i<length; i++) crc = ByteStep(crc, data[i]);
+    return crc;
+}
+
+__attribute__((target("pclmul,sse4.1")))
+uint16_t ClmulRecordAt(const uint8_t* records, size_t i){
+    return ClmulRecord(records + i*Crc16::RECORD_SIZE);
+}
+#endif
+
+std::atomic<int> g_active(-1);
+
+Crc16::Impl Detect(){
+    return Crc16::ClmulSupported() ? Crc16::Impl::CLMUL : Crc16::Impl::SLICE8;
+}
+
+} // namespace
+
+namespace Crc16 {
+
+uint16_t Bitwise(const uint8_t* data, size_t length, uint16_t crc){
+    for(size_t i=0; i<length; i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for(int j=0; j<8; j++){
+            if(crc & 0x8000) crc = (crc<<1) ^ POLY;
+            else crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+uint16_t Slice8(const uint8_t* data, size_t length, uint16_t crc){
+    const auto& t = kTables.t;
+    size_t i = 0;
+    for(; i+8<=length; i+=8){
+        const uint8_t* p = data + i;
+        crc = t[7][p[0] ^ (crc >> 8)] ^ t[6][p[1] ^ (crc & 0xFF)] ^
+              t[5][p[2]] ^ t[4][p[3]] ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for(; i<length; i++) crc = ByteStep(crc, data[i]);
+    return crc;
+}
+
+bool ClmulSupported(){
+#if defined(CRC16_HAVE_CLMUL)
+    static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+uint16_t Clmul(const uint8_t* data, size_t length, uint16_t crc){
+#if defined(CRC16_HAVE_CLMUL)
+    if(ClmulSupported()) return ClmulImpl(data, length, crc);
+#endif
+    return Slice8(data, length, crc);
+}
+
+Impl Active(){
+    int a = g_active.load(std::memory_order_relaxed);
+    if(a<0){
+        a = (int)Detect();
+        g_active.store(a, std::memory_order_relaxed);
+    }
+    return (Impl)a;
+}
+
+const char* Name(Impl impl){
+    switch(impl){
+        case Impl::BITWISE: return "bitwise";
+        case Impl::SLICE8: return "slice8";
+        case Impl::CLMUL: return "clmul";
+    }
+    return "?";
+}
+
+void Select(Impl impl){
+    if(impl==Impl::CLMUL && !ClmulSupported()) impl = Impl::SLICE8;
+    g_active.store((int)impl, std::memory_order_relaxed);
+}
+
+uint16_t Compute(const uint8_t* data, size_t length){
+    switch(Active()){
+        case Impl::BITWISE: return Bitwise(data, length);
+        case Impl::CLMUL: return Clmul(data, length);
+        default: return Slice8(data, length);
+    }
+}
+
+// The batch loops dispatch once and then run the same kernel over every
+// record; the records are independent so their CRC chains overlap in the core.
+template <typename Fn>
+static void ForEachRecord(const uint8_t* records, size_t count, Fn fn){
+    switch(Active()){
+        case Impl::BITWISE:
+            for(size_t i=0; i<count; i++) fn(i, Bitwise(records + i*RECORD_SIZE, COVERED));
+            break;
+#if defined(CRC16_HAVE_CLMUL)
+        case Impl::CLMUL:
+            for(size_t i=0; i<count; i++) fn(i, ClmulRecordAt(records, i));
+            break;
+#endif
+        default:
+            for(size_t i=0; i<count; i++) fn(i, Slice8(records + i*RECORD_SIZE, COVERED));
+            break;
+    }
+}
+
+void ComputeBatch(const uint8_t* records, size_t count, uint16_t* out){
+    ForEachRecord(records, count, [out](size_t i, uint16_t crc){ out[i] = crc; });
+}
+
+void StampBatch(uint8_t* records, size_t count){
+    ForEachRecord(records, count, [records](size_t i, uint16_t crc){
+        uint8_t* r = records + i*RECORD_SIZE;
+        r[OFFSET] = (crc >> 8) & 0xFF;
+        r[OFFSET+1] = crc & 0xFF;
+    });
+}
+
+size_t VerifyBatch(const uint8_t* records, size_t count, uint8_t* ok){
+    size_t valid = 0;
+    ForEachRecord(records, count, [records, ok, &valid](size_t i, uint16_t crc){
+        const uint8_t* r = records + i*RECORD_SIZE;
+        uint16_t stored = (uint16_t)((r[OFFSET] << 8) | r[OFFSET+1]);
+        uint8_t match = (stored == crc);
+        if(ok) ok[i] = match;
+        valid += match;
+    });
+    return valid;
+}
+
+} // namespace Crc16
@@ -0,0 +1,172 @@
+#include "../include/event_log.h"
+#include "../include/command_router.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <thread>
+
+namespace {
+    const char* NAMES[] = {
+        "NONE", "STATUS", "DRIVER_PANIC", "COMMAND_RX", "VEHICLE_KILL", "VEHICLE_LIMP",
+        "VEHICLE_NORMAL", "VEHICLE_UNKNOWN_CMD", "LINK_UP", "LINK_CONNECT_FAILED", "LINK_LOST",
+        "SPOOL_REPLAY", "MQTT_SUB_REFUSED", "SCENARIO_EVENT"
+    };
+    static_assert(sizeof(NAMES)/sizeof(NAMES[0])==(size_t)LogEvent::COUNT, "Event names out of date");
+
+    const char* TAGS[] = {"", "[ABS ACTIVE]", "[!!! OVERHEAT !!!]", "[LOW BATTERY]", "(SPRINT)", "(STRESS TEST)", "(BRAKING)"};
+
+    // Drain thread state, only touched by Start/Stop and the thread itself
+    std::FILE* g_file = nullptr;
+    std::ostream* g_console = nullptr;
+    std::atomic<bool> g_running(false);
+    std::unique_ptr<std::thread> g_thread;
+    std::vector<LogRecord> g_batch;
+
+    void DrainOnce(){
+        std::vector<EventLog::ThreadRing*> rings;
+        {
+            EventLog::Registry& r = EventLog::Global();
+            std::lock_guard<std::mutex> guard(r.lock);
+            for(auto& ring : r.rings) rings.push_back(ring.get());
+        }
+        g_batch.clear();
+        for(EventLog::ThreadRing* ring : rings){
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            uint64_t tail = ring->tail.load(std::memory_order_acquire);
+            for(uint64_t i=head; i<tail; i++) g_batch.push_back(ring->slots[i & (EventLog::RING_RECORDS - 1)]);
+            ring->head.store(tail, std::memory_order_release);
+        }
+        if(g_batch.empty()) return;
+        // Each ring is in order already, interleave the threads by time
+        std::stable_sort(g_batch.begin(), g_batch.end(), [](const LogRecord& a, const LogRecord& b){
+            return a.time_ns < b.time_ns;
+        });
+        if(g_file){
+            // Flushed every drain, so a killed process loses at most the last DRAIN_MS
+            std::fwrite(g_batch.data(), sizeof(LogRecord), g_batch.size(), g_file);
+            std::fflush(g_file);
+        }
+        if(g_console){
+            for(const LogRecord& rec : g_batch) EventLog::RenderConsole(rec, *g_console);
+            g_console->flush();
+        }
+    }
+}
+
+bool EventLog::Start(const std::string& path, std::ostream* console){
+    if(g_thread) return true;
+    if(!path.empty()){
+        g_file = std::fopen(path.c_str(), "wb");
+        if(!g_file) return false;
+        LogFileHeader header{MAGIC, VERSION, (uint16_t)sizeof(LogRecord), NowNs()};
+        std::fwrite(&header, sizeof(header), 1, g_file);
+        std::fflush(g_file);
+    }
+    g_console = console;
+    g_running = true;
+    g_thread.reset(new std::thread([]{
+        while(g_running.load(std::memory_order_acquire)){
+            DrainOnce();
+            std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_MS));
+        }
+    }));
+    return true;
+}
+
+uint64_t EventLog::Stop(){
+    if(g_thread){
+        g_running = false;
+        g_thread->join();
+        g_thread.reset();
+    }
+    DrainOnce();
+    if(g_file){
+        std::fclose(g_file);
+        g_file = nullptr;
+    }
+    g_console = nullptr;
+    uint64_t dropped = 0;
+    Registry& r = Global();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for(auto& ring : r.rings) dropped += ring->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+const char* EventLog::Name(LogEvent event){
+    return (size_t)event<(size_t)LogEvent::COUNT ? NAMES[(size_t)event] : "UNKNOWN";
+}
+
+static void RenderArgs(const LogRecord& r, std::ostream& os){
+    const int64_t* a = r.arg;
+    switch((LogEvent)r.code){
+        case LogEvent::STATUS:
+            os << " seq=" << a[0] << " rpm=" << a[1] << " speed=" << a[2];
+            if(a[3]>0 && a[3]<(int64_t)(sizeof(TAGS)/sizeof(TAGS[0]))) os << " " << TAGS[a[3]];
+            if(a[4]>=0) os << " sim=" << a[4] << "s";
+            if(a[5]>=0) os << " queue=" << (a[5] >> 32) << "/" << (a[5] & 0xFFFFFFFF);
+            break;
+        case LogEvent::COMMAND_RX:
+        case LogEvent::VEHICLE_UNKNOWN_CMD:
+            os << " opcode=" << a[0];
+            break;
+        case LogEvent::LINK_UP:
+            os << " subscribed=" << a[0];
+            break;
+        case LogEvent::SPOOL_REPLAY:
+            os << " records=" << a[0];
+            break;
+        case LogEvent::SCENARIO_EVENT:
+            os << " event=" << a[0] << " started=" << a[1];
+            break;
+        default:
+            break;
+    }
+}
+
+void EventLog::Render(const LogRecord& r, std::ostream& os){
+    std::time_t secs = (std::time_t)(r.time_ns / 1000000000ull);
+    std::tm tm{};
+#if defined(_WIN32)
+    localtime_s(&tm, &secs);
+#else
+    localtime_r(&secs, &tm);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    os << stamp << "." << std::setw(6) << std::setfill('0') << (r.time_ns / 1000) % 1000000 << std::setfill(' ')
+       << " T" << r.thread << " V" << r.vehicle_id << " " << Name((LogEvent)r.code);
+    RenderArgs(r, os);
+    os << "\n";
+}
+
+void EventLog::RenderConsole(const LogRecord& r, std::ostream& os){
+    const int64_t* a = r.arg;
+    switch((LogEvent)r.code){
+        case LogEvent::STATUS:
+            os << "TX Seq:" << a[0] << " | RPM:" << a[1] << " | Spd:" << a[2] << " km/h | "
+               << (a[3]>=0 && a[3]<(int64_t)(sizeof(TAGS)/sizeof(TAGS[0])) ? TAGS[a[3]] : "");
+            if(a[4]>=0) os << " | Sim:" << a[4] << "s";
+            if(a[5]>=0) os << " | Queue:" << (a[5] >> 32) << "/" << (a[5] & 0xFFFFFFFF);
+            os << "   \r";
+            break;
+        case LogEvent::DRIVER_PANIC:        os << "\n[!] PANIC!! SLAMMING BRAKES! \n"; break;
+        case LogEvent::COMMAND_RX:          os << "\n[RX] COMMAND RECEIVED: " << a[0] << "\n"; break;
+        case LogEvent::VEHICLE_KILL:        os << "[CMD] REMOTE KILL SWITCH ACTIVE!!"; break;
+        case LogEvent::VEHICLE_LIMP:        os << "[CMD] LIMP MODE ACTIVE!!"; break;
+        case LogEvent::VEHICLE_NORMAL:      os << "[CMD] REGULAR MODE. \n"; break;
+        case LogEvent::VEHICLE_UNKNOWN_CMD: os << "[CMD] Unknown OpCode: " << a[0] << "\n"; break;
+        case LogEvent::LINK_UP:
+            if(a[0]) os << "Link Established, Listening on: " << CommandTopic::For(r.vehicle_id) << " and " << CommandTopic::BROADCAST << "\n";
+            else os << "Link Established. Telemetry System Active. Subscription Failed.\n";
+            break;
+        case LogEvent::LINK_CONNECT_FAILED: os << "Connect Failed. Retrying\n"; break;
+        case LogEvent::LINK_LOST:           os << "LINK LOST. Reconnecting..\n"; break;
+        case LogEvent::SPOOL_REPLAY:        os << "Replaying " << a[0] << " spooled records\n"; break;
+        case LogEvent::MQTT_SUB_REFUSED:    os << "[MQTT] Error: Subscription refused by broker\n"; break;
+        case LogEvent::SCENARIO_EVENT:      os << "\n[SCENARIO] Event " << a[0] << (a[1] ? " started\n" : " ended\n"); break;
+        default:
+            Render(r, os);
+            break;
+    }
+}
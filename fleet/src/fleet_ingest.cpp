@@ -0,0 +1,180 @@
+// Native ingest for fleet telemetry (see ingest.h): subscribes to the fleet's
+// telemetry and batch topics, validates and decodes every record into SoA
+// batches and hands them to the sinks, counting drops per stage. A C++
+// counterpart to backend/main.go for gateways and load tests.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include "../include/ingest.h"
+#include "../include/mqtt_forge.h"
+#include "../include/event_loop.h"
+
+const int RECONNECT_MS = 2000;
+const int POLL_MS = 50;
+std::atomic<bool> g_running(true);
+
+void signal_handler(int){
+    g_running = false;
+}
+
+void Usage(){
+    std::cerr<<"Usage: fleet_ingest [broker_ip] [port] [--topic FILTER]... [--qos 0|1]\n"
+             <<"                    [--queue N] [--overflow drop-newest|drop-oldest|block]\n"
+             <<"                    [--batch N] [--max-age MS] [--influx PATH|-] [--quiet]\n"
+             <<"  --topic    subscription, repeatable (default fleet/+/telemetry and fleet/+/batch)\n"
+             <<"  --qos      highest QoS the broker delivers at, default 1\n"
+             <<"  --queue    records buffered between the network and the decode thread\n"
+             <<"  --overflow what a full queue does: drop-newest (default), drop-oldest, or block the network thread\n"
+             <<"  --batch    records per decoded batch\n"
+             <<"  --max-age  a partial batch goes to the sinks after this many ms\n"
+             <<"  --influx   write InfluxDB line protocol (as the Go backend stores it) to PATH, - for stdout\n"
+             <<"  --quiet    no per-second status line\n";
+}
+
+int main(int argc, char* argv[]){
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    std::string broker_ip = "127.0.0.1";
+    int broker_port = 1883;
+    std::vector<std::string> topics;
+    int qos = 1;
+    IngestOptions options;
+    std::string influx_path;
+    bool quiet = false;
+    try{
+        int pos = 0;
+        for(int a=1; a<argc; a++){
+            std::string arg = argv[a];
+            bool has_value = a+1<argc;
+            if(arg=="--topic" && has_value) topics.push_back(argv[++a]);
+            else if(arg=="--qos" && has_value){
+                qos = std::stoi(argv[++a]);
+                if(qos<0 || qos>1) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--queue" && has_value){
+                options.queue_records = std::stoul(argv[++a]);
+                if(options.queue_records==0) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--overflow" && has_value){
+                std::string policy = argv[++a];
+                if(policy=="drop-oldest") options.overflow = RingOverflow::DROP_OLDEST;
+                else if(policy=="drop-newest") options.overflow = RingOverflow::DROP_NEWEST;
+                else if(policy=="block") options.overflow = RingOverflow::BLOCK;
+                else throw std::invalid_argument(arg);
+            }
+            else if(arg=="--batch" && has_value){
+                options.batch_records = std::stoul(argv[++a]);
+                if(options.batch_records==0) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--max-age" && has_value) options.max_batch_age_ms = std::stoi(argv[++a]);
+            else if(arg=="--influx" && has_value) influx_path = argv[++a];
+            else if(arg=="--quiet") quiet = true;
+            else if(arg.rfind("--", 0)==0) throw std::invalid_argument(arg);
+            else{
+                switch(pos++){
+                    case 0: broker_ip = arg; break;
+                    case 1: broker_port = std::stoi(arg); break;
+                    default: throw std::invalid_argument(arg);
+                }
+            }
+        }
+    } catch(...){
+        Usage();
+        return 1;
+    }
+    if(topics.empty()) topics = {"fleet/+/telemetry", "fleet/+/batch"};
+
+    // Line protocol on stdout pushes everything else to stderr
+    std::ostream& out = influx_path=="-" ? std::cerr : std::cout;
+    std::FILE* influx_file = nullptr;
+    if(influx_path=="-") influx_file = stdout;
+    else if(!influx_path.empty()){
+        influx_file = std::fopen(influx_path.c_str(), "w");
+        if(!influx_file){
+            std::cerr<<"cannot open "<<influx_path<<"\n";
+            return 1;
+        }
+    }
+
+    // Sinks first: they must outlive the ingestor
+    VehicleStatsSink stats_sink;
+    std::unique_ptr<LineProtocolSink> influx_sink;
+    if(influx_file) influx_sink.reset(new LineProtocolSink(influx_file));
+    Ingestor ingest(options);
+    ingest.AddSink(stats_sink);
+    if(influx_sink) ingest.AddSink(*influx_sink);
+
+    EventLoop loop;
+    if(!loop.Valid()){
+        std::cerr<<"cannot create the event loop\n";
+        return 1;
+    }
+    MqttForge link;
+    link.Attach(loop);
+    // Payloads point into the receive buffer, OnMessage copies the records out
+    link.SetCallBack([&](std::string_view, const uint8_t* payload, size_t len){
+        ingest.OnMessage(payload, len);
+    });
+    std::string client_id = "ingest_" + std::to_string(
+        std::chrono::system_clock::now().time_since_epoch().count() % 100000);
+
+    out<<"----------------------DESMO FLEET INGEST: "<<broker_ip<<":"<<broker_port<<"--------------------\n";
+    ingest.Start();
+
+    using Steady = std::chrono::steady_clock;
+    auto start = Steady::now();
+    auto retry_at = start;
+    auto next_status = start + std::chrono::seconds(1);
+    bool was_up = false;
+    uint64_t connects = 0, last_decoded = 0;
+    while(g_running){
+        auto now = Steady::now();
+        if(link.State()==LinkState::DOWN){
+            if(was_up) out<<"\nLINK LOST. Reconnecting..\n";
+            was_up = false;
+            if(now>=retry_at){
+                retry_at = now + std::chrono::milliseconds(RECONNECT_MS);
+                // Attached, the SUBSCRIBEs queue up right behind CONNECT
+                bool ok = link.BeginConnect(broker_ip, broker_port, client_id);
+                for(size_t t=0; ok && t<topics.size(); t++) ok = link.Subscribe(topics[t], qos);
+                if(!ok) std::cerr<<"Connect Failed. Retrying\n";
+            }
+        }
+        else if(link.IsConnected() && !was_up){
+            was_up = true;
+            connects++;
+        }
+        loop.Poll(POLL_MS);
+        link.Tick();
+
+        if(quiet || Steady::now()<next_status) continue;
+        next_status += std::chrono::seconds(1);
+        const IngestStats& s = ingest.Stats();
+        uint64_t decoded = s.decoded.load();
+        out<<"Link:"<<(link.IsConnected() ? "UP" : "DOWN")
+           <<" | Records:"<<decoded
+           <<" | Rate:"<<decoded - last_decoded<<"/s"
+           <<" | Rejected:"<<s.rejected.load()
+           <<" | Queue drops:"<<ingest.QueueDropped()
+           <<"   \r"<<std::flush;
+        last_decoded = decoded;
+    }
+
+    link.Disconnect();
+    ingest.Stop();
+    double wall = std::chrono::duration<double>(Steady::now() - start).count();
+    out<<"\n"<<std::fixed<<std::setprecision(1)<<wall<<" s, "
+       <<(uint64_t)(wall>0 ? ingest.Stats().decoded.load()/wall : 0)<<" records/s average, "
+       <<connects<<" connects\n";
+    ingest.Report(out);
+    stats_sink.Report(out);
+    if(influx_sink) out<<influx_sink->Lines()<<" lines ("<<influx_sink->Bytes()<<" bytes) of line protocol\n";
+    if(influx_file && influx_file!=stdout) std::fclose(influx_file);
+    return 0;
+}
@@ -0,0 +1,407 @@
+// Fleet-scale load generator: N simulated vehicles in one process.
+// The fleet is cut into shards, each with its own epoll loop and one MqttForge
+// session per vehicle. A TickExecutor runs every shard once per tick on a pool
+// of pinned worker threads (one thread unless --threads says otherwise).
+// With --batch N each shard instead goes out through a single gateway session
+// as batch frames of up to N records (see batch_publisher.h).
+// Commands reach a shard through one fleet/+/cmd subscription (the gateway,
+// or the first link with --cmd-wildcard) and a CommandRouter, or through one
+// fleet/<id>/cmd subscription per vehicle session.
+// With --scenario every shard drives its slice through a ScenarioRunner
+// (scenario.h) instead of the fixed city-cruise wave. With --record the
+// packets of every shard are appended to one recording after each tick.
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <string>
+#include <csignal>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include "../include/fleet_state.h"
+#include "../include/packet.h"
+#include "../include/mqtt_forge.h"
+#include "../include/crc16.h"
+#include "../include/batch_publisher.h"
+#include "../include/sim_clock.h"
+#include "../include/event_log.h"
+#include "../include/tick_executor.h"
+#include "../include/command_router.h"
+#include "../include/scenario.h"
+#include "../include/recording.h"
+
+const double DEFAULT_RATE_HZ = 10.0;
+const int RECONNECT_DELAY_MS = 2000;
+const size_t SHARDS_PER_WORKER = 4;
+std::atomic<bool> g_running(true);
+
+void signal_handler(int){
+    g_running = false;
+}
+
+// Settings shared by every shard
+struct LoadConfig {
+    std::string broker_ip = "127.0.0.1";
+    int broker_port = 1883;
+    size_t batch = 0;
+    bool dry_run = false;
+    bool wildcard_cmd = false;  // One fleet/+/cmd subscription per shard instead of one per vehicle
+    double sim_dt = 0.1;
+    const Scenario* scenario = nullptr;  // nullptr = everyone cruises
+    bool record = false;                 // Shards keep this tick's packets in Shard::recorded
+};
+
+// One slice of the fleet and the sockets that carry it. Only one worker
+// touches a shard during a tick, and the tick barrier orders it with
+// whichever worker (owner or thief) gets it next time.
+struct Shard {
+    FleetState fleet;
+    EventLoop loop;
+    std::vector<std::unique_ptr<MqttForge>> links;
+    std::vector<std::string> topics_cmd, client_ids;
+    CommandRouter router;
+    std::vector<PreparedPublish> telemetry;
+    std::vector<std::chrono::steady_clock::time_point> next_retry;
+    std::vector<uint32_t> seq;
+    std::vector<Packet> packets;
+    std::unique_ptr<ScenarioRunner> driver;
+    std::vector<double> throttle;
+    std::vector<uint8_t> recorded;
+
+    // Batch mode: one gateway session carries the whole shard
+    MqttForge gateway;
+    std::string gateway_id;
+    BatchPublisher batcher;
+    std::chrono::steady_clock::time_point gateway_retry;
+
+    uint64_t sent = 0, dropped = 0;
+    size_t up = 0;
+
+    Shard(size_t count, uint16_t first_id, const LoadConfig& cfg)
+        : fleet(count, first_id),
+          loop(1024),
+          topics_cmd(count), client_ids(count), telemetry(count), next_retry(count),
+          seq(count, 0), packets(count), throttle(count),
+          gateway_id("gateway_" + std::to_string(first_id)),
+          batcher(gateway, "fleet/" + gateway_id + "/batch", cfg.batch, (int)std::ceil(cfg.sim_dt*1000), 0),
+          gateway_retry(std::chrono::steady_clock::now()) {
+        if(cfg.scenario){
+            std::vector<uint16_t> ids(count);
+            for(size_t i=0; i<count; i++) ids[i] = fleet.Id(i);
+            // Seed 0 like the fleet's own noise, ids keep the vehicles apart
+            driver.reset(new ScenarioRunner(*cfg.scenario, ids, 0));
+        }
+        if(cfg.dry_run) return;
+        for(size_t i=0; i<count; i++) router.Add(fleet.Id(i), (uint32_t)i);
+        gateway.Attach(loop);
+        gateway.SetCallBack([this](std::string_view topic, const uint8_t* payload, size_t len){
+            RouteShard(topic, payload, len);
+        });
+        for(size_t i=0; i<count && cfg.batch==0; i++){
+            std::string id = std::to_string(fleet.Id(i));
+            client_ids[i] = "sim_client_" + id;
+            topics_cmd[i] = CommandTopic::For(fleet.Id(i));
+
+            links.emplace_back(new MqttForge());
+            telemetry[i] = links[i]->Prepare("fleet/" + id + "/telemetry", 0);
+            links[i]->Attach(loop);
+            if(cfg.wildcard_cmd){
+                if(i>0) continue;
+                links[i]->SetCallBack([this](std::string_view topic, const uint8_t* payload, size_t len){
+                    RouteShard(topic, payload, len);
+                });
+                continue;
+            }
+            // Own topic plus the broadcast, either way only this vehicle is touched
+            links[i]->SetCallBack([this, i](std::string_view topic, const uint8_t* payload, size_t len){
+                router.Route(topic, payload, len,
+                    [this](uint32_t index, uint8_t opcode){ fleet.OnCommand(index, opcode); },
+                    [this, i](uint8_t opcode){ fleet.OnCommand(i, opcode); });
+            });
+        }
+    }
+
+    // fleet/+/cmd traffic: the vehicles of this shard, or all of them at once
+    void RouteShard(std::string_view topic, const uint8_t* payload, size_t len){
+        router.Route(topic, payload, len,
+            [this](uint32_t index, uint8_t opcode){ fleet.OnCommand(index, opcode); },
+            [this](uint8_t opcode){ fleet.OnCommandAll(opcode); });
+    }
+
+    // Per-vehicle sessions subscribe to their own topic and the broadcast,
+    // with --cmd-wildcard only the shard's first session subscribes
+    void Subscribe(const LoadConfig& cfg, size_t i){
+        MqttForge& link = *links[i];
+        if(!cfg.wildcard_cmd){
+            link.Subscribe(topics_cmd[i]);
+            link.Subscribe(std::string(CommandTopic::BROADCAST));
+        }
+        else if(i==0) link.Subscribe(std::string(CommandTopic::WILDCARD));
+    }
+
+    // Everything one tick does for this slice: socket I/O that arrived since
+    // the last tick, reconnects, physics, serialize + CRC, publish
+    void Tick(const LoadConfig& cfg, uint64_t periods, uint64_t timestamp, double sim_s){
+        auto now = std::chrono::steady_clock::now();
+        size_t count = fleet.Size();
+        if(!cfg.dry_run){
+            loop.Poll(0);
+
+            // (Re)connect without waiting, later polls finish the handshakes
+            up = 0;
+            if(cfg.batch>0 && gateway.State()==LinkState::DOWN && now>=gateway_retry){
+                gateway_retry = now + std::chrono::milliseconds(RECONNECT_DELAY_MS);
+                if(gateway.BeginConnect(cfg.broker_ip, cfg.broker_port, "sim_" + gateway_id)){
+                    gateway.Subscribe(std::string(CommandTopic::WILDCARD));
+                }
+            }
+            for(size_t i=0; i<links.size(); i++){
+                MqttForge& link = *links[i];
+                if(link.State()==LinkState::DOWN && now>=next_retry[i]){
+                    next_retry[i] = now + std::chrono::milliseconds(RECONNECT_DELAY_MS);
+                    if(link.BeginConnect(cfg.broker_ip, cfg.broker_port, client_ids[i])) Subscribe(cfg, i);
+                }
+                if(link.IsConnected()) up++;
+            }
+        }
+        else up = count;
+
+        if(driver){
+            driver->Step(sim_s, throttle.data());
+            for(size_t i=0; i<count; i++) fleet.SetThrottle(i, throttle[i]);
+        }
+        else{
+            // City cruising for everyone, phase shifted by id
+            for(size_t i=0; i<count; i++){
+                fleet.SetThrottle(i, (std::sin((seq[i]+fleet.Id(i))*0.05)+1.0) / 2.0 * 0.6);
+            }
+        }
+        // Ticks skipped after an overrun still move the physics
+        for(; periods>1; periods--) fleet.Tick(cfg.sim_dt);
+        fleet.Tick(cfg.sim_dt);
+        fleet.Snapshot(packets.data(), count, cfg.sim_dt);
+
+        uint8_t wire[32];
+        if(cfg.record) recorded.resize(count * sizeof(wire));
+        for(size_t i=0; i<count; i++){
+            Packet& packet = packets[i];
+            packet.magic = 0xD350;
+            packet.sequence_id = seq[i]++;
+            packet.timestamp = timestamp;
+            packet.crc16 = 0;
+            packet.serialize(wire);
+            uint16_t checksum = CalculateCRC(wire, 28);
+            wire[28] = (checksum >> 8) & 0xFF;
+            wire[29] = (checksum & 0xFF);
+            if(cfg.record) std::memcpy(recorded.data() + i*sizeof(wire), wire, sizeof(wire));
+
+            if(cfg.dry_run){
+                sent++;
+                continue;
+            }
+            if(cfg.batch>0){
+                // Only drop once the link is down, Flush() accounts for the rest
+                if(gateway.IsConnected()) batcher.Add(wire);
+                else dropped++;
+                continue;
+            }
+            if(links[i]->IsConnected() && links[i]->Publish(telemetry[i], wire, sizeof(wire))) sent++;
+            else dropped++;
+        }
+        if(cfg.dry_run) return;
+
+        for(auto& link : links) link->Tick();
+        if(cfg.batch>0){
+            batcher.Poll();
+            gateway.Tick();
+            if(gateway.IsConnected()) up = count;
+        }
+    }
+
+    void Close(const LoadConfig& cfg){
+        for(auto& link : links) link->Disconnect();
+        if(cfg.batch>0){
+            batcher.Flush();
+            gateway.Disconnect();
+        }
+    }
+
+    uint64_t Sent() const { return sent + batcher.RecordsSent(); }
+    uint64_t Dropped() const { return dropped + batcher.RecordsDropped(); }
+};
+
+int main(int argc, char* argv[]) {
+    signal(SIGINT, signal_handler);
+    size_t count = 100;
+    uint16_t first_id = 1000;
+    LoadConfig cfg;
+    ClockMode mode = ClockMode::REALTIME;
+    double scale = 1.0;
+    double rate_hz = DEFAULT_RATE_HZ;
+    OverrunPolicy overrun = OverrunPolicy::CATCH_UP;
+    size_t threads = 1, shard_count = 0;
+    bool pin = true;
+    std::string scenario_path, record_path;
+    try{
+        int pos = 0;
+        for(int a=1; a<argc; a++){
+            std::string arg = argv[a];
+            if(arg=="--batch" && a+1<argc) { cfg.batch = std::stoul(argv[++a]); continue; }
+            if(arg=="--threads" && a+1<argc) { threads = std::stoul(argv[++a]); continue; }
+            if(arg=="--shards" && a+1<argc) { shard_count = std::stoul(argv[++a]); continue; }
+            if(arg=="--no-pin") { pin = false; continue; }
+            if(arg=="--dry-run") { cfg.dry_run = true; continue; }
+            if(arg=="--cmd-wildcard") { cfg.wildcard_cmd = true; continue; }
+            if(arg=="--scenario" && a+1<argc) { scenario_path = argv[++a]; continue; }
+            if(arg=="--record" && a+1<argc) { record_path = argv[++a]; continue; }
+            if(arg=="--speed" && a+1<argc){
+                if(!SimClock::ParseSpeed(argv[++a], mode, scale)) throw std::invalid_argument(arg);
+                continue;
+            }
+            if(arg=="--rate" && a+1<argc){
+                rate_hz = std::stod(argv[++a]);
+                if(!(rate_hz>0)) throw std::invalid_argument(arg);
+                continue;
+            }
+            if(arg=="--overrun" && a+1<argc){
+                std::string policy = argv[++a];
+                if(policy=="catch-up") overrun = OverrunPolicy::CATCH_UP;
+                else if(policy=="skip") overrun = OverrunPolicy::SKIP;
+                else throw std::invalid_argument(arg);
+                continue;
+            }
+            switch(pos++){
+                case 0: count = std::stoul(arg); break;
+                case 1: first_id = static_cast<uint16_t>(std::stoi(arg)); break;
+                case 2: cfg.broker_ip = arg; break;
+                case 3: cfg.broker_port = std::stoi(arg); break;
+                default: throw std::invalid_argument(arg);
+            }
+        }
+    } catch(...){
+        std::cerr<<"Usage: fleet_load [count] [first_id] [broker_ip] [port] [--batch N] [--speed 1|N|max]\n"
+                 <<"                  [--rate HZ] [--overrun catch-up|skip]\n"
+                 <<"                  [--threads N] [--shards N] [--no-pin] [--dry-run] [--cmd-wildcard]\n"
+                 <<"                  [--scenario PATH] [--record PATH]\n"
+                 <<"  --threads  worker threads, 0 = one per core (default 1)\n"
+                 <<"  --shards   fleet slices shared out between workers (default "<<SHARDS_PER_WORKER<<" per worker)\n"
+                 <<"  --dry-run  build and checksum packets without any broker\n"
+                 <<"  --cmd-wildcard one fleet/+/cmd subscription per shard instead of one per vehicle\n"
+                 <<"                 (batch gateways always do this)\n"
+                 <<"  --scenario drive the fleet by this scenario file (default: everyone city-cruises)\n"
+                 <<"  --record   keep every packet generated in this recording (see fleet_replay)\n";
+        return 1;
+    }
+    cfg.sim_dt = 1.0 / rate_hz;
+    Scenario scenario;
+    std::string scenario_error;
+    if(!scenario_path.empty()){
+        if(!scenario.Load(scenario_path, scenario_error)){
+            std::cerr<<scenario_path<<": "<<scenario_error<<"\n";
+            return 1;
+        }
+        cfg.scenario = &scenario;
+    }
+    RecordingWriter recorder;
+    if(!record_path.empty()){
+        if(!recorder.Open(record_path)){
+            std::cerr<<"cannot create recording "<<record_path<<"\n";
+            return 1;
+        }
+        cfg.record = true;
+    }
+
+    size_t workers = threads>0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    if(shard_count==0) shard_count = workers * SHARDS_PER_WORKER;
+    shard_count = std::max<size_t>(1, std::min(shard_count, count));
+    TickExecutor executor(workers, shard_count, pin);
+    // More workers than vehicles leaves the extra shard slots empty
+    size_t shards_n = shard_count;
+    std::cout<<"----------------------DESMO FLEET LOAD: "<<count<<" vehicles from id "<<first_id
+             <<", "<<executor.Workers()<<" workers--------------------\n";
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    for(size_t s=0; s<shards_n; s++){
+        size_t lo = count * s / shards_n, hi = count * (s + 1) / shards_n;
+        shards.emplace_back(new Shard(hi - lo, static_cast<uint16_t>(first_id + lo), cfg));
+        if(!shards.back()->loop.Valid()){
+            std::cerr<<"epoll unavailable\n";
+            return 1;
+        }
+    }
+    // Broker refusals from the sessions, echoed off the worker threads
+    EventLog::Start("", &std::cout);
+
+    // Status line about 1/s of wall time whatever the speed
+    uint64_t status_every = mode==ClockMode::AFAP ? 1000 : (uint64_t)std::ceil(rate_hz*scale);
+    uint64_t ticks = 0;
+    uint64_t periods = 0, timestamp = 0;
+    double sim_s = 0;
+    const TickExecutor::Task tick = [&](size_t s, size_t){
+        if(s<shards.size()) shards[s]->Tick(cfg, periods, timestamp, sim_s);
+    };
+
+    SimClock clock(cfg.sim_dt, mode, scale, 0, overrun);
+    while(g_running){
+        periods = clock.Tick();
+        timestamp = clock.NowMs();
+        sim_s = clock.Seconds();
+        executor.Run(tick);
+        // Shard order after the barrier, so the file stays in time order
+        if(cfg.record){
+            for(auto& shard : shards) recorder.Append(shard->recorded.data(), shard->recorded.size() / Recording::RECORD_SIZE);
+        }
+        // Every shard runs the same schedule, the first one speaks for the fleet
+        if(shards[0]->driver){
+            for(const auto& change : shards[0]->driver->EventChanges()){
+                EventLog::Write(LogEvent::SCENARIO_EVENT, 0, (int64_t)change.first, change.second ? 1 : 0);
+            }
+        }
+
+        if(++ticks % status_every == 0){
+            uint64_t sent = 0, dropped = 0;
+            size_t up = 0;
+            for(auto& shard : shards){
+                sent += shard->Sent();
+                dropped += shard->Dropped();
+                up += shard->up;
+            }
+            std::cout << "Tick:" << ticks
+                    << " | Links:" << up << "/" << count
+                    << " | TX:" << sent
+                    << " | Dropped:" << dropped
+                    << "   \r" << std::flush;
+        }
+    }
+
+    uint64_t total = 0, dropped = 0, commands = 0, broadcasts = 0, decisions = 0, alerts = 0;
+    for(auto& shard : shards){
+        if(shard->driver){
+            decisions += shard->driver->Decisions() * shard->driver->Size();
+            alerts += shard->driver->Alerts();
+        }
+        shard->Close(cfg);
+        total += shard->Sent();
+        dropped += shard->Dropped();
+        commands += shard->router.Routed();
+        broadcasts += shard->router.Broadcasts();
+    }
+    EventLog::Stop();
+    bool recorded = recorder.Close();
+    double wall = clock.WallSeconds();
+    std::cout << "\nSent " << total << " packets, dropped " << dropped << ", "
+              << (uint64_t)(wall>0 ? total/wall : 0) << " pkt/s sustained over "
+              << (uint64_t)clock.Seconds() << " simulated s\n";
+    if(cfg.record){
+        std::cout << "Recording: " << recorder.Records() << " records in " << recorder.Blocks() << " blocks, "
+                  << recorder.Bytes() << " bytes" << (recorded ? "" : ", WRITE FAILED") << " in " << record_path << "\n";
+    }
+    if(cfg.scenario) std::cout << "Scenario: " << decisions << " driver decisions, " << alerts << " alerts\n";
+    if(commands || broadcasts) std::cout << "Commands: " << commands << " to single vehicles, " << broadcasts << " broadcasts\n";
+    if(clock.Pacer()) clock.Pacer()->Report(std::cout);
+    executor.Report(std::cout);
+    return 0;
+}
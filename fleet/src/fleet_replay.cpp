@@ -0,0 +1,267 @@
+// Streams a recording (fleet_sim / fleet_load --record, see recording.h) back
+// to a broker: the same 32-byte records on the same fleet/<id>/telemetry
+// topics, paced by their timestamps at 1x, Nx or as fast as the link takes
+// them. No physics runs, so replaying a big fleet costs little CPU.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include "../include/recording.h"
+#include "../include/mqtt_forge.h"
+#include "../include/batch_publisher.h"
+#include "../include/sim_clock.h"
+#include "../include/crc16.h"
+
+const int RECONNECT_MS = 2000;
+const int BATCH_MAX_AGE_MS = 100;
+const int DRAIN_MS = 5000;              // Wait for outstanding PUBACKs at the end
+std::atomic<bool> g_running(true);
+
+void signal_handler(int){
+    g_running = false;
+}
+
+void Usage(){
+    std::cerr<<"Usage: fleet_replay FILE [broker_ip] [port] [--speed 1|N|max] [--vehicle ID]\n"
+             <<"                    [--from MS] [--to MS] [--retime] [--batch N] [--dry-run] [--info]\n"
+             <<"  --speed   1 = the recorded pace (default), N = N times faster, max = as fast as possible\n"
+             <<"  --vehicle only this vehicle's records\n"
+             <<"  --from/--to only records with timestamps in this range (Unix ms)\n"
+             <<"  --retime  rewrite timestamps (and CRCs) to the time each record is replayed\n"
+             <<"  --batch   send batch frames of up to N records to fleet/replay/batch instead\n"
+             <<"  --dry-run read and pace the recording without a broker\n"
+             <<"  --info    print what the recording holds, from the block headers only, and exit\n";
+}
+
+static uint64_t WallMs(){
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::string FormatMs(uint64_t ms){
+    std::time_t secs = (std::time_t)(ms / 1000);
+    std::tm tm{};
+#if defined(_WIN32)
+    gmtime_s(&tm, &secs);
+#else
+    gmtime_r(&secs, &tm);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    std::string out = stamp;
+    std::string frac = std::to_string(1000 + ms % 1000);
+    return out + "." + frac.substr(1) + " UTC";
+}
+
+static int Info(RecordingReader& reader){
+    RecordingBlock block;
+    uint64_t blocks = 0, records = 0, first = UINT64_MAX, last = 0;
+    std::vector<uint32_t> per_vehicle(65536, 0);
+    while(reader.Next(block)){
+        blocks++;
+        records += block.records;
+        first = std::min(first, block.first_ts);
+        last = std::max(last, block.last_ts);
+        for(const auto& v : block.vehicles) per_vehicle[v.first] += v.second;
+    }
+    size_t vehicles = 0;
+    uint16_t lo = 0, hi = 0;
+    for(size_t id=0; id<per_vehicle.size(); id++){
+        if(!per_vehicle[id]) continue;
+        if(vehicles++==0) lo = (uint16_t)id;
+        hi = (uint16_t)id;
+    }
+    std::cout<<"Version "<<(int)reader.Version()<<", created "<<FormatMs(reader.Created())<<", "
+             <<reader.FileSize()<<" bytes, blocks of up to "<<reader.BlockRecords()<<" records\n"
+             <<blocks<<" blocks, "<<records<<" records, "<<vehicles<<" vehicles";
+    if(vehicles) std::cout<<" (ids "<<lo<<".."<<hi<<")";
+    std::cout<<"\n";
+    if(records){
+        std::cout<<"From "<<FormatMs(first)<<" to "<<FormatMs(last)<<" ("
+                 <<std::fixed<<std::setprecision(1)<<(last - first)/1000.0<<" s)\n";
+    }
+    if(reader.Damaged()) std::cout<<"Damaged block at the end, replay stops before it\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    signal(SIGINT, signal_handler);
+    std::string path;
+    std::string broker_ip = "127.0.0.1";
+    int broker_port = 1883;
+    ClockMode mode = ClockMode::REALTIME;
+    double scale = 1.0;
+    int vehicle = -1;
+    uint64_t from_ms = 0, to_ms = UINT64_MAX;
+    bool retime = false, dry_run = false, info = false;
+    size_t batch = 0;
+    try{
+        int pos = 0;
+        for(int a=1; a<argc; a++){
+            std::string arg = argv[a];
+            bool has_value = a+1<argc;
+            if(arg=="--speed" && has_value){
+                if(!SimClock::ParseSpeed(argv[++a], mode, scale)) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--vehicle" && has_value){
+                vehicle = std::stoi(argv[++a]);
+                if(vehicle<0 || vehicle>0xFFFF) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--from" && has_value) from_ms = std::stoull(argv[++a]);
+            else if(arg=="--to" && has_value) to_ms = std::stoull(argv[++a]);
+            else if(arg=="--batch" && has_value) batch = std::stoul(argv[++a]);
+            else if(arg=="--retime") retime = true;
+            else if(arg=="--dry-run") dry_run = true;
+            else if(arg=="--info") info = true;
+            else if(arg.rfind("--", 0)==0) throw std::invalid_argument(arg);
+            else{
+                switch(pos++){
+                    case 0: path = arg; break;
+                    case 1: broker_ip = arg; break;
+                    case 2: broker_port = std::stoi(arg); break;
+                    default: throw std::invalid_argument(arg);
+                }
+            }
+        }
+        if(path.empty()) throw std::invalid_argument("no file");
+    } catch(...){
+        Usage();
+        return 1;
+    }
+
+    RecordingReader reader;
+    std::string error;
+    if(!reader.Open(path, error)){
+        std::cerr<<error<<"\n";
+        return 1;
+    }
+    if(info) return Info(reader);
+
+    std::cout<<"----------------------DESMO FLEET REPLAY: "<<path<<" at "
+             <<(mode==ClockMode::AFAP ? std::string("max") : std::to_string(scale) + "x")<<"--------------------\n";
+
+    MqttForge uplink;
+    std::string client_id = "replay_" + std::to_string(WallMs() % 100000);
+    std::vector<PreparedPublish> topics(65536);
+    std::unique_ptr<BatchPublisher> batcher;
+    if(batch>0) batcher.reset(new BatchPublisher(uplink, "fleet/replay/batch", batch, BATCH_MAX_AGE_MS));
+    auto connect = [&]{
+        while(g_running && !uplink.Connect(broker_ip, broker_port, client_id)){
+            std::cerr<<"Connect Failed. Retrying\n";
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_MS));
+        }
+        return g_running.load();
+    };
+    if(!dry_run && !connect()) return 1;
+
+    // Paced by timestamps: the first record goes out now, every later one
+    // (ts - first) / speed after it
+    RecordingBlock block;
+    bool started = false;
+    uint64_t first_ts = 0, start_ms = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sent = 0, bad = 0, reconnects = 0, blocks = 0, skipped = 0;
+    while(g_running && reader.Next(block)){
+        if(block.last_ts<from_ms || block.first_ts>to_ms || (vehicle>=0 && !block.CountOf((uint16_t)vehicle))){
+            skipped++;
+            continue;
+        }
+        if(!reader.Load(block)){
+            std::cerr<<"read error at offset "<<block.offset<<"\n";
+            break;
+        }
+        blocks++;
+        for(uint32_t r=0; r<block.records && g_running; r++){
+            uint8_t* record = block.data.data() + (size_t)r*Recording::RECORD_SIZE;
+            uint16_t id = (uint16_t)((record[2] << 8) | record[3]);
+            uint64_t ts = 0;
+            for(int i=0; i<8; i++) ts = (ts << 8) | record[8 + i];
+            if((vehicle>=0 && id!=vehicle) || ts<from_ms || ts>to_ms) continue;
+
+            if(!started){
+                started = true;
+                first_ts = ts;
+                start = std::chrono::steady_clock::now();
+                start_ms = WallMs();
+            }
+            // Out-of-order records (late spool replays) go out right away
+            uint64_t offset_ms = ts>first_ts ? ts - first_ts : 0;
+            if(mode!=ClockMode::AFAP){
+                auto due = start + std::chrono::microseconds((int64_t)(offset_ms * 1000.0 / scale));
+                if(due>std::chrono::steady_clock::now() && batcher) batcher->Flush();
+                // Long gaps are slept in slices so keep-alives and Ctrl-C still get through
+                while(g_running && due>std::chrono::steady_clock::now()){
+                    std::this_thread::sleep_until(std::min(due, std::chrono::steady_clock::now() + std::chrono::seconds(1)));
+                    if(!dry_run) uplink.Tick();
+                }
+            }
+
+            uint16_t stored = (uint16_t)((record[Crc16::OFFSET] << 8) | record[Crc16::OFFSET+1]);
+            bool valid = Crc16::Compute(record, Crc16::COVERED)==stored;
+            if(!valid) bad++;
+            if(retime){
+                uint64_t now = mode==ClockMode::AFAP ? WallMs() : start_ms + (uint64_t)(offset_ms / scale);
+                for(int i=0; i<8; i++) record[8 + i] = (now >> (56 - i*8)) & 0xFF;
+                // A record that arrived broken stays broken
+                if(valid){
+                    uint16_t crc = Crc16::Compute(record, Crc16::COVERED);
+                    record[Crc16::OFFSET] = crc >> 8;
+                    record[Crc16::OFFSET+1] = crc & 0xFF;
+                }
+            }
+            if(dry_run){
+                sent++;
+                continue;
+            }
+
+            if(batcher){
+                if(batcher->Add(record) && batcher->Poll()) continue;
+            }
+            // A publish that got into the in-flight window before the link
+            // broke is replayed by the reconnect, only the rest is sent again
+            uint16_t tracked = 0;
+            if(!batcher){
+                PreparedPublish& topic = topics[id];
+                if(!topic.Valid()) topic = uplink.Prepare("fleet/" + std::to_string(id) + "/telemetry", 1);
+                if(uplink.Publish(topic, record, Recording::RECORD_SIZE, &tracked)) { sent++; continue; }
+            }
+            // The link dropped: reconnect and carry on where it broke off
+            std::cerr<<"LINK LOST. Reconnecting..\n";
+            reconnects++;
+            if(!connect()) break;
+            if(!batcher){
+                if(tracked || uplink.Publish(topics[id], record, Recording::RECORD_SIZE)) sent++;
+            }
+        }
+        if(!dry_run) uplink.Tick();
+    }
+    if(batcher){
+        batcher->Flush();
+        sent = batcher->RecordsSent();
+    }
+    if(!dry_run){
+        // Closing with PUBACKs unread makes the kernel reset the connection,
+        // and the broker may throw away the last publishes with it
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_MS);
+        while(uplink.IsConnected() && uplink.InFlight()>0 && std::chrono::steady_clock::now()<deadline){
+            uplink.Tick();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        uplink.Disconnect();
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout<<std::fixed<<std::setprecision(1)<<"Replayed "<<sent<<" records from "<<blocks<<" blocks ("
+             <<skipped<<" skipped by the index) in "<<wall<<" s, "<<(wall>0 ? sent/wall : 0)<<" rec/s\n";
+    if(bad) std::cout<<bad<<" records had a bad CRC in the recording and went out as recorded\n";
+    if(reconnects) std::cout<<reconnects<<" reconnects\n";
+    if(batcher && batcher->RecordsDropped()) std::cout<<batcher->RecordsDropped()<<" records dropped with a failed batch\n";
+    if(reader.Damaged()) std::cout<<"Stopped at a damaged block, the rest of the file was not replayed\n";
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Stand-in MQTT broker for local load tests (see mini_broker.h).
+// Accepts fleet_sim / fleet_load sessions, acks and counts what they send,
+// prints a rate line every second and a summary on Ctrl-C.
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include <atomic>
+#include "../include/mini_broker.h"
+
+std::atomic<bool> g_running(true);
+
+void signal_handler(int){
+    g_running = false;
+}
+
+void Usage(){
+    std::cerr<<"Usage: fleet_sink [port] [--bind ip] [--decode] [--ack-delay ms] [--ack-drop fraction] [--seed N]\n"
+             <<"  --decode     parse payloads as packets / batch frames and count them per vehicle\n"
+             <<"  --ack-delay  hold every PUBACK this many ms\n"
+             <<"  --ack-drop   never send this fraction of PUBACKs (0..1), clients must retransmit\n";
+}
+
+int main(int argc, char* argv[]){
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    BrokerOptions options;
+    try{
+        int pos = 0;
+        for(int a=1; a<argc; a++){
+            std::string arg = argv[a];
+            bool has_value = a+1<argc;
+            if(arg=="--bind" && has_value) options.bind_ip = argv[++a];
+            else if(arg=="--decode") options.decode = true;
+            else if(arg=="--ack-delay" && has_value) options.ack_delay_ms = std::stoi(argv[++a]);
+            else if(arg=="--ack-drop" && has_value){
+                options.ack_drop_rate = std::stod(argv[++a]);
+                if(options.ack_drop_rate<0 || options.ack_drop_rate>1) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--seed" && has_value) options.seed = std::stoull(argv[++a]);
+            else if(pos++==0 && arg[0]!='-') options.port = std::stoi(arg);
+            else throw std::invalid_argument(arg);
+        }
+    } catch(...){
+        Usage();
+        return 1;
+    }
+
+    MiniBroker broker(options);
+    if(!broker.Start()){
+        std::cerr<<"cannot listen on "<<options.bind_ip<<":"<<options.port<<"\n";
+        return 1;
+    }
+    std::cout<<"----------------------DESMO FLEET SINK: "<<options.bind_ip<<":"<<broker.Port()<<"--------------------\n";
+
+    const BrokerStats& stats = broker.Stats();
+    auto start = std::chrono::steady_clock::now();
+    auto next_status = start + std::chrono::seconds(1);
+    uint64_t last = 0;
+    while(g_running){
+        broker.Poll(50);
+        auto now = std::chrono::steady_clock::now();
+        if(now<next_status) continue;
+        next_status += std::chrono::seconds(1);
+        uint64_t publishes = stats.publishes.load();
+        std::cout << "Links:" << stats.connections.load()
+                  << " | PUBLISH:" << publishes
+                  << " | Rate:" << publishes - last << "/s"
+                  << " | Acks:" << stats.acks_sent.load()
+                  << (options.decode ? " | Packets:" + std::to_string(stats.packets.load()) : "")
+                  << "   \r" << std::flush;
+        last = publishes;
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\n" << std::fixed << std::setprecision(1) << wall << " s, "
+              << (uint64_t)(wall>0 ? stats.publishes.load()/wall : 0) << " PUBLISH/s average\n";
+    broker.Report(std::cout);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "../include/fleet_state.h"
+#include "../include/counter_rng.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+template <typename T>
+inline T clamp(T v, T lo, T hi)
+{
+    return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+FleetState::FleetState(size_t count, uint16_t first_id, uint64_t seed) : m_seed(seed) {
+    m_id.resize(count);
+    for(size_t i=0; i<count; i++) m_id[i] = static_cast<uint16_t>(first_id + i);
+    Init(count);
+}
+
+FleetState::FleetState(const std::vector<uint16_t>& ids, uint64_t seed) : m_id(ids), m_seed(seed) {
+    Init(ids.size());
+}
+
+void FleetState::Init(size_t count){
+    m_speed.assign(count, 0.0);
+    m_rpm.assign(count, 800.0);
+    m_temp.assign(count, 25.0);
+    m_acceleration.assign(count, 0.0);
+    m_prev_accel.assign(count, 0.0);
+    m_throttle.assign(count, 0.0);
+    m_battery_level.assign(count, 100.0);
+    m_gear.assign(count, 1);
+    m_remote_kill.assign(count, 0);
+    m_limp_mode.assign(count, 0);
+
+    m_target_speed.resize(count);
+    m_noise_scratch.resize(count);
+    for(size_t i=0; i<count; i++) m_target_speed[i] = 110.0+(m_id[i]%50);
+    m_ticks = 0;
+}
+
+void FleetState::SetThrottle(size_t i, double throttle){
+    m_throttle[i] = clamp(throttle, -1.0, 1.0);
+}
+
+// Silent counterpart of Vehicle::OnCommand, a fleet can't print per vehicle
+void FleetState::OnCommand(size_t i, uint8_t opcode){
+    switch (opcode) {
+        case CMD_KILL:
+            m_remote_kill[i] = 1;
+            break;
+        case CMD_LIMP:
+            m_limp_mode[i] = 1;
+            break;
+        case CMD_NORMAL:
+            m_remote_kill[i] = 0;
+            m_limp_mode[i] = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+void FleetState::OnCommandAll(uint8_t opcode){
+    size_t n = Size();
+    switch (opcode) {
+        case CMD_KILL:
+            std::fill(m_remote_kill.begin(), m_remote_kill.begin() + n, 1);
+            break;
+        case CMD_LIMP:
+            std::fill(m_limp_mode.begin(), m_limp_mode.begin() + n, 1);
+            break;
+        case CMD_NORMAL:
+            std::fill(m_remote_kill.begin(), m_remote_kill.begin() + n, 0);
+            std::fill(m_limp_mode.begin(), m_limp_mode.begin() + n, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+// Same as Vehicle::CalculateRPM, as a pure function of the lane state
+static inline double FleetRPM(double speed, double gear, bool kill){
+    double gear_ratio = 4.8 - (gear*0.65);
+    gear_ratio = (gear_ratio<0.8) ? 0.8 : gear_ratio;
+    double rpm = speed*gear_ratio*25.0;
+    rpm = (rpm<800.0) ? 800.0 : rpm;
+    rpm = (rpm>16000.0) ? 16000.0 : rpm;
+    return kill ? 0.0 : rpm;
+}
+
+void FleetState::Tick(double dt){
+    const size_t n = Size();
+    m_ticks++;
+    double* __restrict speed = m_speed.data();
+    double* __restrict rpm = m_rpm.data();
+    double* __restrict temp = m_temp.data();
+    double* __restrict accel = m_acceleration.data();
+    double* __restrict prev_accel = m_prev_accel.data();
+    double* __restrict battery = m_battery_level.data();
+    double* __restrict gear = m_gear.data();
+    const double* __restrict target = m_target_speed.data();
+    const double* __restrict throttle = m_throttle.data();
+    const int64_t* __restrict kill = m_remote_kill.data();
+    const int64_t* __restrict limp = m_limp_mode.data();
+
+    // Every branch of Vehicle::Tick is a select here, the expressions (and
+    // their evaluation order) are kept identical so results match bit for bit.
+    // Lanes are all 64-bit wide, mixing widths stops GCC from vectorizing.
+#pragma GCC ivdep
+    for(size_t i=0; i<n; i++){
+        const double v = speed[i];
+        const bool k = kill[i] != 0;
+
+        // 1. CONTINUOUS THROTTLE
+        double internal_demand = clamp((target[i] - v)*0.1, 0.0, 1.0);
+        double final_throttle = (throttle[i]>0) ? throttle[i] : internal_demand;
+
+        // Intervention logic
+        double limp_throttle = (v>40.0) ? -0.5 : ((final_throttle>0.3) ? 0.3 : final_throttle);
+        final_throttle = k ? -1.0 : (limp[i] ? limp_throttle : final_throttle);
+        double r = k ? 0.0 : rpm[i];
+
+        // 2. Engine force
+        double deviation = (r-4500)/4500;
+        double torque_curve = clamp(1.0 - (deviation*deviation), 0.3, 1.0);
+        double force_engine = final_throttle * torque_curve * 100.0;
+
+        // 3. RESISTANCE
+        double force_friction = (v>0) ? 5.0 : 0.0;
+        double force_drag = 0.0035*v*v;
+
+        // 4. INTEGRATION
+        double net_force = force_engine - force_friction - force_drag;
+        net_force = (final_throttle<-0.1) ? net_force - std::fabs(final_throttle)*15.0 : net_force;
+        double coast_force = (v>0) ? net_force - 2.0 : net_force;
+        net_force = (final_throttle<0.05) ? coast_force : net_force;
+
+        prev_accel[i] = accel[i];
+        accel[i] = net_force;
+
+        double new_speed = v + (net_force*dt);
+        new_speed = (new_speed<0) ? 0.0 : new_speed;
+        speed[i] = new_speed;
+
+        // Gear shift, then RPM at the new ratio
+        double g = gear[i];
+        r = FleetRPM(new_speed, g, k);
+        double g_up = (g<6) ? g+1.0 : g;
+        double g_down = (g>1) ? g-1.0 : g;
+        g = (r>7500) ? g_up : ((r<2500) ? g_down : g);
+        r = FleetRPM(new_speed, g, k);
+        gear[i] = g;
+        rpm[i] = r;
+
+        // Thermodynamics
+        double heat_in = (r/3000.0)*15.0*dt;
+        double heat_out = (temp[i]-25.0)*0.2*dt;
+        temp[i] = clamp(temp[i] + (heat_in - heat_out), 25.0, 150.0);
+
+        double b = (new_speed>0) ? battery[i] - (0.05 * dt) : battery[i];
+        battery[i] = (b<0) ? 0.0 : b;
+    }
+}
+
+void FleetState::Snapshot(Packet* out, size_t count, double dt){
+    if(count>Size()) count = Size();
+
+    // Whole-fleet batch, same values as drawing one vehicle at a time
+    CounterRng::Gaussian(m_seed, m_id.data(), count, m_ticks, CounterRng::RPM_NOISE, m_noise_scratch.data());
+
+    for(size_t i=0; i<count; i++){
+        Packet& p = out[i];
+        p.vehicle_id = m_id[i];
+        p.version = 1;
+        double noisy_rpm = m_rpm[i] + VehicleNoise::RPM_SIGMA * m_noise_scratch[i];
+        p.rpm = static_cast<uint16_t>(clamp(noisy_rpm, 0.0, 16000.0));
+        p.speed = static_cast<uint16_t>(m_speed[i]);
+        p.gear = static_cast<uint8_t>(m_gear[i]);
+        p.temp = static_cast<uint8_t>(m_temp[i]);
+        p.battery_level = static_cast<uint8_t>(m_battery_level[i]);
+        if(dt>0.0001){
+            double jerk_per_second = (m_acceleration[i] - m_prev_accel[i])/dt;
+            p.jerk = static_cast<int16_t>(clamp(jerk_per_second * 100.0, -32768.0, 32767.0));
+        }
+        else p.jerk = 0;
+        p.flags = 0;
+        if(p.temp>115) p.flags |= Flags::OVERHEAT;
+        if(p.battery_level<20) p.flags |= Flags::LOW_BATTERY;
+        if(m_acceleration[i]<-5.0) p.flags |= Flags::ABS_ACTIVE;
+
+        if(m_remote_kill[i]) p.flags |= Flags::REMOTE_KILL;
+
+        p.cpu_load = VehicleNoise::CPU_LOAD_BASE
+                   + CounterRng::Below(CounterRng::Bits(m_seed, m_id[i], m_ticks, CounterRng::CPU_LOAD), VehicleNoise::CPU_LOAD_SPAN);
+
+        p.reserved[0] = 0;
+        p.reserved[1] = 1;
+    }
+}
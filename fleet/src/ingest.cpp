@@ -0,0 +1,215 @@
+#include "../include/ingest.h"
+#include "../include/batch_frame.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+const int IDLE_US = 200;            // Decode thread nap when the queue is empty
+const size_t MAX_LINE = 192;        // Longest line LineProtocolSink can produce
+
+Ingestor::Ingestor(const IngestOptions& options)
+    : m_options(options),
+      m_ring(std::max<size_t>(options.queue_records, 1), options.overflow),
+      m_scratch(std::max<size_t>(options.batch_records, 1) * Packet::SIZE),
+      m_batch(std::max<size_t>(options.batch_records, 1)),
+      m_max_age(std::chrono::milliseconds(options.max_batch_age_ms)) {}
+
+Ingestor::~Ingestor(){
+    Stop();
+}
+
+void Ingestor::AddSink(IngestSink& sink){
+    m_sinks.emplace_back(&sink);
+}
+
+void Ingestor::Push(const uint8_t* record){
+    if(m_ring.Push(record)) SingleWriter::Bump(m_stats.queued);
+}
+
+void Ingestor::OnMessage(const uint8_t* payload, size_t len){
+    SingleWriter::Bump(m_stats.messages);
+    SingleWriter::Bump(m_stats.payload_bytes, len);
+    // A lone packet is told apart from a frame by its size and magic; whether
+    // it is any good is the decode thread's job
+    if(len==Packet::SIZE && ((payload[0] << 8) | payload[1])==Packet::MAGIC){
+        SingleWriter::Bump(m_stats.records);
+        Push(payload);
+        return;
+    }
+    BatchView view;
+    if(BatchView::Parse(payload, len, view)!=BatchError::OK){
+        SingleWriter::Bump(m_stats.bad_payloads);
+        return;
+    }
+    SingleWriter::Bump(m_stats.records, view.Count());
+    for(size_t i=0; i<view.Count(); i++) Push(view.Record(i));
+}
+
+size_t Ingestor::Pump(){
+    size_t n = m_ring.Pop(m_scratch.data(), m_batch.Room());
+    auto now = std::chrono::steady_clock::now();
+    if(n>0){
+        size_t before = m_batch.count;
+        uint64_t rejected = 0;
+        PacketDecode::DecodeValid(m_scratch.data(), n, m_batch, &rejected);
+        if(rejected) SingleWriter::Bump(m_stats.rejected, rejected);
+        SingleWriter::Bump(m_stats.decoded, m_batch.count - before);
+        if(before==0) m_oldest = now;
+    }
+    if(m_batch.count>0 && (m_batch.Room()==0 || now - m_oldest >= m_max_age)) Deliver();
+    return n;
+}
+
+void Ingestor::Deliver(){
+    if(m_batch.count==0) return;
+    for(SinkEntry& entry : m_sinks){
+        if(entry.sink->Consume(m_batch)) SingleWriter::Bump(entry.records, m_batch.count);
+        else SingleWriter::Bump(entry.dropped, m_batch.count);
+    }
+    SingleWriter::Bump(m_stats.batches);
+    m_batch.Clear();
+}
+
+void Ingestor::Start(){
+    if(m_running.exchange(true)) return;
+    m_thread = std::thread([this]{
+        while(m_running.load(std::memory_order_acquire)){
+            if(Pump()==0) std::this_thread::sleep_for(std::chrono::microseconds(IDLE_US));
+        }
+    });
+}
+
+void Ingestor::Stop(){
+    if(m_running.exchange(false)) m_thread.join();
+    if(m_stopped) return;
+    m_stopped = true;
+    m_ring.Close();
+    while(Pump()>0) {}
+    Deliver();
+    for(SinkEntry& entry : m_sinks) entry.sink->Flush();
+}
+
+void Ingestor::Report(std::ostream& os) const {
+    const IngestStats& s = m_stats;
+    os<<"Received "<<s.messages.load()<<" payloads ("<<s.payload_bytes.load()<<" bytes), "
+      <<s.records.load()<<" records\n"
+      <<"Decoded "<<s.decoded.load()<<" records in "<<s.batches.load()<<" batches\n"
+      <<"Dropped: "<<s.bad_payloads.load()<<" bad payloads, "
+      <<QueueDropped()<<" records on a full queue, "
+      <<s.rejected.load()<<" records failed validation\n";
+    for(const SinkEntry& entry : m_sinks){
+        os<<"Sink "<<entry.sink->Name()<<": "<<entry.records.load()<<" records";
+        if(entry.dropped.load()) os<<", "<<entry.dropped.load()<<" dropped";
+        os<<"\n";
+    }
+}
+
+VehicleStatsSink::VehicleStatsSink() : m_count(65536, 0), m_last_seq(65536, 0) {}
+
+bool VehicleStatsSink::Consume(const PacketBatch& batch){
+    const uint16_t* ids = batch.vehicle_id.data();
+    const uint32_t* seqs = batch.sequence_id.data();
+    const uint8_t* flags = batch.flags.data();
+    for(size_t i=0; i<batch.count; i++){
+        uint16_t id = ids[i];
+        uint32_t seq = seqs[i];
+        if(m_count[id]++==0){
+            m_vehicles++;
+            m_last_seq[id] = seq;
+        }
+        else if(seq>m_last_seq[id]){
+            m_gaps += seq - m_last_seq[id] - 1;
+            m_last_seq[id] = seq;
+        }
+        else m_late++;
+        m_alerts += flags[i]!=0;
+    }
+    m_records += batch.count;
+    return true;
+}
+
+void VehicleStatsSink::Report(std::ostream& os) const {
+    os<<m_vehicles<<" vehicles, "<<m_records<<" records, "<<m_gaps<<" sequence ids missing, "
+      <<m_late<<" late or duplicate, "<<m_alerts<<" with alert flags\n";
+    if(m_vehicles==0) return;
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for(uint64_t c : m_count){
+        if(!c) continue;
+        lo = std::min(lo, c);
+        hi = std::max(hi, c);
+    }
+    os<<"Records per vehicle: min "<<lo<<", max "<<hi<<", mean "
+      <<std::fixed<<std::setprecision(1)<<(double)m_records/m_vehicles<<"\n";
+}
+
+// Decimal digits of v at p, returns the end
+static char* PutUint(char* p, uint64_t v){
+    char tmp[20];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while(v);
+    while(n) *p++ = tmp[--n];
+    return p;
+}
+
+static char* PutInt(char* p, int64_t v){
+    if(v<0){
+        *p++ = '-';
+        return PutUint(p, (uint64_t)0 - (uint64_t)v);
+    }
+    return PutUint(p, (uint64_t)v);
+}
+
+static char* PutText(char* p, const char* text, size_t len){
+    std::memcpy(p, text, len);
+    return p + len;
+}
+
+#define PUT_TEXT(p, literal) PutText(p, literal, sizeof(literal) - 1)
+
+LineProtocolSink::LineProtocolSink(std::FILE* file, size_t buffer_bytes)
+    : m_file(file), m_buffer(std::max(buffer_bytes, MAX_LINE)) {}
+
+bool LineProtocolSink::Consume(const PacketBatch& batch){
+    if(m_failed) return false;
+    for(size_t i=0; i<batch.count; i++){
+        if(m_buffer.size() - m_used < MAX_LINE && !WriteOut()) return false;
+        char* p = m_buffer.data() + m_used;
+        p = PUT_TEXT(p, "vehicle_status,vehicle_id=");
+        p = PutUint(p, batch.vehicle_id[i]);
+        p = PUT_TEXT(p, " speed=");
+        p = PutUint(p, batch.speed[i]);
+        p = PUT_TEXT(p, "u,rpm=");
+        p = PutUint(p, batch.rpm[i]);
+        p = PUT_TEXT(p, "u,jerk=");
+        p = PutInt(p, batch.jerk[i]);
+        p = PUT_TEXT(p, "i,temp=");
+        p = PutUint(p, batch.temp[i]);
+        p = PUT_TEXT(p, "u,battery=");
+        p = PutUint(p, batch.battery_level[i]);
+        p = PUT_TEXT(p, "u,gear=");
+        p = PutUint(p, batch.gear[i]);
+        p = PUT_TEXT(p, "u,flags=");
+        p = PutUint(p, batch.flags[i]);
+        p = PUT_TEXT(p, "u ");
+        p = PutUint(p, batch.timestamp[i] * 1000000ull);
+        *p++ = '\n';
+        m_used = (size_t)(p - m_buffer.data());
+    }
+    m_lines += batch.count;
+    return true;
+}
+
+void LineProtocolSink::Flush(){
+    WriteOut();
+    if(!m_failed) std::fflush(m_file);
+}
+
+bool LineProtocolSink::WriteOut(){
+    if(m_failed) return false;
+    if(m_used>0 && std::fwrite(m_buffer.data(), 1, m_used, m_file)!=m_used) m_failed = true;
+    else m_bytes += m_used;
+    m_used = 0;
+    return !m_failed;
+}
+
+#undef PUT_TEXT
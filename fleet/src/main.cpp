@@ -1,4 +1,5 @@
 #include <iostream>
+#include <iomanip>
 #include <thread>
 #include <chrono>
 #include <vector>
@@ -6,50 +7,194 @@
 #include <atomic>
 #include <cmath>
 #include <random>
+#include <deque>
 #include "../include/vehicle.h"
 #include "../include/packet.h"
 #include "../include/mqtt_forge.h"
+#include "../include/crc16.h"
+#include "../include/sim_clock.h"
+#include "../include/packet_ring.h"
+#include "../include/spool.h"
+#include "../include/command_router.h"
+#include "../include/metrics.h"
+#include "../include/event_log.h"
+#include "../include/scenario.h"
+#include "../include/recording.h"
 
-const double SIM_DT = 0.1;
+const double DEFAULT_RATE_HZ = 10.0;
+const size_t DEFAULT_RING_RECORDS = 4096;
+const size_t NET_BATCH = 64;            // Records the network thread takes per pop
+const int NET_IDLE_US = 1000;           // Network thread nap when the ring is empty
+const int RECONNECT_MS = 2000;
+const double DEFAULT_SPOOL_RATE = 5000; // Backlog records replayed per second after a reconnect
+const int SPOOL_SYNC_MS = 1000;         // msync interval while the spool is in use
+const int DRAIN_MS = 5000;              // Wait for outstanding PUBACKs at exit
 std::atomic<bool> g_running(true);
 
-enum DriverState {
-    CITY_CRUISE,
-    HIGHWAY_SPRINT,
-    PANIC_STOP,
-    IDLE,
-    BATTERY_STRESS
-};
-
-uint16_t CalculateCRC(const uint8_t *data, size_t length){
-    uint16_t crc = 0xFFFF;
-    for(size_t i=0; i<length; i++){
-        crc ^= (uint16_t)data[i] << 8;
-        for(int j=0; j<8; j++){
-            if(crc & 0x8000) crc = (crc<<1) ^ 0x1021;
-            else crc <<= 1;
-        }
+void signal_handler(int){
+    g_running = false;
+}
+
+// FNV-1a over every packet sent, equal digests mean identical streams
+uint64_t Digest(uint64_t h, const uint8_t* data, size_t len){
+    for(size_t i=0; i<len; i++){
+        h ^= data[i];
+        h *= 1099511628211ull;
     }
-    return crc;
+    return h;
 }
 
-void signal_handler(int){
-    g_running = false;
+void Usage(){
+    std::cerr<<"Usage: fleet_sim [vehicle_id] [--speed 1|N|max] [--rate HZ] [--overrun catch-up|skip]\n"
+             <<"                 [--seed N] [--ticks N] [--epoch ms] [--dry-run] [--histogram]\n"
+             <<"                 [--ring N] [--overflow drop-oldest|drop-newest|block]\n"
+             <<"                 [--spool PATH] [--spool-mb N] [--spool-rate N]\n"
+             <<"                 [--metrics PATH] [--metrics-port N] [--log PATH] [--quiet]\n"
+             <<"                 [--scenario PATH] [--record PATH]\n"
+             <<"  --speed   1 = real time (default), N = N times faster, max = as fast as possible\n"
+             <<"  --rate    telemetry (and physics) ticks per simulated second, default "<<DEFAULT_RATE_HZ<<"\n"
+             <<"  --overrun late ticks are run back to back (catch-up, default) or dropped (skip)\n"
+             <<"  --seed    fixes every random choice, same seed + same flags = same packets\n"
+             <<"  --ticks   stop after N ticks\n"
+             <<"  --epoch   virtual start time in ms (default: now, or 2024-01-01 when seeded or sped up)\n"
+             <<"  --dry-run generate and count packets without a broker\n"
+             <<"  --histogram print the full tick lateness histogram at exit\n"
+             <<"  --ring    records queued between the physics and the network thread (default "<<DEFAULT_RING_RECORDS<<")\n"
+             <<"  --overflow what a full queue does: drop-oldest (default), drop-newest, or block the physics\n"
+             <<"  --spool   keep telemetry in this file while the link is down and replay it after reconnecting\n"
+             <<"  --spool-mb size cap of the spool file, oldest records are overwritten (default "<<(Spooler::DEFAULT_MAX_BYTES>>20)<<")\n"
+             <<"  --spool-rate backlog records replayed per second next to live data (default "<<DEFAULT_SPOOL_RATE<<")\n"
+             <<"  --metrics rewrite this file with Prometheus-format counters and latencies every second\n"
+             <<"  --metrics-port serve the same text on http://127.0.0.1:N/metrics\n"
+             <<"  --log     append every event (status lines, commands, link changes) to this binary log, see fleet_log\n"
+             <<"  --quiet   don't echo events to the console\n"
+             <<"  --scenario drive by this scenario file instead of the built-in city/highway/idle mix\n"
+             <<"  --record  keep every packet sent in this recording, replay it with fleet_replay\n";
 }
 
 int main(int argc, char* argv[]) {
     signal(SIGINT, signal_handler);
     uint16_t vehicle_id = 101;
-    if(argc>1){
+    ClockMode mode = ClockMode::REALTIME;
+    double scale = 1.0;
+    double rate_hz = DEFAULT_RATE_HZ;
+    OverrunPolicy overrun = OverrunPolicy::CATCH_UP;
+    bool seeded = false, dry_run = false, histogram = false;
+    size_t ring_records = DEFAULT_RING_RECORDS;
+    RingOverflow overflow = RingOverflow::DROP_OLDEST;
+    std::string spool_path;
+    size_t spool_bytes = Spooler::DEFAULT_MAX_BYTES;
+    double spool_rate = DEFAULT_SPOOL_RATE;
+    std::string metrics_path;
+    int metrics_port = 0;
+    std::string log_path;
+    std::string scenario_path;
+    std::string record_path;
+    bool quiet = false;
+    uint32_t seed = 0;
+    uint64_t max_ticks = 0, epoch_ms = 0;
+    for(int a=1; a<argc; a++){
+        std::string arg = argv[a];
+        bool has_value = a+1<argc;
         try{
-            vehicle_id = static_cast<uint16_t>(std::stoi(argv[1]));
+            if(arg=="--speed" && has_value){
+                if(!SimClock::ParseSpeed(argv[++a], mode, scale)) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--rate" && has_value){
+                rate_hz = std::stod(argv[++a]);
+                if(!(rate_hz>0)) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--overrun" && has_value){
+                std::string policy = argv[++a];
+                if(policy=="catch-up") overrun = OverrunPolicy::CATCH_UP;
+                else if(policy=="skip") overrun = OverrunPolicy::SKIP;
+                else throw std::invalid_argument(arg);
+            }
+            else if(arg=="--seed" && has_value) { seed = (uint32_t)std::stoul(argv[++a]); seeded = true; }
+            else if(arg=="--ticks" && has_value) max_ticks = std::stoull(argv[++a]);
+            else if(arg=="--epoch" && has_value) epoch_ms = std::stoull(argv[++a]);
+            else if(arg=="--ring" && has_value){
+                ring_records = std::stoul(argv[++a]);
+                if(ring_records==0) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--overflow" && has_value){
+                std::string policy = argv[++a];
+                if(policy=="drop-oldest") overflow = RingOverflow::DROP_OLDEST;
+                else if(policy=="drop-newest") overflow = RingOverflow::DROP_NEWEST;
+                else if(policy=="block") overflow = RingOverflow::BLOCK;
+                else throw std::invalid_argument(arg);
+            }
+            else if(arg=="--spool" && has_value) spool_path = argv[++a];
+            else if(arg=="--spool-mb" && has_value){
+                double mb = std::stod(argv[++a]);
+                if(!(mb>0)) throw std::invalid_argument(arg);
+                spool_bytes = (size_t)(mb * (1 << 20));
+            }
+            else if(arg=="--spool-rate" && has_value){
+                spool_rate = std::stod(argv[++a]);
+                if(!(spool_rate>0)) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--metrics" && has_value) metrics_path = argv[++a];
+            else if(arg=="--metrics-port" && has_value){
+                metrics_port = std::stoi(argv[++a]);
+                if(metrics_port<=0 || metrics_port>65535) throw std::invalid_argument(arg);
+            }
+            else if(arg=="--log" && has_value) log_path = argv[++a];
+            else if(arg=="--scenario" && has_value) scenario_path = argv[++a];
+            else if(arg=="--record" && has_value) record_path = argv[++a];
+            else if(arg=="--quiet") quiet = true;
+            else if(arg=="--dry-run") dry_run = true;
+            else if(arg=="--histogram") histogram = true;
+            else if(arg.rfind("--", 0)==0) throw std::invalid_argument(arg);
+            else vehicle_id = static_cast<uint16_t>(std::stoi(arg));
         } catch(...){
+            if(arg.rfind("--", 0)==0){
+                Usage();
+                return 1;
+            }
             std::cerr<<"INVALID ID PROVIDED. Defaulting to 101\n";
         }
     }
+    Scenario loaded;
+    std::string scenario_error;
+    if(!scenario_path.empty() && !loaded.Load(scenario_path, scenario_error)){
+        std::cerr<<scenario_path<<": "<<scenario_error<<"\n";
+        return 1;
+    }
+    const Scenario& scenario = scenario_path.empty() ? Scenario::Builtin() : loaded;
+    RecordingWriter recorder;
+    if(!record_path.empty() && !recorder.Open(record_path)){
+        std::cerr<<"cannot create recording "<<record_path<<"\n";
+        return 1;
+    }
+
+    // Reproducible runs need a reproducible start time too
+    if(epoch_ms==0 && (seeded || mode!=ClockMode::REALTIME)) epoch_ms = SimClock::FIXED_EPOCH_MS;
+    const double sim_dt = 1.0 / rate_hz;
+    SimClock clock(sim_dt, mode, scale, epoch_ms, overrun);
+
     std::cout<<"----------------------DESMO FLEET: Vehicle: " << vehicle_id<< "--------------------\n";
+    if(mode!=ClockMode::REALTIME || seeded){
+        std::cout<<"Clock: "<<(mode==ClockMode::AFAP ? std::string("max") : std::to_string(scale) + "x")
+                 <<(seeded ? " | Seed: " + std::to_string(seed) : std::string())<<"\n";
+    }
+    // Recording only starts once an exporter is asking for it
+    MetricsExporter exporter(metrics_path, metrics_port);
+    if((!metrics_path.empty() || metrics_port>0) && !exporter.Start()){
+        std::cerr<<"cannot serve metrics on port "<<metrics_port<<"\n";
+        return 1;
+    }
+    // Everything after the banner goes through the event log, the drain
+    // thread does the formatting and the console writes
+    if(!EventLog::Start(log_path, quiet ? nullptr : &std::cout)){
+        std::cerr<<"cannot create log "<<log_path<<"\n";
+        return 1;
+    }
+
+    if(!seeded) seed = std::random_device{}();
     MqttForge uplink;
-    Vehicle car(vehicle_id);
+    Vehicle car(vehicle_id, seed);
+    ScenarioRunner driver(scenario, {vehicle_id}, seed);
 
     Packet packet{};
     packet.magic = 0xD350; // Desmo System ;)
@@ -57,139 +202,298 @@ int main(int argc, char* argv[]) {
 
     std::string client_id = "sim_client_" + std::to_string(vehicle_id);
     std::string topic = "fleet/"+std::to_string(vehicle_id)+"/telemetry";
-    std::string topic_cmd = "fleet/" + std::to_string(vehicle_id)+"/cmd";
+    std::string topic_cmd = CommandTopic::For(vehicle_id);
 
-    uplink.SetCallBack([&](std::string topic, const uint8_t* payload, int len){
-        if(topic==topic_cmd && len>0){
-            uint8_t opcode = payload[0];
-
-            if(opcode=='1') opcode = 0x01;
-            if(opcode=='2') opcode = 0x02;
-            if(opcode=='3') opcode = 0x03;
-
-            std::cout<<"\n[RX] COMMAND RECEIVED: "<<(int) opcode << "\n";
-            car.OnCommand(opcode);
+    // Commands arrive on the network thread, the physics picks them up on its next tick
+    std::atomic<int> pending_command(-1);
+    uplink.SetCallBack([&](std::string_view topic, const uint8_t* payload, size_t len){
+        uint16_t target = 0;
+        CommandTopic::Target kind = CommandTopic::Parse(topic, target);
+        bool mine = kind==CommandTopic::Target::BROADCAST || (kind==CommandTopic::Target::VEHICLE && target==vehicle_id);
+        if(mine && len>0){
+            uint8_t opcode = CommandTopic::Opcode(payload, len);
+            EventLog::Write(LogEvent::COMMAND_RX, vehicle_id, opcode);
+            pending_command.store(opcode, std::memory_order_release);
         }
     });
     
-    std::vector<uint8_t> buffer;
-    buffer.reserve(32);
+    // Encoded once, every publish only patches the packet id
+    PreparedPublish telemetry = uplink.Prepare(topic, 1);
+    uint8_t wire[32];
     uint32_t seq = 0;
 
-    std::random_device rd;
-    std::mt19937 rng(rd() + vehicle_id);
-    std::uniform_int_distribution<int> dice(0,99);
+    // Outage backlog, possibly left over from an earlier run that never got
+    // to deliver it. Only the network thread touches it once that starts.
+    Spool spool;
+    if(!spool_path.empty() && !dry_run){
+        if(!spool.Open(spool_path, spool_bytes)){
+            std::cerr<<"cannot open spool "<<spool_path<<"\n";
+            EventLog::Stop();
+            return 1;
+        }
+        std::cout<<"Spool: "<<spool_path<<", "<<spool.Capacity()<<" records";
+        if(spool.Recovered()) std::cout<<", "<<spool.Recovered()<<" recovered";
+        if(spool.Discarded()) std::cout<<", "<<spool.Discarded()<<" corrupt discarded";
+        std::cout<<"\n";
+    }
 
-    DriverState current_state = CITY_CRUISE;
-    int state_timer = 0;
+    // The simulation never touches the socket: serialized records go through
+    // the ring and this thread connects, publishes (QoS 1) and reconnects.
+    // A slow send or a full PUBACK window backs up the ring, not the physics.
+    // While the link is down records go to the spool (if any) and are
+    // replayed untouched after reconnecting, rate-limited and behind live data.
+    // A spooled record stays on disk until its PUBACK (and those of every
+    // spooled record before it) is in, so a crash never loses one the broker
+    // hasn't confirmed.
+    PacketRing ring(ring_records, overflow);
+    std::atomic<bool> sim_done(false);
+    uint64_t net_sent = 0, net_lost = 0, net_spooled = 0, net_replayed = 0;
+    std::thread network;
+    if(!dry_run) network = std::thread([&]{
+        using Steady = std::chrono::steady_clock;
+        uint8_t batch[NET_BATCH * PacketRing::RECORD_SIZE];
+        uint8_t backlog[NET_BATCH * PacketRing::RECORD_SIZE];
+        bool need_connect = true;
+        Steady::time_point retry_at = Steady::now();
+        Steady::time_point next_sync = retry_at;
+        Steady::time_point last_refill = retry_at;
+        double tokens = 0;
 
-    while(g_running){
-        if(!uplink.Connect("127.0.0.1", 1883, client_id)){
-            std::cout << "Connect Failed. Retrying";
-            Sleep(2000);
-            continue;
-        }
+        auto keep = [&](const uint8_t* record){
+            if(spool.IsOpen()) { spool.Append(record); net_spooled++; }
+            else net_lost++;
+        };
 
-        if(uplink.Subscribe(topic_cmd)) std::cout<<"Link Established, Listening on: "<<topic_cmd<<"\n";
-        else std::cout<<"Link Established. Telemetry System Active. Subscription Failed.\n";
-        
-        while(g_running){
-
-            // Driver Logic
-            if(state_timer++>100){
-                state_timer = 0;
-                int roll = dice(rng);
-                if(roll<2){
-                    current_state = PANIC_STOP;
-                    std::cout<<"\n[!] PANIC!! SLAMMING BRAKES! \n";
+        // Spooled records published and not yet consumed, oldest first, with
+        // whether their PUBACK came in
+        std::deque<std::pair<uint16_t, bool>> spool_unacked;
+        uint64_t spool_overwritten = spool.Overwritten();
+        uplink.SetAckCallBack([&](uint16_t pid){
+            for(auto& entry : spool_unacked){
+                if(entry.first==pid && !entry.second) { entry.second = true; break; }
+            }
+        });
+        auto settle = [&]{
+            // The size cap overwrote the oldest records, in flight or not
+            for(; spool_overwritten<spool.Overwritten(); spool_overwritten++){
+                if(!spool_unacked.empty()) spool_unacked.pop_front();
+            }
+            size_t acked = 0;
+            while(acked<spool_unacked.size() && spool_unacked[acked].second) acked++;
+            if(acked==0) return;
+            spool.Consume(acked);
+            spool_unacked.erase(spool_unacked.begin(), spool_unacked.begin() + acked);
+        };
+        auto link_lost = [&]{
+            EventLog::Write(LogEvent::LINK_LOST, vehicle_id);
+            need_connect = true;
+            retry_at = Steady::now();
+        };
+
+        while(true){
+            Steady::time_point now = Steady::now();
+            if(need_connect && now>=retry_at){
+                // Once the simulation is over, one last attempt to deliver the backlog
+                bool last_try = !g_running || sim_done.load(std::memory_order_acquire);
+                if(uplink.Connect("127.0.0.1", 1883, client_id)){
+                    need_connect = false;
+                    tokens = 0;
+                    last_refill = Steady::now();
+                    bool subscribed = uplink.Subscribe(topic_cmd) && uplink.Subscribe(std::string(CommandTopic::BROADCAST));
+                    EventLog::Write(LogEvent::LINK_UP, vehicle_id, subscribed);
+                    if(!spool.Empty()) EventLog::Write(LogEvent::SPOOL_REPLAY, vehicle_id, (int64_t)spool.Size());
                 }
-                else if(roll<22){
-                    current_state = HIGHWAY_SPRINT;
-                } 
-                else if(roll<70){
-                    current_state = CITY_CRUISE;
+                else {
+                    if(last_try) break;
+                    EventLog::Write(LogEvent::LINK_CONNECT_FAILED, vehicle_id);
+                    retry_at = Steady::now() + std::chrono::milliseconds(RECONNECT_MS);
                 }
+            }
+
+            // Live data first, the ring keeps draining while the link is down
+            size_t n = ring.Pop(batch, NET_BATCH);
+            for(size_t i=0; i<n; i++){
+                const uint8_t* record = batch + i*PacketRing::RECORD_SIZE;
+                if(need_connect) { keep(record); continue; }
+                // Publish to this with QOS1 (pipelined, PUBACKs are matched in Tick).
+                // One the window took before the link broke is replayed after
+                // the reconnect, only the rest goes to the spool.
+                uint16_t tracked = 0;
+                if(uplink.Publish(telemetry, record, PacketRing::RECORD_SIZE, &tracked)) net_sent++;
                 else {
-                    current_state = IDLE;
+                    link_lost();
+                    if(tracked) net_sent++;
+                    else keep(record);
                 }
             }
 
-            double throttle_input = 0.0;
-            switch(current_state){
-                case HIGHWAY_SPRINT:
-                    throttle_input = 1.0;
-                    break;
-                case CITY_CRUISE:
-                    throttle_input = (std::sin((seq+vehicle_id)*0.05)+1.0) / 2.0 * 0.6;
-                    break;
-                case PANIC_STOP:
-                    throttle_input = -1.0;
-                    break;
-                case IDLE:
-                    throttle_input = 0.0;
-                    break;
-                case BATTERY_STRESS:
-                    throttle_input = 1.0;
-                    break;
-            }
-            
-            // Pedal to the metal
-            car.SetThrottle(throttle_input);
-
-            // Physics
-            car.Tick(SIM_DT);
-            car.Snapshot(packet, SIM_DT);
-
-            // Metadata
-            packet.sequence_id = seq++;
-            auto now = std::chrono::system_clock::now();
-            packet.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now.time_since_epoch()
-            ).count();
-
-            // Serialization and checksum
-            packet.crc16 = 0;
-            packet.serialize(buffer);
-            uint16_t checksum = CalculateCRC(buffer.data(), 28);
-            buffer[28] = (checksum >> 8) & 0xFF;
-            buffer[29] = (checksum & 0xFF);
-
-            // Network Transmission
-            // Publish to this with QOS1
-            if(!uplink.Publish(topic, buffer, 0)){
-                std::cerr << "LINK LOST. Reconnecting..\n";
-                break;
+            // Then the backlog, at most spool_rate records/s. Records already
+            // in flight are skipped, the window retransmits them like any
+            // other QoS 1 publish and settle() consumes them once acked.
+            size_t replayed = 0;
+            if(!need_connect && !spool.Empty()){
+                now = Steady::now();
+                tokens += std::chrono::duration<double>(now - last_refill).count() * spool_rate;
+                last_refill = now;
+                double burst = spool_rate/10 > NET_BATCH ? spool_rate/10 : NET_BATCH;
+                if(tokens>burst) tokens = burst;
+                size_t want = tokens<NET_BATCH ? (size_t)tokens : NET_BATCH;
+                size_t k = spool.Peek(backlog, want, spool_unacked.size());
+                for(size_t i=0; i<k; i++){
+                    uint16_t tracked = 0;
+                    bool ok = uplink.Publish(telemetry, backlog + i*PacketRing::RECORD_SIZE, PacketRing::RECORD_SIZE, &tracked);
+                    if(tracked){
+                        spool_unacked.emplace_back(tracked, false);
+                        replayed++;
+                    }
+                    if(!ok){
+                        link_lost();
+                        break;
+                    }
+                }
+                tokens -= replayed;
+                net_replayed += replayed;
             }
 
             // Maintenance
             uplink.Tick();
+            if(!need_connect && !uplink.IsConnected()) link_lost();
+            settle();
+            Metrics::Set(Gauge::SPOOL_DEPTH, (int64_t)spool.Size());
+            if(spool.IsOpen() && Steady::now()>=next_sync){
+                spool.Sync();
+                next_sync = Steady::now() + std::chrono::milliseconds(SPOOL_SYNC_MS);
+            }
+            if(n==0 && replayed==0){
+                // What is still spooled at exit stays on disk for the next run
+                if(sim_done.load(std::memory_order_acquire) && ring.Empty() && (!need_connect || spool.IsOpen())) break;
+                std::this_thread::sleep_for(std::chrono::microseconds(NET_IDLE_US));
+            }
+        }
+        // Closing with PUBACKs outstanding would throw the unacked records away
+        Steady::time_point deadline = Steady::now() + std::chrono::milliseconds(DRAIN_MS);
+        while(uplink.IsConnected() && uplink.InFlight()>0 && Steady::now()<deadline){
+            uplink.Tick();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        settle();
+        uplink.Disconnect();
+        // Still unacked: spooled ones never left the spool, live ones go back in
+        uplink.TakeInflight([&](uint16_t pid, const uint8_t* payload, size_t len){
+            for(const auto& entry : spool_unacked){
+                if(entry.first==pid && !entry.second) return;
+            }
+            if(len!=PacketRing::RECORD_SIZE) return;
+            net_sent--;
+            keep(payload);
+        });
+        uint8_t rest[PacketRing::RECORD_SIZE];
+        while(ring.Pop(rest, 1)) keep(rest);
+        spool.Close();
+    });
 
-            if (seq % 10 == 0) {
-                std::string status = "";
-                if (packet.flags & Flags::ABS_ACTIVE) status = "[ABS ACTIVE]";
-                else if (packet.flags & Flags::OVERHEAT) status = "[!!! OVERHEAT !!!]";
-                else if (packet.flags & Flags::LOW_BATTERY) status = "[LOW BATTERY]";
-                
-                else if (current_state == HIGHWAY_SPRINT) status = "(SPRINT)";
-                else if (current_state == BATTERY_STRESS) status = "(STRESS TEST)";
-                else if (current_state == PANIC_STOP) status = "(BRAKING)";
-                std::cout << "TX Seq:" << seq 
-                        << " | RPM:" << packet.rpm 
-                        << " | Spd:" << packet.speed << " km/h"
-                        << " | " << status
-                        << "   \r" << std::flush;
-            }
-
-            // Pacing
-            Sleep(100);
+    uint64_t digest = 14695981039346656037ull;
 
+    // Status line about 1/s of wall time whatever the speed
+    uint32_t status_every = mode==ClockMode::AFAP ? 100000 : (uint32_t)std::ceil(rate_hz*scale);
+
+    while(g_running && (max_ticks==0 || clock.Ticks()<max_ticks)){
+        uint64_t tick_start = Metrics::On() ? Metrics::NowNs() : 0;
+        int command = pending_command.exchange(-1, std::memory_order_acquire);
+        if(command>=0) car.OnCommand((uint8_t)command);
+
+        // Driver Logic, on virtual time
+        double throttle_input = 0.0;
+        driver.Step(clock.Seconds(), &throttle_input);
+        for(const auto& change : driver.EventChanges()){
+            EventLog::Write(LogEvent::SCENARIO_EVENT, vehicle_id, (int64_t)change.first, change.second ? 1 : 0);
         }
+        if(driver.Alerted(0)) EventLog::Write(LogEvent::DRIVER_PANIC, vehicle_id);
 
-    }
+        // Pedal to the metal
+        car.SetThrottle(throttle_input);
 
-    uplink.Disconnect();
-    return 0;
+        // Physics
+        car.Tick(sim_dt);
+        car.Snapshot(packet, sim_dt);
+
+        // Metadata
+        packet.sequence_id = seq++;
+        packet.timestamp = clock.NowMs();
+
+        // Serialization and checksum
+        packet.crc16 = 0;
+        packet.serialize(wire);
+        uint16_t checksum = CalculateCRC(wire, 28);
+        wire[28] = (checksum >> 8) & 0xFF;
+        wire[29] = (checksum & 0xFF);
+        digest = Digest(digest, wire, sizeof(wire));
+        if(recorder.IsOpen()) recorder.Append(wire);
+
+        // Network Transmission, handed to the network thread
+        if(!dry_run) ring.Push(wire);
+
+        if (seq % status_every == 0) {
+            StatusTag status = StatusTag::NONE;
+            if (packet.flags & Flags::ABS_ACTIVE) status = StatusTag::ABS;
+            else if (packet.flags & Flags::OVERHEAT) status = StatusTag::OVERHEAT;
+            else if (packet.flags & Flags::LOW_BATTERY) status = StatusTag::LOW_BATTERY;
+            else status = driver.Tag(0);
+            int64_t sim_s = mode!=ClockMode::REALTIME ? (int64_t)clock.Seconds() : -1;
+            int64_t queue = dry_run ? -1 : (int64_t)((uint64_t)ring.Size() << 32 | (uint32_t)ring.Capacity());
+            EventLog::Write(LogEvent::STATUS, vehicle_id, seq, packet.rpm, packet.speed, (int64_t)status, sim_s, queue);
+        }
+
+        if(tick_start){
+            Metrics::Record(Latency::SIM_TICK, Metrics::NowNs() - tick_start);
+            Metrics::Add(Counter::SIM_TICKS);
+            Metrics::Set(Gauge::RING_DEPTH, (int64_t)ring.Size());
+            if(clock.Pacer()) Metrics::Set(Gauge::TICK_OVERRUNS, (int64_t)clock.Pacer()->Overruns());
+        }
 
+        // Pacing, absolute deadlines on the virtual clock. Ticks the pacer
+        // skipped after an overrun still move the physics, just unreported.
+        uint64_t periods = clock.Tick();
+        if(periods>1) Metrics::Add(Counter::TICKS_SKIPPED, periods - 1);
+        for(; periods>1; periods--) car.Tick(sim_dt);
 
+    }
+
+    // The network thread delivers what is still queued, then disconnects.
+    // Simulation speed is measured before that wait.
+    double wall = clock.WallSeconds();
+    sim_done.store(true, std::memory_order_release);
+    ring.Close();
+    if(network.joinable()) network.join();
+    exporter.Stop();
+    uint64_t log_dropped = EventLog::Stop();
+    bool recorded = recorder.Close();
+    double drain = clock.WallSeconds() - wall;
+    std::cout << std::fixed << std::setprecision(1)
+              << "\nSimulated " << clock.Seconds() << " s in " << wall << " s wall ("
+              << (wall>0 ? clock.Seconds()/wall : 0) << "x), " << seq << " packets, "
+              << (wall>0 ? seq/wall : 0) << " pkt/s sustained\n";
+    std::cout << "Stream digest: " << std::hex << digest << std::dec << "\n";
+    if(!dry_run){
+        std::cout << "Queue: " << ring.Pushed() << " in, " << net_sent << " published, "
+                  << net_lost << " lost on link drops, " << ring.DroppedOldest() + ring.DroppedNewest()
+                  << " dropped on overflow, " << ring.Blocked() << " blocked pushes, high water "
+                  << ring.HighWater() << "/" << ring.Capacity() << ", " << drain << " s to drain at exit\n";
+        if(!spool_path.empty()){
+            std::cout << "Spool: " << net_spooled << " stored during outages, " << net_replayed << " replayed, "
+                      << spool.Overwritten() << " overwritten at the size cap, " << spool.Size() << " left in "
+                      << spool_path << "\n";
+        }
+    }
+    if(!record_path.empty()){
+        std::cout << "Recording: " << recorder.Records() << " records in " << recorder.Blocks() << " blocks, "
+                  << recorder.Bytes() << " bytes" << (recorded ? "" : ", WRITE FAILED") << " in " << record_path << "\n";
+    }
+    if(log_dropped) std::cout << "Log: " << log_dropped << " events dropped on a full ring\n";
+    if(clock.Pacer()){
+        clock.Pacer()->Report(std::cout);
+        if(histogram) clock.Pacer()->Lateness().Print(std::cout, 1e3, " us");
+    }
+    return 0;
 }
 
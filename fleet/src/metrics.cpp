@@ -0,0 +1,193 @@
+#include "../include/metrics.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+#endif
+
+struct MetricInfo {
+    const char* name;
+    const char* help;
+};
+
+// Same order as the enums in metrics.h
+static const MetricInfo COUNTERS[] = {
+    {"fleet_vehicle_ticks", "Vehicle::Tick calls"},
+    {"fleet_sim_ticks", "Simulation loop ticks"},
+    {"fleet_ticks_skipped", "Paced ticks dropped after an overrun"},
+    {"fleet_mqtt_publishes", "MQTT publishes written"},
+    {"fleet_mqtt_publish_bytes", "Payload bytes published"},
+    {"fleet_mqtt_publish_failures", "Publishes refused (dead link, full window or backlog)"},
+    {"fleet_mqtt_send_calls", "SendAll calls"},
+    {"fleet_mqtt_send_bytes", "Bytes the kernel took immediately"},
+    {"fleet_mqtt_tx_queued_bytes", "Bytes parked in the transmit backlog"},
+    {"fleet_mqtt_pubacks", "PUBACKs matched to an in-flight publish"},
+    {"fleet_mqtt_retransmits", "QoS 1 publishes sent again"},
+    {"fleet_mqtt_pings", "PINGREQs sent"},
+    {"fleet_mqtt_connects", "Sessions accepted by the broker"},
+    {"fleet_mqtt_link_drops", "Connected sessions lost"},
+};
+
+static const MetricInfo GAUGES[] = {
+    {"fleet_ring_depth", "Records queued between the simulation and the network thread"},
+    {"fleet_spool_depth", "Records waiting in the outage spool"},
+    {"fleet_tick_overruns", "Ticks that started after a later deadline had passed"},
+};
+
+static const MetricInfo LATENCIES[] = {
+    {"fleet_vehicle_tick_seconds", "Vehicle::Tick duration"},
+    {"fleet_sim_tick_seconds", "Simulation tick work, wake-up to the next wait"},
+    {"fleet_mqtt_publish_seconds", "MqttForge::Publish call duration"},
+    {"fleet_mqtt_puback_rtt_seconds", "QoS 1 publish to PUBACK"},
+};
+
+static_assert(sizeof(COUNTERS)/sizeof(COUNTERS[0])==(size_t)Counter::COUNT, "Counter names out of date");
+static_assert(sizeof(GAUGES)/sizeof(GAUGES[0])==(size_t)Gauge::COUNT, "Gauge names out of date");
+static_assert(sizeof(LATENCIES)/sizeof(LATENCIES[0])==(size_t)Latency::COUNT, "Latency names out of date");
+
+const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+const int ACCEPT_POLL_MS = 100;
+
+MetricsSnapshot Metrics::Snapshot(){
+    MetricsSnapshot snap;
+    Registry& r = Global();
+    std::lock_guard<std::mutex> guard(r.lock); // Only keeps new threads from registering meanwhile
+    for(const auto& t : r.threads){
+        for(size_t c=0; c<(size_t)Counter::COUNT; c++) snap.counters[c] += t->counters[c].load(std::memory_order_relaxed);
+        for(size_t l=0; l<(size_t)Latency::COUNT; l++) t->latency[l].AddTo(snap.latency[l]);
+    }
+    for(size_t g=0; g<(size_t)Gauge::COUNT; g++) snap.gauges[g] = r.gauges[g].load(std::memory_order_relaxed);
+    snap.threads = r.threads.size();
+    return snap;
+}
+
+void Metrics::WritePrometheus(std::ostream& os, const MetricsSnapshot& snap){
+    for(size_t c=0; c<(size_t)Counter::COUNT; c++){
+        os << "# HELP " << COUNTERS[c].name << "_total " << COUNTERS[c].help << "\n"
+           << "# TYPE " << COUNTERS[c].name << "_total counter\n"
+           << COUNTERS[c].name << "_total " << snap.counters[c] << "\n";
+    }
+    for(size_t g=0; g<(size_t)Gauge::COUNT; g++){
+        os << "# HELP " << GAUGES[g].name << " " << GAUGES[g].help << "\n"
+           << "# TYPE " << GAUGES[g].name << " gauge\n"
+           << GAUGES[g].name << " " << snap.gauges[g] << "\n";
+    }
+    for(size_t l=0; l<(size_t)Latency::COUNT; l++){
+        const Histogram& h = snap.latency[l];
+        const char* name = LATENCIES[l].name;
+        os << "# HELP " << name << " " << LATENCIES[l].help << "\n"
+           << "# TYPE " << name << " summary\n";
+        for(double q : QUANTILES) os << name << "{quantile=\"" << q << "\"} " << h.Percentile(q) * 1e-9 << "\n";
+        os << name << "_sum " << h.Sum() * 1e-9 << "\n"
+           << name << "_count " << h.Count() << "\n";
+    }
+}
+
+MetricsExporter::MetricsExporter(std::string path, int port, int interval_ms)
+    : m_path(std::move(path)), m_port(port), m_interval_ms(interval_ms>0 ? interval_ms : 1000) {}
+
+MetricsExporter::~MetricsExporter(){
+    Stop();
+}
+
+bool MetricsExporter::Start(){
+    if(m_thread) return true;
+#if defined(__linux__)
+    if(m_port>0){
+        m_listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(m_listen<0) return false;
+        int one = 1;
+        setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(m_port);
+        if(bind(m_listen, (sockaddr*)&addr, sizeof(addr))<0 || listen(m_listen, 16)<0){
+            close(m_listen);
+            m_listen = -1;
+            return false;
+        }
+    }
+#else
+    if(m_port>0) return false;
+#endif
+    Metrics::Enable(true);
+    m_running = true;
+    m_thread.reset(new std::thread([this]{ Run(); }));
+    return true;
+}
+
+void MetricsExporter::Stop(){
+    if(!m_thread) return;
+    m_running = false;
+    m_thread->join();
+    m_thread.reset();
+    if(!m_path.empty()) WriteFile();
+#if defined(__linux__)
+    if(m_listen>=0) close(m_listen);
+    m_listen = -1;
+#endif
+}
+
+void MetricsExporter::Run(){
+    auto next_write = std::chrono::steady_clock::now();
+    while(m_running){
+        auto now = std::chrono::steady_clock::now();
+        if(!m_path.empty() && now>=next_write){
+            WriteFile();
+            next_write = now + std::chrono::milliseconds(m_interval_ms);
+        }
+#if defined(__linux__)
+        if(m_listen>=0){
+            pollfd pfd{m_listen, POLLIN, 0};
+            if(poll(&pfd, 1, ACCEPT_POLL_MS)>0) Serve();
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_POLL_MS));
+    }
+}
+
+// Readers never see a half-written file
+bool MetricsExporter::WriteFile(){
+    std::string tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if(!out) return false;
+        Metrics::WritePrometheus(out, Metrics::Snapshot());
+        if(!out) return false;
+    }
+    return std::rename(tmp.c_str(), m_path.c_str())==0;
+}
+
+// One request per connection, whatever the path: the scrape target is the page
+void MetricsExporter::Serve(){
+#if defined(__linux__)
+    int fd = accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+    if(fd<0) return;
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    char request[1024];
+    if(recv(fd, request, sizeof(request), 0)>0){
+        std::ostringstream body;
+        Metrics::WritePrometheus(body, Metrics::Snapshot());
+        std::string text = body.str();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                             + std::to_string(text.size()) + "\r\nConnection: close\r\n\r\n" + text;
+        size_t sent = 0;
+        while(sent<response.size()){
+            ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if(n<=0) break;
+            sent += n;
+        }
+    }
+    close(fd);
+#endif
+}
@@ -0,0 +1,480 @@
+#include "../include/mini_broker.h"
+
+#if defined(__linux__)
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "../include/mqtt_protocol.h"
+#include "../include/packet.h"
+#include "../include/batch_frame.h"
+
+const size_t READ_CHUNK = 64 * 1024;
+const size_t MAX_SESSION_BACKLOG = 8 << 20; // Unsent bytes before a subscriber counts as stuck
+const int64_t ACCEPT_BACKOFF_MS = 100;      // Listener pause after running out of fds
+
+class MiniBroker::Acceptor : public IoHandler {
+    MiniBroker& m_broker;
+public:
+    explicit Acceptor(MiniBroker& broker) : m_broker(broker) {}
+    void OnIoEvent(uint32_t) override { m_broker.Accept(); }
+};
+
+class MiniBroker::Session : public IoHandler {
+public:
+    MiniBroker& broker;
+    int fd;
+    uint64_t id;
+    bool connected = false;   // CONNECT seen
+    bool dead = false;
+    std::vector<uint8_t> rx;
+    std::vector<uint8_t> tx;
+    size_t tx_head = 0;
+    bool want_write = false;
+    std::vector<std::string_view> filters;
+
+    Session(MiniBroker& b, int f, uint64_t i) : broker(b), fd(f), id(i) {}
+
+    void Send(const uint8_t* data, size_t len){
+        if(dead) return;
+        size_t sent = 0;
+        if(tx_head==tx.size()){
+            while(sent<len){
+                long n = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+                if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) break;
+                if(n<=0) { broker.Close(*this); return; }
+                sent += n;
+            }
+        }
+        if(sent==len) return;
+        if(tx.size() - tx_head + (len - sent) > MAX_SESSION_BACKLOG) { broker.Close(*this); return; }
+        tx.insert(tx.end(), data + sent, data + len);
+        WantWrite(true);
+    }
+
+    void WantWrite(bool on){
+        if(want_write==on) return;
+        want_write = on;
+        broker.m_loop.Modify(fd, on ? EPOLLIN | EPOLLOUT : EPOLLIN, this);
+    }
+
+    void Flush(){
+        while(tx_head<tx.size()){
+            long n = send(fd, tx.data() + tx_head, tx.size() - tx_head, MSG_NOSIGNAL);
+            if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) return;
+            if(n<=0) { broker.Close(*this); return; }
+            tx_head += n;
+        }
+        tx.clear();
+        tx_head = 0;
+        WantWrite(false);
+    }
+
+    void OnIoEvent(uint32_t events) override {
+        if(dead) return;
+        if(events & EPOLLOUT) Flush();
+        if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)) Read();
+    }
+
+    void Read(){
+        while(!dead){
+            size_t old = rx.size();
+            rx.resize(old + READ_CHUNK);
+            long n = recv(fd, rx.data() + old, READ_CHUNK, 0);
+            rx.resize(old + (n>0 ? n : 0));
+            if(n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) break;
+            if(n<=0) { broker.Close(*this); return; }
+            if((size_t)n<READ_CHUNK) break;
+        }
+        Frames();
+    }
+
+    // Handles every complete frame at the front of rx
+    void Frames(){
+        size_t pos = 0;
+        while(!dead && pos+2<=rx.size()){
+            size_t i = pos + 1;
+            size_t len = 0, mult = 1;
+            bool complete = false;
+            while(i<rx.size() && i<pos+5){
+                uint8_t b = rx[i++];
+                len += (b & 127) * mult;
+                mult *= 128;
+                if(!(b & 128)) { complete = true; break; }
+            }
+            if(!complete){
+                if(i>=pos+5) { Fail(); return; } // Length longer than 4 bytes
+                break;
+            }
+            if(rx.size()-i < len) break;
+            Handle(rx[pos], rx.data() + i, len);
+            pos = i + len;
+        }
+        if(dead) return;
+        rx.erase(rx.begin(), rx.begin() + pos);
+    }
+
+    void Fail(){
+        broker.m_stats.protocol_errors.fetch_add(1, std::memory_order_relaxed);
+        broker.Close(*this);
+    }
+
+    void Handle(uint8_t header, const uint8_t* body, size_t len){
+        uint8_t type = header & 0xF0;
+        if(!connected && type!=PACKET_CONNECT) { Fail(); return; }
+        switch(type){
+            case PACKET_CONNECT: {
+                // Protocol name "MQTT", level 4 (3.1.1)
+                if(connected || len<10 || body[1]!=4 || std::memcmp(body+2, "MQTT", 4)!=0) { Fail(); return; }
+                if(body[6]!=4){
+                    const uint8_t refuse[4] = {PACKET_CONNACK, 2, 0, 1}; // Unacceptable protocol level
+                    Send(refuse, 4);
+                    broker.Close(*this);
+                    return;
+                }
+                connected = true;
+                const uint8_t ack[4] = {PACKET_CONNACK, 2, 0, 0};
+                Send(ack, 4);
+                return;
+            }
+            case PACKET_PUBLISH:
+                broker.OnPublish(*this, header, body, len);
+                return;
+            case PACKET_SUBSCRIBE & 0xF0:
+                broker.OnSubscribe(*this, body, len);
+                return;
+            case PACKET_PINGREQ: {
+                const uint8_t pong[2] = {PACKET_PINGRESP, 0};
+                Send(pong, 2);
+                return;
+            }
+            case PACKET_DISCONNECT:
+                broker.Close(*this);
+                return;
+            default:
+                return; // PUBACK for forwarded messages never happens, they go out at QoS 0
+        }
+    }
+};
+
+MiniBroker::MiniBroker(const BrokerOptions& options)
+    : m_options(options), m_loop(4096), m_rng(options.seed ? options.seed : 1) {
+    if(m_options.decode) m_per_vehicle.assign(65536, 0);
+}
+
+MiniBroker::~MiniBroker(){
+    for(auto& entry : m_sessions) close(entry.second->fd);
+    if(m_listen>=0) close(m_listen);
+}
+
+bool MiniBroker::Start(){
+    if(!m_loop.Valid()) return false;
+    m_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_listen<0) return false;
+    int one = 1;
+    setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(m_options.bind_ip.c_str());
+    addr.sin_port = htons(m_options.port);
+    socklen_t alen = sizeof(addr);
+    if(bind(m_listen, (sockaddr*)&addr, sizeof(addr))<0 || listen(m_listen, 4096)<0
+       || getsockname(m_listen, (sockaddr*)&addr, &alen)<0) return false;
+    m_port = ntohs(addr.sin_port);
+
+    m_acceptor.reset(new Acceptor(*this));
+    return m_loop.Add(m_listen, EPOLLIN, m_acceptor.get());
+}
+
+void MiniBroker::Accept(){
+    while(true){
+        int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd<0){
+            // The listener stays readable while out of fds, level-triggered
+            // epoll would hand it straight back: park it for a while instead
+            if(errno==EMFILE || errno==ENFILE || errno==ENOBUFS || errno==ENOMEM) PauseAccept();
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        uint64_t id = m_next_id++;
+        Session* s = new Session(*this, fd, id);
+        m_sessions[id].reset(s);
+        m_stats.accepted.fetch_add(1, std::memory_order_relaxed);
+        m_stats.connections.fetch_add(1, std::memory_order_relaxed);
+        if(!m_loop.Add(fd, EPOLLIN, s)) Close(*s);
+    }
+}
+
+void MiniBroker::PauseAccept(){
+    if(m_accept_paused_until) return;
+    m_accept_paused_until = NowMs() + ACCEPT_BACKOFF_MS;
+    m_loop.Modify(m_listen, 0, m_acceptor.get());
+}
+
+void MiniBroker::ResumeAccept(){
+    if(!m_accept_paused_until) return;
+    m_accept_paused_until = 0;
+    m_loop.Modify(m_listen, EPOLLIN, m_acceptor.get());
+}
+
+int64_t MiniBroker::NowMs(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MiniBroker::Poll(int timeout_ms){
+    if(!m_delayed.empty()){
+        int64_t left = m_delayed.front().due_ms - NowMs();
+        if(left<0) left = 0;
+        if(timeout_ms<0 || left<timeout_ms) timeout_ms = (int)left;
+    }
+    if(m_accept_paused_until){
+        int64_t left = m_accept_paused_until - NowMs();
+        if(left<0) left = 0;
+        if(timeout_ms<0 || left<timeout_ms) timeout_ms = (int)left;
+    }
+    m_loop.Poll(timeout_ms);
+    if(!m_delayed.empty()) FlushDelayedAcks(NowMs());
+    // A closed session frees an fd, otherwise retry once the backoff is over
+    if(m_accept_paused_until && (!m_dead.empty() || NowMs()>=m_accept_paused_until)) ResumeAccept();
+    Reap();
+}
+
+void MiniBroker::Run(const std::atomic<bool>& running){
+    while(running.load(std::memory_order_relaxed)) Poll(50);
+}
+
+void MiniBroker::OnPublish(Session& s, uint8_t header, const uint8_t* body, size_t len){
+    int qos = (header >> 1) & 3;
+    if(qos>1 || len<2) { s.Fail(); return; }
+    size_t topic_len = ((size_t)body[0] << 8) | body[1];
+    size_t offset = 2 + topic_len + (qos ? 2 : 0);
+    if(offset>len) { s.Fail(); return; }
+
+    m_stats.publishes.fetch_add(1, std::memory_order_relaxed);
+    m_stats.payload_bytes.fetch_add(len - offset, std::memory_order_relaxed);
+    if(header & 0x08) m_stats.duplicates.fetch_add(1, std::memory_order_relaxed);
+
+    if(qos==1){
+        m_stats.publishes_qos1.fetch_add(1, std::memory_order_relaxed);
+        uint16_t pid = (uint16_t)((body[2+topic_len] << 8) | body[3+topic_len]);
+        if(DropAck()) m_stats.acks_dropped.fetch_add(1, std::memory_order_relaxed);
+        else if(m_options.ack_delay_ms>0) m_delayed.push_back({NowMs() + m_options.ack_delay_ms, s.id, pid});
+        else Ack(s.id, pid);
+    }
+
+    if(m_options.decode) Decode(body + offset, len - offset);
+    if(!m_exact.empty() || !m_wildcard.empty()){
+        Forward(std::string_view((const char*)body + 2, topic_len), body + offset, len - offset);
+    }
+}
+
+void MiniBroker::Decode(const uint8_t* payload, size_t len){
+    Packet p;
+    if(len==Packet::SIZE){
+        if(Packet::parse(payload, len, p)==PacketError::OK){
+            m_per_vehicle[p.vehicle_id]++;
+            m_stats.packets.fetch_add(1, std::memory_order_relaxed);
+        }
+        else m_stats.bad_packets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    BatchView batch;
+    if(BatchView::Parse(payload, len, batch)!=BatchError::OK){
+        m_stats.bad_packets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t good = 0;
+    for(size_t i=0; i<batch.Count(); i++){
+        if(Packet::parse(batch.Record(i), Packet::SIZE, p)!=PacketError::OK) continue;
+        m_per_vehicle[p.vehicle_id]++;
+        good++;
+    }
+    m_stats.packets.fetch_add(good, std::memory_order_relaxed);
+    m_stats.bad_packets.fetch_add(batch.Count() - good, std::memory_order_relaxed);
+}
+
+void MiniBroker::OnSubscribe(Session& s, const uint8_t* body, size_t len){
+    if(len<2) { s.Fail(); return; }
+    std::vector<uint8_t> ack = {PACKET_SUBACK, 0, body[0], body[1]};
+    size_t pos = 2;
+    while(pos+2<=len){
+        size_t n = ((size_t)body[pos] << 8) | body[pos+1];
+        if(pos+2+n+1>len) { s.Fail(); return; }
+        std::string_view filter((const char*)body + pos + 2, n);
+        pos += 2 + n + 1;
+
+        bool wildcard = filter.find_first_of("+#")!=std::string_view::npos;
+        std::string_view owned = Intern(filter);
+        if(wildcard) m_wildcard.emplace_back(owned, s.id);
+        else m_exact[owned].push_back(s.id);
+        s.filters.push_back(owned);
+        ack.push_back(0); // Granted QoS 0, forwarded copies go out at QoS 0
+    }
+    if(ack.size()==4) { s.Fail(); return; } // No topics
+    ack[1] = (uint8_t)(ack.size() - 2);
+    s.Send(ack.data(), ack.size());
+}
+
+// One copy of each filter string however many sessions hold it, so a load
+// test with reconnecting clients keeps a constant footprint
+std::string_view MiniBroker::Intern(std::string_view filter){
+    auto it = m_filters.find(std::string(filter));
+    if(it==m_filters.end()) it = m_filters.emplace(std::string(filter), 0).first;
+    it->second++;
+    return it->first;
+}
+
+void MiniBroker::Release(std::string_view filter){
+    auto it = m_filters.find(std::string(filter));
+    if(it!=m_filters.end() && --it->second==0) m_filters.erase(it);
+}
+
+// MQTT topic filter match: + is one level, # the rest (including none)
+bool MiniBroker::TopicMatches(std::string_view filter, std::string_view topic){
+    size_t f = 0, t = 0;
+    while(f<filter.size()){
+        if(filter[f]=='#') return true;
+        if(filter[f]=='+'){
+            while(t<topic.size() && topic[t]!='/') t++;
+            f++;
+        }
+        else {
+            if(t>=topic.size() || filter[f]!=topic[t]) {
+                // "a/#" also matches "a"
+                return t==topic.size() && filter.compare(f, std::string_view::npos, "/#")==0;
+            }
+            f++;
+            t++;
+        }
+    }
+    return t==topic.size();
+}
+
+void MiniBroker::Forward(std::string_view topic, const uint8_t* payload, size_t len){
+    auto deliver = [&](uint64_t id){
+        auto it = m_sessions.find(id);
+        if(it==m_sessions.end() || it->second->dead) return;
+        if(m_frame.empty()){
+            size_t remaining = 2 + topic.size() + len;
+            m_frame.push_back(PACKET_PUBLISH);
+            do {
+                uint8_t b = remaining % 128;
+                remaining /= 128;
+                if(remaining>0) b |= 0x80;
+                m_frame.push_back(b);
+            } while(remaining>0);
+            m_frame.push_back((uint8_t)(topic.size() >> 8));
+            m_frame.push_back((uint8_t)(topic.size() & 0xFF));
+            m_frame.insert(m_frame.end(), topic.begin(), topic.end());
+            m_frame.insert(m_frame.end(), payload, payload + len);
+        }
+        it->second->Send(m_frame.data(), m_frame.size());
+        m_stats.forwarded.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    m_frame.clear();
+    auto exact = m_exact.find(topic);
+    if(exact!=m_exact.end()){
+        for(uint64_t id : exact->second) deliver(id);
+    }
+    for(auto& sub : m_wildcard){
+        if(TopicMatches(sub.first, topic)) deliver(sub.second);
+    }
+}
+
+void MiniBroker::Ack(uint64_t session, uint16_t pid){
+    auto it = m_sessions.find(session);
+    if(it==m_sessions.end() || it->second->dead) return;
+    const uint8_t ack[4] = {PACKET_PUBACK, 2, (uint8_t)(pid >> 8), (uint8_t)(pid & 0xFF)};
+    it->second->Send(ack, 4);
+    m_stats.acks_sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MiniBroker::FlushDelayedAcks(int64_t now_ms){
+    while(!m_delayed.empty() && m_delayed.front().due_ms<=now_ms){
+        Ack(m_delayed.front().session, m_delayed.front().pid);
+        m_delayed.pop_front();
+    }
+}
+
+bool MiniBroker::DropAck(){
+    if(m_options.ack_drop_rate<=0) return false;
+    // xorshift64*, top 53 bits as a double in [0,1)
+    m_rng ^= m_rng >> 12;
+    m_rng ^= m_rng << 25;
+    m_rng ^= m_rng >> 27;
+    double u = (double)((m_rng * 2685821657736338717ull) >> 11) / 9007199254740992.0;
+    return u < m_options.ack_drop_rate;
+}
+
+// Only marks the session, it may be in the middle of its own callback
+void MiniBroker::Close(Session& s){
+    if(s.dead) return;
+    s.dead = true;
+    m_dead.push_back(s.id);
+}
+
+void MiniBroker::Reap(){
+    for(uint64_t id : m_dead){
+        auto it = m_sessions.find(id);
+        if(it==m_sessions.end()) continue;
+        Session& s = *it->second;
+        for(std::string_view filter : s.filters){
+            auto exact = m_exact.find(filter);
+            if(exact!=m_exact.end()){
+                auto& ids = exact->second;
+                for(size_t k=0; k<ids.size(); k++){
+                    if(ids[k]==id) { ids[k] = ids.back(); ids.pop_back(); break; }
+                }
+                if(ids.empty()) m_exact.erase(exact);
+            }
+        }
+        for(size_t k=m_wildcard.size(); k-->0;){
+            if(m_wildcard[k].second==id) m_wildcard.erase(m_wildcard.begin() + k);
+        }
+        for(std::string_view filter : s.filters) Release(filter);
+        close(s.fd); // Also drops it from epoll
+        m_sessions.erase(it);
+        m_stats.connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+    m_dead.clear();
+}
+
+void MiniBroker::Report(std::ostream& os) const {
+    os << "Connections: " << m_stats.accepted.load() << " accepted, " << m_stats.connections.load() << " open\n"
+       << "PUBLISH: " << m_stats.publishes.load() << " (" << m_stats.publishes_qos1.load() << " QoS 1, "
+       << m_stats.duplicates.load() << " dup), " << m_stats.payload_bytes.load() << " payload bytes\n"
+       << "PUBACK: " << m_stats.acks_sent.load() << " sent, " << m_stats.acks_dropped.load() << " dropped"
+       << (m_options.ack_delay_ms>0 ? ", delayed " + std::to_string(m_options.ack_delay_ms) + " ms" : "") << "\n";
+    if(m_stats.forwarded.load()) os << "Forwarded: " << m_stats.forwarded.load() << "\n";
+    if(m_stats.protocol_errors.load()) os << "Protocol errors: " << m_stats.protocol_errors.load() << "\n";
+    if(!m_options.decode) return;
+
+    uint64_t vehicles = 0, low = UINT64_MAX, high = 0;
+    uint16_t low_id = 0, high_id = 0;
+    for(size_t id=0; id<m_per_vehicle.size(); id++){
+        uint64_t n = m_per_vehicle[id];
+        if(!n) continue;
+        vehicles++;
+        if(n<low) { low = n; low_id = (uint16_t)id; }
+        if(n>high) { high = n; high_id = (uint16_t)id; }
+    }
+    os << "Packets: " << m_stats.packets.load() << " good, " << m_stats.bad_packets.load() << " bad, from "
+       << vehicles << " vehicles";
+    if(vehicles){
+        os << std::fixed << std::setprecision(1) << " | min " << low << " (id " << low_id << ")"
+           << " | mean " << (double)m_stats.packets.load() / vehicles
+           << " | max " << high << " (id " << high_id << ")";
+    }
+    os << "\n";
+}
+
+#endif // __linux__
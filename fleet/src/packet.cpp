@@ -0,0 +1,24 @@
+#include "../include/packet.h"
+#include "../include/crc16.h"
+
+const char* PacketErrorName(PacketError err){
+    switch(err){
+        case PacketError::OK: return "ok";
+        case PacketError::TOO_SHORT: return "too short";
+        case PacketError::BAD_MAGIC: return "bad magic";
+        case PacketError::BAD_VERSION: return "bad version";
+        case PacketError::BAD_CRC: return "bad crc";
+    }
+    return "?";
+}
+
+PacketError Packet::parse(const uint8_t* ptr, size_t len, Packet& out){
+    if(len<SIZE) return PacketError::TOO_SHORT;
+    const uint8_t* magic = ptr + PacketProtocol::MAGIC_OFFSET;
+    if(((magic[0] << 8) | magic[1]) != MAGIC) return PacketError::BAD_MAGIC;
+    if(!PacketProtocol::Known(ptr[PacketProtocol::VERSION_OFFSET])) return PacketError::BAD_VERSION;
+    uint16_t stored = (uint16_t)((ptr[Crc16::OFFSET] << 8) | ptr[Crc16::OFFSET+1]);
+    if(Crc16::Compute(ptr, Crc16::COVERED) != stored) return PacketError::BAD_CRC;
+    out.deserialize(ptr);
+    return PacketError::OK;
+}
@@ -0,0 +1,443 @@
+#include "../include/packet_batch.h"
+#include "../include/crc16.h"
+#include <atomic>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define PACKET_DECODE_HAVE_X86 1
+#endif
+
+void PacketBatch::Reserve(size_t capacity){
+    vehicle_id.resize(capacity);
+    sequence_id.resize(capacity);
+    timestamp.resize(capacity);
+    rpm.resize(capacity);
+    speed.resize(capacity);
+    jerk.resize(capacity);
+    temp.resize(capacity);
+    battery_level.resize(capacity);
+    gear.resize(capacity);
+    flags.resize(capacity);
+    version.resize(capacity);
+    cpu_load.resize(capacity);
+    crc16.resize(capacity);
+    if(count>capacity) count = capacity;
+}
+
+Packet PacketBatch::Get(size_t i) const {
+    Packet p{};
+    p.magic = Packet::MAGIC;
+    p.vehicle_id = vehicle_id[i];
+    p.sequence_id = sequence_id[i];
+    p.timestamp = timestamp[i];
+    p.rpm = rpm[i];
+    p.speed = speed[i];
+    p.jerk = jerk[i];
+    p.temp = temp[i];
+    p.battery_level = battery_level[i];
+    p.gear = gear[i];
+    p.flags = flags[i];
+    p.version = version[i];
+    p.cpu_load = cpu_load[i];
+    p.crc16 = crc16[i];
+    return p;
+}
+
+namespace {
+
+// Raw column pointers at the write position
+struct Columns {
+    uint16_t* vehicle_id;
+    uint32_t* sequence_id;
+    uint64_t* timestamp;
+    uint16_t* rpm;
+    uint16_t* speed;
+    int16_t*  jerk;
+    uint8_t*  temp;
+    uint8_t*  battery_level;
+    uint8_t*  gear;
+    uint8_t*  flags;
+    uint8_t*  version;
+    uint8_t*  cpu_load;
+    uint16_t* crc16;
+
+    Columns(PacketBatch& b, size_t at)
+        : vehicle_id(b.vehicle_id.data() + at), sequence_id(b.sequence_id.data() + at),
+          timestamp(b.timestamp.data() + at), rpm(b.rpm.data() + at), speed(b.speed.data() + at),
+          jerk(b.jerk.data() + at), temp(b.temp.data() + at), battery_level(b.battery_level.data() + at),
+          gear(b.gear.data() + at), flags(b.flags.data() + at), version(b.version.data() + at),
+          cpu_load(b.cpu_load.data() + at), crc16(b.crc16.data() + at) {}
+
+    // Same columns, n rows further on (kernel tails)
+    Columns Skip(size_t n) const {
+        Columns c = *this;
+        c.vehicle_id += n; c.sequence_id += n; c.timestamp += n;
+        c.rpm += n; c.speed += n; c.jerk += n;
+        c.temp += n; c.battery_level += n; c.gear += n;
+        c.flags += n; c.version += n; c.cpu_load += n; c.crc16 += n;
+        return c;
+    }
+};
+
+inline uint16_t BE16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+// Which column each schema field lands in. Magic and reserved have none.
+template <Schema::FieldId F> struct ColumnOf { static constexpr bool HAS = false; };
+
+#define PACKET_COLUMN(ID, MEMBER) \
+    template <> struct ColumnOf<Schema::FieldId::ID> { \
+        static constexpr bool HAS = true; \
+        static auto Get(const Columns& c) { return c.MEMBER; } \
+    };
+
+PACKET_COLUMN(VEHICLE_ID, vehicle_id)
+PACKET_COLUMN(SEQUENCE_ID, sequence_id)
+PACKET_COLUMN(TIMESTAMP, timestamp)
+PACKET_COLUMN(RPM, rpm)
+PACKET_COLUMN(SPEED, speed)
+PACKET_COLUMN(JERK, jerk)
+PACKET_COLUMN(TEMP, temp)
+PACKET_COLUMN(BATTERY_LEVEL, battery_level)
+PACKET_COLUMN(GEAR, gear)
+PACKET_COLUMN(FLAGS, flags)
+PACKET_COLUMN(VERSION, version)
+PACKET_COLUMN(CPU_LOAD, cpu_load)
+PACKET_COLUMN(CRC16, crc16)
+#undef PACKET_COLUMN
+
+// Row-at-a-time decode generated from a layout's field table
+template <typename Layout>
+void DecodeRows(const uint8_t* r, size_t n, const Columns& c){
+    for(size_t i=0; i<n; i++, r+=Packet::SIZE){
+        Schema::ForEachField<Layout>([&](auto k){
+            constexpr Schema::Field f = Layout::FIELDS[decltype(k)::value];
+            if constexpr (ColumnOf<f.id>::HAS){
+                auto* column = ColumnOf<f.id>::Get(c);
+                column[i] = (std::remove_pointer_t<decltype(column)>)Schema::Load<f.width, f.endian>(r + f.offset);
+            }
+        });
+    }
+}
+
+void DecodeScalar(const uint8_t* r, size_t n, const Columns& c){
+    DecodeRows<Schema::V1>(r, n, c);
+}
+
+#if defined(PACKET_DECODE_HAVE_X86)
+
+// Byte-swap masks, one 16-byte half of a record each.
+// Header half -> [magic, vehicle_id | sequence_id | timestamp], little-endian.
+#define SWAP_HEADER 1,0, 3,2, 7,6,5,4, 15,14,13,12,11,10,9,8
+// Payload half -> [rpm, speed, jerk, crc16 | temp, battery, gear, flags, version, cpu, reserved x2]
+#define SWAP_PAYLOAD 1,0, 3,2, 5,4, 13,12, 6,7,8,9,10,11,14,15
+// vehicle_id out of (magic | vehicle_id << 16) dwords
+#define PICK_VID 2,3, 6,7, 10,11, 14,15, -1,-1,-1,-1,-1,-1,-1,-1
+
+// The masks and transposes below are written for exactly this layout
+constexpr bool KernelLayout(Schema::FieldId id, size_t offset, size_t width){
+    return Schema::OffsetOf<Schema::V1>(id)==offset && Schema::V1::FIELDS[Schema::Find<Schema::V1>(id)].width==width
+        && Schema::EndianOf<Schema::V1>(id)==Schema::Endian::BIG;
+}
+static_assert(KernelLayout(Schema::FieldId::MAGIC, 0, 2) && KernelLayout(Schema::FieldId::VEHICLE_ID, 2, 2) &&
+              KernelLayout(Schema::FieldId::SEQUENCE_ID, 4, 4) && KernelLayout(Schema::FieldId::TIMESTAMP, 8, 8) &&
+              KernelLayout(Schema::FieldId::RPM, 16, 2) && KernelLayout(Schema::FieldId::SPEED, 18, 2) &&
+              KernelLayout(Schema::FieldId::JERK, 20, 2) && KernelLayout(Schema::FieldId::TEMP, 22, 1) &&
+              KernelLayout(Schema::FieldId::BATTERY_LEVEL, 23, 1) && KernelLayout(Schema::FieldId::GEAR, 24, 1) &&
+              KernelLayout(Schema::FieldId::FLAGS, 25, 1) && KernelLayout(Schema::FieldId::VERSION, 26, 1) &&
+              KernelLayout(Schema::FieldId::CPU_LOAD, 27, 1) && KernelLayout(Schema::FieldId::CRC16, 28, 2),
+              "SIMD decode masks no longer match the V1 layout");
+
+// 8 records per step. Each record is loaded as two 16-byte halves, byte-swapped
+// with one pshufb each, then the halves of all 8 are transposed with unpacks so
+// every column comes out as one contiguous store.
+__attribute__((target("ssse3")))
+void DecodeSsse3(const uint8_t* r, size_t n, const Columns& c){
+    const __m128i swap_h = _mm_setr_epi8(SWAP_HEADER);
+    const __m128i swap_p = _mm_setr_epi8(SWAP_PAYLOAD);
+    const __m128i pick_vid = _mm_setr_epi8(PICK_VID);
+
+    size_t i = 0;
+    for(; i+8<=n; i+=8, r+=8*Packet::SIZE){
+        __m128i h[8], p[8];
+        for(int k=0; k<8; k++){
+            h[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r + k*Packet::SIZE)), swap_h);
+            p[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r + k*Packet::SIZE + 16)), swap_p);
+        }
+
+        // Timestamps are the high qword of each header
+        for(int k=0; k<8; k+=2){
+            _mm_storeu_si128((__m128i*)(c.timestamp + i + k), _mm_unpackhi_epi64(h[k], h[k+1]));
+        }
+
+        // Low qwords: dword 0 = magic | vid << 16, dword 1 = sequence
+        __m128 lo[4];
+        for(int k=0; k<4; k++) lo[k] = _mm_castsi128_ps(_mm_unpacklo_epi64(h[2*k], h[2*k+1]));
+        __m128i seq0 = _mm_castps_si128(_mm_shuffle_ps(lo[0], lo[1], _MM_SHUFFLE(3,1,3,1)));
+        __m128i seq1 = _mm_castps_si128(_mm_shuffle_ps(lo[2], lo[3], _MM_SHUFFLE(3,1,3,1)));
+        __m128i mv0 = _mm_castps_si128(_mm_shuffle_ps(lo[0], lo[1], _MM_SHUFFLE(2,0,2,0)));
+        __m128i mv1 = _mm_castps_si128(_mm_shuffle_ps(lo[2], lo[3], _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_si128((__m128i*)(c.sequence_id + i), seq0);
+        _mm_storeu_si128((__m128i*)(c.sequence_id + i + 4), seq1);
+        _mm_storeu_si128((__m128i*)(c.vehicle_id + i),
+                         _mm_unpacklo_epi64(_mm_shuffle_epi8(mv0, pick_vid), _mm_shuffle_epi8(mv1, pick_vid)));
+
+        // 16-bit columns: 8x4 transpose of the payload low qwords
+        __m128i w01 = _mm_unpacklo_epi16(p[0], p[1]);
+        __m128i w23 = _mm_unpacklo_epi16(p[2], p[3]);
+        __m128i w45 = _mm_unpacklo_epi16(p[4], p[5]);
+        __m128i w67 = _mm_unpacklo_epi16(p[6], p[7]);
+        __m128i rs03 = _mm_unpacklo_epi32(w01, w23);  // rpm 0-3, speed 0-3
+        __m128i jc03 = _mm_unpackhi_epi32(w01, w23);  // jerk 0-3, crc 0-3
+        __m128i rs47 = _mm_unpacklo_epi32(w45, w67);
+        __m128i jc47 = _mm_unpackhi_epi32(w45, w67);
+        _mm_storeu_si128((__m128i*)(c.rpm + i), _mm_unpacklo_epi64(rs03, rs47));
+        _mm_storeu_si128((__m128i*)(c.speed + i), _mm_unpackhi_epi64(rs03, rs47));
+        _mm_storeu_si128((__m128i*)(c.jerk + i), _mm_unpacklo_epi64(jc03, jc47));
+        _mm_storeu_si128((__m128i*)(c.crc16 + i), _mm_unpackhi_epi64(jc03, jc47));
+
+        // 8-bit columns: 8x8 transpose of the payload high qwords
+        __m128i b01 = _mm_unpackhi_epi8(p[0], p[1]);
+        __m128i b23 = _mm_unpackhi_epi8(p[2], p[3]);
+        __m128i b45 = _mm_unpackhi_epi8(p[4], p[5]);
+        __m128i b67 = _mm_unpackhi_epi8(p[6], p[7]);
+        __m128i tbgf03 = _mm_unpacklo_epi16(b01, b23);
+        __m128i vc03 = _mm_unpackhi_epi16(b01, b23);
+        __m128i tbgf47 = _mm_unpacklo_epi16(b45, b67);
+        __m128i vc47 = _mm_unpackhi_epi16(b45, b67);
+        __m128i tb = _mm_unpacklo_epi32(tbgf03, tbgf47); // temp | battery
+        __m128i gf = _mm_unpackhi_epi32(tbgf03, tbgf47); // gear | flags
+        __m128i vc = _mm_unpacklo_epi32(vc03, vc47);     // version | cpu
+        _mm_storel_epi64((__m128i*)(c.temp + i), tb);
+        _mm_storel_epi64((__m128i*)(c.battery_level + i), _mm_unpackhi_epi64(tb, tb));
+        _mm_storel_epi64((__m128i*)(c.gear + i), gf);
+        _mm_storel_epi64((__m128i*)(c.flags + i), _mm_unpackhi_epi64(gf, gf));
+        _mm_storel_epi64((__m128i*)(c.version + i), vc);
+        _mm_storel_epi64((__m128i*)(c.cpu_load + i), _mm_unpackhi_epi64(vc, vc));
+    }
+
+    DecodeScalar(r, n - i, c.Skip(i));
+}
+
+__attribute__((target("avx2")))
+inline __m256i LoadPair(const uint8_t* lo, const uint8_t* hi){
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)lo)),
+                                   _mm_loadu_si128((const __m128i*)hi), 1);
+}
+
+__attribute__((target("avx2")))
+inline void StorePair(void* lo, void* hi, __m256i v){
+    _mm_storeu_si128((__m128i*)lo, _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i*)hi, _mm256_extracti128_si256(v, 1));
+}
+
+// Same transpose as the SSSE3 kernel, 16 records per step: lane 0 carries
+// records 0-7 and lane 1 records 8-15, and the in-lane unpacks never mix them.
+// Columns whose 8-record result is a full 16 bytes land contiguously in one
+// 32-byte store; the rest are written per lane.
+__attribute__((target("avx2")))
+void DecodeAvx2(const uint8_t* r, size_t n, const Columns& c){
+    const __m256i swap_h = _mm256_setr_epi8(SWAP_HEADER, SWAP_HEADER);
+    const __m256i swap_p = _mm256_setr_epi8(SWAP_PAYLOAD, SWAP_PAYLOAD);
+    const __m256i pick_vid = _mm256_setr_epi8(PICK_VID, PICK_VID);
+    const size_t HALF = 8*Packet::SIZE;
+
+    size_t i = 0;
+    for(; i+16<=n; i+=16, r+=16*Packet::SIZE){
+        __m256i h[8], p[8];
+        for(int k=0; k<8; k++){
+            const uint8_t* a = r + k*Packet::SIZE;
+            h[k] = _mm256_shuffle_epi8(LoadPair(a, a + HALF), swap_h);
+            p[k] = _mm256_shuffle_epi8(LoadPair(a + 16, a + HALF + 16), swap_p);
+        }
+
+        for(int k=0; k<8; k+=2){
+            StorePair(c.timestamp + i + k, c.timestamp + i + 8 + k, _mm256_unpackhi_epi64(h[k], h[k+1]));
+        }
+
+        __m256 lo[4];
+        for(int k=0; k<4; k++) lo[k] = _mm256_castsi256_ps(_mm256_unpacklo_epi64(h[2*k], h[2*k+1]));
+        __m256i seq0 = _mm256_castps_si256(_mm256_shuffle_ps(lo[0], lo[1], _MM_SHUFFLE(3,1,3,1)));
+        __m256i seq1 = _mm256_castps_si256(_mm256_shuffle_ps(lo[2], lo[3], _MM_SHUFFLE(3,1,3,1)));
+        __m256i mv0 = _mm256_castps_si256(_mm256_shuffle_ps(lo[0], lo[1], _MM_SHUFFLE(2,0,2,0)));
+        __m256i mv1 = _mm256_castps_si256(_mm256_shuffle_ps(lo[2], lo[3], _MM_SHUFFLE(2,0,2,0)));
+        StorePair(c.sequence_id + i, c.sequence_id + i + 8, seq0);
+        StorePair(c.sequence_id + i + 4, c.sequence_id + i + 12, seq1);
+        _mm256_storeu_si256((__m256i*)(c.vehicle_id + i),
+                            _mm256_unpacklo_epi64(_mm256_shuffle_epi8(mv0, pick_vid), _mm256_shuffle_epi8(mv1, pick_vid)));
+
+        __m256i w01 = _mm256_unpacklo_epi16(p[0], p[1]);
+        __m256i w23 = _mm256_unpacklo_epi16(p[2], p[3]);
+        __m256i w45 = _mm256_unpacklo_epi16(p[4], p[5]);
+        __m256i w67 = _mm256_unpacklo_epi16(p[6], p[7]);
+        __m256i rs03 = _mm256_unpacklo_epi32(w01, w23);
+        __m256i jc03 = _mm256_unpackhi_epi32(w01, w23);
+        __m256i rs47 = _mm256_unpacklo_epi32(w45, w67);
+        __m256i jc47 = _mm256_unpackhi_epi32(w45, w67);
+        _mm256_storeu_si256((__m256i*)(c.rpm + i), _mm256_unpacklo_epi64(rs03, rs47));
+        _mm256_storeu_si256((__m256i*)(c.speed + i), _mm256_unpackhi_epi64(rs03, rs47));
+        _mm256_storeu_si256((__m256i*)(c.jerk + i), _mm256_unpacklo_epi64(jc03, jc47));
+        _mm256_storeu_si256((__m256i*)(c.crc16 + i), _mm256_unpackhi_epi64(jc03, jc47));
+
+        __m256i b01 = _mm256_unpackhi_epi8(p[0], p[1]);
+        __m256i b23 = _mm256_unpackhi_epi8(p[2], p[3]);
+        __m256i b45 = _mm256_unpackhi_epi8(p[4], p[5]);
+        __m256i b67 = _mm256_unpackhi_epi8(p[6], p[7]);
+        __m256i tbgf03 = _mm256_unpacklo_epi16(b01, b23);
+        __m256i vc03 = _mm256_unpackhi_epi16(b01, b23);
+        __m256i tbgf47 = _mm256_unpacklo_epi16(b45, b67);
+        __m256i vc47 = _mm256_unpackhi_epi16(b45, b67);
+        // Each lane is [column A 8 bytes | column B 8 bytes]; regroup the
+        // qwords so A for records 0-15 is the low half and B the high half
+        __m256i tb = _mm256_permute4x64_epi64(_mm256_unpacklo_epi32(tbgf03, tbgf47), _MM_SHUFFLE(3,1,2,0));
+        __m256i gf = _mm256_permute4x64_epi64(_mm256_unpackhi_epi32(tbgf03, tbgf47), _MM_SHUFFLE(3,1,2,0));
+        __m256i vc = _mm256_permute4x64_epi64(_mm256_unpacklo_epi32(vc03, vc47), _MM_SHUFFLE(3,1,2,0));
+        StorePair(c.temp + i, c.battery_level + i, tb);
+        StorePair(c.gear + i, c.flags + i, gf);
+        StorePair(c.version + i, c.cpu_load + i, vc);
+    }
+
+    DecodeSsse3(r, n - i, c.Skip(i));
+}
+
+#undef SWAP_HEADER
+#undef SWAP_PAYLOAD
+#undef PICK_VID
+#endif
+
+std::atomic<int> g_active(-1);
+
+PacketDecode::Impl Detect(){
+    if(PacketDecode::Supported(PacketDecode::Impl::AVX2)) return PacketDecode::Impl::AVX2;
+    if(PacketDecode::Supported(PacketDecode::Impl::SSSE3)) return PacketDecode::Impl::SSSE3;
+    return PacketDecode::Impl::SCALAR;
+}
+
+// V1 records with the widest kernel the CPU has
+void DecodeV1(const uint8_t* records, size_t count, const Columns& cols){
+    switch(PacketDecode::Active()){
+#if defined(PACKET_DECODE_HAVE_X86)
+        case PacketDecode::Impl::AVX2: DecodeAvx2(records, count, cols); break;
+        case PacketDecode::Impl::SSSE3: DecodeSsse3(records, count, cols); break;
+#endif
+        default: DecodeScalar(records, count, cols); break;
+    }
+}
+
+// Validate() works through the input in chunks of this many records
+const size_t CHUNK = 256;
+
+} // namespace
+
+namespace PacketDecode {
+
+bool Supported(Impl impl){
+#if defined(PACKET_DECODE_HAVE_X86)
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    switch(impl){
+        case Impl::SCALAR: return true;
+        case Impl::SSSE3: return ssse3;
+        case Impl::AVX2: return avx2 && ssse3;
+    }
+    return false;
+#else
+    return impl==Impl::SCALAR;
+#endif
+}
+
+Impl Active(){
+    int a = g_active.load(std::memory_order_relaxed);
+    if(a<0){
+        a = (int)Detect();
+        g_active.store(a, std::memory_order_relaxed);
+    }
+    return (Impl)a;
+}
+
+const char* Name(Impl impl){
+    switch(impl){
+        case Impl::SCALAR: return "scalar";
+        case Impl::SSSE3: return "ssse3";
+        case Impl::AVX2: return "avx2";
+    }
+    return "?";
+}
+
+void Select(Impl impl){
+    if(!Supported(impl)) impl = Detect();
+    g_active.store((int)impl, std::memory_order_relaxed);
+}
+
+size_t Decode(const uint8_t* records, size_t count, PacketBatch& out){
+    if(count>out.Room()) count = out.Room();
+    if(count==0) return 0;
+    Columns cols(out, out.count);
+    if constexpr (PacketProtocol::COUNT==1 && std::is_same<PacketProtocol::Latest, Schema::V1>::value){
+        DecodeV1(records, count, cols);
+    }
+    else{
+        // Runs of V1 records go to the kernels, anything else row by row
+        // with its own layout (unknown versions as the newest, like deserialize)
+        size_t i = 0;
+        while(i<count){
+            size_t start = i;
+            bool v1 = records[i*Packet::SIZE + PacketProtocol::VERSION_OFFSET]==Schema::V1::VERSION;
+            while(i<count && (records[i*Packet::SIZE + PacketProtocol::VERSION_OFFSET]==Schema::V1::VERSION)==v1) i++;
+            const uint8_t* r = records + start*Packet::SIZE;
+            if(v1) DecodeV1(r, i - start, cols.Skip(start));
+            else{
+                for(size_t k=start; k<i; k++, r+=Packet::SIZE){
+                    PacketProtocol::Dispatch(r[PacketProtocol::VERSION_OFFSET],
+                                             [&](auto layout){ DecodeRows<decltype(layout)>(r, 1, cols.Skip(k)); });
+                }
+            }
+        }
+    }
+    out.count += count;
+    return count;
+}
+
+size_t Validate(const uint8_t* records, size_t count, uint8_t* ok){
+    size_t valid = 0;
+    uint8_t crc_ok[CHUNK];
+    for(size_t base=0; base<count; base+=CHUNK){
+        size_t n = count - base < CHUNK ? count - base : CHUNK;
+        const uint8_t* r = records + base*Packet::SIZE;
+        Crc16::VerifyBatch(r, n, crc_ok);
+        for(size_t i=0; i<n; i++, r+=Packet::SIZE){
+            uint8_t good = crc_ok[i] & (BE16(r + PacketProtocol::MAGIC_OFFSET) == Packet::MAGIC)
+                         & PacketProtocol::Known(r[PacketProtocol::VERSION_OFFSET]);
+            if(ok) ok[base + i] = good;
+            valid += good;
+        }
+    }
+    return valid;
+}
+
+// Bad records are rare, so decode each run of good ones with the bulk kernel
+// instead of compacting record by record.
+size_t DecodeValid(const uint8_t* records, size_t count, PacketBatch& out, uint64_t* rejected){
+    if(count>out.Room()) count = out.Room();
+    uint8_t ok[CHUNK];
+    for(size_t base=0; base<count; base+=CHUNK){
+        size_t n = count - base < CHUNK ? count - base : CHUNK;
+        const uint8_t* r = records + base*Packet::SIZE;
+        size_t valid = Validate(r, n, ok);
+        if(valid==n){
+            Decode(r, n, out);
+            continue;
+        }
+        if(rejected) *rejected += n - valid;
+        size_t i = 0;
+        while(i<n){
+            while(i<n && !ok[i]) i++;
+            size_t start = i;
+            while(i<n && ok[i]) i++;
+            if(i>start) Decode(r + start*Packet::SIZE, i - start, out);
+        }
+    }
+    return count;
+}
+
+} // namespace PacketDecode
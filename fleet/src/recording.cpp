@@ -0,0 +1,220 @@
+#include "../include/recording.h"
+#include "../include/crc16.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const size_t TIMESTAMP_OFFSET = 8;   // In a serialized Packet
+const size_t WRITE_BUFFER = 1 << 20;
+
+static void Put16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; }
+static void Put32(uint8_t* p, uint32_t v) { for(int i=0; i<4; i++) p[i] = (v >> (24 - i*8)) & 0xFF; }
+static void Put64(uint8_t* p, uint64_t v) { for(int i=0; i<8; i++) p[i] = (v >> (56 - i*8)) & 0xFF; }
+static uint16_t Get16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t Get32(const uint8_t* p) { uint32_t v = 0; for(int i=0; i<4; i++) v = (v << 8) | p[i]; return v; }
+static uint64_t Get64(const uint8_t* p) { uint64_t v = 0; for(int i=0; i<8; i++) v = (v << 8) | p[i]; return v; }
+
+// Recordings outgrow 2 GB, plain fseek/ftell stop there
+static bool Seek(std::FILE* f, uint64_t offset){
+#if defined(_WIN32)
+    return _fseeki64(f, (long long)offset, SEEK_SET)==0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET)==0;
+#endif
+}
+
+static uint64_t SizeOf(std::FILE* f){
+#if defined(_WIN32)
+    _fseeki64(f, 0, SEEK_END);
+    return (uint64_t)_ftelli64(f);
+#else
+    fseeko(f, 0, SEEK_END);
+    return (uint64_t)ftello(f);
+#endif
+}
+
+uint16_t RecordingBlock::CountOf(uint16_t vehicle_id) const {
+    auto it = std::lower_bound(vehicles.begin(), vehicles.end(), std::make_pair(vehicle_id, (uint16_t)0));
+    return it!=vehicles.end() && it->first==vehicle_id ? it->second : 0;
+}
+
+RecordingWriter::~RecordingWriter(){
+    Close();
+}
+
+bool RecordingWriter::Open(const std::string& path, size_t block_records){
+    Close();
+    m_file = std::fopen(path.c_str(), "wb");
+    if(!m_file) return false;
+    std::setvbuf(m_file, nullptr, _IOFBF, WRITE_BUFFER);
+    m_failed = false;
+    m_block_records = std::max<size_t>(1, std::min(block_records, Recording::MAX_BLOCK_RECORDS));
+    m_data.assign(m_block_records * Recording::RECORD_SIZE, 0);
+    m_counts.assign(65536, 0);
+    m_vehicles.clear();
+    m_pending = 0;
+    m_records = m_blocks = m_bytes = 0;
+
+    uint8_t header[Recording::HEADER_SIZE] = {};
+    Put32(header, Recording::MAGIC);
+    header[4] = Recording::VERSION;
+    header[5] = Recording::RECORD_SIZE;
+    Put32(header + 8, (uint32_t)m_block_records);
+    Put64(header + 16, (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    if(std::fwrite(header, 1, sizeof(header), m_file)!=sizeof(header) || std::fflush(m_file)!=0){
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_bytes = sizeof(header);
+    return true;
+}
+
+bool RecordingWriter::Close(){
+    if(!m_file) return !m_failed;
+    Flush();
+    if(std::fclose(m_file)!=0) m_failed = true;
+    m_file = nullptr;
+    return !m_failed;
+}
+
+bool RecordingWriter::Append(const uint8_t* record){
+    if(!m_file || m_failed) return false;
+    uint64_t ts = Get64(record + TIMESTAMP_OFFSET);
+    uint16_t id = Get16(record + 2);
+    if(m_pending==0) m_first_ts = m_last_ts = ts;
+    m_first_ts = std::min(m_first_ts, ts);
+    m_last_ts = std::max(m_last_ts, ts);
+    if(m_counts[id]++==0) m_vehicles.push_back(id);
+    std::memcpy(m_data.data() + (size_t)m_pending*Recording::RECORD_SIZE, record, Recording::RECORD_SIZE);
+    m_pending++;
+    m_records++;
+    return m_pending<m_block_records || Flush();
+}
+
+bool RecordingWriter::Append(const uint8_t* records, size_t count){
+    for(size_t i=0; i<count; i++){
+        if(!Append(records + i*Recording::RECORD_SIZE)) return false;
+    }
+    return true;
+}
+
+bool RecordingWriter::Flush(){
+    if(!m_file || m_failed) return false;
+    if(m_pending==0) return true;
+
+    std::sort(m_vehicles.begin(), m_vehicles.end());
+    size_t index_len = m_vehicles.size() * Recording::INDEX_ENTRY_SIZE;
+    m_header.assign(Recording::BLOCK_HEADER_SIZE + index_len, 0);
+    uint8_t* h = m_header.data();
+    Put32(h, Recording::BLOCK_MAGIC);
+    Put32(h + 4, m_pending);
+    Put32(h + 8, (uint32_t)m_vehicles.size());
+    Put64(h + 16, m_first_ts);
+    Put64(h + 24, m_last_ts);
+    uint8_t* entry = h + Recording::BLOCK_HEADER_SIZE;
+    for(uint16_t id : m_vehicles){
+        Put16(entry, id);
+        Put16(entry + 2, m_counts[id]);
+        m_counts[id] = 0;
+        entry += Recording::INDEX_ENTRY_SIZE;
+    }
+    Put16(h + 12, Crc16::Compute(h, m_header.size()));
+
+    size_t data_len = (size_t)m_pending * Recording::RECORD_SIZE;
+    bool ok = std::fwrite(h, 1, m_header.size(), m_file)==m_header.size()
+           && std::fwrite(m_data.data(), 1, data_len, m_file)==data_len
+           && std::fflush(m_file)==0;
+    m_vehicles.clear();
+    m_pending = 0;
+    if(!ok){
+        m_failed = true;
+        return false;
+    }
+    m_blocks++;
+    m_bytes += m_header.size() + data_len;
+    return true;
+}
+
+RecordingReader::~RecordingReader(){
+    Close();
+}
+
+bool RecordingReader::Open(const std::string& path, std::string& error){
+    Close();
+    m_file = std::fopen(path.c_str(), "rb");
+    if(!m_file){
+        error = "cannot open " + path;
+        return false;
+    }
+    m_size = SizeOf(m_file);
+    uint8_t header[Recording::HEADER_SIZE];
+    if(!Seek(m_file, 0) || std::fread(header, 1, sizeof(header), m_file)!=sizeof(header) || Get32(header)!=Recording::MAGIC){
+        error = path + " is not a recording";
+        Close();
+        return false;
+    }
+    m_version = header[4];
+    if(m_version==0 || m_version>Recording::VERSION || header[5]!=Recording::RECORD_SIZE){
+        error = path + ": unsupported recording version " + std::to_string(m_version);
+        Close();
+        return false;
+    }
+    m_block_records = Get32(header + 8);
+    m_created = Get64(header + 16);
+    m_next = Recording::HEADER_SIZE;
+    m_damaged = false;
+    return true;
+}
+
+void RecordingReader::Close(){
+    if(m_file) std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool RecordingReader::Next(RecordingBlock& block){
+    if(!m_file || m_next>=m_size) return false;
+    // From here on anything short of a whole, valid block is damage
+    m_damaged = true;
+    if(m_size - m_next < Recording::BLOCK_HEADER_SIZE || !Seek(m_file, m_next)) return false;
+    m_header.resize(Recording::BLOCK_HEADER_SIZE);
+    if(std::fread(m_header.data(), 1, Recording::BLOCK_HEADER_SIZE, m_file)!=Recording::BLOCK_HEADER_SIZE) return false;
+    const uint8_t* h = m_header.data();
+    uint32_t records = Get32(h + 4), vehicles = Get32(h + 8);
+    if(Get32(h)!=Recording::BLOCK_MAGIC || records==0 || records>Recording::MAX_BLOCK_RECORDS || vehicles==0 || vehicles>records){
+        return false;
+    }
+    uint64_t index_len = (uint64_t)vehicles * Recording::INDEX_ENTRY_SIZE;
+    uint64_t data_len = (uint64_t)records * Recording::RECORD_SIZE;
+    if(m_size - m_next < Recording::BLOCK_HEADER_SIZE + index_len + data_len) return false;
+    m_header.resize(Recording::BLOCK_HEADER_SIZE + index_len);
+    if(std::fread(m_header.data() + Recording::BLOCK_HEADER_SIZE, 1, index_len, m_file)!=index_len) return false;
+
+    h = m_header.data();
+    uint16_t stored = Get16(h + 12);
+    m_header[12] = m_header[13] = 0;
+    if(Crc16::Compute(h, m_header.size())!=stored) return false;
+
+    block.offset = m_next;
+    block.records = records;
+    block.first_ts = Get64(h + 16);
+    block.last_ts = Get64(h + 24);
+    block.vehicles.resize(vehicles);
+    const uint8_t* entry = h + Recording::BLOCK_HEADER_SIZE;
+    for(uint32_t v=0; v<vehicles; v++, entry += Recording::INDEX_ENTRY_SIZE){
+        block.vehicles[v] = {Get16(entry), Get16(entry + 2)};
+    }
+    block.data.clear();
+    m_records_at = m_next + Recording::BLOCK_HEADER_SIZE + index_len;
+    m_next = m_records_at + data_len;
+    m_damaged = false;
+    return true;
+}
+
+bool RecordingReader::Load(RecordingBlock& block){
+    if(!m_file) return false;
+    size_t len = (size_t)block.records * Recording::RECORD_SIZE;
+    block.data.resize(len);
+    return Seek(m_file, m_records_at) && std::fread(block.data.data(), 1, len, m_file)==len;
+}
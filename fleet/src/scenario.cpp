@@ -0,0 +1,296 @@
+#include "../include/scenario.h"
+#include "../include/counter_rng.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+// fleet_sim's behaviour before scenarios existed, decision for decision
+static const char* BUILTIN = R"(
+decision 10
+initial CITY_CRUISE
+
+state CITY_CRUISE    wave 0.6 0.5 0.05
+state HIGHWAY_SPRINT constant 1 tag SPRINT
+state PANIC_STOP     constant -1 tag BRAKING alert
+state IDLE           constant 0
+state BATTERY_STRESS constant 1 tag STRESS
+
+row * PANIC_STOP 2 HIGHWAY_SPRINT 20 CITY_CRUISE 48 IDLE 30
+)";
+
+static const char* TAG_NAMES[] = {"NONE", "ABS", "OVERHEAT", "LOW_BATTERY", "SPRINT", "STRESS", "BRAKING"};
+
+const double FULL_RANGE = 4294967296.0; // 2^32, one past the largest draw
+
+bool ScenarioEvent::ActiveAt(double t) const {
+    if(t<at) return false;
+    double since = t - at;
+    if(every>0) since = std::fmod(since, every);
+    return since<duration;
+}
+
+const Scenario& Scenario::Builtin(){
+    static const Scenario builtin = []{
+        Scenario s;
+        std::string error;
+        s.Parse(BUILTIN, error);
+        return s;
+    }();
+    return builtin;
+}
+
+int Scenario::FindState(const std::string& name) const {
+    for(size_t i=0; i<states.size(); i++) if(states[i].name==name) return (int)i;
+    return -1;
+}
+
+int Scenario::FindMatrix(const std::string& name) const {
+    for(size_t i=0; i<matrices.size(); i++) if(matrices[i].name==name) return (int)i;
+    return -1;
+}
+
+bool Scenario::Load(const std::string& path, std::string& error){
+    std::ifstream in(path);
+    if(!in){
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    return Parse(text.str(), error);
+}
+
+// Lines are "keyword args...", '#' starts a comment:
+//   decision SECONDS
+//   initial STATE
+//   state NAME constant THROTTLE [tag TAG] [alert]
+//   state NAME wave PEAK RAD_PER_S RAD_PER_ID [tag TAG] [alert]
+//   matrix NAME                        (rows below belong to it, the first is "base")
+//   row FROM|* TO WEIGHT [TO WEIGHT...]
+//   event AT DURATION [every PERIOD] force STATE|use MATRIX
+bool Scenario::Parse(const std::string& text, std::string& error){
+    *this = Scenario();
+    matrices.push_back(Matrix{"base", {}});
+
+    // Rows and event targets are resolved once every state and matrix is known
+    struct PendingRow { size_t matrix; std::string from; std::vector<std::pair<std::string, double>> to; int line; };
+    struct PendingEvent { ScenarioEvent event; std::string target; int line; };
+    std::vector<PendingRow> rows;
+    std::vector<PendingEvent> pending_events;
+    std::string initial_name;
+    size_t matrix = 0;
+    bool base_named = false;
+
+    std::istringstream lines(text);
+    std::string line;
+    int number = 0;
+    auto fail = [&](int at, const std::string& what){
+        error = "line " + std::to_string(at) + ": " + what;
+        return false;
+    };
+    while(std::getline(lines, line)){
+        number++;
+        size_t hash = line.find('#');
+        if(hash!=std::string::npos) line.resize(hash);
+        std::istringstream in(line);
+        std::string keyword;
+        if(!(in >> keyword)) continue;
+
+        if(keyword=="decision"){
+            if(!(in >> decision_s) || !(decision_s>0)) return fail(number, "decision needs a positive number of seconds");
+        }
+        else if(keyword=="initial"){
+            if(!(in >> initial_name)) return fail(number, "initial needs a state name");
+        }
+        else if(keyword=="state"){
+            ScenarioState s;
+            std::string profile;
+            if(!(in >> s.name >> profile)) return fail(number, "state needs a name and a profile");
+            if(FindState(s.name)>=0) return fail(number, "state " + s.name + " defined twice");
+            if(profile=="constant"){
+                if(!(in >> s.level)) return fail(number, "constant needs a throttle");
+            }
+            else if(profile=="wave"){
+                s.profile = ScenarioState::Profile::WAVE;
+                if(!(in >> s.level >> s.freq >> s.phase)) return fail(number, "wave needs peak, rad/s and rad/id");
+            }
+            else return fail(number, "unknown profile " + profile);
+            if(s.level<-1.0 || s.level>1.0) return fail(number, "throttle must be within -1..1");
+            std::string option;
+            while(in >> option){
+                if(option=="alert") s.alert = true;
+                else if(option=="tag"){
+                    std::string tag;
+                    in >> tag;
+                    int found = -1;
+                    for(size_t t=0; t<sizeof(TAG_NAMES)/sizeof(TAG_NAMES[0]); t++) if(tag==TAG_NAMES[t]) found = (int)t;
+                    if(found<0) return fail(number, "unknown tag " + tag);
+                    s.tag = (StatusTag)found;
+                }
+                else return fail(number, "unknown state option " + option);
+            }
+            if(states.size()==MAX_STATES) return fail(number, "more than " + std::to_string(MAX_STATES) + " states");
+            states.push_back(s);
+        }
+        else if(keyword=="matrix"){
+            std::string name;
+            if(!(in >> name)) return fail(number, "matrix needs a name");
+            // Naming the first matrix renames "base" as long as nothing went into it yet
+            bool base_empty = !base_named && matrices.size()==1 && rows.empty();
+            if(FindMatrix(name)>=0 && !(base_empty && name=="base")) return fail(number, "matrix " + name + " defined twice");
+            if(base_empty) matrices[0].name = name;
+            else matrices.push_back(Matrix{name, {}});
+            base_named = true;
+            matrix = matrices.size() - 1;
+        }
+        else if(keyword=="row"){
+            PendingRow row{matrix, "", {}, number};
+            if(!(in >> row.from)) return fail(number, "row needs a source state or *");
+            std::string to;
+            double weight;
+            while(in >> to){
+                if(!(in >> weight) || weight<0) return fail(number, "weight for " + to + " must be a number >= 0");
+                row.to.emplace_back(to, weight);
+            }
+            if(row.to.empty()) return fail(number, "row has no targets");
+            rows.push_back(row);
+        }
+        else if(keyword=="event"){
+            PendingEvent e{ScenarioEvent(), "", number};
+            std::string word;
+            if(!(in >> e.event.at >> e.event.duration) || e.event.at<0 || !(e.event.duration>0)){
+                return fail(number, "event needs a start >= 0 and a positive duration");
+            }
+            if(!(in >> word)) return fail(number, "event needs force STATE or use MATRIX");
+            if(word=="every"){
+                if(!(in >> e.event.every) || !(e.event.every>0)) return fail(number, "every needs a positive period");
+                if(!(in >> word)) return fail(number, "event needs force STATE or use MATRIX");
+            }
+            if(word=="force") e.event.kind = ScenarioEvent::Kind::FORCE;
+            else if(word=="use") e.event.kind = ScenarioEvent::Kind::MATRIX;
+            else return fail(number, "unknown event action " + word);
+            if(!(in >> e.target)) return fail(number, word + " needs a name");
+            pending_events.push_back(e);
+        }
+        else return fail(number, "unknown keyword " + keyword);
+    }
+
+    if(states.empty()) return fail(number, "no states");
+    if(!initial_name.empty()){
+        int s = FindState(initial_name);
+        if(s<0) return fail(number, "initial state " + initial_name + " not defined");
+        initial = (uint8_t)s;
+    }
+
+    // Rows: explicit ones win over "*" in the same matrix
+    for(size_t m=0; m<matrices.size(); m++){
+        std::map<int, const PendingRow*> chosen;
+        const PendingRow* any = nullptr;
+        for(const PendingRow& row : rows){
+            if(row.matrix!=m) continue;
+            if(row.from=="*") { any = &row; continue; }
+            int from = FindState(row.from);
+            if(from<0) return fail(row.line, "unknown state " + row.from);
+            chosen[from] = &row;
+        }
+        matrices[m].rows.resize(states.size());
+        for(size_t from=0; from<states.size(); from++){
+            const PendingRow* row = chosen.count((int)from) ? chosen[(int)from] : any;
+            if(!row) return fail(number, "matrix " + matrices[m].name + " has no row for " + states[from].name);
+            if(row->to.size()>MAX_STATES) return fail(row->line, "too many targets");
+            double total = 0;
+            for(const auto& to : row->to) total += to.second;
+            if(!(total>0)) return fail(row->line, "row weights add up to zero");
+
+            // Cumulative thresholds over 2^32, rounded up so that integer
+            // percentages pick exactly what CounterRng::Below(bits, 100) would
+            Scenario::Row& out = matrices[m].rows[from];
+            double cumulative = 0;
+            for(size_t k=0; k<MAX_STATES; k++){
+                out.threshold[k] = (uint64_t)FULL_RANGE;
+                out.target[k] = 0;
+                if(k>=row->to.size()) continue;
+                int target = FindState(row->to[k].first);
+                if(target<0) return fail(row->line, "unknown state " + row->to[k].first);
+                cumulative += row->to[k].second;
+                out.target[k] = (uint8_t)target;
+                out.threshold[k] = k+1==row->to.size() ? (uint64_t)FULL_RANGE : (uint64_t)std::ceil(cumulative / total * FULL_RANGE);
+            }
+        }
+    }
+
+    for(PendingEvent& e : pending_events){
+        int target = e.event.kind==ScenarioEvent::Kind::FORCE ? FindState(e.target) : FindMatrix(e.target);
+        if(target<0) return fail(e.line, "unknown " + std::string(e.event.kind==ScenarioEvent::Kind::FORCE ? "state " : "matrix ") + e.target);
+        e.event.target = (uint8_t)target;
+        events.push_back(e.event);
+    }
+    return true;
+}
+
+ScenarioRunner::ScenarioRunner(const Scenario& scenario, const std::vector<uint16_t>& ids, uint64_t seed)
+    : m_scenario(scenario), m_ids(ids), m_seed(seed),
+      m_state(ids.size(), scenario.initial), m_alerted(ids.size(), 0),
+      m_event_active(scenario.events.size(), 0),
+      m_next_decision(scenario.decision_s) {}
+
+// Every vehicle at once: one draw and a branch-free walk over the row
+void ScenarioRunner::Decide(const Scenario::Matrix& matrix){
+    const size_t n = m_ids.size();
+    const Scenario::Row* rows = matrix.rows.data();
+    for(size_t i=0; i<n; i++){
+        uint32_t bits = CounterRng::Bits(m_seed, m_ids[i], m_decisions, CounterRng::DRIVER);
+        const Scenario::Row& row = rows[m_state[i]];
+        uint32_t pick = 0;
+        for(size_t k=0; k<Scenario::MAX_STATES; k++) pick += row.threshold[k]<=bits;
+        uint8_t next = row.target[pick];
+        m_state[i] = next;
+        m_alerted[i] = m_scenario.states[next].alert;
+    }
+    m_decisions++;
+}
+
+size_t ScenarioRunner::Step(double t, double* throttle){
+    const size_t n = m_ids.size();
+    std::fill(m_alerted.begin(), m_alerted.end(), 0);
+    m_changes.clear();
+
+    // Later events win when several are active
+    size_t matrix = 0;
+    int force = -1;
+    bool force_started = false;
+    for(size_t e=0; e<m_scenario.events.size(); e++){
+        const ScenarioEvent& event = m_scenario.events[e];
+        bool active = event.ActiveAt(t);
+        if(active!=(m_event_active[e]!=0)){
+            m_event_active[e] = active;
+            m_changes.emplace_back(e, active);
+            if(active && event.kind==ScenarioEvent::Kind::FORCE) force_started = true;
+        }
+        if(!active) continue;
+        if(event.kind==ScenarioEvent::Kind::MATRIX) matrix = event.target;
+        else force = event.target;
+    }
+
+    // Vehicles keep deciding underneath a forced state and resume their own
+    // chain once it ends
+    if(t>=m_next_decision){
+        m_next_decision += m_scenario.decision_s;
+        Decide(m_scenario.matrices[matrix]);
+    }
+    if(force>=0){
+        // The whole fleet enters together, once, when the event starts
+        uint8_t forced_alert = force_started && m_scenario.states[force].alert;
+        std::fill(m_alerted.begin(), m_alerted.end(), forced_alert);
+    }
+    m_force = force;
+
+    size_t alerted = 0;
+    for(size_t i=0; i<n; i++){
+        throttle[i] = m_scenario.states[State(i)].Throttle(t, m_ids[i]);
+        alerted += m_alerted[i];
+    }
+    m_alerts += alerted;
+    return alerted;
+}
@@ -0,0 +1,184 @@
+#include "../include/spool.h"
+#include "../include/crc16.h"
+#include "../include/packet.h"
+#include <cstring>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+const size_t COMMIT_A = 0x40;
+const size_t COMMIT_B = 0x80;
+
+struct CommitSlot {
+    uint64_t seq;
+    uint64_t head;
+    uint64_t tail;
+    uint16_t crc;
+};
+
+static uint16_t CommitCrc(const CommitSlot& c){
+    return Crc16::Compute(reinterpret_cast<const uint8_t*>(&c), offsetof(CommitSlot, crc));
+}
+
+static bool ReadCommit(const uint8_t* base, size_t at, uint64_t capacity, CommitSlot& out){
+    std::memcpy(&out, base + at, sizeof(out));
+    return CommitCrc(out)==out.crc && out.tail>=out.head && out.tail - out.head <= capacity;
+}
+
+static bool ValidRecord(const uint8_t* r){
+    uint16_t magic = (r[0] << 8) | r[1];
+    uint16_t stored = (r[Crc16::OFFSET] << 8) | r[Crc16::OFFSET+1];
+    return magic==Packet::MAGIC && Crc16::Compute(r, Crc16::COVERED)==stored;
+}
+
+Spool::~Spool(){
+    Close();
+}
+
+uint8_t* Spool::Slot(uint64_t n) const {
+    return m_base + Spooler::HEADER_SIZE + (n % m_capacity) * Spooler::RECORD_SIZE;
+}
+
+#if !defined(_WIN32)
+
+bool Spool::Open(const std::string& path, size_t max_bytes){
+    Close();
+    m_appended = m_overwritten = m_recovered = m_discarded = 0;
+    uint64_t want = max_bytes>Spooler::HEADER_SIZE ? (max_bytes - Spooler::HEADER_SIZE) / Spooler::RECORD_SIZE : 0;
+    if(want<1) want = 1;
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(m_fd<0) return false;
+    struct stat st;
+    if(fstat(m_fd, &st)<0) { Close(); return false; }
+
+    // Keep an existing spool's geometry if it still holds data
+    uint64_t capacity = want;
+    bool existing = false;
+    if((size_t)st.st_size>=Spooler::HEADER_SIZE){
+        uint8_t fixed[16];
+        if(pread(m_fd, fixed, sizeof(fixed), 0)==(ssize_t)sizeof(fixed)){
+            uint32_t magic;
+            uint64_t cap;
+            std::memcpy(&magic, fixed, 4);
+            std::memcpy(&cap, fixed + 8, 8);
+            if(magic==Spooler::MAGIC && fixed[4]==Spooler::VERSION && fixed[5]==Spooler::RECORD_SIZE && cap>0
+               && (uint64_t)st.st_size>=Spooler::HEADER_SIZE + cap*Spooler::RECORD_SIZE){
+                capacity = cap;
+                existing = true;
+            }
+        }
+    }
+
+    m_map_size = Spooler::HEADER_SIZE + capacity*Spooler::RECORD_SIZE;
+    if(!existing && ftruncate(m_fd, (off_t)m_map_size)<0) { Close(); return false; }
+    void* map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(map==MAP_FAILED) { m_base = nullptr; Close(); return false; }
+    m_base = static_cast<uint8_t*>(map);
+    m_capacity = capacity;
+
+    CommitSlot a{}, b{};
+    bool a_ok = existing && ReadCommit(m_base, COMMIT_A, capacity, a);
+    bool b_ok = existing && ReadCommit(m_base, COMMIT_B, capacity, b);
+    if(a_ok || b_ok){
+        const CommitSlot& c = (a_ok && (!b_ok || a.seq>=b.seq)) ? a : b;
+        m_seq = c.seq;
+        m_head = c.head;
+        m_tail = c.tail;
+        // Anything after the first record that doesn't check out is lost
+        for(uint64_t n=m_head; n<m_tail; n++){
+            if(!ValidRecord(Slot(n))){
+                m_discarded = m_tail - n;
+                m_tail = n;
+                break;
+            }
+        }
+        m_recovered = m_tail - m_head;
+    }
+    if(existing && capacity!=want && m_recovered==0){
+        // Nothing worth keeping, so free to take the new size
+        uint64_t discarded = m_discarded;
+        Close();
+        if(::truncate(path.c_str(), 0)<0) return false;
+        bool ok = Open(path, max_bytes);
+        m_discarded = discarded;
+        return ok;
+    }
+    if(!a_ok && !b_ok){
+        std::memset(m_base, 0, Spooler::HEADER_SIZE);
+        uint32_t magic = Spooler::MAGIC;
+        std::memcpy(m_base, &magic, 4);
+        m_base[4] = Spooler::VERSION;
+        m_base[5] = Spooler::RECORD_SIZE;
+        std::memcpy(m_base + 8, &capacity, 8);
+        m_seq = m_head = m_tail = 0;
+    }
+    Commit();
+    return true;
+}
+
+void Spool::Close(){
+    if(m_base){
+        msync(m_base, m_map_size, MS_SYNC);
+        munmap(m_base, m_map_size);
+        m_base = nullptr;
+    }
+    if(m_fd>=0){
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void Spool::Sync(bool wait){
+    if(m_base) msync(m_base, m_map_size, wait ? MS_SYNC : MS_ASYNC);
+}
+
+#else
+
+bool Spool::Open(const std::string&, size_t) { return false; }
+void Spool::Close() {}
+void Spool::Sync(bool) {}
+
+#endif
+
+// Alternates between the two slots, never overwriting the newest one
+void Spool::Commit(){
+    CommitSlot c{};
+    c.seq = ++m_seq;
+    c.head = m_head;
+    c.tail = m_tail;
+    c.crc = CommitCrc(c);
+    std::memcpy(m_base + ((c.seq & 1) ? COMMIT_A : COMMIT_B), &c, sizeof(c));
+}
+
+void Spool::Append(const uint8_t* record){
+    if(!m_base) return;
+    if(m_tail - m_head == m_capacity){
+        m_head++;
+        m_overwritten++;
+        Commit(); // Oldest slot is free before it gets overwritten
+    }
+    std::memcpy(Slot(m_tail), record, Spooler::RECORD_SIZE);
+    m_tail++;
+    m_appended++;
+    Commit();
+}
+
+size_t Spool::Peek(uint8_t* out, size_t max, size_t skip) const {
+    if(!m_base || skip>=Size()) return 0;
+    size_t left = Size() - skip;
+    size_t n = left<max ? left : max;
+    for(size_t i=0; i<n; i++) std::memcpy(out + i*Spooler::RECORD_SIZE, Slot(m_head + skip + i), Spooler::RECORD_SIZE);
+    return n;
+}
+
+void Spool::Consume(size_t n){
+    if(!m_base) return;
+    if(n>Size()) n = Size();
+    m_head += n;
+    Commit();
+}
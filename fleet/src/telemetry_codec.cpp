@@ -0,0 +1,568 @@
+#include "../include/telemetry_codec.h"
+#include "../include/crc16.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Worst case encoded bytes per packet, column by column:
+// seq 5 + ts 10 + rpm/speed/jerk 3 each + temp/battery/cpu 2 each
+// + 6 run-length columns at 6 + crc 2 = 68, plus the per-column tag bytes
+const size_t MAX_BYTES_PER_PACKET = 72;
+const size_t MAX_TAG_BYTES = 8;
+const size_t WRITE_SLACK = 8; // PutPacked's overhanging stores
+
+// Varint columns are stored either way, whichever is smaller for the block
+const uint8_t COLUMN_VARINT = 0;
+const uint8_t COLUMN_PACKED = 1;
+
+// Bit-packed groups: one width byte, then GROUP values at that many bits
+const size_t GROUP = 32;
+
+inline uint64_t ZigZag(uint64_t v) { return (v << 1) ^ (uint64_t)((int64_t)v >> 63); }
+inline uint64_t UnZigZag(uint64_t v) { return (v >> 1) ^ (0 - (v & 1)); }
+
+inline uint8_t* PutVarint(uint8_t* w, uint64_t v){
+    while(v>=0x80){
+        *w++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *w++ = (uint8_t)v;
+    return w;
+}
+
+inline bool GetVarint(const uint8_t*& r, const uint8_t* end, uint64_t& v){
+    v = 0;
+    for(int shift=0; shift<64 && r<end; shift+=7){
+        uint8_t b = *r++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline void PutBE(uint8_t* w, uint64_t v, int bytes){
+    for(int i=0; i<bytes; i++) w[i] = (uint8_t)(v >> (8*(bytes-1-i)));
+}
+
+inline uint64_t GetBE(const uint8_t* r, int bytes){
+    uint64_t v = 0;
+    for(int i=0; i<bytes; i++) v = (v << 8) | r[i];
+    return v;
+}
+
+// --- Column transforms, all in wrapping uint64 arithmetic ---
+// Narrow fields are widened (jerk sign-extended) so small changes stay small.
+
+void Delta(uint64_t* v, size_t n){
+    for(size_t i=n; i-->1;) v[i] -= v[i-1];
+}
+
+void UnDelta(uint64_t* v, size_t n){
+    for(size_t i=1; i<n; i++) v[i] += v[i-1];
+}
+
+// v0, v1-v0, then (vi-vi-1) - (vi-1 - vi-2)
+void DeltaOfDelta(uint64_t* v, size_t n){
+    Delta(v, n);
+    for(size_t i=n; i-->2;) v[i] -= v[i-1];
+}
+
+void UnDeltaOfDelta(uint64_t* v, size_t n){
+    for(size_t i=2; i<n; i++) v[i] += v[i-1];
+    UnDelta(v, n);
+}
+
+// Zig-zag varints, a zero is followed by (run length - 1)
+uint8_t* PutVarints(uint8_t* w, const uint64_t* v, size_t n){
+    size_t i = 0;
+    while(i<n){
+        if(v[i]!=0){
+            w = PutVarint(w, ZigZag(v[i++]));
+            continue;
+        }
+        size_t run = 1;
+        while(i+run<n && v[i+run]==0) run++;
+        *w++ = 0;
+        w = PutVarint(w, run - 1);
+        i += run;
+    }
+    return w;
+}
+
+bool GetVarints(const uint8_t*& r, const uint8_t* end, uint64_t* v, size_t n){
+    size_t i = 0;
+    while(i<n){
+        uint64_t zz;
+        if(!GetVarint(r, end, zz)) return false;
+        if(zz!=0){
+            v[i++] = UnZigZag(zz);
+            continue;
+        }
+        uint64_t run;
+        if(!GetVarint(r, end, run) || run>=n-i) return false;
+        std::fill(v + i, v + i + run + 1, 0);
+        i += run + 1;
+    }
+    return true;
+}
+
+inline int BitWidth(uint64_t v) { return v ? 64 - __builtin_clzll(v) : 0; }
+
+inline uint64_t LowBits(uint64_t v, int bits) { return bits>=64 ? v : v & ((1ull << bits) - 1); }
+
+inline size_t VarintLen(uint64_t v) { return 1 + (BitWidth(v | 1) - 1) / 7; }
+
+// What PutVarints would write, without writing it
+size_t VarintsSize(const uint64_t* v, size_t n){
+    size_t size = 0;
+    size_t i = 0;
+    while(i<n){
+        if(v[i]!=0){
+            size += VarintLen(ZigZag(v[i++]));
+            continue;
+        }
+        size_t run = 1;
+        while(i+run<n && v[i+run]==0) run++;
+        size += 1 + VarintLen(run - 1);
+        i += run;
+    }
+    return size;
+}
+
+size_t PackedSize(const uint64_t* v, size_t n){
+    size_t size = 0;
+    for(size_t g=0; g<n; g+=GROUP){
+        size_t m = std::min(GROUP, n - g);
+        uint64_t any = 0;
+        for(size_t i=0; i<m; i++) any |= ZigZag(v[g+i]);
+        size += 1 + (m*BitWidth(any) + 7) / 8;
+    }
+    return size;
+}
+
+// Zig-zag values bit-packed LSB first, every group starts on a byte.
+// May write up to 8 bytes of scratch past the returned end.
+uint8_t* PutPacked(uint8_t* w, const uint64_t* v, size_t n){
+    for(size_t g=0; g<n; g+=GROUP){
+        size_t m = std::min(GROUP, n - g);
+        uint64_t any = 0;
+        for(size_t i=0; i<m; i++) any |= ZigZag(v[g+i]);
+        int width = BitWidth(any);
+        *w++ = (uint8_t)width;
+
+        uint64_t acc = 0;
+        int bits = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if(width<=56){
+            // Branch-free: store the whole accumulator every value and move
+            // on by the bytes that are complete (at most 7, never a full 64)
+            for(size_t i=0; i<m; i++){
+                acc |= ZigZag(v[g+i]) << bits;
+                std::memcpy(w, &acc, 8);
+                bits += width;
+                w += bits >> 3;
+                acc >>= bits & ~7;
+                bits &= 7;
+            }
+            if(bits>0) w++;
+            continue;
+        }
+#endif
+        for(size_t i=0; i<m; i++){
+            uint64_t z = ZigZag(v[g+i]);
+            acc |= z << bits;
+            bits += width;
+            if(bits>=64){
+                for(int b=0; b<8; b++) *w++ = (uint8_t)(acc >> (8*b));
+                bits -= 64;
+                acc = bits ? z >> (width - bits) : 0;
+            }
+        }
+        for(; bits>0; bits-=8, acc>>=8) *w++ = (uint8_t)acc;
+    }
+    return w;
+}
+
+// Generic bit reader, any width up to 64
+void UnpackSlow(const uint8_t* p, const uint8_t* end, int width, uint64_t* v, size_t m){
+    uint64_t acc = 0;
+    int avail = 0;
+    for(size_t i=0; i<m; i++){
+        uint64_t z = 0;
+        int got = 0;
+        while(got<width){
+            if(avail==0){
+                acc = 0;
+                for(; avail<64 && p<end; avail+=8) acc |= (uint64_t)*p++ << avail;
+            }
+            int take = std::min(width - got, avail);
+            z |= LowBits(acc, take) << got;
+            acc = take>=64 ? 0 : acc >> take;
+            avail -= take;
+            got += take;
+        }
+        v[i] = UnZigZag(z);
+    }
+}
+
+bool GetPacked(const uint8_t*& r, const uint8_t* end, uint64_t* v, size_t n){
+    // Group copied into a padded buffer so every value is one unaligned
+    // 8-byte load + shift + mask, without reading past the column
+    uint8_t buf[GROUP*8 + 8];
+    for(size_t g=0; g<n; g+=GROUP){
+        size_t m = std::min(GROUP, n - g);
+        if(r>=end) return false;
+        int width = *r++;
+        if(width>64) return false;
+        size_t bytes = (m*width + 7) / 8;
+        if((size_t)(end - r) < bytes) return false;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if(width<=57){
+            std::memcpy(buf, r, bytes);
+            std::memset(buf + bytes, 0, 8);
+            const uint64_t mask = LowBits(~0ull, width);
+            for(size_t i=0; i<m; i++){
+                size_t pos = i*width;
+                uint64_t word;
+                std::memcpy(&word, buf + pos/8, 8);
+                v[g+i] = UnZigZag((word >> (pos & 7)) & mask);
+            }
+            r += bytes;
+            continue;
+        }
+#endif
+        UnpackSlow(r, r + bytes, width, v + g, m);
+        r += bytes;
+    }
+    return true;
+}
+
+// Tag byte, then the varint or bit-packed form, whichever is smaller
+uint8_t* PutColumn(uint8_t* w, const uint64_t* v, size_t n){
+    if(PackedSize(v, n) < VarintsSize(v, n)){
+        *w++ = COLUMN_PACKED;
+        return PutPacked(w, v, n);
+    }
+    *w++ = COLUMN_VARINT;
+    return PutVarints(w, v, n);
+}
+
+bool GetColumn(const uint8_t*& r, const uint8_t* end, uint64_t* v, size_t n){
+    if(r>=end) return false;
+    uint8_t tag = *r++;
+    if(tag==COLUMN_VARINT) return GetVarints(r, end, v, n);
+    if(tag==COLUMN_PACKED) return GetPacked(r, end, v, n);
+    return false;
+}
+
+// (value, run length - 1) pairs
+uint8_t* PutRuns(uint8_t* w, const uint64_t* v, size_t n){
+    size_t i = 0;
+    while(i<n){
+        size_t run = 1;
+        while(i+run<n && v[i+run]==v[i]) run++;
+        w = PutVarint(w, v[i]);
+        w = PutVarint(w, run - 1);
+        i += run;
+    }
+    return w;
+}
+
+bool GetRuns(const uint8_t*& r, const uint8_t* end, uint64_t* v, size_t n){
+    size_t i = 0;
+    while(i<n){
+        uint64_t value, run;
+        if(!GetVarint(r, end, value) || !GetVarint(r, end, run) || run>=n-i) return false;
+        std::fill(v + i, v + i + run + 1, value);
+        i += run + 1;
+    }
+    return true;
+}
+
+template <typename Fn>
+void Gather(const Packet* p, size_t n, uint64_t* v, Fn field){
+    for(size_t i=0; i<n; i++) v[i] = field(p[i]);
+}
+
+template <typename Fn>
+void Scatter(Packet* p, size_t n, const uint64_t* v, Fn field){
+    for(size_t i=0; i<n; i++) field(p[i], v[i]);
+}
+
+} // namespace
+
+// --- Encoder ---
+
+TelemetryEncoder::TelemetryEncoder(size_t block_records)
+    : m_block_records(block_records==0 ? 1 : std::min(block_records, Codec::MAX_BLOCK_RECORDS)) {
+    m_pending.reserve(m_block_records);
+}
+
+void TelemetryEncoder::Add(const Packet& packet){
+    if(!m_pending.empty() && m_pending.back().vehicle_id!=packet.vehicle_id) Flush();
+    m_pending.push_back(packet);
+    if(m_pending.size()>=m_block_records) Flush();
+}
+
+void TelemetryEncoder::Add(const Packet* packets, size_t count){
+    for(size_t i=0; i<count; i++) Add(packets[i]);
+}
+
+void TelemetryEncoder::Flush(){
+    if(m_pending.empty()) return;
+    m_index.push_back(EncodeBlock(m_pending.data(), m_pending.size(), m_out));
+    m_pending.clear();
+}
+
+void TelemetryEncoder::Clear(){
+    m_pending.clear();
+    m_out.clear();
+    m_index.clear();
+}
+
+CodecBlockInfo TelemetryEncoder::EncodeBlock(const Packet* p, size_t n, std::vector<uint8_t>& out){
+    CodecBlockInfo info;
+    info.offset = out.size();
+    info.count = (uint16_t)n;
+    info.vehicle_id = p[0].vehicle_id;
+    info.first_seq = p[0].sequence_id;
+    info.first_ts = p[0].timestamp;
+    info.last_ts = p[n-1].timestamp;
+
+    // CRC column only if some packet doesn't carry its own valid CRC
+    m_wire.resize(n * Packet::SIZE);
+    for(size_t i=0; i<n; i++) p[i].serialize(m_wire.data() + i*Packet::SIZE);
+    if(Crc16::VerifyBatch(m_wire.data(), n, nullptr)==n) info.options |= Codec::OPT_CRC_RECOMPUTE;
+
+    out.resize(info.offset + Codec::HEADER_SIZE + n*MAX_BYTES_PER_PACKET + MAX_TAG_BYTES + WRITE_SLACK);
+    uint8_t* start = out.data() + info.offset + Codec::HEADER_SIZE;
+    uint8_t* w = start;
+    m_values.resize(n);
+    uint64_t* v = m_values.data();
+
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.sequence_id; });
+    DeltaOfDelta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.timestamp; });
+    DeltaOfDelta(v, n);
+    w = PutColumn(w, v, n);
+
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.rpm; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.speed; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)(int64_t)x.jerk; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.temp; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.battery_level; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.cpu_load; });
+    Delta(v, n);
+    w = PutColumn(w, v, n);
+
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.gear; });
+    w = PutRuns(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.flags; });
+    w = PutRuns(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.version; });
+    w = PutRuns(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.magic; });
+    w = PutRuns(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.reserved[0]; });
+    w = PutRuns(w, v, n);
+    Gather(p, n, v, [](const Packet& x){ return (uint64_t)x.reserved[1]; });
+    w = PutRuns(w, v, n);
+
+    if(!(info.options & Codec::OPT_CRC_RECOMPUTE)){
+        for(size_t i=0; i<n; i++, w+=2) PutBE(w, p[i].crc16, 2);
+    }
+
+    uint32_t payload = (uint32_t)(w - start);
+    info.size = (uint32_t)Codec::HEADER_SIZE + payload;
+    out.resize(info.offset + info.size);
+
+    uint8_t* h = out.data() + info.offset;
+    PutBE(h + 0x00, Codec::MAGIC, 2);
+    h[0x02] = Codec::VERSION;
+    h[0x03] = info.options;
+    PutBE(h + 0x04, info.count, 2);
+    PutBE(h + 0x06, info.vehicle_id, 2);
+    PutBE(h + 0x08, info.first_seq, 4);
+    PutBE(h + 0x0C, info.first_ts, 8);
+    PutBE(h + 0x14, info.last_ts, 8);
+    PutBE(h + 0x1C, payload, 4);
+    return info;
+}
+
+// --- Decoder ---
+
+CodecError TelemetryDecoder::ReadHeader(const uint8_t* data, size_t len, CodecBlockInfo& out){
+    if(len<Codec::HEADER_SIZE) return CodecError::TOO_SHORT;
+    if(GetBE(data, 2)!=Codec::MAGIC) return CodecError::BAD_MAGIC;
+    if(data[2]==0 || data[2]>Codec::VERSION) return CodecError::BAD_VERSION;
+    uint64_t payload = GetBE(data + 0x1C, 4);
+    if(payload > len - Codec::HEADER_SIZE) return CodecError::TOO_SHORT;
+    out.options = data[0x03];
+    out.count = (uint16_t)GetBE(data + 0x04, 2);
+    out.vehicle_id = (uint16_t)GetBE(data + 0x06, 2);
+    out.first_seq = (uint32_t)GetBE(data + 0x08, 4);
+    out.first_ts = GetBE(data + 0x0C, 8);
+    out.last_ts = GetBE(data + 0x14, 8);
+    out.size = (uint32_t)(Codec::HEADER_SIZE + payload);
+    if(out.count==0) return CodecError::CORRUPT;
+    return CodecError::OK;
+}
+
+CodecError TelemetryDecoder::DecodeBlock(const uint8_t* data, size_t len, std::vector<Packet>& out, size_t* consumed){
+    CodecBlockInfo info;
+    CodecError err = ReadHeader(data, len, info);
+    if(err!=CodecError::OK) return err;
+
+    const size_t n = info.count;
+    const uint8_t* r = data + Codec::HEADER_SIZE;
+    const uint8_t* end = data + info.size;
+    size_t base = out.size();
+    out.resize(base + n);
+    Packet* p = out.data() + base;
+    m_values.resize(n);
+    uint64_t* v = m_values.data();
+    bool ok = true;
+
+    for(size_t i=0; i<n; i++) p[i].vehicle_id = info.vehicle_id;
+
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDeltaOfDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.sequence_id = (uint32_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDeltaOfDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.timestamp = val; });
+    }
+
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.rpm = (uint16_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.speed = (uint16_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.jerk = (int16_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.temp = (uint8_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.battery_level = (uint8_t)val; });
+    }
+    ok = ok && GetColumn(r, end, v, n);
+    if(ok){
+        UnDelta(v, n);
+        Scatter(p, n, v, [](Packet& x, uint64_t val){ x.cpu_load = (uint8_t)val; });
+    }
+
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.gear = (uint8_t)val; });
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.flags = (uint8_t)val; });
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.version = (uint8_t)val; });
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.magic = (uint16_t)val; });
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.reserved[0] = (uint8_t)val; });
+    ok = ok && GetRuns(r, end, v, n);
+    if(ok) Scatter(p, n, v, [](Packet& x, uint64_t val){ x.reserved[1] = (uint8_t)val; });
+
+    if(ok && (info.options & Codec::OPT_CRC_RECOMPUTE)){
+        m_wire.resize(n * Packet::SIZE);
+        for(size_t i=0; i<n; i++) p[i].serialize(m_wire.data() + i*Packet::SIZE);
+        Crc16::StampBatch(m_wire.data(), n);
+        for(size_t i=0; i<n; i++) p[i].crc16 = (uint16_t)GetBE(m_wire.data() + i*Packet::SIZE + Crc16::OFFSET, 2);
+    }
+    else if(ok){
+        ok = (size_t)(end - r) >= 2*n;
+        for(size_t i=0; ok && i<n; i++, r+=2) p[i].crc16 = (uint16_t)GetBE(r, 2);
+    }
+
+    if(!ok || r!=end){
+        out.resize(base);
+        return CodecError::CORRUPT;
+    }
+    if(consumed) *consumed = info.size;
+    return CodecError::OK;
+}
+
+CodecError TelemetryDecoder::DecodeStream(const uint8_t* data, size_t len, std::vector<Packet>& out){
+    size_t pos = 0;
+    while(pos<len){
+        size_t used = 0;
+        CodecError err = DecodeBlock(data + pos, len - pos, out, &used);
+        if(err!=CodecError::OK) return err;
+        pos += used;
+    }
+    return CodecError::OK;
+}
+
+// --- Index ---
+
+CodecError BlockIndex::Build(const uint8_t* data, size_t len){
+    m_blocks.clear();
+    size_t pos = 0;
+    while(pos<len){
+        CodecBlockInfo info;
+        CodecError err = TelemetryDecoder::ReadHeader(data + pos, len - pos, info);
+        if(err!=CodecError::OK) return err;
+        info.offset = pos;
+        m_blocks.push_back(info);
+        pos += info.size;
+    }
+    Sort();
+    return CodecError::OK;
+}
+
+void BlockIndex::Assign(const std::vector<CodecBlockInfo>& blocks){
+    m_blocks = blocks;
+    Sort();
+}
+
+void BlockIndex::Sort(){
+    m_order.resize(m_blocks.size());
+    for(size_t i=0; i<m_order.size(); i++) m_order[i] = (uint32_t)i;
+    std::stable_sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b){
+        const CodecBlockInfo& x = m_blocks[a];
+        const CodecBlockInfo& y = m_blocks[b];
+        if(x.vehicle_id!=y.vehicle_id) return x.vehicle_id < y.vehicle_id;
+        return x.first_ts < y.first_ts;
+    });
+}
+
+const CodecBlockInfo* BlockIndex::Find(uint16_t vehicle_id, uint64_t timestamp) const {
+    // Blocks of one vehicle don't overlap in time, so last_ts is sorted too
+    auto it = std::lower_bound(m_order.begin(), m_order.end(), 0u, [&](uint32_t i, uint32_t){
+        const CodecBlockInfo& b = m_blocks[i];
+        if(b.vehicle_id!=vehicle_id) return b.vehicle_id < vehicle_id;
+        return b.last_ts < timestamp;
+    });
+    if(it==m_order.end() || m_blocks[*it].vehicle_id!=vehicle_id) return nullptr;
+    return &m_blocks[*it];
+}
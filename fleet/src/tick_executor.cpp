@@ -0,0 +1,146 @@
+#include "../include/tick_executor.h"
+#include <chrono>
+#include <iomanip>
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+static uint64_t NowNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TickExecutor::TickExecutor(size_t workers, size_t shards, bool pin) : m_pin(pin) {
+    if(workers==0) workers = std::thread::hardware_concurrency();
+    if(workers==0) workers = 1;
+    if(shards<workers) shards = workers;
+
+    m_shards.resize(shards);
+    for(size_t w=0; w<workers; w++){
+        m_workers.emplace_back(new Worker());
+        m_workers[w]->begin = (uint32_t)(w * shards / workers);
+        m_workers[w]->end = (uint32_t)((w + 1) * shards / workers);
+    }
+    for(size_t w=1; w<workers; w++){
+        m_workers[w]->thread = std::thread(&TickExecutor::WorkerMain, this, w);
+    }
+}
+
+TickExecutor::~TickExecutor(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for(auto& worker : m_workers){
+        if(worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+void TickExecutor::Pin(size_t cpu){
+#if defined(__linux__)
+    unsigned cores = std::thread::hardware_concurrency();
+    if(cores==0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cores, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+void TickExecutor::Run(const Task& task){
+    // The caller is pinned on its first tick rather than at construction, so
+    // side threads it started in between keep the full CPU mask. Only worth
+    // it with a pool to spread over.
+    if(m_ticks==0 && m_pin && m_workers.size()>1) Pin(0);
+    uint64_t start = NowNs();
+    for(auto& worker : m_workers) worker->next.store(worker->begin, std::memory_order_relaxed);
+
+    if(m_workers.size()>1){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_busy.store(m_workers.size() - 1, std::memory_order_relaxed);
+            m_generation.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_start.notify_all();
+    }
+    else m_task = &task;
+
+    Drain(0);
+
+    if(m_workers.size()>1){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]{ return m_busy.load(std::memory_order_acquire)==0; });
+    }
+    m_task = nullptr;
+    m_tick_time.Record(NowNs() - start);
+    m_ticks++;
+}
+
+void TickExecutor::WorkerMain(size_t w){
+    if(m_pin) Pin(w);
+    uint64_t seen = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&]{ return m_stop || m_generation.load(std::memory_order_relaxed)!=seen; });
+            if(m_stop) return;
+            seen = m_generation.load(std::memory_order_relaxed);
+        }
+        Drain(w);
+        if(m_busy.fetch_sub(1, std::memory_order_acq_rel)==1){
+            // Taking the lock orders this with the waiter's predicate check
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.notify_one();
+        }
+    }
+}
+
+// Own range first, then whatever is left in the other workers' ranges
+void TickExecutor::Drain(size_t w){
+    Worker& own = *m_workers[w];
+    uint32_t shard;
+    while((shard = own.next.fetch_add(1, std::memory_order_relaxed)) < own.end) RunShard(w, shard);
+
+    size_t count = m_workers.size();
+    for(size_t k=1; k<count; k++){
+        Worker& victim = *m_workers[(w + k) % count];
+        while((shard = victim.next.fetch_add(1, std::memory_order_relaxed)) < victim.end){
+            RunShard(w, shard);
+            own.stolen++;
+        }
+    }
+}
+
+void TickExecutor::RunShard(size_t w, uint32_t shard){
+    uint64_t start = NowNs();
+    (*m_task)(shard, w);
+    Shard& s = m_shards[shard];
+    s.last_ns = NowNs() - start;
+    s.last_worker = w;
+    s.time.Record(s.last_ns);
+    m_workers[w]->executed++;
+}
+
+void TickExecutor::Report(std::ostream& os) const {
+    os << std::fixed << std::setprecision(1)
+       << "Executor: " << m_workers.size() << " workers, " << m_shards.size() << " shards, "
+       << m_ticks << " ticks | tick p50 " << m_tick_time.Percentile(0.50) / 1e3
+       << " | p99 " << m_tick_time.Percentile(0.99) / 1e3
+       << " | max " << m_tick_time.Max() / 1e3 << " us\n";
+    for(size_t w=0; w<m_workers.size(); w++){
+        os << "  worker " << w << ": " << m_workers[w]->executed << " shard runs, "
+           << m_workers[w]->stolen << " stolen\n";
+    }
+    for(size_t s=0; s<m_shards.size(); s++){
+        const Histogram& h = m_shards[s].time;
+        os << "  shard " << s << " (us): p50 " << h.Percentile(0.50) / 1e3
+           << " | p99 " << h.Percentile(0.99) / 1e3
+           << " | max " << h.Max() / 1e3 << "\n";
+    }
+}
@@ -1,7 +1,9 @@
 #include "../include/vehicle.h"
+#include "../include/metrics.h"
+#include "../include/event_log.h"
+#include "../include/counter_rng.h"
 #include <algorithm>
 #include <cmath>
-#include <iostream>
 
 template <typename T>
 inline T clamp(T v, T lo, T hi)
@@ -9,125 +11,142 @@ inline T clamp(T v, T lo, T hi)
     return (v < lo) ? lo : (v > hi) ? hi : v;
 }
 
-Vehicle::Vehicle(uint16_t id) 
+// Magnitude without std::abs, which has no Fixed16 overload
+template <typename Real>
+static inline Real Abs(Real v){
+    return (v < Real(0)) ? -v : v;
+}
+
+template <typename Real>
+BasicVehicle<Real>::BasicVehicle(uint16_t id, uint64_t seed) 
         : m_id(id), 
-        m_noise(0.0,2.5), 
         m_battery_level(100.0),
         m_remote_kill(false),
-        m_limp_mode(false) {
-    m_rng.seed(id);
-    m_speed = 0.0;
-    m_rpm = 800;
-    m_temp = 25.0;
+        m_limp_mode(false),
+        m_seed(seed),
+        m_ticks(0) {
+    m_speed = Real(0.0);
+    m_rpm = Real(800.0);
+    m_temp = Real(25.0);
     m_gear = 1;
 
-    m_target_speed = 110.0+(id%50);
-    m_acceleration = 0.0;
-    m_prev_accel = 0.0;
-    m_throttle = 0.0;
+    m_target_speed = Real(110.0+(id%50));
+    m_acceleration = Real(0.0);
+    m_prev_accel = Real(0.0);
+    m_throttle = Real(0.0);
 }
 
-double Vehicle::GetTorqueCurve(double rpm){
+template <typename Real>
+Real BasicVehicle<Real>::GetTorqueCurve(Real rpm){
     // peak torque at 4500 RPM
 
-    double deviation = (rpm-4500)/4500;
-    double curve_factor = 1.0 - (deviation*deviation);
+    Real deviation = (rpm-Real(4500.0))/Real(4500.0);
+    Real curve_factor = Real(1.0) - (deviation*deviation);
 
-    return clamp(curve_factor, 0.3, 1.0);
+    return clamp(curve_factor, Real(0.3), Real(1.0));
 }
 
-void Vehicle::CalculateRPM(){
+template <typename Real>
+void BasicVehicle<Real>::CalculateRPM(){
     if(m_remote_kill){
-        m_rpm = 0.0;
+        m_rpm = Real(0.0);
         return;
     }
-    double gear_ratio = 4.8 - (m_gear*0.65);
-    if(gear_ratio<0.8) gear_ratio = 0.8;
+    Real gear_ratio = Real(4.8) - (Real(m_gear)*Real(0.65));
+    if(gear_ratio<Real(0.8)) gear_ratio = Real(0.8);
 
     // RPM = Speed+Ratio*FinalDrive
-    m_rpm = m_speed*gear_ratio*25.0;
+    m_rpm = m_speed*gear_ratio*Real(25.0);
 
     // Engine Idle Floor
-    if (m_rpm<800.0) m_rpm = 800.0;
+    if (m_rpm<Real(800.0)) m_rpm = Real(800.0);
 
     // Safety Redline Cap
-    if(m_rpm>16000.0) m_rpm = 16000.0;
+    if(m_rpm>Real(16000.0)) m_rpm = Real(16000.0);
 }
 
-void Vehicle::SetThrottle(double throttle){
+template <typename Real>
+void BasicVehicle<Real>::SetThrottle(double throttle){
     throttle = clamp(throttle, -1.0, 1.0);
-    m_throttle = throttle;
+    m_throttle = Real(throttle);
 }
 
-void Vehicle::OnCommand(uint8_t opcode){
+template <typename Real>
+void BasicVehicle<Real>::OnCommand(uint8_t opcode){
     switch (opcode) {
         case CMD_KILL:
             m_remote_kill = true;
-            std::cout<<"[CMD] REMOTE KILL SWITCH ACTIVE!!";
+            EventLog::Write(LogEvent::VEHICLE_KILL, m_id);
             break;
         case CMD_LIMP:
             m_limp_mode = true;
-            std::cout<<"[CMD] LIMP MODE ACTIVE!!";
+            EventLog::Write(LogEvent::VEHICLE_LIMP, m_id);
             break;
         case CMD_NORMAL:
             m_remote_kill = false;
             m_limp_mode = false;
-            std::cout<<"[CMD] REGULAR MODE. \n";
+            EventLog::Write(LogEvent::VEHICLE_NORMAL, m_id);
             break;
         default:
-            std::cout<<"[CMD] Unknown OpCode: " << (int)opcode << "\n";
+            EventLog::Write(LogEvent::VEHICLE_UNKNOWN_CMD, m_id, opcode);
             break;
     }
 }
 
-void Vehicle::Tick(double dt){
+template <typename Real>
+void BasicVehicle<Real>::Tick(double dt_seconds){
+    Metrics::ScopedTimer timer(Latency::VEHICLE_TICK);
+    Metrics::Add(Counter::VEHICLE_TICKS);
+    m_ticks++;
+    const Real dt(dt_seconds);
     // 1. CONTINUOUS THROTTLE (Proportional Control)
     // Error = target - current
-    double speed_error = m_target_speed - m_speed;
+    Real speed_error = m_target_speed - m_speed;
 
-    double internal_demand = clamp(speed_error*0.1, 0.0, 1.0);
-    double final_throttle = (m_throttle>0) ? m_throttle : internal_demand;
+    Real internal_demand = clamp(speed_error*Real(0.1), Real(0.0), Real(1.0));
+    Real final_throttle = (m_throttle>Real(0.0)) ? m_throttle : internal_demand;
 
     // Intervention logic
     if(m_remote_kill){
-        final_throttle = -1.0;
-        m_rpm = 0;
+        final_throttle = Real(-1.0);
+        m_rpm = Real(0.0);
     } else if(m_limp_mode){
-        if(m_speed>40.0) final_throttle = -0.5;
-        else if(final_throttle>0.3) final_throttle = 0.3;
+        if(m_speed>Real(40.0)) final_throttle = Real(-0.5);
+        else if(final_throttle>Real(0.3)) final_throttle = Real(0.3);
     }
 
     // 2. Engine force
-    double max_torque = 100.0;
-    double torque_curve = GetTorqueCurve(m_rpm);
+    Real max_torque(100.0);
+    Real torque_curve = GetTorqueCurve(m_rpm);
 
     // Final force (PID)
-    double force_engine = final_throttle * torque_curve * max_torque;
+    Real force_engine = final_throttle * torque_curve * max_torque;
 
     // 3. RESISTANCE
-    double force_friction = (m_speed>0) ? 5.0 : 0.0;
-    double force_drag = 0.0035*m_speed*m_speed;
+    Real force_friction = (m_speed>Real(0.0)) ? Real(5.0) : Real(0.0);
+    // Coefficient first, so Fixed16 never holds speed squared
+    Real force_drag = Real(0.0035)*m_speed*m_speed;
 
     // 4. INTEGRATION
-    double net_force = force_engine - force_friction - force_drag;
+    Real net_force = force_engine - force_friction - force_drag;
 
     // Engine Braking
-    if(final_throttle<-0.1) net_force -= (std::abs(final_throttle))*15.0;
-    if (final_throttle<0.05 && m_speed>0) net_force -= 2.0;
+    if(final_throttle<Real(-0.1)) net_force -= Abs(final_throttle)*Real(15.0);
+    if (final_throttle<Real(0.05) && m_speed>Real(0.0)) net_force -= Real(2.0);
 
     m_prev_accel = m_acceleration;
     m_acceleration = net_force;
 
     m_speed += (m_acceleration*dt);
-    if(m_speed<0) m_speed = 0;
+    if(m_speed<Real(0.0)) m_speed = Real(0.0);
 
     CalculateRPM();
 
     bool shifted = false;
-    if(m_rpm>7500 && m_gear<6) {
+    if(m_rpm>Real(7500.0) && m_gear<6) {
         m_gear++; shifted = true;
     }
-    else if(m_rpm < 2500 && m_gear>1) {
+    else if(m_rpm < Real(2500.0) && m_gear>1) {
         m_gear--; shifted = true;
     }
 
@@ -135,42 +154,52 @@ void Vehicle::Tick(double dt){
     if(shifted) CalculateRPM();
 
     // Thermodynamics
-    double heat_in = (m_rpm/3000.0)*15.0*dt;
-    double heat_out = (m_temp-25.0)*0.2*dt;
+    Real heat_in = (m_rpm/Real(3000.0))*Real(15.0)*dt;
+    Real heat_out = (m_temp-Real(25.0))*Real(0.2)*dt;
     m_temp += (heat_in - heat_out);
-    m_temp = clamp(m_temp,25.0,150.0);
+    m_temp = clamp(m_temp,Real(25.0),Real(150.0));
 
-    if(m_speed>0) {
-        m_battery_level -= (0.05 * dt);
+    if(m_speed>Real(0.0)) {
+        m_battery_level -= (Real(0.05) * dt);
     }
-    if(m_battery_level<0) m_battery_level = 0;
+    if(m_battery_level<Real(0.0)) m_battery_level = Real(0.0);
 
 }
 
-void Vehicle::Snapshot(Packet &p, double dt){
+template <typename Real>
+void BasicVehicle<Real>::Snapshot(Packet &p, double dt){
+    // Everything leaves the model as double, the packet fields are narrower anyway
+    const double rpm = static_cast<double>(m_rpm);
+    const double acceleration = static_cast<double>(m_acceleration);
+    const double prev_accel = static_cast<double>(m_prev_accel);
     p.vehicle_id = m_id;
     p.version = 1;
-    double noisy_rpm = m_rpm + m_noise(m_rng);
+    double noisy_rpm = rpm + VehicleNoise::RPM_SIGMA * CounterRng::Gaussian(m_seed, m_id, m_ticks, CounterRng::RPM_NOISE);
     p.rpm = static_cast<uint16_t>(clamp(noisy_rpm, 0.0, 16000.0));
-    p.speed = static_cast<uint16_t>(m_speed);
+    p.speed = static_cast<uint16_t>(static_cast<double>(m_speed));
     p.gear = static_cast<uint8_t>(m_gear);
-    p.temp = static_cast<uint8_t>(m_temp);
-    p.battery_level = static_cast<uint8_t>(m_battery_level);
+    p.temp = static_cast<uint8_t>(static_cast<double>(m_temp));
+    p.battery_level = static_cast<uint8_t>(static_cast<double>(m_battery_level));
     if(dt>0.0001){
-        double jerk_per_second = (m_acceleration - m_prev_accel)/0.1;
-        p.jerk = static_cast<int16_t>(jerk_per_second * 100.0);
+        double jerk_per_second = (acceleration - prev_accel)/dt;
+        p.jerk = static_cast<int16_t>(clamp(jerk_per_second * 100.0, -32768.0, 32767.0));
     }
     else p.jerk = 0;
     p.flags = 0;
     if(p.temp>115) p.flags |= Flags::OVERHEAT;
     if(p.battery_level<20) p.flags |= Flags::LOW_BATTERY;
-    if(m_acceleration<-5.0) p.flags |= Flags::ABS_ACTIVE;
+    if(acceleration<-5.0) p.flags |= Flags::ABS_ACTIVE;
 
     if(m_remote_kill) p.flags |= Flags::REMOTE_KILL;
 
-    p.cpu_load = 10 + (rand()%30);
+    p.cpu_load = VehicleNoise::CPU_LOAD_BASE
+               + CounterRng::Below(CounterRng::Bits(m_seed, m_id, m_ticks, CounterRng::CPU_LOAD), VehicleNoise::CPU_LOAD_SPAN);
 
     p.reserved[0] = 0;
     p.reserved[1] = 1;
 
-}
\ No newline at end of file
+}
+
+template class BasicVehicle<double>;
+template class BasicVehicle<float>;
+template class BasicVehicle<Fixed16>;
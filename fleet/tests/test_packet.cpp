@@ -3,7 +3,27 @@
 #include <cassert>
 #include <iomanip>
 #include <cstddef>
+#include <cstring>
 #include "../include/packet.h"
+#include "../include/batch_frame.h"
+#include "../include/crc16.h"
+#include "../include/packet_batch.h"
+#include "../include/telemetry_codec.h"
+#include "../include/packet_ring.h"
+#include "../include/spool.h"
+#include "../include/metrics.h"
+#include "../include/event_log.h"
+#include "../include/counter_rng.h"
+#include "../include/recording.h"
+#include "../include/ingest.h"
+#include "../include/tick_scheduler.h"
+#include <thread>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
 
 // "Hardcore" Test Macro
 #define ASSERT_EQ(val1, val2, msg) \
@@ -50,12 +70,893 @@ void test_alignment_offsets() {
     ASSERT_EQ(offsetof(Packet, crc16), 28, "CRC16 must start at byte 28");
 }
 
+// A second layout the tests can dispatch to: fields shuffled, timestamp and
+// rpm little-endian. Magic, version and CRC stay where every version has them.
+struct TestV2 {
+    static constexpr uint8_t VERSION = 2;
+    static constexpr Schema::Field FIELDS[] = {
+        {Schema::FieldId::MAGIC,         "magic",         0x00, 2, false, Schema::Endian::BIG},
+        {Schema::FieldId::RPM,           "rpm",           0x02, 2, false, Schema::Endian::LITTLE},
+        {Schema::FieldId::TIMESTAMP,     "timestamp",     0x04, 8, false, Schema::Endian::LITTLE},
+        {Schema::FieldId::SEQUENCE_ID,   "sequence_id",   0x0C, 4, false, Schema::Endian::BIG},
+        {Schema::FieldId::VEHICLE_ID,    "vehicle_id",    0x10, 2, false, Schema::Endian::BIG},
+        {Schema::FieldId::JERK,          "jerk",          0x12, 2, true,  Schema::Endian::BIG},
+        {Schema::FieldId::SPEED,         "speed",         0x14, 2, false, Schema::Endian::BIG},
+        {Schema::FieldId::TEMP,          "temp",          0x16, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::GEAR,          "gear",          0x17, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::BATTERY_LEVEL, "battery_level", 0x18, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::FLAGS,         "flags",         0x19, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::VERSION,       "version",       0x1A, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::CPU_LOAD,      "cpu_load",      0x1B, 1, false, Schema::Endian::BIG},
+        {Schema::FieldId::CRC16,         "crc16",         0x1C, 2, false, Schema::Endian::BIG},
+        {Schema::FieldId::RESERVED,      "reserved",      0x1E, 2, false, Schema::Endian::BIG},
+    };
+};
+using TestProtocol = Schema::Protocol<Schema::V1, TestV2>;
+static_assert(Schema::FitsPacket(TestProtocol{}), "TestV2 fits Packet");
+
+void test_packet_schema() {
+    Packet p{};
+    p.magic = Packet::MAGIC;
+    p.vehicle_id = 0x0102;
+    p.sequence_id = 0x03040506;
+    p.timestamp = 0x0708090A0B0C0D0Eull;
+    p.rpm = 0x1112;
+    p.speed = 0x1314;
+    p.jerk = -2;
+    p.temp = 0x15; p.battery_level = 0x16; p.gear = 0x17; p.flags = 0x18;
+    p.version = 1;
+    p.cpu_load = 0x19;
+    p.crc16 = 0x1A1B;
+    p.reserved[0] = p.reserved[1] = 0xEE;
+
+    // The generated V1 serializer against the layout as it was hand-written
+    const uint8_t expected[32] = {0xD3,0x50, 0x01,0x02, 0x03,0x04,0x05,0x06, 0x07,0x08,0x09,0x0A,0x0B,0x0C,0x0D,0x0E,
+                                  0x11,0x12, 0x13,0x14, 0xFF,0xFE, 0x15,0x16,0x17,0x18, 0x01,0x19, 0x1A,0x1B, 0x00,0x00};
+    uint8_t wire[32];
+    p.serialize(wire);
+    ASSERT_EQ(std::memcmp(wire, expected, 32), 0, "Generated V1 serialize matches the wire layout");
+    Packet back{};
+    back.deserialize(wire);
+    ASSERT_EQ(back.jerk, -2, "Negative jerk survives the round trip");
+    ASSERT_EQ(back.timestamp, p.timestamp, "Timestamp survives the round trip");
+
+    ASSERT_EQ((int)TestProtocol::Known(1) + (int)TestProtocol::Known(2), 2, "Both versions are known");
+    ASSERT_EQ((int)TestProtocol::Known(0) + (int)TestProtocol::Known(3), 0, "Version 0 and 3 are not");
+    ASSERT_EQ((int)TestProtocol::LATEST, 2, "Latest version is the last layout");
+
+    // Dispatch on the version byte picks the matching layout
+    p.version = 2;
+    uint8_t v2[32];
+    bool known = TestProtocol::Dispatch(p.version, [&](auto layout){ Schema::SerializeAs<decltype(layout)>(p, v2); });
+    ASSERT_EQ((int)known, 1, "Version 2 dispatches");
+    ASSERT_EQ((int)v2[2], 0x12, "V2 rpm is little-endian");
+    ASSERT_EQ((int)v2[4], 0x0E, "V2 timestamp is little-endian");
+    ASSERT_EQ((int)v2[0x10], 0x01, "V2 vehicle id moved");
+    ASSERT_EQ((int)v2[TestProtocol::VERSION_OFFSET], 2, "V2 version byte");
+
+    Packet got{};
+    TestProtocol::Dispatch(v2[TestProtocol::VERSION_OFFSET], [&](auto layout){ Schema::DeserializeAs<decltype(layout)>(got, v2); });
+    got.reserved[0] = got.reserved[1] = 0xEE;
+    ASSERT_EQ(std::memcmp(&got, &p, sizeof(Packet)), 0, "V2 round trip restores every field");
+
+    uint8_t other[32];
+    ASSERT_EQ((int)TestProtocol::Dispatch(7, [&](auto layout){ Schema::SerializeAs<decltype(layout)>(p, other); }), 0,
+              "Unknown version is reported");
+    ASSERT_EQ(std::memcmp(other, v2, 32), 0, "Unknown version falls back to the newest layout");
+}
+
+void test_batch_frame_roundtrip() {
+    // Header + 3 records, built the way BatchPublisher lays them out
+    std::vector<uint8_t> frame(Batch::HEADER_SIZE + 3*Batch::RECORD_SIZE, 0);
+    frame[0] = 0xD3; frame[1] = 0x51;
+    frame[2] = Batch::VERSION;
+    frame[3] = Batch::RECORD_SIZE;
+    frame[5] = 3;
+    for(uint32_t i=0; i<3; i++){
+        Packet p{};
+        p.magic = 0xD350;
+        p.vehicle_id = 100 + i;
+        p.sequence_id = i;
+        p.serialize(frame.data() + Batch::HEADER_SIZE + i*Batch::RECORD_SIZE);
+    }
+
+    BatchView view;
+    ASSERT_EQ((int)BatchView::Parse(frame.data(), frame.size(), view), (int)BatchError::OK, "Batch frame parses");
+    ASSERT_EQ(view.Count(), 3u, "Batch carries 3 records");
+    ASSERT_EQ(view.Record(2)[3], 102, "Third record is vehicle 102");
+
+    ASSERT_EQ((int)BatchView::Parse(frame.data(), frame.size()-1, view), (int)BatchError::BAD_LENGTH, "Truncated batch is rejected");
+    frame[1] = 0x50;
+    ASSERT_EQ((int)BatchView::Parse(frame.data(), frame.size(), view), (int)BatchError::BAD_MAGIC, "Single-packet magic is not a batch");
+}
+
+void test_crc_implementations() {
+    // CRC-16/CCITT-FALSE check value
+    const uint8_t check[] = {'1','2','3','4','5','6','7','8','9'};
+    ASSERT_EQ(Crc16::Bitwise(check, 9), 0x29B1, "Bitwise CRC check value");
+    ASSERT_EQ(Crc16::Slice8(check, 9), 0x29B1, "Slice8 CRC check value");
+    ASSERT_EQ(Crc16::Clmul(check, 9), 0x29B1, "Clmul CRC check value");
+
+    // Every length around the 8-byte step, pseudo-random content
+    uint8_t data[100];
+    uint32_t x = 12345;
+    for(auto& b : data) { x = x*1103515245 + 12345; b = (uint8_t)(x >> 16); }
+    int mismatches = 0;
+    for(size_t len=0; len<=sizeof(data); len++){
+        uint16_t ref = Crc16::Bitwise(data, len);
+        if(Crc16::Slice8(data, len)!=ref || Crc16::Clmul(data, len)!=ref) mismatches++;
+    }
+    ASSERT_EQ(mismatches, 0, "Slice8/Clmul bit-exact with bitwise for 0..100 bytes");
+}
+
+void test_crc_batch() {
+    const size_t N = 64;
+    std::vector<uint8_t> records(N*32);
+    for(size_t i=0; i<N; i++){
+        Packet p{};
+        p.magic = 0xD350;
+        p.vehicle_id = (uint16_t)i;
+        p.sequence_id = (uint32_t)(i*7);
+        p.serialize(records.data() + i*32);
+    }
+    Crc16::StampBatch(records.data(), N);
+    ASSERT_EQ(((records[5*32+28]<<8) | records[5*32+29]), Crc16::Bitwise(records.data()+5*32, 28), "Stamped CRC matches reference");
+
+    records[10*32+3] ^= 0x01; // Corrupt one record
+    std::vector<uint8_t> ok(N);
+    ASSERT_EQ(Crc16::VerifyBatch(records.data(), N, ok.data()), N-1, "Batch verify flags exactly one bad record");
+    ASSERT_EQ((int)ok[10], 0, "Corrupted record is the one flagged");
+}
+
+// Deterministic records with every field busy, CRC stamped
+std::vector<uint8_t> make_records(size_t n) {
+    std::vector<uint8_t> records(n*32);
+    uint32_t x = 777;
+    for(size_t i=0; i<n; i++){
+        Packet p{};
+        p.magic = Packet::MAGIC;
+        p.vehicle_id = (uint16_t)(i*131);
+        p.sequence_id = 0x01020304u * (uint32_t)(i+1);
+        p.timestamp = 0x0102030405060708ull * (i+1);
+        x = x*1103515245 + 12345; p.rpm = (uint16_t)(x >> 8);
+        x = x*1103515245 + 12345; p.speed = (uint16_t)(x >> 8);
+        x = x*1103515245 + 12345; p.jerk = (int16_t)(x >> 8);
+        p.temp = (uint8_t)(i*3);
+        p.battery_level = (uint8_t)(i*5);
+        p.gear = (uint8_t)(i % 7);
+        p.flags = (uint8_t)(i*11);
+        p.version = Packet::VERSION;
+        p.cpu_load = (uint8_t)(i*13);
+        p.serialize(records.data() + i*32);
+    }
+    Crc16::StampBatch(records.data(), n);
+    return records;
+}
+
+void test_packet_parse() {
+    std::vector<uint8_t> wire = make_records(1);
+    Packet p{};
+    ASSERT_EQ((int)Packet::parse(wire.data(), wire.size(), p), (int)PacketError::OK, "Valid packet parses");
+    ASSERT_EQ(p.vehicle_id, 0, "Parsed vehicle id");
+    ASSERT_EQ(p.sequence_id, 0x01020304u, "Parsed sequence id");
+    ASSERT_EQ(p.timestamp, 0x0102030405060708ull, "Parsed timestamp");
+
+    std::vector<uint8_t> again(32);
+    p.serialize(again.data());
+    ASSERT_EQ((int)(again==wire), 1, "parse/serialize round trip is byte exact");
+
+    ASSERT_EQ((int)Packet::parse(wire.data(), 31, p), (int)PacketError::TOO_SHORT, "Short buffer is rejected");
+    wire[26] = 9;
+    ASSERT_EQ((int)Packet::parse(wire.data(), 32, p), (int)PacketError::BAD_VERSION, "Unknown version is rejected");
+    wire[26] = Packet::VERSION;
+    wire[17] ^= 0x40;
+    ASSERT_EQ((int)Packet::parse(wire.data(), 32, p), (int)PacketError::BAD_CRC, "Flipped bit fails the CRC");
+    wire[0] = 0xD3; wire[1] = 0x51;
+    ASSERT_EQ((int)Packet::parse(wire.data(), 32, p), (int)PacketError::BAD_MAGIC, "Batch magic is not a packet");
+}
+
+void test_batch_decode_kernels() {
+    // Odd count so every kernel also runs its tail
+    const size_t N = 16*9 + 7;
+    std::vector<uint8_t> records = make_records(N);
+
+    int mismatches = 0;
+    const PacketDecode::Impl impls[] = {PacketDecode::Impl::SCALAR, PacketDecode::Impl::SSSE3, PacketDecode::Impl::AVX2};
+    for(PacketDecode::Impl impl : impls){
+        if(!PacketDecode::Supported(impl)) continue;
+        PacketDecode::Select(impl);
+        PacketBatch batch(N + 1);
+        PacketDecode::Decode(records.data(), 5, batch); // Unaligned start in the columns
+        PacketDecode::Decode(records.data() + 5*32, N - 5, batch);
+        for(size_t i=0; i<N; i++){
+            Packet ref{};
+            ref.deserialize(records.data() + i*32);
+            Packet got = batch.Get(i);
+            got.reserved[0] = ref.reserved[0];
+            got.reserved[1] = ref.reserved[1];
+            if(std::memcmp(&ref, &got, sizeof(Packet))!=0) mismatches++;
+        }
+        if(batch.count!=N) mismatches++;
+    }
+    PacketDecode::Select(PacketDecode::Impl::AVX2);
+    ASSERT_EQ(mismatches, 0, "SIMD decoders match deserialize for every field");
+
+    PacketBatch small(10);
+    ASSERT_EQ(PacketDecode::Decode(records.data(), N, small), 10u, "Decode stops at capacity");
+}
+
+void test_batch_decode_valid() {
+    const size_t N = 600;
+    std::vector<uint8_t> records = make_records(N);
+    records[3*32 + 20] ^= 0x01;  // CRC
+    records[300*32] = 0x00;      // Magic
+    records[599*32 + 26] = 0;    // Version
+
+    PacketBatch batch(N);
+    uint64_t rejected = 0;
+    ASSERT_EQ(PacketDecode::DecodeValid(records.data(), N, batch, &rejected), N, "DecodeValid consumes everything");
+    ASSERT_EQ(rejected, 3u, "Three bad records rejected");
+    ASSERT_EQ(batch.count, N-3, "Only good records decoded");
+    ASSERT_EQ(batch.vehicle_id[3], (uint16_t)(4*131), "Record after the bad one moves up");
+    ASSERT_EQ(batch.vehicle_id[299], (uint16_t)(301*131), "Second gap closed too");
+}
+
+// Slowly drifting single-vehicle run with a steady 100 ms stride
+std::vector<Packet> make_run(uint16_t vehicle_id, size_t n, uint32_t seed) {
+    std::vector<Packet> run(n);
+    uint32_t x = seed;
+    int rpm = 3000, speed = 40, temp = 80;
+    for(size_t i=0; i<n; i++){
+        x = x*1103515245 + 12345;
+        rpm += (int)((x >> 16) % 41) - 20;
+        if(i % 17 == 0) speed += (int)((x >> 8) % 3) - 1;
+        if(i % 50 == 0) temp++;
+        Packet& p = run[i];
+        p = Packet{};
+        p.magic = Packet::MAGIC;
+        p.vehicle_id = vehicle_id;
+        p.sequence_id = (uint32_t)(1000 + i);
+        p.timestamp = 1700000000000ull + i*100 + (i % 7 == 0 ? 1 : 0);
+        p.rpm = (uint16_t)rpm;
+        p.speed = (uint16_t)speed;
+        p.jerk = (int16_t)((int)((x >> 4) % 200) - 100);
+        p.temp = (uint8_t)temp;
+        p.battery_level = 90;
+        p.gear = (uint8_t)(1 + (i / 300) % 6);
+        p.flags = (i > n/2) ? Flags::OVERHEAT : 0;
+        p.version = Packet::VERSION;
+        p.cpu_load = (uint8_t)(10 + (x >> 20) % 30);
+        uint8_t wire[32];
+        p.serialize(wire);
+        p.crc16 = CalculateCRC(wire, 28);
+    }
+    return run;
+}
+
+bool same_packets(const std::vector<Packet>& a, const std::vector<Packet>& b) {
+    return a.size()==b.size() && std::memcmp(a.data(), b.data(), a.size()*sizeof(Packet))==0;
+}
+
+void test_codec_roundtrip() {
+    std::vector<Packet> all;
+    for(uint16_t v=0; v<3; v++){
+        std::vector<Packet> run = make_run(500 + v, 3000, 99 + v);
+        all.insert(all.end(), run.begin(), run.end());
+    }
+    // A raw value nobody would delta-encode well, plus a packet with a stale CRC
+    all[10].timestamp = 0xFFFFFFFFFFFFFFF0ull;
+    all[11].jerk = -32768;
+    all[4000].crc16 ^= 0xFFFF;
+    all[4001].reserved[1] = 1;
+
+    TelemetryEncoder encoder(1000);
+    encoder.Add(all.data(), all.size());
+    encoder.Flush();
+    ASSERT_EQ(encoder.Index().size(), 9u, "3 vehicles x 3000 packets in 1000-packet blocks");
+    ASSERT_EQ((int)(encoder.Data().size() * 5 < all.size() * 32), 1, "Drifting telemetry compresses at least 5x");
+
+    TelemetryDecoder decoder;
+    std::vector<Packet> decoded;
+    ASSERT_EQ((int)decoder.DecodeStream(encoder.Data().data(), encoder.Data().size(), decoded), (int)CodecError::OK, "Stream decodes");
+    ASSERT_EQ((int)same_packets(all, decoded), 1, "Decode is bit-exact, stale CRC and reserved bytes included");
+
+    // Random garbage in every field goes through the generic paths
+    std::vector<Packet> noise(777);
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for(auto& p : noise){
+        uint8_t* raw = reinterpret_cast<uint8_t*>(&p);
+        for(size_t b=0; b<sizeof(Packet); b++){ x ^= x << 13; x ^= x >> 7; x ^= x << 17; raw[b] = (uint8_t)x; }
+        p.vehicle_id = 7;
+    }
+    TelemetryEncoder noisy(256);
+    noisy.Add(noise.data(), noise.size());
+    noisy.Flush();
+    decoded.clear();
+    decoder.DecodeStream(noisy.Data().data(), noisy.Data().size(), decoded);
+    ASSERT_EQ((int)same_packets(noise, decoded), 1, "Incompressible packets still round trip");
+
+    std::vector<uint8_t> cut(encoder.Data().begin(), encoder.Data().begin() + encoder.Index()[0].size - 1);
+    decoded.clear();
+    ASSERT_EQ((int)decoder.DecodeBlock(cut.data(), cut.size(), decoded), (int)CodecError::TOO_SHORT, "Truncated block is rejected");
+    ASSERT_EQ(decoded.size(), 0u, "Failed decode appends nothing");
+}
+
+void test_codec_index() {
+    TelemetryEncoder encoder(500);
+    for(uint16_t v=0; v<4; v++){
+        std::vector<Packet> run = make_run(20 + v, 2000, v);
+        encoder.Add(run.data(), run.size());
+    }
+    encoder.Flush();
+
+    BlockIndex index;
+    ASSERT_EQ((int)index.Build(encoder.Data().data(), encoder.Data().size()), (int)CodecError::OK, "Index builds from headers");
+    ASSERT_EQ(index.Size(), 16u, "One entry per block");
+
+    // Vehicle 22, packet 1234 sits in its third block
+    uint64_t ts = 1700000000000ull + 1234*100;
+    const CodecBlockInfo* block = index.Find(22, ts);
+    ASSERT_EQ((int)(block!=nullptr), 1, "Block found for vehicle 22");
+    ASSERT_EQ(block->first_seq, 1000u + 1000, "Third block of the run");
+
+    TelemetryDecoder decoder;
+    std::vector<Packet> packets;
+    decoder.DecodeBlock(encoder.Data().data() + block->offset, encoder.Data().size() - block->offset, packets);
+    ASSERT_EQ(packets[234].timestamp, ts, "Random access decode lands on the packet");
+    ASSERT_EQ((int)(index.Find(22, ts + 1000000)==nullptr), 1, "Nothing after the end of the run");
+    ASSERT_EQ((int)(index.Find(99, 0)==nullptr), 1, "Unknown vehicle");
+}
+
+// Record whose first 8 bytes carry n, enough to check order through the ring
+static void ring_record(uint8_t* out, uint64_t n){
+    std::memset(out, 0, 32);
+    std::memcpy(out, &n, 8);
+}
+
+static uint64_t ring_value(const uint8_t* rec){
+    uint64_t n;
+    std::memcpy(&n, rec, 8);
+    return n;
+}
+
+void test_packet_ring_policies() {
+    uint8_t rec[32], out[32*8];
+
+    PacketRing newest(4, RingOverflow::DROP_NEWEST);
+    for(uint64_t i=0; i<6; i++) { ring_record(rec, i); newest.Push(rec); }
+    ASSERT_EQ(newest.Size(), 4u, "Full ring holds capacity records");
+    ASSERT_EQ(newest.DroppedNewest(), 2u, "Two pushes refused");
+    ASSERT_EQ(newest.Pop(out, 8), 4u, "Pop drains everything");
+    ASSERT_EQ(ring_value(out), 0u, "DROP_NEWEST keeps the oldest");
+    ASSERT_EQ(ring_value(out + 3*32), 3u, "...up to the last one that fit");
+
+    PacketRing oldest(4, RingOverflow::DROP_OLDEST);
+    for(uint64_t i=0; i<6; i++) { ring_record(rec, i); oldest.Push(rec); }
+    ASSERT_EQ(oldest.DroppedOldest(), 2u, "Two records overwritten");
+    ASSERT_EQ(oldest.Pop(out, 8), 4u, "Still capacity records queued");
+    ASSERT_EQ(ring_value(out), 2u, "DROP_OLDEST keeps the newest");
+    ASSERT_EQ(ring_value(out + 3*32), 5u, "...ending at the last push");
+    ASSERT_EQ(oldest.HighWater(), 4u, "High water mark is the capacity");
+
+    PacketRing block(3, RingOverflow::BLOCK);
+    ASSERT_EQ(block.Capacity(), 4u, "Capacity rounds up to a power of two");
+    for(uint64_t i=0; i<4; i++) { ring_record(rec, i); block.Push(rec); }
+    block.Close();
+    ASSERT_EQ((int)block.Push(rec), 0, "Closed BLOCK ring refuses instead of waiting");
+    ASSERT_EQ(block.Blocked(), 1u, "The refused push counted as blocked");
+}
+
+void test_packet_ring_threads() {
+    const uint64_t N = 200000;
+    for(RingOverflow policy : {RingOverflow::BLOCK, RingOverflow::DROP_OLDEST}){
+        PacketRing ring(64, policy);
+        std::thread producer([&]{
+            uint8_t rec[32];
+            for(uint64_t i=1; i<=N; i++) { ring_record(rec, i); ring.Push(rec); }
+        });
+        uint8_t out[32*16];
+        uint64_t last = 0, received = 0, disorder = 0;
+        while(last<N){
+            size_t n = ring.Pop(out, 16);
+            for(size_t k=0; k<n; k++){
+                uint64_t v = ring_value(out + k*32);
+                if(v<=last) disorder++;
+                last = v;
+                received++;
+            }
+            if(n==0) std::this_thread::yield();
+        }
+        producer.join();
+        ASSERT_EQ(disorder, 0u, "Records come out in order, never twice");
+        ASSERT_EQ(received + ring.DroppedOldest(), N, "Every record is either delivered or counted dropped");
+        if(policy==RingOverflow::BLOCK) { ASSERT_EQ(received, N, "BLOCK loses nothing"); }
+    }
+}
+
+// Valid wire record carrying n as its sequence id
+static void spool_record(uint8_t* out, uint32_t n){
+    std::memset(out, 0, 32);
+    out[0] = 0xD3; out[1] = 0x50; out[2] = Packet::VERSION;
+    out[4] = n>>24; out[5] = n>>16; out[6] = n>>8; out[7] = n;
+    Crc16::StampBatch(out, 1);
+}
+
+static uint32_t spool_seq(const uint8_t* rec){
+    return (rec[4]<<24) | (rec[5]<<16) | (rec[6]<<8) | rec[7];
+}
+
+static std::string spool_path(){
+    char path[] = "/tmp/test_spool_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd>=0) close(fd);
+    return path;
+}
+
+void test_spool_wrap() {
+    std::string path = spool_path();
+    uint8_t rec[32], out[32*16];
+    Spool spool;
+    ASSERT_EQ((int)spool.Open(path, Spooler::HEADER_SIZE + 8*32), 1, "Spool opens");
+    ASSERT_EQ(spool.Capacity(), 8u, "Capacity follows the size cap");
+    for(uint32_t i=0; i<11; i++) { spool_record(rec, i); spool.Append(rec); }
+    ASSERT_EQ(spool.Size(), 8u, "Full spool holds capacity records");
+    ASSERT_EQ(spool.Overwritten(), 3u, "Three oldest overwritten");
+    ASSERT_EQ(spool.Peek(out, 16), 8u, "Peek sees everything");
+    ASSERT_EQ(spool_seq(out), 3u, "Oldest survivor first");
+    ASSERT_EQ(spool_seq(out + 7*32), 10u, "Newest last, across the wrap");
+    ASSERT_EQ(std::memcmp(out + 7*32, rec, 32), 0, "Records come back byte exact");
+    ASSERT_EQ(spool.Peek(out, 2, 6), 2u, "Peek past records already in flight");
+    ASSERT_EQ(spool_seq(out), 9u, "Skipped ones stay in the spool");
+    ASSERT_EQ(spool.Peek(out, 4, 8), 0u, "Nothing past the newest");
+    spool.Consume(5);
+    ASSERT_EQ(spool.Peek(out, 16), 3u, "Consume removes from the front");
+    ASSERT_EQ(spool_seq(out), 8u, "Next in line after consume");
+    spool.Close();
+    unlink(path.c_str());
+}
+
+void test_spool_recovery() {
+    std::string path = spool_path();
+    uint8_t rec[32], out[32*16];
+    {
+        Spool spool;
+        spool.Open(path, Spooler::HEADER_SIZE + 16*32);
+        for(uint32_t i=0; i<10; i++) { spool_record(rec, i); spool.Append(rec); }
+        spool.Consume(2);
+    }
+    Spool again;
+    ASSERT_EQ((int)again.Open(path, Spooler::HEADER_SIZE + 64*32), 1, "Spool reopens");
+    ASSERT_EQ(again.Capacity(), 16u, "Non-empty spool keeps its capacity");
+    ASSERT_EQ(again.Recovered(), 8u, "Unconsumed records recovered");
+    again.Peek(out, 16);
+    ASSERT_EQ(spool_seq(out), 2u, "Recovery resumes at the committed head");
+    again.Close();
+
+    // Newest commit slot (the reopen above) torn: the previous one wins
+    FILE* f = fopen(path.c_str(), "r+b");
+    fseek(f, 0x40, SEEK_SET);
+    fputc(0xAA, f);
+    fclose(f);
+    ASSERT_EQ((int)again.Open(path), 1, "Spool with a torn header opens");
+    ASSERT_EQ(again.Recovered(), 8u, "Older commit slot describes the same ring");
+    again.Close();
+    unlink(path.c_str());
+
+    // Torn record in the middle: the tail is cut there
+    path = spool_path();
+    {
+        Spool spool;
+        spool.Open(path, Spooler::HEADER_SIZE + 16*32);
+        for(uint32_t i=0; i<10; i++) { spool_record(rec, i); spool.Append(rec); }
+    }
+    f = fopen(path.c_str(), "r+b");
+    fseek(f, Spooler::HEADER_SIZE + 6*32 + 10, SEEK_SET);
+    fputc(0xFF, f);
+    fclose(f);
+    ASSERT_EQ((int)again.Open(path), 1, "Spool with a bad record opens");
+    ASSERT_EQ(again.Recovered(), 6u, "Records before the bad one kept");
+    ASSERT_EQ(again.Discarded(), 4u, "Bad record and everything after it dropped");
+    again.Close();
+    unlink(path.c_str());
+}
+
+void test_metrics_threads() {
+    Metrics::Add(Counter::PUBLISHES, 5);
+    ASSERT_EQ(Metrics::Snapshot().counters[(size_t)Counter::PUBLISHES], 0u, "Nothing recorded while disabled");
+
+    Metrics::Enable(true);
+    const uint64_t N = 100000;
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++) threads.emplace_back([=]{
+        for(uint64_t i=0; i<N; i++){
+            Metrics::Add(Counter::PUBLISHES);
+            Metrics::Add(Counter::PUBLISH_BYTES, 32);
+            Metrics::Record(Latency::PUBLISH, 1000 + (i % 1000));
+        }
+    });
+    // Reading while they record must be safe and never run ahead
+    uint64_t seen = Metrics::Snapshot().counters[(size_t)Counter::PUBLISHES];
+    for(auto& t : threads) t.join();
+    MetricsSnapshot snap = Metrics::Snapshot();
+    Metrics::Enable(false);
+
+    ASSERT_EQ((int)(seen<=4*N), 1, "Mid-run snapshot is a lower bound");
+    ASSERT_EQ(snap.counters[(size_t)Counter::PUBLISHES], 4*N, "Per-thread counters sum up");
+    ASSERT_EQ(snap.counters[(size_t)Counter::PUBLISH_BYTES], 4*N*32, "Byte counter sums up");
+    const Histogram& h = snap.latency[(size_t)Latency::PUBLISH];
+    ASSERT_EQ(h.Count(), 4*N, "Every latency sample merged");
+    ASSERT_EQ(h.Min(), 1000u, "Merged minimum");
+    ASSERT_EQ(h.Max(), 1999u, "Merged maximum");
+    ASSERT_EQ((int)(h.Percentile(0.5)>=1400 && h.Percentile(0.5)<=1700), 1, "Merged median within bucket precision");
+
+    std::ostringstream buckets;
+    std::ios_base::fmtflags flags = buckets.flags();
+    h.Print(buckets, 1000.0, " us");
+    ASSERT_EQ((int)(buckets.flags()==flags && buckets.precision()==6), 1, "Histogram::Print leaves the stream format alone");
+
+    std::ostringstream text;
+    Metrics::WritePrometheus(text, snap);
+    ASSERT_EQ((int)(text.str().find("fleet_mqtt_publishes_total 400000\n")!=std::string::npos), 1, "Prometheus counter line");
+    ASSERT_EQ((int)(text.str().find("fleet_mqtt_publish_seconds_count 400000\n")!=std::string::npos), 1, "Prometheus summary count");
+}
+
+void test_event_log_threads() {
+    // A writer nobody drains loses what doesn't fit, and only counts it
+    std::thread([]{
+        for(size_t i=0; i<EventLog::RING_RECORDS + 10; i++) EventLog::Write(LogEvent::STATUS, 1, (int64_t)i);
+    }).join();
+
+    std::string path = "/tmp/fleet_test_" + std::to_string(getpid()) + ".log";
+    ASSERT_EQ((int)EventLog::Start(path, nullptr), 1, "Log starts");
+    const int64_t N = 2000; // Under a ring, so nothing is dropped while draining
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++) threads.emplace_back([=]{
+        for(int64_t i=0; i<N; i++) EventLog::Write(LogEvent::COMMAND_RX, (uint16_t)(10 + t), i, EventLog::Bits(i * 0.5));
+    });
+    for(auto& t : threads) t.join();
+    ASSERT_EQ(EventLog::Stop(), 10u, "Overflow counted, not blocked on");
+
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    LogFileHeader header{};
+    ASSERT_EQ(std::fread(&header, sizeof(header), 1, f), 1u, "Header present");
+    ASSERT_EQ(header.magic, EventLog::MAGIC, "Header magic");
+    ASSERT_EQ(header.record_size, sizeof(LogRecord), "Header record size");
+    std::vector<LogRecord> records(EventLog::RING_RECORDS + 4*N + 1);
+    size_t n = std::fread(records.data(), sizeof(LogRecord), records.size(), f);
+    std::fclose(f);
+    unlink(path.c_str());
+    ASSERT_EQ(n, (size_t)(EventLog::RING_RECORDS + 4*N), "Every kept record reaches the file");
+
+    int64_t next[4] = {0, 0, 0, 0};
+    int64_t early = 0;
+    bool ordered = true, intact = true;
+    for(size_t i=0; i<n; i++){
+        const LogRecord& r = records[i];
+        if(r.code==(uint16_t)LogEvent::STATUS){
+            ordered &= r.arg[0]==early++;
+            continue;
+        }
+        int t = r.vehicle_id - 10;
+        ordered &= r.arg[0]==next[t]++;
+        intact &= EventLog::Double(r.arg[1])==r.arg[0] * 0.5;
+    }
+    ASSERT_EQ(early, (int64_t)EventLog::RING_RECORDS, "The undrained ring kept its oldest records");
+    ASSERT_EQ((int)ordered, 1, "Each writer's records stay in order");
+    ASSERT_EQ((int)intact, 1, "Arguments survive the round trip");
+
+    std::ostringstream text;
+    EventLog::Render(records[n-1], text);
+    ASSERT_EQ((int)(text.str().find(" COMMAND_RX opcode=1999\n")!=std::string::npos), 1, "Rendered line");
+}
+
+void test_counter_rng() {
+    // Known answers from the Random123 reference (philox4x32_10)
+    CounterRng::Block zero = CounterRng::Philox(CounterRng::Block{{0, 0, 0, 0}}, 0, 0);
+    ASSERT_EQ(zero.v[0], 0x6627e8d5u, "Philox zero counter, word 0");
+    ASSERT_EQ(zero.v[3], 0x9b00dbd8u, "Philox zero counter, word 3");
+    CounterRng::Block pi = CounterRng::Philox(CounterRng::Block{{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}},
+                                              0xa4093822, 0x299f31d0);
+    ASSERT_EQ(pi.v[0], 0xd16cfe09u, "Philox pi counter, word 0");
+    ASSERT_EQ(pi.v[2], 0x5001e420u, "Philox pi counter, word 2");
+
+    double worst_log = 0;
+    for(int i=1; i<=1000; i++) worst_log = std::max(worst_log, std::fabs(CounterRng::Log(i/1000.0) - std::log(i/1000.0)));
+    ASSERT_EQ((int)(worst_log<1e-11), 1, "In-house log matches libm");
+
+    // A fleet in one batch, and the same ids split over threads, draw exactly
+    // what vehicles drawing one at a time do
+    const size_t N = 5000;
+    std::vector<uint16_t> ids(N);
+    for(size_t i=0; i<N; i++) ids[i] = (uint16_t)(1000 + i);
+    std::vector<double> batch(N), split(N);
+    CounterRng::Gaussian(42, ids.data(), N, 7, CounterRng::RPM_NOISE, batch.data());
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<4; t++) threads.emplace_back([&, t]{
+        size_t lo = N*t/4, hi = N*(t+1)/4;
+        CounterRng::Gaussian(42, ids.data() + lo, hi - lo, 7, CounterRng::RPM_NOISE, split.data() + lo);
+    });
+    for(auto& t : threads) t.join();
+    size_t mismatched = 0;
+    for(size_t i=0; i<N; i++){
+        if(batch[i]!=CounterRng::Gaussian(42, ids[i], 7, CounterRng::RPM_NOISE) || batch[i]!=split[i]) mismatched++;
+    }
+    ASSERT_EQ(mismatched, 0u, "Batch, threaded and scalar draws bit identical");
+
+    // 200k draws over ids and ticks look standard normal
+    double sum = 0, sum2 = 0, sum4 = 0;
+    size_t beyond2 = 0, count = 0;
+    for(uint64_t tick=0; tick<40; tick++){
+        CounterRng::Gaussian(1, ids.data(), N, tick, CounterRng::RPM_NOISE, batch.data());
+        for(double z : batch) { sum += z; sum2 += z*z; sum4 += z*z*z*z; beyond2 += std::fabs(z)>2; count++; }
+    }
+    double mean = sum/count, var = sum2/count - mean*mean;
+    ASSERT_EQ((int)(std::fabs(mean)<0.01 && std::fabs(var-1)<0.015), 1, "Gaussian mean 0, variance 1");
+    ASSERT_EQ((int)(std::fabs(sum4/count-3)<0.06), 1, "Gaussian kurtosis 3");
+    ASSERT_EQ((int)(std::fabs((double)beyond2/count-0.0455)<0.002), 1, "Gaussian tail beyond 2 sigma");
+    ASSERT_EQ((int)(CounterRng::Gaussian(1, 5, 0, CounterRng::RPM_NOISE)!=CounterRng::Gaussian(1, 5, 0, CounterRng::CPU_LOAD)), 1,
+              "Streams are independent");
+
+    uint32_t seen[30] = {};
+    for(uint32_t i=0; i<30000; i++) seen[CounterRng::Below(CounterRng::Bits(3, 9, i, CounterRng::CPU_LOAD), 30)]++;
+    uint32_t lo = *std::min_element(seen, seen+30), hi = *std::max_element(seen, seen+30);
+    ASSERT_EQ((int)(lo>850 && hi<1150), 1, "Below() spreads evenly");
+}
+
+void test_recording() {
+    std::string path = spool_path();
+    RecordingWriter writer;
+    ASSERT_EQ((int)writer.Open(path, 100), 1, "Recording created");
+    // 3 vehicles interleaved, vehicle 30 only joins after 200 records
+    std::vector<uint8_t> sent;
+    Packet p{};
+    p.magic = Packet::MAGIC;
+    p.version = Packet::VERSION;
+    uint8_t wire[32];
+    for(uint32_t i=0; i<250; i++){
+        p.vehicle_id = (uint16_t)(i<200 ? 10 + (i % 2)*10 : 10 + (i % 3)*10);
+        p.sequence_id = i;
+        p.timestamp = 1000 + i*10;
+        p.serialize(wire);
+        Crc16::StampBatch(wire, 1);
+        writer.Append(wire);
+        sent.insert(sent.end(), wire, wire + 32);
+    }
+    ASSERT_EQ((int)writer.Close(), 1, "Recording closed");
+    ASSERT_EQ(writer.Blocks(), 3u, "250 records in blocks of 100");
+
+    RecordingReader reader;
+    std::string error;
+    ASSERT_EQ((int)reader.Open(path, error), 1, "Recording opens");
+    RecordingBlock block;
+    std::vector<uint8_t> back;
+    std::vector<RecordingBlock> blocks;
+    while(reader.Next(block)){
+        blocks.push_back(block);
+        reader.Load(block);
+        back.insert(back.end(), block.data.begin(), block.data.end());
+    }
+    ASSERT_EQ((int)(back==sent), 1, "Records come back byte for byte, in order");
+    ASSERT_EQ((int)reader.Damaged(), 0, "Clean recording not damaged");
+    ASSERT_EQ(blocks[0].first_ts, 1000u, "Block time range starts at its first record");
+    ASSERT_EQ(blocks[0].last_ts, 1990u, "Block time range ends at its last record");
+    ASSERT_EQ(blocks[0].CountOf(10) + blocks[0].CountOf(20), 100, "Index counts every record");
+    ASSERT_EQ(blocks[1].CountOf(30), 0, "Vehicle absent from the index before it joined");
+    ASSERT_EQ((int)(blocks[2].CountOf(30)>0), 1, "Vehicle indexed once it joined");
+
+    // Last block cut short: the first two still read, the damage is reported
+    FILE* f = fopen(path.c_str(), "r+b");
+    ftruncate(fileno(f), (off_t)(blocks[2].offset + 40));
+    fclose(f);
+    RecordingReader torn;
+    torn.Open(path, error);
+    int good = 0;
+    while(torn.Next(block)) good++;
+    ASSERT_EQ(good, 2, "Blocks before a torn one read");
+    ASSERT_EQ((int)torn.Damaged(), 1, "Torn block reported");
+
+    // A flipped bit in an index fails the header CRC
+    f = fopen(path.c_str(), "r+b");
+    fseek(f, (long)(blocks[1].offset + Recording::BLOCK_HEADER_SIZE), SEEK_SET);
+    fputc(0x77, f);
+    fclose(f);
+    RecordingReader corrupt;
+    corrupt.Open(path, error);
+    good = 0;
+    while(corrupt.Next(block)) good++;
+    ASSERT_EQ(good, 1, "Reading stops at a corrupt index");
+    unlink(path.c_str());
+}
+
+// Keeps a copy of every batch it is handed, refuses them when told to
+class CaptureSink : public IngestSink {
+public:
+    std::vector<Packet> got;
+    bool refuse = false;
+    const char* Name() const override { return "capture"; }
+    bool Consume(const PacketBatch& batch) override {
+        if(refuse) return false;
+        for(size_t i=0; i<batch.count; i++) got.push_back(batch.Get(i));
+        return true;
+    }
+};
+
+void test_ingest() {
+    // Vehicle 5, sequence 0..9: 4 single packets, then a frame of 6 with one bad CRC
+    std::vector<uint8_t> wire(10*32);
+    for(uint32_t i=0; i<10; i++){
+        Packet p{};
+        p.magic = Packet::MAGIC;
+        p.vehicle_id = 5;
+        p.sequence_id = i;
+        p.timestamp = 1700000000000ull + i;
+        p.speed = (uint16_t)(40 + i);
+        p.jerk = -3;
+        p.flags = i==2 ? Flags::OVERHEAT : 0;
+        p.version = Packet::VERSION;
+        p.serialize(wire.data() + i*32);
+    }
+    Crc16::StampBatch(wire.data(), 10);
+    wire[7*32 + 19] ^= 0x01;
+
+    std::vector<uint8_t> frame(Batch::HEADER_SIZE + 6*32, 0);
+    frame[0] = Batch::MAGIC >> 8; frame[1] = Batch::MAGIC & 0xFF;
+    frame[2] = Batch::VERSION; frame[3] = Batch::RECORD_SIZE; frame[5] = 6;
+    std::memcpy(frame.data() + Batch::HEADER_SIZE, wire.data() + 4*32, 6*32);
+
+    CaptureSink capture;
+    VehicleStatsSink stats;
+    IngestOptions options;
+    options.batch_records = 4;
+    Ingestor ingest(options);
+    ingest.AddSink(capture);
+    ingest.AddSink(stats);
+    for(int i=0; i<4; i++) ingest.OnMessage(wire.data() + i*32, 32);
+    ingest.OnMessage(frame.data(), frame.size());
+    const uint8_t junk[5] = {1, 2, 3, 4, 5};
+    ingest.OnMessage(junk, sizeof(junk));
+    frame[5] = 7;  // Count no longer matches the length
+    ingest.OnMessage(frame.data(), frame.size());
+    ingest.Stop();
+
+    const IngestStats& s = ingest.Stats();
+    ASSERT_EQ(s.messages.load(), 7u, "Every payload counted");
+    ASSERT_EQ(s.bad_payloads.load(), 2u, "Junk and a broken frame are bad payloads");
+    ASSERT_EQ(s.records.load(), 10u, "Records from packets and the frame");
+    ASSERT_EQ(s.rejected.load(), 1u, "Bad CRC rejected at validation");
+    ASSERT_EQ(s.decoded.load(), 9u, "The rest decoded");
+    ASSERT_EQ(s.batches.load(), 3u, "Batches of 4, the last one partial");
+    ASSERT_EQ(capture.got.size(), 9u, "Sink saw every valid record");
+    ASSERT_EQ(capture.got[8].sequence_id, 9u, "In arrival order");
+    ASSERT_EQ(capture.got[8].jerk, -3, "Signed field decoded");
+    ASSERT_EQ(stats.Gaps(), 1u, "The rejected record is a sequence gap");
+    ASSERT_EQ(stats.Alerts(), 1u, "One record with a flag");
+    ASSERT_EQ(ingest.SinkRecords(0), 9u, "Per-sink delivered count");
+
+    // A small queue that nobody drains, and a sink that refuses
+    options.queue_records = 4;
+    options.batch_records = 64;
+    Ingestor tight(options);
+    CaptureSink refusing;
+    refusing.refuse = true;
+    tight.AddSink(refusing);
+    for(int i=0; i<10; i++) tight.OnMessage(wire.data(), 32);
+    tight.Stop();
+    ASSERT_EQ(tight.QueueDropped(), 6u, "Full queue drops the newest records");
+    ASSERT_EQ(tight.Stats().queued.load(), 4u, "Queue kept what fit");
+    ASSERT_EQ(tight.SinkDropped(0), 4u, "Refused batch counted against the sink");
+
+    // Line protocol, the way the Go backend writes points
+    std::string path = spool_path();
+    std::FILE* f = std::fopen(path.c_str(), "w");
+    LineProtocolSink lines(f, 256);
+    PacketBatch batch(2);
+    PacketDecode::Decode(wire.data() + 2*32, 2, batch);
+    ASSERT_EQ((int)lines.Consume(batch), 1, "Line protocol sink takes the batch");
+    lines.Flush();
+    std::fclose(f);
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    ASSERT_EQ(line, std::string("vehicle_status,vehicle_id=5 speed=42u,rpm=0u,jerk=-3i,temp=0u,battery=0u,gear=0u,flags=2u 1700000000002000000"),
+              "Line protocol point");
+    ASSERT_EQ(lines.Lines(), 2u, "One line per record");
+    unlink(path.c_str());
+}
+
+// TickScheduler time source moved by hand: only the test and Wait's sleeps
+// advance it, so every deadline and overrun is exact
+struct ManualClock {
+    static int64_t now;
+    static int64_t NowNs() { return now; }
+    static void SleepUntilNs(int64_t deadline) { if(deadline>now) now = deadline; }
+};
+int64_t ManualClock::now = 0;
+
+void test_tick_scheduler() {
+    const int64_t MS = 1000000;
+
+    // 0.4 ms of work per 1 ms tick: every wake-up lands on start + n*period
+    ManualClock::now = 5*MS;
+    BasicTickScheduler<ManualClock> paced(1000.0);
+    uint64_t periods = 0;
+    for(int i=0; i<100; i++){
+        periods += paced.Wait();
+        if(i==99) { ASSERT_EQ(ManualClock::now, 105*MS, "Deadline 100 is exactly start + 100 periods"); }
+        ManualClock::now += 4*MS/10;
+    }
+    ASSERT_EQ(periods, 100u, "One period per tick on schedule");
+    ASSERT_EQ(paced.Overruns() + paced.Skipped(), 0u, "No overruns, nothing skipped");
+    ASSERT_EQ(paced.Lateness().Max(), 0u, "Woken exactly on the deadline");
+
+    // SKIP: a 3.5 ms stall drops the two deadlines it missed
+    ManualClock::now = 0;
+    BasicTickScheduler<ManualClock> skip(1000.0, OverrunPolicy::SKIP);
+    skip.Wait();
+    ManualClock::now += 35*MS/10;
+    ASSERT_EQ(skip.Wait(), 3u, "Late wake-up covers the missed periods");
+    ASSERT_EQ(skip.Wait(), 1u, "Back on schedule");
+    ASSERT_EQ(ManualClock::now, 5*MS, "Resumed on the next future deadline");
+    ASSERT_EQ(skip.Skipped(), 2u, "Two ticks skipped");
+    ASSERT_EQ(skip.Overruns(), 1u, "One overrun");
+    ASSERT_EQ(skip.Lateness().Max(), (uint64_t)(25*MS/10), "Lateness of the stalled tick recorded");
+
+    // CATCH_UP: missed ticks run back to back, beyond max_backlog they are dropped
+    ManualClock::now = 0;
+    BasicTickScheduler<ManualClock> catchup(1000.0, OverrunPolicy::CATCH_UP, 5);
+    // Wait() calls that return without sleeping, up to the first that sleeps
+    auto without_sleep = [&]{
+        int n = 0;
+        uint64_t periods = 0;
+        while(true){
+            int64_t before = ManualClock::now;
+            periods += catchup.Wait();
+            if(ManualClock::now!=before) break;
+            n++;
+        }
+        return n==(int)periods - 1 ? n : -1;
+    };
+    catchup.Wait();
+    ManualClock::now += 35*MS/10;
+    ASSERT_EQ(without_sleep(), 3, "Deadlines 2, 3 and 4 run back to back, one period each");
+    ASSERT_EQ(ManualClock::now, 5*MS, "Caught up by deadline 5");
+    ManualClock::now += 205*MS/10;
+    ASSERT_EQ(catchup.Wait(), 15u, "20 ms stall with a backlog cap of 5 drops 14 ticks");
+    ASSERT_EQ(without_sleep(), 5, "The capped backlog of 5 still runs back to back");
+    ASSERT_EQ(catchup.Skipped(), 14u, "Only the ticks beyond the cap skipped");
+    ASSERT_EQ(catchup.Lateness().Count(), catchup.Ticks(), "Every wake-up in the lateness histogram");
+
+    std::ostringstream os;
+    std::ios_base::fmtflags flags = os.flags();
+    catchup.Report(os);
+    ASSERT_EQ((int)(os.flags()==flags && os.precision()==6), 1, "Report leaves the stream format alone");
+}
+
 int main() {
     std::cout << "--- RUNNING UNIT TESTS ---\n";
     
     test_packet_size();
     test_alignment_offsets();
+    test_packet_schema();
     test_serialization_endianness();
+    test_batch_frame_roundtrip();
+    test_crc_implementations();
+    test_crc_batch();
+    test_packet_parse();
+    test_batch_decode_kernels();
+    test_batch_decode_valid();
+    test_codec_roundtrip();
+    test_codec_index();
+    test_packet_ring_policies();
+    test_packet_ring_threads();
+    test_spool_wrap();
+    test_spool_recovery();
+    test_metrics_threads();
+    test_event_log_threads();
+    test_tick_scheduler();
+    test_counter_rng();
+    test_recording();
+    test_ingest();
 
     std::cout << "--- ALL SYSTEMS OPERATIONAL ---\n";
     return 0;
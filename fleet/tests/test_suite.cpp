@@ -4,9 +4,14 @@
 #include <cmath>
 #include <cstring>
 #include <iomanip>
+#include <algorithm>
 
 #include "../include/vehicle.h"
 #include "../include/packet.h"
+#include "../include/fleet_state.h"
+#include "../include/command_router.h"
+#include "../include/scenario.h"
+#include "../include/counter_rng.h"
 
 // --- UTILITIES ---
 void print_pass(const std::string& name) {
@@ -149,6 +154,264 @@ void Test_Battery_Drain() {
     print_pass("Physics: Battery Drain");
 }
 
+void Test_FleetState_MatchesVehicle() {
+    const size_t N = 40;
+    FleetState fleet(N, 200);
+    std::vector<Vehicle> cars;
+    for(size_t i=0; i<N; i++) cars.emplace_back(static_cast<uint16_t>(200+i));
+
+    std::vector<Packet> batch(N);
+    for(int t=0; t<3000; t++){
+        for(size_t i=0; i<N; i++){
+            // Mix of pedal inputs and interventions so every branch gets hit
+            double throttle = std::sin((t+i*7)*0.01);
+            fleet.SetThrottle(i, throttle);
+            cars[i].SetThrottle(throttle);
+            if(t==500+(int)i*10){
+                uint8_t op = (i%3==0) ? CMD_KILL : CMD_LIMP;
+                fleet.OnCommand(i, op);
+                cars[i].OnCommand(op);
+            }
+            if(t==1500+(int)i*10){
+                fleet.OnCommand(i, CMD_NORMAL);
+                cars[i].OnCommand(CMD_NORMAL);
+            }
+        }
+        fleet.Tick(0.1);
+        for(auto& car : cars) car.Tick(0.1);
+
+        if(t%50 != 0) continue;
+        fleet.Snapshot(batch.data(), N, 0.1);
+        for(size_t i=0; i<N; i++){
+            Packet p;
+            cars[i].Snapshot(p, 0.1);
+            const Packet& q = batch[i];
+            if(p.vehicle_id!=q.vehicle_id || p.rpm!=q.rpm || p.speed!=q.speed ||
+               p.jerk!=q.jerk || p.temp!=q.temp || p.battery_level!=q.battery_level ||
+               p.gear!=q.gear || p.flags!=q.flags || p.cpu_load!=q.cpu_load){
+                print_fail("FleetState", "Diverged from Vehicle at tick " + std::to_string(t));
+            }
+        }
+    }
+
+    print_pass("FleetState: Matches Scalar Vehicle");
+}
+
+// Jerk is d(accel)/dt over the real tick length: the same drive sampled at
+// 10 Hz and 100 Hz reports about the same jerk, in both engines
+void Test_JerkRate() {
+    int16_t jerk[2];
+    const int rates[2] = {10, 100};
+    for(int r=0; r<2; r++){
+        double dt = 1.0 / rates[r];
+        Vehicle car(101);
+        FleetState fleet(1, 101);
+        car.SetThrottle(1.0);
+        fleet.SetThrottle(0, 1.0);
+        for(int t=0; t<3*rates[r]; t++){
+            car.Tick(dt);
+            fleet.Tick(dt);
+        }
+        Packet p, q;
+        car.Snapshot(p, dt);
+        fleet.Snapshot(&q, 1, dt);
+        if(p.jerk!=q.jerk) print_fail("Jerk", "FleetState and Vehicle disagree at " + std::to_string(rates[r]) + " Hz");
+        jerk[r] = p.jerk;
+    }
+    // Same sign, within 15% (Euler steps differ a little between the rates)
+    if(jerk[0]>=0 || jerk[1]>=0 || std::abs(jerk[1] - jerk[0]) > std::abs(jerk[0])*0.15){
+        print_fail("Jerk", "10 Hz reports " + std::to_string(jerk[0]) + ", 100 Hz " + std::to_string(jerk[1]));
+    }
+
+    // A kill at speed saturates the int16 field instead of wrapping around
+    Vehicle car(102);
+    car.SetThrottle(1.0);
+    for(int t=0; t<300; t++) car.Tick(0.01);
+    car.OnCommand(CMD_KILL);
+    car.Tick(0.01);
+    Packet p;
+    car.Snapshot(p, 0.01);
+    if(p.jerk!=-32768) print_fail("Jerk", "Kill at 100 Hz reported " + std::to_string(p.jerk));
+
+    print_pass("Jerk: Scaled by the Tick Length");
+}
+
+void Test_CommandRouting() {
+    uint16_t id = 0;
+    if(CommandTopic::Parse("fleet/4711/cmd", id)!=CommandTopic::Target::VEHICLE || id!=4711)
+        print_fail("Commands", "fleet/4711/cmd not parsed");
+    if(CommandTopic::Parse("fleet/all/cmd", id)!=CommandTopic::Target::BROADCAST)
+        print_fail("Commands", "Broadcast topic not recognised");
+    for(const char* bad : {"fleet/65536/cmd", "fleet/-1/cmd", "fleet//cmd", "fleet/12/telemetry", "fleet/1x/cmd", "flee/12/cmd"}){
+        if(CommandTopic::Parse(bad, id)!=CommandTopic::Target::NONE) print_fail("Commands", std::string("Accepted ") + bad);
+    }
+
+    // Two shards of one fleet, each routing only its own vehicles
+    FleetState a(50, 100), b(50, 150);
+    CommandRouter ra, rb;
+    for(size_t i=0; i<a.Size(); i++) ra.Add(a.Id(i), (uint32_t)i);
+    for(size_t i=0; i<b.Size(); i++) rb.Add(b.Id(i), (uint32_t)i);
+    const uint8_t kill[1] = {'1'};
+    auto deliver = [&](const std::string& topic, const uint8_t* payload){
+        ra.Route(topic, payload, 1, [&](uint32_t i, uint8_t op){ a.OnCommand(i, op); }, [&](uint8_t op){ a.OnCommandAll(op); });
+        rb.Route(topic, payload, 1, [&](uint32_t i, uint8_t op){ b.OnCommand(i, op); }, [&](uint8_t op){ b.OnCommandAll(op); });
+    };
+    deliver(CommandTopic::For(160), kill);
+    if(ra.Routed()!=0 || ra.Foreign()!=1 || rb.Routed()!=1) print_fail("Commands", "Vehicle command routed to the wrong shard");
+
+    const uint8_t limp[1] = {CMD_LIMP};
+    deliver(std::string(CommandTopic::BROADCAST), limp);
+    for(int t=0; t<200; t++){
+        a.SetThrottle(t%50, 1.0);
+        b.SetThrottle(t%50, 1.0);
+        a.Tick(0.1);
+        b.Tick(0.1);
+    }
+    // Killed car coasts to a stop, limp mode holds the others around 40 km/h
+    if(b.Speed(10)>1.0) print_fail("Commands", "Vehicle 160 still moving after KILL");
+    for(size_t i=0; i<50; i++){
+        if(a.Speed(i)>45.0 || (i!=10 && b.Speed(i)>45.0)) print_fail("Commands", "Broadcast LIMP missed a vehicle");
+    }
+
+    print_pass("Commands: Wildcard Routing + Broadcast");
+}
+
+struct Drift {
+    double max_speed = 0, max_rpm = 0, max_temp = 0, max_battery = 0;
+    double sum_speed = 0, sum_rpm = 0, sum_temp = 0;
+    long samples = 0;
+};
+
+// One simulated hour per car against the double model: full throttle, braking,
+// cruise, coasting and a limp period, so every branch and gear gets exercised
+template <typename Real>
+Drift MeasureDrift(){
+    Drift d;
+    for(uint16_t i=0; i<10; i++){
+        Vehicle ref(300+i);
+        BasicVehicle<Real> car(300+i);
+        for(int t=0; t<36000; t++){
+            int phase = (t/600) % 4;
+            double throttle = phase==0 ? 1.0 : phase==1 ? -1.0 : phase==2 ? std::sin((t+i*7)*0.01) : 0.0;
+            ref.SetThrottle(throttle);
+            car.SetThrottle(throttle);
+            if(t==5000+i*10) { ref.OnCommand(CMD_LIMP); car.OnCommand(CMD_LIMP); }
+            if(t==9000+i*10) { ref.OnCommand(CMD_NORMAL); car.OnCommand(CMD_NORMAL); }
+            ref.Tick(0.1);
+            car.Tick(0.1);
+            double ds = std::fabs(ref.Speed()-car.Speed()), dr = std::fabs(ref.Rpm()-car.Rpm());
+            double dt = std::fabs(ref.Temp()-car.Temp()), db = std::fabs(ref.Battery()-car.Battery());
+            d.max_speed = std::max(d.max_speed, ds);
+            d.max_rpm = std::max(d.max_rpm, dr);
+            d.max_temp = std::max(d.max_temp, dt);
+            d.max_battery = std::max(d.max_battery, db);
+            d.sum_speed += ds; d.sum_rpm += dr; d.sum_temp += dt;
+            d.samples++;
+        }
+    }
+    return d;
+}
+
+void Test_NumericPolicies() {
+    if(static_cast<double>(Fixed16(1.5)*Fixed16(-2.25))!=-3.375) print_fail("Fixed16", "Product");
+    if(static_cast<double>(Fixed16(7.0)/Fixed16(2.0))!=3.5) print_fail("Fixed16", "Quotient");
+    if(std::fabs(static_cast<double>(Fixed16(0.1))-0.1)>1.0/Fixed16::ONE) print_fail("Fixed16", "Rounding of 0.1");
+
+    // float tracks the reference to well under a packet's resolution
+    Drift f = MeasureDrift<float>();
+    if(f.max_speed>0.1 || f.max_rpm>5.0 || f.max_temp>0.1 || f.max_battery>0.05){
+        print_fail("Numeric Policy", "float drifted: speed " + std::to_string(f.max_speed) + ", rpm " + std::to_string(f.max_rpm)
+                   + ", temp " + std::to_string(f.max_temp) + ", battery " + std::to_string(f.max_battery));
+    }
+
+    // Q16.16 shifts gears a tick early or late now and then, which shows as
+    // short excursions; on average it has to stay close and never run away
+    Drift q = MeasureDrift<Fixed16>();
+    double n = (double)q.samples;
+    if(q.sum_speed/n>1.0 || q.sum_rpm/n>100.0 || q.sum_temp/n>1.0){
+        print_fail("Numeric Policy", "Q16.16 mean drift: speed " + std::to_string(q.sum_speed/n) + ", rpm "
+                   + std::to_string(q.sum_rpm/n) + ", temp " + std::to_string(q.sum_temp/n));
+    }
+    if(q.max_speed>20.0 || q.max_battery>0.25){
+        print_fail("Numeric Policy", "Q16.16 ran away: speed " + std::to_string(q.max_speed) + ", battery " + std::to_string(q.max_battery));
+    }
+
+    print_pass("Numeric Policy: float and Q16.16 Track the double Model");
+}
+
+void Test_Scenario() {
+    // The built-in scenario makes the same calls the old hard-coded driver did
+    const Scenario& builtin = Scenario::Builtin();
+    ScenarioRunner runner(builtin, {7}, 42);
+    int state = builtin.FindState("CITY_CRUISE");
+    int expected[4] = {builtin.FindState("PANIC_STOP"), builtin.FindState("HIGHWAY_SPRINT"),
+                       builtin.FindState("CITY_CRUISE"), builtin.FindState("IDLE")};
+    double throttle = 0;
+    for(int t=0; t<20000; t++){
+        runner.Step(t*0.1, &throttle);
+        if(t>0 && t%100==0){
+            uint32_t roll = CounterRng::Below(CounterRng::Bits(42, 7, t/100 - 1, CounterRng::DRIVER), 100);
+            state = expected[roll<2 ? 0 : roll<22 ? 1 : roll<70 ? 2 : 3];
+            if(runner.Alerted(0)!=(roll<2)) print_fail("Scenario", "Panic not reported at decision " + std::to_string(t/100));
+        }
+        if(runner.State(0)!=state){
+            print_fail("Scenario", "Built-in driver diverged at tick " + std::to_string(t));
+            break;
+        }
+    }
+
+    std::string error;
+    Scenario bad;
+    if(bad.Parse("state A constant 0\nrow A B 1\n", error) || error.rfind("line 2:", 0)!=0)
+        print_fail("Scenario", "Unknown target not reported on its line: " + error);
+    if(bad.Parse("state A constant 2\n", error)) print_fail("Scenario", "Throttle out of range accepted");
+    if(bad.Parse("state A constant 0\nstate B constant 0\nrow A B 1\n", error)) print_fail("Scenario", "Missing row accepted");
+
+    // A stress-heavy chain with a panic storm at 100 s
+    Scenario s;
+    const char* text =
+        "decision 5\n"
+        "state CRUISE constant 0.3\n"
+        "state STRESS constant 1 tag STRESS\n"
+        "state PANIC constant -1 alert\n"
+        "row * CRUISE 1 STRESS 3   # mostly stress\n"
+        "matrix calm\n"
+        "row * CRUISE 1\n"
+        "event 50 20 use calm\n"
+        "event 100 2 force PANIC\n";
+    if(!s.Parse(text, error)){
+        print_fail("Scenario", "Parse: " + error);
+        return;
+    }
+    std::vector<uint16_t> ids;
+    for(uint16_t i=0; i<64; i++) ids.push_back(500 + i*3);
+    ScenarioRunner fleet(s, ids, 9);
+    std::vector<ScenarioRunner> singles;
+    for(uint16_t id : ids) singles.emplace_back(s, std::vector<uint16_t>{id}, 9);
+    std::vector<double> throttles(ids.size());
+    int stress = 0, storm_alerts = 0;
+    for(int t=0; t<2000; t++){
+        double now = t*0.1;
+        size_t alerted = fleet.Step(now, throttles.data());
+        if(t==1000) storm_alerts = (int)alerted;
+        for(size_t i=0; i<ids.size(); i++){
+            double one = 0;
+            singles[i].Step(now, &one);
+            if(one!=throttles[i] || singles[i].State(0)!=fleet.State(i)){
+                print_fail("Scenario", "Fleet runner and single runner disagree");
+                return;
+            }
+            if(fleet.Tag(i)==StatusTag::STRESS) stress++;
+            if(now>=55 && now<70 && fleet.State(i)!=0) print_fail("Scenario", "Matrix event not applied");
+            if(now>=100 && now<102 && throttles[i]!=-1.0) print_fail("Scenario", "Forced state not applied");
+        }
+    }
+    if(storm_alerts!=(int)ids.size()) print_fail("Scenario", "Storm alerted " + std::to_string(storm_alerts) + " vehicles");
+    if(stress<(int)(ids.size()*2000/2)) print_fail("Scenario", "STRESS state rarely reached");
+
+    print_pass("Scenario: Built-in Driver, Events + Fleet Batch");
+}
+
 int main() {
     std::cout << "--- RUNNING UNIT TESTS ---\n";
     
@@ -157,6 +420,11 @@ int main() {
     Test_Flags_ABS();
     Test_Battery_Drain();
     Test_Flags_Overheat();
+    Test_FleetState_MatchesVehicle();
+    Test_JerkRate();
+    Test_CommandRouting();
+    Test_NumericPolicies();
+    Test_Scenario();
     
     std::cout << "--- ALL TESTS PASSED ---\n";
     return 0;